@@ -21,10 +21,11 @@
 #include "wolk/service/firmware_update/debian/DebianPackageInstaller.h"
 
 #include <chrono>
+#include <csignal>
+#include <pthread.h>
 #include <random>
 #include <stdexcept>
 #include <string>
-#include <thread>
 #include <iostream>
 
 using namespace wolkabout;
@@ -99,6 +100,13 @@ wolkabout::legacy::LogLevel parseLogLevel(const std::string& levelStr)
 
 int main(int argc, char** argv)
 {
+    // The shutdown signals are blocked before any thread is started, so they can be waited for by the main thread
+    sigset_t shutdownSignals;
+    sigemptyset(&shutdownSignals);
+    sigaddset(&shutdownSignals, SIGINT);
+    sigaddset(&shutdownSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &shutdownSignals, nullptr);
+
     if (argc < 2)
     {
         std::cerr << "WolkGateway Application: Usage -  " << argv[0] << " [gatewayConfigurationFilePath] [logLevel]";
@@ -167,8 +175,9 @@ int main(int argc, char** argv)
 
     wolk->connect();
 
-    while (true)
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-
-    return 0;
+    auto signal = 0;
+    sigwait(&shutdownSignals, &signal);
+    LOG(INFO) << "WolkGateway Application: Received signal " << signal << ", shutting down.";
+    const auto report = wolk->shutdown(std::chrono::seconds{10});
+    return report.completed ? 0 : 1;
 }
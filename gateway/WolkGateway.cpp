@@ -19,27 +19,40 @@
 #include "core/connectivity/OutboundMessageHandler.h"
 #include "core/connectivity/OutboundRetryMessageHandler.h"
 #include "core/utility/Logger.h"
+#include "gateway/connectivity/BacklogReplayController.h"
 #include "gateway/connectivity/GatewayMessageRouter.h"
+#include "gateway/connectivity/PipelinedOutboundMessageHandler.h"
+#include "gateway/connectivity/PlatformConnectionPool.h"
+#include "gateway/connectivity/PriorityOutboundMessageHandler.h"
+#include "gateway/connectivity/ReconnectScheduler.h"
+#include "gateway/memory/MemoryBudget.h"
+#include "gateway/persistence/SegmentedFileMessagePersistence.h"
 #include "gateway/repository/device/InMemoryDeviceRepository.h"
 #include "gateway/service/devices/DevicesService.h"
 #include "gateway/service/external_data/ExternalDataService.h"
 #include "gateway/service/internal_data/InternalDataService.h"
+#include "gateway/service/platform_status/GatewayLoadMonitor.h"
 #include "gateway/service/platform_status/GatewayPlatformStatusService.h"
 
+#include <algorithm>
+#include <future>
 #include <memory>
-#include <thread>
 #include <utility>
 
 using namespace wolkabout::legacy;
 
-namespace
-{
-const unsigned RECONNECT_DELAY_MSEC = 2000;
-}
-
 namespace wolkabout::gateway
 {
-WolkGateway::~WolkGateway() = default;
+WolkGateway::~WolkGateway()
+{
+    // The attempts that are still scheduled must not outlive the connectivity services
+    m_platformReconnectScheduler->stop();
+    m_localReconnectScheduler->stop();
+    if (m_backlogReplayController != nullptr)
+        m_backlogReplayController->stop();
+    if (m_gatewayLoadMonitor != nullptr)
+        m_gatewayLoadMonitor->stop();
+}
 
 gateway::WolkGatewayBuilder WolkGateway::newBuilder(Device device)
 {
@@ -55,6 +68,10 @@ void WolkGateway::connect()
 void WolkGateway::disconnect()
 {
     WolkSingle::disconnect();
+    if (m_platformConnectionPool != nullptr)
+        m_platformConnectionPool->disconnect();
+    if (m_gatewayLoadMonitor != nullptr)
+        m_gatewayLoadMonitor->stop();
     if (m_localConnectivityService != nullptr)
     {
         m_localConnectivityService->disconnect();
@@ -79,6 +96,109 @@ void WolkGateway::publish()
     WolkInterface::publish();
 }
 
+ShutdownReport WolkGateway::shutdown(std::chrono::milliseconds timeout)
+{
+    LOG(INFO) << TAG << "Shutting down...";
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start + timeout;
+    const auto remaining = [&] {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::max(deadline - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero()));
+    };
+    auto report = ShutdownReport{{}, std::chrono::milliseconds{0}, true};
+    const auto runStage = [&](const std::string& name, const std::function<bool()>& stage) {
+        const auto stageStart = std::chrono::steady_clock::now();
+        const auto completed = stage();
+        const auto elapsed =
+          std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - stageStart);
+        report.stages.emplace_back(ShutdownStage{name, elapsed, completed});
+        report.completed = report.completed && completed;
+        LOG(INFO) << TAG << "Shutdown stage '" << name << "' " << (completed ? "finished" : "ran out of time") << " in "
+                  << elapsed.count() << "ms.";
+    };
+
+    // Nothing new comes in from the local broker, and neither connection is attempted again
+    runStage("stop_ingest", [&] {
+        m_platformReconnectScheduler->stop();
+        m_localReconnectScheduler->stop();
+        if (m_backlogReplayController != nullptr)
+            m_backlogReplayController->stop();
+        if (m_gatewayLoadMonitor != nullptr)
+            m_gatewayLoadMonitor->stop();
+        if (m_localConnectivityService != nullptr)
+        {
+            m_localConnectivityService->disconnect();
+            m_localConnected = false;
+        }
+        return true;
+    });
+
+    // The messages are followed in the order they flow - from the router, through the services, to the platform
+    runStage("drain", [&] {
+        auto drained = true;
+        if (m_gatewayMessageRouter != nullptr)
+            drained = m_gatewayMessageRouter->drain(remaining()) && drained;
+        if (m_externalDataService != nullptr)
+            drained = m_externalDataService->drain(remaining()) && drained;
+        if (m_subdeviceManagementService != nullptr)
+            drained = m_subdeviceManagementService->drain(remaining()) && drained;
+        if (isPlatformConnected())
+            publish();
+        else if (m_messagePersistence != nullptr && !m_messagePersistence->empty())
+            LOG(WARN) << TAG << "The platform is not connected, so the stored messages are not published.";
+        auto commandsDone = std::make_shared<std::promise<void>>();
+        auto future = commandsDone->get_future();
+        addToCommandBuffer([commandsDone] { commandsDone->set_value(); });
+        drained = future.wait_for(remaining()) == std::future_status::ready && drained;
+        if (m_priorityOutboundMessageHandler != nullptr)
+            drained = m_priorityOutboundMessageHandler->drain(remaining()) && drained;
+        if (m_pipelinedOutboundMessageHandler != nullptr)
+            drained = m_pipelinedOutboundMessageHandler->drain(remaining()) && drained;
+        return drained;
+    });
+
+    runStage("flush", [&] {
+        auto flushed = true;
+        if (m_cacheDeviceRepository != nullptr)
+            flushed = m_cacheDeviceRepository->flush(remaining());
+        const auto segmentedPersistence =
+          std::dynamic_pointer_cast<SegmentedFileMessagePersistence>(m_messagePersistence);
+        if (segmentedPersistence != nullptr)
+        {
+            flushed = segmentedPersistence->flush() && flushed;
+        }
+        else if (m_messagePersistence != nullptr && !m_messagePersistence->empty())
+        {
+            LOG(ERROR) << TAG << "Dropping the messages waiting in the message persistence held only in memory.";
+            flushed = false;
+        }
+        if (m_platformConnectionPool != nullptr)
+        {
+            auto buffered = std::size_t{0};
+            for (auto i = std::size_t{1}; i < m_platformConnectionPool->getSessionCount(); ++i)
+                buffered += m_platformConnectionPool->getBufferedMessageCount(i);
+            if (buffered > 0)
+            {
+                LOG(ERROR) << TAG << "Dropping " << buffered
+                           << " message(s) buffered for the platform sessions that are not connected.";
+                flushed = false;
+            }
+        }
+        return flushed;
+    });
+
+    runStage("disconnect", [&] {
+        disconnect();
+        return true;
+    });
+
+    report.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    LOG(INFO) << TAG << "Shut down in " << report.elapsed.count() << "ms"
+              << (report.completed ? "." : ", but not everything finished before the deadline.");
+    return report;
+}
+
 connect::WolkInterfaceType WolkGateway::getType() const
 {
     return connect::WolkInterfaceType::Gateway;
@@ -89,6 +209,8 @@ WolkGateway::WolkGateway(Device device)
 , m_localConnected{false}
 , m_localOutboundMessageHandler{nullptr}
 , m_outboundMessageHandler{nullptr}
+, m_platformReconnectScheduler{new ReconnectScheduler}
+, m_localReconnectScheduler{new ReconnectScheduler}
 {
 }
 
@@ -98,11 +220,45 @@ std::uint64_t WolkGateway::currentRtc()
     return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
 }
 
+GatewayLoadSample WolkGateway::sampleLoad() const
+{
+    // The occupancy is that of the fullest of the bounded queues
+    auto sample = GatewayLoadSample{0, false, 0};
+    if (m_memoryBudget != nullptr)
+    {
+        const auto statistics = m_memoryBudget->getStatistics();
+        if (statistics.capacity > 0)
+            sample.occupancy = static_cast<double>(statistics.used) / static_cast<double>(statistics.capacity);
+    }
+    const auto segmentedPersistence = std::dynamic_pointer_cast<SegmentedFileMessagePersistence>(m_messagePersistence);
+    if (segmentedPersistence != nullptr && segmentedPersistence->byteCap() > 0)
+        sample.occupancy =
+          std::max(sample.occupancy, static_cast<double>(segmentedPersistence->storedBytes()) /
+                                       static_cast<double>(segmentedPersistence->byteCap()));
+    if (m_backlogReplayController != nullptr)
+        sample.replaying = m_backlogReplayController->isRunning();
+
+    // The messages count as sent out once the platform acknowledges them, or at least once they leave the lanes
+    if (m_pipelinedOutboundMessageHandler != nullptr)
+    {
+        sample.sentMessages = m_pipelinedOutboundMessageHandler->getCompleted();
+    }
+    else if (m_priorityOutboundMessageHandler != nullptr)
+    {
+        for (const auto& lane : m_priorityOutboundMessageHandler->getStatistics())
+            sample.sentMessages += lane.sent;
+    }
+    return sample;
+}
+
 void WolkGateway::platformDisconnected()
 {
     addToCommandBuffer([=] {
         notifyPlatformDisconnected();
-        connectPlatform(true);
+
+        // Even the first attempt waits, so the gateways that lost the connection together do not reconnect together
+        m_platformReconnectScheduler->reset();
+        connectPlatform();
     });
 }
 
@@ -117,7 +273,12 @@ void WolkGateway::notifyPlatformConnected()
         m_subdeviceManagementService->updateDeviceCache();
     if (m_gatewayPlatformStatusService != nullptr)
         m_gatewayPlatformStatusService->sendPlatformConnectionStatusMessage(true);
-    publish();
+
+    // The backlog is replayed at its own pace, and the data is published only after it, so it stays in order
+    if (m_backlogReplayController != nullptr)
+        m_backlogReplayController->start([=] { addToCommandBuffer([=] { publish(); }); });
+    else
+        publish();
 }
 
 void WolkGateway::notifyPlatformDisconnected()
@@ -125,13 +286,16 @@ void WolkGateway::notifyPlatformDisconnected()
     LOG(INFO) << "Connection to platform lost";
 
     WolkSingle::notifyDisconnected();
+    if (m_backlogReplayController != nullptr)
+        m_backlogReplayController->stop();
     if (m_gatewayPlatformStatusService != nullptr)
         m_gatewayPlatformStatusService->sendPlatformConnectionStatusMessage(false);
 }
 
 void WolkGateway::connectPlatform(bool firstTime)
 {
-    addToCommandBuffer([=] {
+    // The attempts run on the thread of the scheduler, so the command buffer is never kept waiting by them
+    auto attempt = [=] {
         if (m_connectivityService == nullptr)
             return;
 
@@ -140,22 +304,30 @@ void WolkGateway::connectPlatform(bool firstTime)
 
         if (m_connectivityService->connect())
         {
-            notifyPlatformConnected();
+            m_platformReconnectScheduler->reset();
+            if (m_platformConnectionPool != nullptr)
+                m_platformConnectionPool->connect();
+            addToCommandBuffer([=] { notifyPlatformConnected(); });
         }
         else
         {
             if (firstTime)
                 LOG(INFO) << TAG << "Failed to connect to platform.";
-
-            std::this_thread::sleep_for(std::chrono::milliseconds{RECONNECT_DELAY_MSEC});
             connectPlatform();
         }
-    });
+    };
+    if (firstTime)
+    {
+        m_platformReconnectScheduler->attemptNow(attempt);
+        return;
+    }
+    const auto delay = m_platformReconnectScheduler->schedule(attempt);
+    LOG(DEBUG) << TAG << "Reconnecting to platform in " << delay.count() << "ms.";
 }
 
 void WolkGateway::connectLocal(bool firstTime)
 {
-    addToCommandBuffer([=] {
+    auto attempt = [=] {
         if (m_localConnectivityService == nullptr)
             return;
 
@@ -164,16 +336,24 @@ void WolkGateway::connectLocal(bool firstTime)
 
         if (m_localConnectivityService->connect())
         {
+            m_localReconnectScheduler->reset();
             m_localConnected = true;
+            if (m_gatewayLoadMonitor != nullptr)
+                m_gatewayLoadMonitor->start();
         }
         else
         {
             if (firstTime)
                 LOG(INFO) << TAG << "Failed to connect to local broker.";
-
-            std::this_thread::sleep_for(std::chrono::milliseconds{RECONNECT_DELAY_MSEC});
             connectLocal();
         }
-    });
+    };
+    if (firstTime)
+    {
+        m_localReconnectScheduler->attemptNow(attempt);
+        return;
+    }
+    const auto delay = m_localReconnectScheduler->schedule(attempt);
+    LOG(DEBUG) << TAG << "Reconnecting to local broker in " << delay.count() << "ms.";
 }
 }    // namespace wolkabout::gateway
@@ -24,6 +24,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -55,14 +56,47 @@ class RegistrationService;
 
 namespace gateway
 {
+class BacklogReplayController;
 class DeviceRepository;
 class ExternalDataService;
 class ExistingDevicesRepository;
+class GatewayExecutor;
+class GatewayLoadMonitor;
 class GatewayMessageRouter;
 class InMemoryDeviceRepository;
 class InternalDataService;
+class MemoryBudget;
+class PipelinedOutboundMessageHandler;
+class PlatformConnectionPool;
+class PriorityOutboundMessageHandler;
 class GatewayPlatformStatusService;
 class DevicesService;
+class ReconnectScheduler;
+struct GatewayLoadSample;
+
+/**
+ * This struct describes how a single stage of the shutdown went.
+ */
+struct ShutdownStage
+{
+    std::string name;
+    std::chrono::milliseconds elapsed;
+
+    // Whether the stage finished before the deadline, without leaving behind messages that are lost with the gateway
+    bool completed;
+};
+
+/**
+ * This struct describes how the whole shutdown went, stage by stage.
+ */
+struct ShutdownReport
+{
+    std::vector<ShutdownStage> stages;
+    std::chrono::milliseconds elapsed;
+
+    // Whether every stage completed
+    bool completed;
+};
 
 class WolkGateway : public connect::WolkSingle
 {
@@ -99,6 +133,19 @@ public:
      */
     bool isPlatformConnected();
 
+    /**
+     * Shuts the gateway down in stages. First the gateway stops taking in new messages from the local broker, and
+     * stops reconnecting. Then the messages already inside of it are drained through the routers, the services and the
+     * outbound handlers, the repositories and the message persistence are flushed, and at last both connections are
+     * closed. The stages share the deadline - once it passes, the remaining stages no longer wait for anything, but the
+     * connections are always closed. If the platform is not connected, the messages are not published. The flush stage
+     * is then not completed if any of them is held only in memory, and is dropped with the gateway.
+     *
+     * @param timeout How long the shutdown can wait for the messages to drain and the state to be flushed.
+     * @return The report of how long every stage took, and whether it finished in time.
+     */
+    ShutdownReport shutdown(std::chrono::milliseconds timeout = std::chrono::seconds{10});
+
     /**
      * Default getter for the local connection status.
      *
@@ -133,21 +180,37 @@ protected:
     /**
      * Internal method used to connect the platform connectivity service to the platform.
      *
-     * @param firstTime Whether this is the first attempt at connecting to the platform.
+     * @param firstTime Whether this is the first attempt at connecting to the platform. The first attempt is made
+     * right away, and the others after the backoff delay.
      */
     void connectPlatform(bool firstTime = false);
 
     /**
      * Internal method used to connect the local connectivity service to the local broker.
      *
-     * @param firstTime Whether this is the first attempt at connecting to the local broker.
+     * @param firstTime Whether this is the first attempt at connecting to the local broker. The first attempt is made
+     * right away, and the others after the backoff delay.
      */
     void connectLocal(bool firstTime = false);
 
+    /**
+     * Internal method used to sample how full the queues of the gateway are, whether the backlog is being replayed, and
+     * how many messages were sent out to the platform, from which the load published to the local modules is derived.
+     *
+     * @return The sample of the load.
+     */
+    GatewayLoadSample sampleLoad() const;
+
     const std::string TAG = "[WolkGateway] -> ";
 
     std::atomic<bool> m_localConnected;
 
+    // The threads shared by the services and the repositories
+    std::shared_ptr<GatewayExecutor> m_executor;
+
+    // The budget of the memory taken by the waiting messages, if there is one
+    std::shared_ptr<MemoryBudget> m_memoryBudget;
+
     std::shared_ptr<InMemoryDeviceRepository> m_cacheDeviceRepository;
     std::shared_ptr<DeviceRepository> m_persistentDeviceRepository;
     std::shared_ptr<ExistingDevicesRepository> m_existingDevicesRepository;
@@ -159,6 +222,9 @@ protected:
 
     // Additional connectivity
     std::shared_ptr<MessagePersistence> m_messagePersistence;
+    std::unique_ptr<PlatformConnectionPool> m_platformConnectionPool;
+    std::unique_ptr<PipelinedOutboundMessageHandler> m_pipelinedOutboundMessageHandler;
+    std::unique_ptr<PriorityOutboundMessageHandler> m_priorityOutboundMessageHandler;
     OutboundMessageHandler* m_outboundMessageHandler;
     std::unique_ptr<OutboundRetryMessageHandler> m_outboundRetryMessageHandler;
 
@@ -177,6 +243,16 @@ protected:
     std::shared_ptr<InternalDataService> m_internalDataService;
     std::shared_ptr<GatewayPlatformStatusService> m_gatewayPlatformStatusService;
     std::shared_ptr<DevicesService> m_subdeviceManagementService;
+
+    // Replays the messages persisted while the platform connection was down
+    std::unique_ptr<BacklogReplayController> m_backlogReplayController;
+
+    // Each connection is attempted, and retried, by its own scheduler
+    std::unique_ptr<ReconnectScheduler> m_platformReconnectScheduler;
+    std::unique_ptr<ReconnectScheduler> m_localReconnectScheduler;
+
+    // Publishes the load of the gateway to the local modules
+    std::unique_ptr<GatewayLoadMonitor> m_gatewayLoadMonitor;
 };
 }    // namespace gateway
 }    // namespace wolkabout
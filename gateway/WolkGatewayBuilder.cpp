@@ -32,12 +32,18 @@
 #include "core/protocol/wolkabout/WolkaboutRegistrationProtocol.h"
 #include "gateway/WolkGateway.h"
 #include "gateway/connectivity/GatewayMessageRouter.h"
+#include "gateway/connectivity/PipelinedOutboundMessageHandler.h"
+#include "gateway/connectivity/PlatformConnectionPool.h"
+#include "gateway/connectivity/ReconnectScheduler.h"
+#include "gateway/persistence/BudgetedMessagePersistence.h"
+#include "gateway/persistence/SegmentedFileMessagePersistence.h"
 #include "gateway/repository/device/InMemoryDeviceRepository.h"
 #include "gateway/repository/device/SQLiteDeviceRepository.h"
 #include "gateway/repository/existing_device/JsonFileExistingDevicesRepository.h"
 #include "gateway/service/devices/DevicesService.h"
 #include "gateway/service/external_data/ExternalDataService.h"
 #include "gateway/service/internal_data/InternalDataService.h"
+#include "gateway/service/platform_status/GatewayLoadMonitor.h"
 #include "gateway/service/platform_status/GatewayPlatformStatusService.h"
 
 #include <memory>
@@ -53,8 +59,18 @@ WolkGatewayBuilder::WolkGatewayBuilder(Device device)
 , m_platformMqttKeepAliveSec{60}
 , m_persistence{new InMemoryPersistence}
 , m_messagePersistence{new InMemoryMessagePersistence}
+, m_backlogReplayRate{0}
+, m_backlogReplayBurst{1}
+, m_publishWindow{1}
+, m_platformSessions{1}
 , m_deviceStoragePolicy{DeviceStoragePolicy::FULL}
+, m_deviceStorageProfile{SQLiteStorageProfile::defaults()}
+, m_deviceRegistrySnapshot{false}
+, m_deviceCacheCapacity{0}
 , m_existingDeviceRepository{new JsonFileExistingDevicesRepository}
+, m_registrationBatchWindow{0}
+, m_registrationBatchSize{0}
+, m_registeredDevicesStalenessBound{0}
 , m_dataProtocol{new WolkaboutDataProtocol}
 , m_errorProtocol{new WolkaboutErrorProtocol}
 , m_errorRetainTime{1}
@@ -123,12 +139,92 @@ WolkGatewayBuilder& WolkGatewayBuilder::withMessagePersistence(std::unique_ptr<M
     return *this;
 }
 
+WolkGatewayBuilder& WolkGatewayBuilder::withSegmentedFileMessagePersistence(const std::string& directory,
+                                                                            std::uint64_t byteCap,
+                                                                            std::uint64_t deviceQuota)
+{
+    m_messagePersistence =
+      std::unique_ptr<MessagePersistence>{new SegmentedFileMessagePersistence{directory, byteCap, deviceQuota}};
+    return *this;
+}
+
+WolkGatewayBuilder& WolkGatewayBuilder::backlogReplay(double messagesPerSecond, std::uint64_t burst,
+                                                      BacklogReplayController::ProgressListener progressListener)
+{
+    m_backlogReplayRate = messagesPerSecond;
+    m_backlogReplayBurst = burst;
+    m_backlogReplayProgressListener = std::move(progressListener);
+    return *this;
+}
+
+WolkGatewayBuilder& WolkGatewayBuilder::withOutboundPriorityLanes(std::vector<OutboundLane> lanes)
+{
+    m_outboundPriorityLanes = std::move(lanes);
+    return *this;
+}
+
+WolkGatewayBuilder& WolkGatewayBuilder::publishWindow(std::size_t window)
+{
+    m_publishWindow = window;
+    return *this;
+}
+
+WolkGatewayBuilder& WolkGatewayBuilder::platformSessions(std::size_t sessions)
+{
+    m_platformSessions = sessions;
+    return *this;
+}
+
+WolkGatewayBuilder& WolkGatewayBuilder::withExecutor(std::shared_ptr<GatewayExecutor> executor)
+{
+    m_executor = std::move(executor);
+    return *this;
+}
+
+WolkGatewayBuilder& WolkGatewayBuilder::withMemoryBudget(std::shared_ptr<MemoryBudget> memoryBudget)
+{
+    m_memoryBudget = std::move(memoryBudget);
+    return *this;
+}
+
 WolkGatewayBuilder& WolkGatewayBuilder::deviceStoragePolicy(DeviceStoragePolicy policy)
 {
     m_deviceStoragePolicy = policy;
     return *this;
 }
 
+WolkGatewayBuilder& WolkGatewayBuilder::deviceStorageProfile(const SQLiteStorageProfile& profile)
+{
+    m_deviceStorageProfile = profile;
+    return *this;
+}
+
+WolkGatewayBuilder& WolkGatewayBuilder::deviceRegistrySnapshot(bool enabled)
+{
+    m_deviceRegistrySnapshot = enabled;
+    return *this;
+}
+
+WolkGatewayBuilder& WolkGatewayBuilder::deviceCacheCapacity(std::size_t capacity)
+{
+    m_deviceCacheCapacity = capacity;
+    return *this;
+}
+
+WolkGatewayBuilder& WolkGatewayBuilder::registrationBatching(std::chrono::milliseconds window,
+                                                             std::size_t maxBatchSize)
+{
+    m_registrationBatchWindow = window;
+    m_registrationBatchSize = maxBatchSize;
+    return *this;
+}
+
+WolkGatewayBuilder& WolkGatewayBuilder::registeredDevicesStalenessBound(std::chrono::milliseconds stalenessBound)
+{
+    m_registeredDevicesStalenessBound = stalenessBound;
+    return *this;
+}
+
 WolkGatewayBuilder& WolkGatewayBuilder::withExistingDeviceRepository(
   std::unique_ptr<ExistingDevicesRepository> repository)
 {
@@ -264,19 +360,38 @@ std::unique_ptr<WolkGateway> WolkGatewayBuilder::build()
     auto wolk = std::unique_ptr<WolkGateway>{new WolkGateway{m_device}};
     auto wolkRaw = wolk.get();
 
-    // Move the persistence objects
+    // Move the persistence objects. The messages kept in memory are kept within the budget, if there is one.
+    wolk->m_memoryBudget = m_memoryBudget;
     wolk->m_persistence = std::move(m_persistence);
-    wolk->m_messagePersistence = std::move(m_messagePersistence);
+    if (m_memoryBudget != nullptr && dynamic_cast<InMemoryMessagePersistence*>(m_messagePersistence.get()) != nullptr)
+    {
+        // The data protocol is moved into the instance later, but it remains the same object
+        wolk->m_messagePersistence = std::make_shared<BudgetedMessagePersistence>(std::move(m_messagePersistence),
+                                                                                  *m_dataProtocol, m_memoryBudget);
+    }
+    else
+    {
+        wolk->m_messagePersistence = std::move(m_messagePersistence);
+    }
+
+    // Create the threads the services and the repositories share
+    wolk->m_executor = m_executor != nullptr ? m_executor : std::make_shared<GatewayExecutor>();
+
+    // The connections are attempted, and retried, on the same threads
+    wolk->m_platformReconnectScheduler.reset(new ReconnectScheduler{wolk->m_executor});
+    wolk->m_localReconnectScheduler.reset(new ReconnectScheduler{wolk->m_executor});
 
     // Move the repository objects
     if (m_deviceStoragePolicy == DeviceStoragePolicy::PERSISTENT || m_deviceStoragePolicy == DeviceStoragePolicy::FULL)
     {
-        wolk->m_persistentDeviceRepository = std::make_shared<SQLiteDeviceRepository>();
+        wolk->m_persistentDeviceRepository = std::make_shared<SQLiteDeviceRepository>(DATABASE, m_deviceStorageProfile);
         wolk->m_existingDevicesRepository = std::make_shared<JsonFileExistingDevicesRepository>();
     }
     if (m_deviceStoragePolicy == DeviceStoragePolicy::CACHED || m_deviceStoragePolicy == DeviceStoragePolicy::FULL)
     {
-        wolk->m_cacheDeviceRepository = std::make_shared<InMemoryDeviceRepository>(wolk->m_persistentDeviceRepository);
+        wolk->m_cacheDeviceRepository = std::make_shared<InMemoryDeviceRepository>(
+          wolk->m_persistentDeviceRepository, m_deviceRegistrySnapshot ? DEVICE_REGISTRY_SNAPSHOT : "",
+          m_deviceCacheCapacity, wolk->m_executor);
     }
     wolk->m_existingDevicesRepository = std::move(m_existingDeviceRepository);
 
@@ -287,22 +402,58 @@ std::unique_ptr<WolkGateway> WolkGatewayBuilder::build()
       ByteUtils::toUUIDString(ByteUtils::generateRandomBytes(ByteUtils::UUID_VECTOR_SIZE)),
       wolk->m_messagePersistence}};
     wolk->m_outboundMessageHandler = dynamic_cast<MqttConnectivityService*>(wolk->m_connectivityService.get());
+    if (m_platformSessions > 1)
+    {
+        auto sessions = std::vector<PlatformSession>{};
+        for (auto i = std::size_t{1}; i < m_platformSessions; ++i)
+        {
+            auto session = std::make_shared<MqttConnectivityService>(
+              std::make_shared<PahoMqttClient>(m_platformMqttKeepAliveSec), m_device.getKey(), m_device.getPassword(),
+              m_platformHost, m_platformTrustStore,
+              ByteUtils::toUUIDString(ByteUtils::generateRandomBytes(ByteUtils::UUID_VECTOR_SIZE)),
+              wolk->m_messagePersistence);
+            sessions.emplace_back(PlatformSession{session, session});
+        }
+
+        // The protocol is moved into the instance later, but it remains the same object
+        auto* protocol = m_platformSubdeviceProtocol.get();
+        wolk->m_platformConnectionPool = std::unique_ptr<PlatformConnectionPool>{
+          new PlatformConnectionPool{*wolk->m_outboundMessageHandler, std::move(sessions),
+                                     [protocol](const Message& message) { return protocol->getDeviceKey(message); },
+                                     wolk->m_executor}};
+        wolk->m_outboundMessageHandler = wolk->m_platformConnectionPool.get();
+    }
+    if (m_publishWindow > 1)
+    {
+        wolk->m_pipelinedOutboundMessageHandler = std::unique_ptr<PipelinedOutboundMessageHandler>{
+          new PipelinedOutboundMessageHandler{*wolk->m_outboundMessageHandler, m_publishWindow}};
+        wolk->m_outboundMessageHandler = wolk->m_pipelinedOutboundMessageHandler.get();
+    }
+    if (!m_outboundPriorityLanes.empty())
+    {
+        // The data protocol is moved into the instance later, but it remains the same object
+        wolk->m_priorityOutboundMessageHandler =
+          std::unique_ptr<PriorityOutboundMessageHandler>{new PriorityOutboundMessageHandler{
+            *wolk->m_outboundMessageHandler, *m_dataProtocol, std::move(m_outboundPriorityLanes), m_memoryBudget}};
+        wolk->m_outboundMessageHandler = wolk->m_priorityOutboundMessageHandler.get();
+    }
     wolk->m_outboundRetryMessageHandler =
       std::unique_ptr<OutboundRetryMessageHandler>{new OutboundRetryMessageHandler{*wolk->m_outboundMessageHandler}};
+    wolk->m_backlogReplayController = std::unique_ptr<BacklogReplayController>{
+      new BacklogReplayController{*wolk->m_messagePersistence, *wolk->m_connectivityService, m_backlogReplayRate,
+                                  m_backlogReplayBurst, m_backlogReplayProgressListener, wolk->m_executor}};
 
     // Set up the connection links
     wolk->m_inboundMessageHandler =
       std::make_shared<InboundPlatformMessageHandler>(std::vector<std::string>{m_device.getKey()});
-    wolk->m_connectivityService->onConnectionLost([wolkRaw] {
-        wolkRaw->notifyPlatformDisconnected();
-        wolkRaw->connectPlatform(true);
-    });
+    wolk->m_connectivityService->onConnectionLost([wolkRaw] { wolkRaw->platformDisconnected(); });
     wolk->m_connectivityService->setListner(wolk->m_inboundMessageHandler);
 
     // Set up the gateway message router
     wolk->m_platformSubdeviceProtocol = std::move(m_platformSubdeviceProtocol);
     wolk->m_localSubdeviceProtocol = std::move(m_localSubdeviceProtocol);
-    wolk->m_gatewayMessageRouter = std::make_shared<GatewayMessageRouter>(*wolk->m_platformSubdeviceProtocol);
+    wolk->m_gatewayMessageRouter =
+      std::make_shared<GatewayMessageRouter>(*wolk->m_platformSubdeviceProtocol, wolk->m_executor, m_memoryBudget);
     wolk->m_inboundMessageHandler->addListener(wolk->m_gatewayMessageRouter);
 
     // Set up the device services
@@ -417,7 +568,7 @@ std::unique_ptr<WolkGateway> WolkGatewayBuilder::build()
         // Create the external data service
         wolk->m_externalDataService = std::make_shared<ExternalDataService>(
           m_device.getKey(), *wolk->m_platformSubdeviceProtocol, *wolk->m_dataProtocol, *wolk->m_outboundMessageHandler,
-          *m_dataProvider);
+          *m_dataProvider, wolk->m_executor, m_memoryBudget);
         m_dataProvider->setDataHandler(wolk->m_externalDataService.get(), m_device.getKey());
         wolk->m_gatewayMessageRouter->addListener("ExternalDataService", wolk->m_externalDataService);
     }
@@ -432,7 +583,9 @@ std::unique_ptr<WolkGateway> WolkGatewayBuilder::build()
           m_device.getKey(), *wolk->m_platformRegistrationProtocol, *wolk->m_outboundMessageHandler,
           *wolk->m_outboundRetryMessageHandler, wolk->m_localRegistrationProtocol, wolk->m_localOutboundMessageHandler,
           wolk->m_cacheDeviceRepository != nullptr ? wolk->m_cacheDeviceRepository : wolk->m_persistentDeviceRepository,
-          wolk->m_existingDevicesRepository);
+          wolk->m_existingDevicesRepository, wolk->m_executor);
+        wolk->m_subdeviceManagementService->setRegistrationBatching(m_registrationBatchWindow, m_registrationBatchSize);
+        wolk->m_subdeviceManagementService->setRegisteredDevicesStalenessBound(m_registeredDevicesStalenessBound);
         wolk->m_gatewayMessageRouter->addListener("SubdeviceManagement", wolk->m_subdeviceManagementService);
         if (wolk->m_localConnectivityService != nullptr && wolk->m_localRegistrationProtocol != nullptr)
             wolk->m_localInboundMessageHandler->addListener(wolk->m_subdeviceManagementService);
@@ -445,6 +598,14 @@ std::unique_ptr<WolkGateway> WolkGatewayBuilder::build()
         wolk->m_gatewayPlatformStatusProtocol = std::move(m_gatewayPlatformStatusProtocol);
         wolk->m_gatewayPlatformStatusService = std::make_shared<GatewayPlatformStatusService>(
           *wolk->m_localConnectivityService, *wolk->m_gatewayPlatformStatusProtocol, m_device.getKey());
+
+        // And the monitor that tells the local modules how loaded the gateway is
+        wolk->m_gatewayLoadMonitor = std::unique_ptr<GatewayLoadMonitor>{new GatewayLoadMonitor{
+          [wolkRaw] { return wolkRaw->sampleLoad(); },
+          [wolkRaw](const GatewayLoadStatus& status) {
+              wolkRaw->m_gatewayPlatformStatusService->sendLoadStatusMessage(status);
+          },
+          wolk->m_executor}};
     }
 
     return wolk;
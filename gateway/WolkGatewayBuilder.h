@@ -30,7 +30,12 @@
 #include "core/protocol/PlatformStatusProtocol.h"
 #include "core/protocol/RegistrationProtocol.h"
 #include "gateway/api/DataProvider.h"
+#include "gateway/connectivity/BacklogReplayController.h"
+#include "gateway/connectivity/PriorityOutboundMessageHandler.h"
+#include "gateway/executor/GatewayExecutor.h"
+#include "gateway/memory/MemoryBudget.h"
 #include "gateway/repository/device/DeviceRepository.h"
+#include "gateway/repository/device/SQLiteStorageProfile.h"
 #include "gateway/repository/existing_device/ExistingDevicesRepository.h"
 #include "wolk/WolkInterfaceType.h"
 #include "wolk/api/FeedUpdateHandler.h"
@@ -41,10 +46,12 @@
 #include "wolk/api/PlatformStatusListener.h"
 #include "wolk/service/file_management/FileDownloader.h"
 
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace wolkabout::gateway
 {
@@ -135,6 +142,72 @@ public:
      */
     WolkGatewayBuilder& withMessagePersistence(std::unique_ptr<MessagePersistence> persistence);
 
+    /**
+     * @brief Sets up the messages waiting for the platform to be stored in memory mapped segment files, so they are
+     * bounded in size, and survive a restart of the gateway. Replaces the message persistence set before.
+     * @param directory The directory in which the segment files are kept.
+     * @param byteCap The cap on the size of all stored messages, in bytes. Oldest messages are dropped beyond it.
+     * @param deviceQuota The cap on the size of stored messages of a single device, in bytes. 0 means there is no
+     * quota.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     * @throws std::runtime_error if the directory can not be created
+     */
+    WolkGatewayBuilder& withSegmentedFileMessagePersistence(const std::string& directory, std::uint64_t byteCap,
+                                                            std::uint64_t deviceQuota = 0);
+
+    /**
+     * @brief Sets the pace at which the messages persisted while the platform connection was down are replayed once
+     * it is back, so they do not hold back the live traffic. By default, the whole backlog is replayed at once.
+     * @param messagesPerSecond The rate at which the backlog is replayed. 0 replays the whole backlog at once.
+     * @param burst The number of messages that can be replayed at once.
+     * @param progressListener The listener that receives the progress of the replay.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& backlogReplay(double messagesPerSecond, std::uint64_t burst,
+                                      BacklogReplayController::ProgressListener progressListener = nullptr);
+
+    /**
+     * @brief Places the messages going to the platform into lanes by their message type, so control messages are not
+     * held back by telemetry. Strict lanes are always sent first, and the weighted lanes share the rest.
+     * @param lanes The lanes. Messages of types not assigned to any lane go into the last one.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& withOutboundPriorityLanes(
+      std::vector<OutboundLane> lanes = PriorityOutboundMessageHandler::defaultLanes());
+
+    /**
+     * @brief Sets how many messages can be published to the platform at once, without waiting for the acknowledgement
+     * of the others. Messages on the same channel are still published one after another.
+     * @param window The number of messages in flight. 1 publishes the messages one at a time.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& publishWindow(std::size_t window);
+
+    /**
+     * @brief Sets how many MQTT sessions are opened toward the platform. The messages are spread over the sessions by
+     * the key of their device, so the messages of a device keep their order. Subscriptions stay on the first session.
+     * @param sessions The number of sessions. 1 keeps all the traffic on a single connection.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& platformSessions(std::size_t sessions);
+
+    /**
+     * @brief Sets the executor on whose threads the services and the device repositories do their work. Each of them
+     * gets a serial queue on the executor, so their work stays in order while the threads are shared.
+     * @param executor The executor. If none is set, an executor with one thread per CPU is created.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& withExecutor(std::shared_ptr<GatewayExecutor> executor);
+
+    /**
+     * @brief Keeps the messages waiting inside of the gateway within a memory budget. The budget is shared by the
+     * router, the external data service, the outbound lanes (if set up) and the in-memory message persistence, and
+     * the policy of the message type decides what happens to a message once there is no room left.
+     * @param memoryBudget The budget. Keep a reference to read its high-water marks, or listen for the overload.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& withMemoryBudget(std::shared_ptr<MemoryBudget> memoryBudget);
+
     /**
      * @brief Sets the policy that will be used for caching device data.
      * @param policy The policy that will be used for storing device data.
@@ -142,6 +215,49 @@ public:
      */
     WolkGatewayBuilder& deviceStoragePolicy(DeviceStoragePolicy policy);
 
+    /**
+     * @brief Sets the durability/performance profile of the persistent device storage. Used only if the storage policy
+     * is `PERSISTENT` or `FULL`.
+     * @param profile The profile with which the device database will be configured. The default profile leaves SQLite
+     * on its defaults, `SQLiteStorageProfile::flash()` is recommended for gateways running on SD cards.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& deviceStorageProfile(const SQLiteStorageProfile& profile);
+
+    /**
+     * @brief Sets whether the device cache should keep a memory mapped snapshot of the device registry, which is used
+     * to start up without reading the whole database. Used only if the storage policy is `FULL`.
+     * @param enabled Whether the snapshot should be used.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& deviceRegistrySnapshot(bool enabled);
+
+    /**
+     * @brief Sets how many platform owned devices the device cache can hold before it starts evicting the least
+     * recently used ones. Gateway owned devices are never evicted. Used only if the storage policy is `CACHED` or
+     * `FULL`.
+     * @param capacity The maximum number of cached platform owned devices. 0 means there is no limit.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& deviceCacheCapacity(std::size_t capacity);
+
+    /**
+     * @brief Sets up batching of child device registrations. Registrations that arrive within the window are merged
+     * into a single registration message, and are verified with a single children synchronization request.
+     * @param window How long the first registration in a batch waits for others. 0 disables batching.
+     * @param maxBatchSize The number of devices at which a batch is sent out right away. 0 means there is no limit.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& registrationBatching(std::chrono::milliseconds window, std::size_t maxBatchSize);
+
+    /**
+     * @brief Lets the registered devices requests of local modules be answered from the device repository, as long as
+     * it has been brought up to date with the platform within the staleness bound.
+     * @param stalenessBound How long the repository is trusted after being brought up to date. 0 disables this.
+     * @return Reference to current wolkabout::WolkBuilder instance (Provides fluent interface)
+     */
+    WolkGatewayBuilder& registeredDevicesStalenessBound(std::chrono::milliseconds stalenessBound);
+
     /**
      * @brief Sets a custom existing device repository to be used by the Wolk object.
      * @param repository std::unique_ptr to gateway::ExistingDeviceRepository implementation
@@ -299,10 +415,40 @@ private:
     std::unique_ptr<Persistence> m_persistence;
     std::unique_ptr<MessagePersistence> m_messagePersistence;
 
+    // The pace of the backlog replay
+    double m_backlogReplayRate;
+    std::uint64_t m_backlogReplayBurst;
+    BacklogReplayController::ProgressListener m_backlogReplayProgressListener;
+
+    // The lanes of the platform outbound traffic. Empty means the messages are sent in the order they come in.
+    std::vector<OutboundLane> m_outboundPriorityLanes;
+
+    // The number of messages that can be in flight toward the platform at once
+    std::size_t m_publishWindow;
+
+    // The number of MQTT sessions toward the platform
+    std::size_t m_platformSessions;
+
+    // The threads shared by the services and the device repositories
+    std::shared_ptr<GatewayExecutor> m_executor;
+
+    // The budget of the memory taken by the waiting messages
+    std::shared_ptr<MemoryBudget> m_memoryBudget;
+
     // Place for the repository objects
     DeviceStoragePolicy m_deviceStoragePolicy;
+    SQLiteStorageProfile m_deviceStorageProfile;
+    bool m_deviceRegistrySnapshot;
+    std::size_t m_deviceCacheCapacity;
     std::unique_ptr<ExistingDevicesRepository> m_existingDeviceRepository;
 
+    // Batching of child device registrations
+    std::chrono::milliseconds m_registrationBatchWindow;
+    std::size_t m_registrationBatchSize;
+
+    // How long the device repository answers the registered devices requests after being brought up to date
+    std::chrono::milliseconds m_registeredDevicesStalenessBound;
+
     // Here is the place for all the protocols that are being held
     std::unique_ptr<DataProtocol> m_dataProtocol;
     std::unique_ptr<ErrorProtocol> m_errorProtocol;
@@ -337,6 +483,7 @@ private:
     static const constexpr char* TRUST_STORE = "/PATH/TO/YOUR/CA.CRT/FILE";
     static const constexpr std::uint64_t MAX_PACKET_SIZE = 268434;
     static const constexpr char* DATABASE = "deviceRepository.db";
+    static const constexpr char* DEVICE_REGISTRY_SNAPSHOT = "deviceRegistry.snapshot";
 };
 }    // namespace wolkabout::gateway
 
@@ -46,6 +46,14 @@ public:
     virtual void addAttribute(const std::string& deviceKey, Attribute attribute) = 0;
 
     virtual void updateParameter(const std::string& deviceKey, Parameter parameter) = 0;
+
+    /**
+     * This method is used to check whether the gateway is overloaded. While it is, the data should be held back, as
+     * it might be dropped, or the calls might wait for the room to be freed.
+     *
+     * @return Whether the gateway is overloaded.
+     */
+    virtual bool isOverloaded() const { return false; }
 };
 }    // namespace wolkabout::gateway
 
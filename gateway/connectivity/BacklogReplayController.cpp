@@ -0,0 +1,171 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/connectivity/BacklogReplayController.h"
+
+#include "core/utility/Logger.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace wolkabout::legacy;
+
+namespace wolkabout::gateway
+{
+BacklogReplayController::BacklogReplayController(MessagePersistence& persistence,
+                                                 ConnectivityService& connectivityService, double messagesPerSecond,
+                                                 std::uint64_t burst, ProgressListener progressListener,
+                                                 std::shared_ptr<GatewayExecutor> executor,
+                                                 std::chrono::milliseconds tickInterval,
+                                                 std::chrono::milliseconds progressInterval)
+: m_persistence{persistence}
+, m_connectivityService{connectivityService}
+, m_messagesPerSecond{std::max(messagesPerSecond, 0.0)}
+, m_burst{static_cast<double>(std::max(burst, std::uint64_t{1}))}
+, m_progressListener{std::move(progressListener)}
+, m_tickInterval{tickInterval}
+, m_progressInterval{progressInterval}
+, m_running{false}
+, m_generation{0}
+, m_tokens{0}
+, m_progress{0, 0, std::chrono::milliseconds{0}, false}
+, m_queue{std::move(executor), "backlog-replay"}
+{
+}
+
+BacklogReplayController::~BacklogReplayController()
+{
+    stop();
+}
+
+void BacklogReplayController::start(std::function<void()> onCompleted)
+{
+    if (m_messagesPerSecond > 0)
+        LOG(INFO) << "Replaying the message backlog at " << m_messagesPerSecond << " message(s) per second.";
+
+    // The ticks are scheduled and cancelled under the lock, so a replay that is started over has a single one waiting
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_running = true;
+    m_onCompleted = std::move(onCompleted);
+    m_tokens = m_burst;
+    m_started = m_lastRefill = m_lastReport = std::chrono::steady_clock::now();
+    m_progress = BacklogReplayProgress{0, 0, std::chrono::milliseconds{0}, false};
+    const auto generation = ++m_generation;
+    m_queue.cancelScheduled();
+    m_queue.schedule(m_tickInterval, [this, generation] { tick(generation); });
+}
+
+void BacklogReplayController::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (m_running)
+            LOG(INFO) << "Stopped the message backlog replay after " << m_progress.replayedMessages << " message(s).";
+        m_running = false;
+        m_onCompleted = nullptr;
+        ++m_generation;
+        m_queue.cancelScheduled();
+    }
+
+    // The tick that is already running is waited for
+    m_queue.execute([] {});
+}
+
+bool BacklogReplayController::isRunning() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_running;
+}
+
+BacklogReplayProgress BacklogReplayController::getProgress() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_progress;
+}
+
+void BacklogReplayController::tick(std::uint64_t generation)
+{
+    auto onCompleted = std::function<void()>{};
+    auto progress = BacklogReplayProgress{};
+    auto report = false;
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (!m_running || generation != m_generation)
+            return;
+
+        // Refill the bucket with the tokens gathered since the last tick
+        const auto now = std::chrono::steady_clock::now();
+        const auto paced = m_messagesPerSecond > 0;
+        if (paced)
+        {
+            const auto elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+            m_tokens = std::min(m_burst, m_tokens + elapsed * m_messagesPerSecond);
+        }
+        m_lastRefill = now;
+
+        while (!paced || m_tokens >= 1.0)
+        {
+            auto message = m_persistence.front();
+            if (message == nullptr)
+            {
+                m_running = false;
+                m_progress.completed = true;
+                onCompleted = std::move(m_onCompleted);
+                break;
+            }
+
+            // A message that could not be published stays in the persistence for the replay after the reconnect
+            if (!m_connectivityService.publish(message))
+            {
+                LOG(WARN) << "Paused the message backlog replay - Failed to publish a message.";
+                m_running = false;
+                break;
+            }
+            m_persistence.pop();
+            ++m_progress.replayedMessages;
+            m_progress.replayedBytes += message->getChannel().size() + message->getContent().size();
+            if (paced)
+                m_tokens -= 1.0;
+        }
+
+        m_progress.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_started);
+        if (m_progress.completed)
+        {
+            if (m_progress.replayedMessages > 0)
+                LOG(INFO) << "Replayed the message backlog of " << m_progress.replayedMessages << " message(s) ("
+                          << m_progress.replayedBytes << " bytes) in " << m_progress.elapsed.count() << "ms.";
+            report = true;
+        }
+        else if (now - m_lastReport >= m_progressInterval)
+        {
+            LOG(INFO) << "Replaying the message backlog - " << m_progress.replayedMessages << " message(s) ("
+                      << m_progress.replayedBytes << " bytes) published so far.";
+            m_lastReport = now;
+            report = true;
+        }
+        progress = m_progress;
+
+        // A completed or paused replay schedules no more ticks
+        if (m_running)
+            m_queue.schedule(m_tickInterval, [this, generation] { tick(generation); });
+    }
+
+    if (report && m_progressListener)
+        m_progressListener(progress);
+    if (onCompleted)
+        onCompleted();
+}
+}    // namespace wolkabout::gateway
@@ -0,0 +1,135 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_BACKLOGREPLAYCONTROLLER_H
+#define WOLKGATEWAY_BACKLOGREPLAYCONTROLLER_H
+
+#include "core/connectivity/ConnectivityService.h"
+#include "core/persistence/MessagePersistence.h"
+#include "gateway/executor/GatewayExecutor.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace wolkabout::gateway
+{
+// The progress of a backlog replay, reported while it runs, and once it completes
+struct BacklogReplayProgress
+{
+    std::uint64_t replayedMessages;
+    std::uint64_t replayedBytes;
+    std::chrono::milliseconds elapsed;
+    bool completed;
+};
+
+/**
+ * This class replays the messages that were persisted while the platform connection was down. The messages are taken
+ * out of the persistence in ticks scheduled on the executor, at a rate limited by a token bucket, so the live traffic
+ * (and the requests sent right after the connection is established) is published in between them, instead of waiting
+ * behind the whole backlog.
+ */
+class BacklogReplayController
+{
+public:
+    using ProgressListener = std::function<void(const BacklogReplayProgress&)>;
+
+    /**
+     * Default parameter constructor.
+     *
+     * @param persistence The persistence holding the backlog.
+     * @param connectivityService The connectivity service through which the backlog is published.
+     * @param messagesPerSecond The rate at which the bucket is refilled. 0 replays the whole backlog at once.
+     * @param burst The capacity of the bucket, the number of messages that can be published at once.
+     * @param progressListener The listener that receives the progress of the replay. Can be `nullptr`.
+     * @param executor The executor on which the replay runs. If none is given, the replay gets a thread of its own.
+     * @param tickInterval The interval at which the messages are taken out of the persistence.
+     * @param progressInterval The interval at which the progress is reported while the replay runs.
+     */
+    BacklogReplayController(MessagePersistence& persistence, ConnectivityService& connectivityService,
+                            double messagesPerSecond = 0, std::uint64_t burst = 1,
+                            ProgressListener progressListener = nullptr,
+                            std::shared_ptr<GatewayExecutor> executor = nullptr,
+                            std::chrono::milliseconds tickInterval = std::chrono::milliseconds{100},
+                            std::chrono::milliseconds progressInterval = std::chrono::milliseconds{5000});
+
+    /**
+     * Default destructor. Stops the replay.
+     */
+    ~BacklogReplayController();
+
+    /**
+     * This method is used to start replaying the backlog. A replay that is already running is started over.
+     *
+     * @param onCompleted The callback invoked once the whole backlog has been published. Can be `nullptr`.
+     */
+    void start(std::function<void()> onCompleted = nullptr);
+
+    /**
+     * This method is used to stop the replay. The messages that were not replayed are left in the persistence.
+     */
+    void stop();
+
+    /**
+     * This method is used to check whether the replay is running.
+     *
+     * @return Whether the replay is running.
+     */
+    bool isRunning() const;
+
+    /**
+     * This method is used to obtain the progress of the current, or the last, replay.
+     *
+     * @return The progress of the replay.
+     */
+    BacklogReplayProgress getProgress() const;
+
+private:
+    void tick(std::uint64_t generation);
+
+    MessagePersistence& m_persistence;
+    ConnectivityService& m_connectivityService;
+
+    const double m_messagesPerSecond;
+    const double m_burst;
+    const ProgressListener m_progressListener;
+    const std::chrono::milliseconds m_tickInterval;
+    const std::chrono::milliseconds m_progressInterval;
+
+    mutable std::mutex m_mutex;
+    bool m_running;
+    std::function<void()> m_onCompleted;
+
+    // Every start and stop makes the ticks of the replay before it stale, even the ones that are already due
+    std::uint64_t m_generation;
+
+    // The token bucket
+    double m_tokens;
+    std::chrono::steady_clock::time_point m_lastRefill;
+
+    // The progress of the replay
+    std::chrono::steady_clock::time_point m_started;
+    std::chrono::steady_clock::time_point m_lastReport;
+    BacklogReplayProgress m_progress;
+
+    // The ticks run on the queue, which is destroyed first
+    SerialQueue m_queue;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_BACKLOGREPLAYCONTROLLER_H
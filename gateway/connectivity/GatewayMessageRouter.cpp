@@ -19,16 +19,22 @@
 #include "core/protocol/GatewaySubdeviceProtocol.h"
 #include "core/utility/Logger.h"
 
+#include <utility>
+
 using namespace wolkabout::legacy;
 
 namespace wolkabout::gateway
 {
-GatewayMessageRouter::GatewayMessageRouter(wolkabout::GatewaySubdeviceProtocol& protocol) : m_protocol(protocol) {}
+GatewayMessageRouter::GatewayMessageRouter(wolkabout::GatewaySubdeviceProtocol& protocol,
+                                           std::shared_ptr<GatewayExecutor> executor,
+                                           std::shared_ptr<MemoryBudget> memoryBudget)
+: m_protocol(protocol), m_memoryBudget{std::move(memoryBudget)}, m_queue{std::move(executor), "router"}
+{
+}
 
 void GatewayMessageRouter::messageReceived(std::shared_ptr<Message> message)
 {
     LOG(TRACE) << METHOD_INFO;
-    std::lock_guard<std::mutex> lock{m_mutex};
 
     // Look if we can figure out the type of the message
     LOG(TRACE) << TAG << "Topic: '" << message->getChannel() << "' | Payload: '" << message->getContent() << "'.";
@@ -39,7 +45,20 @@ void GatewayMessageRouter::messageReceived(std::shared_ptr<Message> message)
         return;
     }
 
+    // Reserve the room for the message while it waits, before the lock is taken, as this might have to wait
+    auto reservation = std::make_shared<MemoryBudget::Reservation>();
+    if (m_memoryBudget != nullptr)
+    {
+        *reservation = m_memoryBudget->reserve("router", messageType, MemoryBudget::sizeOf(*message));
+        if (!*reservation)
+        {
+            LOG(WARN) << TAG << "Dropping a received message - The memory budget is exhausted.";
+            return;
+        }
+    }
+
     // Find a handler for the type
+    std::lock_guard<std::mutex> lock{m_mutex};
     auto handlerIt = m_listenersPerType.find(messageType);
     if (handlerIt == m_listenersPerType.cend())
     {
@@ -62,9 +81,11 @@ void GatewayMessageRouter::messageReceived(std::shared_ptr<Message> message)
         return;
     }
 
-    // Take all the messages and route them to the handler
-    m_commandBuffer.pushCommand(
-      std::make_shared<std::function<void()>>([parsedMessage, handler] { handler->receiveMessages(parsedMessage); }));
+    // Take all the messages and route them to the handler, which reserves the room for whatever it keeps by itself
+    m_queue.push([parsedMessage, handler, reservation] {
+        reservation->release();
+        handler->receiveMessages(parsedMessage);
+    });
 }
 
 const Protocol& GatewayMessageRouter::getProtocol()
@@ -92,4 +113,9 @@ void GatewayMessageRouter::addListener(const std::string& name, const std::share
         LOG(DEBUG) << TAG << "Added listener '" << name << "' for type '" << toString(messageType) << "'.";
     }
 }
+
+bool GatewayMessageRouter::drain(std::chrono::milliseconds timeout)
+{
+    return m_queue.drain(timeout);
+}
 }    // namespace wolkabout::gateway
@@ -19,19 +19,24 @@
 
 #include "core/MessageListener.h"
 #include "core/protocol/GatewaySubdeviceProtocol.h"
-#include "core/utility/CommandBuffer.h"
 #include "gateway/GatewayMessageListener.h"
+#include "gateway/executor/GatewayExecutor.h"
+#include "gateway/memory/MemoryBudget.h"
 
+#include <chrono>
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 
 namespace wolkabout::gateway
 {
 class GatewayMessageRouter : public MessageListener
 {
 public:
-    explicit GatewayMessageRouter(GatewaySubdeviceProtocol& protocol);
+    explicit GatewayMessageRouter(GatewaySubdeviceProtocol& protocol,
+                                  std::shared_ptr<GatewayExecutor> executor = nullptr,
+                                  std::shared_ptr<MemoryBudget> memoryBudget = nullptr);
 
     void messageReceived(std::shared_ptr<Message> message) override;
 
@@ -39,6 +44,14 @@ public:
 
     virtual void addListener(const std::string& name, const std::shared_ptr<GatewayMessageListener>& listener);
 
+    /**
+     * This method is used to wait until all the messages received before it have been handed to the listeners.
+     *
+     * @param timeout How long to wait for the messages.
+     * @return Whether all the messages have been handed over in time.
+     */
+    bool drain(std::chrono::milliseconds timeout);
+
 private:
     // Logging tag
     const std::string TAG = "[GatewayInboundPlatformMessageHandler] -> ";
@@ -51,8 +64,11 @@ private:
     std::map<std::string, std::weak_ptr<GatewayMessageListener>> m_listeners;
     std::map<MessageType, std::weak_ptr<GatewayMessageListener>> m_listenersPerType;
 
-    // Command buffer
-    legacy::CommandBuffer m_commandBuffer;
+    // The budget the messages waiting for the listeners are kept within, if there is one
+    std::shared_ptr<MemoryBudget> m_memoryBudget;
+
+    // The queue on which the messages are handed to the listeners
+    SerialQueue m_queue;
 };
 }    // namespace wolkabout::gateway
 
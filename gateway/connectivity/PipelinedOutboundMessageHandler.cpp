@@ -0,0 +1,157 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/connectivity/PipelinedOutboundMessageHandler.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace wolkabout::gateway
+{
+PipelinedOutboundMessageHandler::PipelinedOutboundMessageHandler(OutboundMessageHandler& outboundMessageHandler,
+                                                                 std::size_t window)
+: m_outboundMessageHandler{outboundMessageHandler}
+, m_window{std::max(window, std::size_t{1})}
+, m_stopped{false}
+, m_waitingCount{0}
+, m_inFlight{0}
+, m_peakInFlight{0}
+, m_completed{0}
+{
+    for (auto i = std::size_t{0}; i < m_window; ++i)
+        m_publishingThreads.emplace_back(&PipelinedOutboundMessageHandler::run, this);
+}
+
+PipelinedOutboundMessageHandler::~PipelinedOutboundMessageHandler()
+{
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_windowCondition.wait(lock, [&] { return m_waitingCount == 0 && m_inFlight == 0; });
+        m_stopped = true;
+    }
+    m_publishCondition.notify_all();
+    m_windowCondition.notify_all();
+    for (auto& thread : m_publishingThreads)
+        if (thread.joinable())
+            thread.join();
+}
+
+void PipelinedOutboundMessageHandler::addMessage(std::shared_ptr<Message> message)
+{
+    if (message == nullptr)
+        return;
+
+    auto queued = false;
+    auto ready = false;
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_windowCondition.wait(lock, [&] { return m_stopped || m_waitingCount < m_window; });
+        if (!m_stopped)
+        {
+            // A channel becomes ready with its first waiting message, unless that waits for a message in flight
+            auto& messages = m_waiting[message->getChannel()];
+            if (messages.empty() && m_inFlightChannels.count(message->getChannel()) == 0)
+            {
+                m_readyChannels.push_back(message->getChannel());
+                ready = true;
+            }
+            messages.push_back(message);
+            ++m_waitingCount;
+            queued = true;
+        }
+    }
+
+    // Once the threads are stopped, the message is published right away
+    if (ready)
+        m_publishCondition.notify_one();
+    else if (!queued)
+        m_outboundMessageHandler.addMessage(message);
+}
+
+std::size_t PipelinedOutboundMessageHandler::getInFlight() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_inFlight;
+}
+
+std::size_t PipelinedOutboundMessageHandler::getPeakInFlight() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_peakInFlight;
+}
+
+std::size_t PipelinedOutboundMessageHandler::getWaiting() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_waitingCount;
+}
+
+std::uint64_t PipelinedOutboundMessageHandler::getCompleted() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_completed;
+}
+
+bool PipelinedOutboundMessageHandler::drain(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    return m_windowCondition.wait_for(lock, timeout, [&] { return m_waitingCount == 0 && m_inFlight == 0; });
+}
+
+void PipelinedOutboundMessageHandler::run()
+{
+    while (true)
+    {
+        auto message = std::shared_ptr<Message>{};
+        {
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_publishCondition.wait(lock, [&] { return m_stopped || !m_readyChannels.empty(); });
+            if (m_readyChannels.empty())
+                return;
+            const auto it = m_waiting.find(m_readyChannels.front());
+            m_readyChannels.pop_front();
+            message = std::move(it->second.front());
+            it->second.pop_front();
+            if (it->second.empty())
+                m_waiting.erase(it);
+            --m_waitingCount;
+            m_inFlightChannels.emplace(message->getChannel());
+            m_peakInFlight = std::max(m_peakInFlight, ++m_inFlight);
+        }
+        m_windowCondition.notify_all();
+
+        // The publish waits for the acknowledgement, while the other threads publish their own messages
+        m_outboundMessageHandler.addMessage(message);
+        auto ready = false;
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_inFlightChannels.erase(message->getChannel());
+            --m_inFlight;
+            ++m_completed;
+
+            // The channel goes to the back, so the channels that were waiting for a thread are not passed over
+            if (m_waiting.count(message->getChannel()) != 0)
+            {
+                m_readyChannels.push_back(message->getChannel());
+                ready = true;
+            }
+        }
+        if (ready)
+            m_publishCondition.notify_one();
+        m_windowCondition.notify_all();
+    }
+}
+}    // namespace wolkabout::gateway
@@ -0,0 +1,129 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_PIPELINEDOUTBOUNDMESSAGEHANDLER_H
+#define WOLKGATEWAY_PIPELINEDOUTBOUNDMESSAGEHANDLER_H
+
+#include "core/connectivity/OutboundMessageHandler.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace wolkabout::gateway
+{
+/**
+ * This is an outbound message handler that keeps a window of messages in flight toward the wrapped handler. Every
+ * publish through the MQTT client waits for its acknowledgement, so a window of publishing threads keeps that many
+ * messages unacknowledged at once, and they complete in whatever order the acknowledgements arrive.
+ *
+ * Messages published on the same channel are never in flight together, so they still arrive in the order they were
+ * added. The messages wait in a queue per channel, and a free publishing thread takes the next message of the channel
+ * that has been ready the longest, so a busy channel does not hold back the others. Adding a message blocks only while
+ * a whole window of messages is already waiting behind the channels in flight, so the handler in front of this one
+ * keeps its ordering.
+ */
+class PipelinedOutboundMessageHandler : public OutboundMessageHandler
+{
+public:
+    /**
+     * Default parameter constructor. Starts the publishing threads.
+     *
+     * @param outboundMessageHandler The handler through which the messages are published.
+     * @param window The number of messages that can be in flight at once.
+     */
+    PipelinedOutboundMessageHandler(OutboundMessageHandler& outboundMessageHandler, std::size_t window);
+
+    /**
+     * Default destructor. Waits for the messages in flight, and stops the publishing threads.
+     */
+    ~PipelinedOutboundMessageHandler() override;
+
+    PipelinedOutboundMessageHandler(const PipelinedOutboundMessageHandler&) = delete;
+    PipelinedOutboundMessageHandler& operator=(const PipelinedOutboundMessageHandler&) = delete;
+
+    void addMessage(std::shared_ptr<Message> message) override;
+
+    /**
+     * This method is used to obtain the number of messages currently in flight.
+     *
+     * @return The number of messages in flight.
+     */
+    std::size_t getInFlight() const;
+
+    /**
+     * This method is used to obtain the number of messages waiting for their channel, or for a publishing thread.
+     *
+     * @return The number of waiting messages.
+     */
+    std::size_t getWaiting() const;
+
+    /**
+     * This method is used to obtain the highest number of messages that were in flight at once.
+     *
+     * @return The highest number of messages in flight.
+     */
+    std::size_t getPeakInFlight() const;
+
+    /**
+     * This method is used to obtain the number of messages that were handed over to the wrapped handler.
+     *
+     * @return The number of completed messages.
+     */
+    std::uint64_t getCompleted() const;
+
+    /**
+     * This method is used to wait until all the added messages have been handed over to the wrapped handler.
+     *
+     * @param timeout How long to wait for the messages.
+     * @return Whether all the messages have been handed over in time.
+     */
+    bool drain(std::chrono::milliseconds timeout);
+
+private:
+    void run();
+
+    OutboundMessageHandler& m_outboundMessageHandler;
+    const std::size_t m_window;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_windowCondition;
+    std::condition_variable m_publishCondition;
+    bool m_stopped;
+
+    // The messages waiting per channel, the channels that are not in flight in the order they became ready, and the
+    // channels of all messages in flight
+    std::unordered_map<std::string, std::deque<std::shared_ptr<Message>>> m_waiting;
+    std::deque<std::string> m_readyChannels;
+    std::unordered_set<std::string> m_inFlightChannels;
+    std::size_t m_waitingCount;
+    std::size_t m_inFlight;
+    std::size_t m_peakInFlight;
+    std::uint64_t m_completed;
+
+    std::vector<std::thread> m_publishingThreads;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_PIPELINEDOUTBOUNDMESSAGEHANDLER_H
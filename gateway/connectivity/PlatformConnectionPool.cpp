@@ -0,0 +1,204 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/connectivity/PlatformConnectionPool.h"
+
+#include "core/utility/Logger.h"
+
+#include <utility>
+
+using namespace wolkabout::legacy;
+
+namespace wolkabout::gateway
+{
+PlatformConnectionPool::PlatformConnectionPool(OutboundMessageHandler& primaryOutboundMessageHandler,
+                                               std::vector<PlatformSession> sessions,
+                                               DeviceKeyExtractor deviceKeyExtractor,
+                                               const std::shared_ptr<GatewayExecutor>& executor,
+                                               std::chrono::milliseconds reconnectDelay,
+                                               std::size_t bufferCapacity)
+: m_primaryOutboundMessageHandler{primaryOutboundMessageHandler}
+, m_deviceKeyExtractor{std::move(deviceKeyExtractor)}
+, m_bufferCapacity{bufferCapacity}
+, m_droppedMessages{0}
+, m_active{false}
+{
+    for (auto& platformSession : sessions)
+    {
+        auto session = std::unique_ptr<Session>{new Session};
+        session->session = std::move(platformSession);
+        session->reconnectScheduler =
+          std::unique_ptr<ReconnectScheduler>{new ReconnectScheduler{executor, reconnectDelay}};
+        session->connected = false;
+        auto* sessionRaw = session.get();
+        session->session.connectivityService->onConnectionLost([this, sessionRaw] { onSessionLost(*sessionRaw); });
+        m_sessions.emplace_back(std::move(session));
+    }
+}
+
+PlatformConnectionPool::~PlatformConnectionPool()
+{
+    // The scheduled attempts must not outlive the sessions
+    for (const auto& session : m_sessions)
+        session->reconnectScheduler->stop();
+    disconnect();
+
+    auto discarded = std::size_t{0};
+    for (const auto& session : m_sessions)
+        discarded += session->buffer.size();
+    if (discarded > 0)
+        LOG(WARN) << "Discarded " << discarded << " message(s) buffered for the additional platform sessions.";
+}
+
+void PlatformConnectionPool::addMessage(std::shared_ptr<Message> message)
+{
+    if (message == nullptr)
+        return;
+
+    // The primary connection takes the first share of the devices
+    auto deviceKey = m_deviceKeyExtractor ? m_deviceKeyExtractor(*message) : std::string{};
+    if (deviceKey.empty())
+        deviceKey = message->getChannel();
+    const auto index = std::hash<std::string>{}(deviceKey) % (m_sessions.size() + 1);
+    if (index == 0)
+    {
+        m_primaryOutboundMessageHandler.addMessage(std::move(message));
+        return;
+    }
+
+    // The messages of a session that is down wait for it, behind the ones that are already waiting
+    auto& session = *m_sessions[index - 1];
+    std::lock_guard<std::mutex> lock{session.mutex};
+    if (session.connected && session.buffer.empty())
+    {
+        session.session.outboundMessageHandler->addMessage(std::move(message));
+        return;
+    }
+    session.buffer.emplace_back(std::move(message));
+    if (session.buffer.size() > m_bufferCapacity)
+    {
+        session.buffer.pop_front();
+        if (m_droppedMessages++ == 0)
+            LOG(WARN) << "The buffer of an additional platform session is full, dropping the oldest messages.";
+    }
+}
+
+void PlatformConnectionPool::connect()
+{
+    m_active = true;
+    for (const auto& session : m_sessions)
+    {
+        if (!session->connected)
+            connectSession(*session, true);
+    }
+}
+
+void PlatformConnectionPool::disconnect()
+{
+    m_active = false;
+    for (const auto& session : m_sessions)
+    {
+        auto wasConnected = false;
+        {
+            std::lock_guard<std::mutex> lock{session->mutex};
+            wasConnected = session->connected.exchange(false);
+        }
+        if (wasConnected)
+            session->session.connectivityService->disconnect();
+    }
+}
+
+std::size_t PlatformConnectionPool::getSessionCount() const
+{
+    return m_sessions.size() + 1;
+}
+
+bool PlatformConnectionPool::isSessionConnected(std::size_t index) const
+{
+    if (index == 0)
+        return true;
+    if (index > m_sessions.size())
+        return false;
+    return m_sessions[index - 1]->connected;
+}
+
+std::size_t PlatformConnectionPool::getBufferedMessageCount(std::size_t index) const
+{
+    if (index == 0 || index > m_sessions.size())
+        return 0;
+    std::lock_guard<std::mutex> lock{m_sessions[index - 1]->mutex};
+    return m_sessions[index - 1]->buffer.size();
+}
+
+std::uint64_t PlatformConnectionPool::getDroppedMessageCount() const
+{
+    return m_droppedMessages;
+}
+
+void PlatformConnectionPool::onSessionLost(Session& session)
+{
+    {
+        std::lock_guard<std::mutex> lock{session.mutex};
+        session.connected = false;
+    }
+    if (m_active)
+        connectSession(session, false);
+}
+
+void PlatformConnectionPool::connectSession(Session& session, bool firstTime)
+{
+    auto attempt = [this, &session] {
+        if (!m_active || session.connected)
+            return;
+
+        if (session.session.connectivityService->connect())
+        {
+            session.reconnectScheduler->reset();
+
+            // The buffered messages go out first, and no newer message can overtake them while they do
+            auto sent = std::size_t{0};
+            {
+                std::lock_guard<std::mutex> lock{session.mutex};
+                session.connected = true;
+                for (; !session.buffer.empty(); session.buffer.pop_front(), ++sent)
+                    session.session.outboundMessageHandler->addMessage(session.buffer.front());
+            }
+            LOG(DEBUG) << "Connected an additional platform session, and sent out " << sent
+                       << " buffered message(s).";
+
+            // The pool could have been disconnected while the attempt was running
+            auto disconnected = false;
+            {
+                std::lock_guard<std::mutex> lock{session.mutex};
+                disconnected = !m_active && session.connected.exchange(false);
+            }
+            if (disconnected)
+                session.session.connectivityService->disconnect();
+        }
+        else
+        {
+            connectSession(session, false);
+        }
+    };
+    if (firstTime)
+    {
+        session.reconnectScheduler->attemptNow(attempt);
+        return;
+    }
+    const auto delay = session.reconnectScheduler->schedule(attempt);
+    LOG(DEBUG) << "Reconnecting an additional platform session in " << delay.count() << "ms.";
+}
+}    // namespace wolkabout::gateway
@@ -0,0 +1,158 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_PLATFORMCONNECTIONPOOL_H
+#define WOLKGATEWAY_PLATFORMCONNECTIONPOOL_H
+
+#include "core/connectivity/ConnectivityService.h"
+#include "core/connectivity/OutboundMessageHandler.h"
+#include "gateway/connectivity/ReconnectScheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace wolkabout::gateway
+{
+// An additional platform session. The outbound message handler is usually the connectivity service itself.
+struct PlatformSession
+{
+    std::shared_ptr<ConnectivityService> connectivityService;
+    std::shared_ptr<OutboundMessageHandler> outboundMessageHandler;
+};
+
+/**
+ * This is an outbound message handler that spreads the messages going to the platform over the primary connection
+ * and a number of additional sessions. The session of a message is chosen by the key of its device, so all the
+ * messages of a device go through the same session, and keep their order. The additional sessions only publish, all
+ * the subscriptions stay on the primary connection.
+ *
+ * While the session of a device is not connected, its messages are buffered, and are sent out in their order once
+ * the session connects again, ahead of any newer message. They are never sent through another session, which could
+ * overtake the messages already handed to the session. Once the buffer of a session is full, its oldest messages are
+ * dropped.
+ */
+class PlatformConnectionPool : public OutboundMessageHandler
+{
+public:
+    // Returns the key of the device that a message belongs to
+    using DeviceKeyExtractor = std::function<std::string(const Message&)>;
+
+    /**
+     * Default parameter constructor.
+     *
+     * @param primaryOutboundMessageHandler The outbound message handler of the primary connection.
+     * @param sessions The additional sessions.
+     * @param deviceKeyExtractor The function used to obtain the device key of a message. When it returns an empty
+     * key, the channel of the message is used instead.
+     * @param executor The executor on which the sessions are reconnected. If none is given, every session gets a
+     * thread of its own for it.
+     * @param reconnectDelay The delay before the first attempt at reconnecting a session that was lost.
+     * @param bufferCapacity The number of messages buffered for every session while it is not connected.
+     */
+    PlatformConnectionPool(OutboundMessageHandler& primaryOutboundMessageHandler,
+                           std::vector<PlatformSession> sessions, DeviceKeyExtractor deviceKeyExtractor,
+                           const std::shared_ptr<GatewayExecutor>& executor = nullptr,
+                           std::chrono::milliseconds reconnectDelay = std::chrono::milliseconds{2000},
+                           std::size_t bufferCapacity = 10000);
+
+    /**
+     * Default destructor. Stops the reconnect attempts, and disconnects all the additional sessions. The messages still
+     * buffered for the sessions are discarded.
+     */
+    ~PlatformConnectionPool() override;
+
+    PlatformConnectionPool(const PlatformConnectionPool&) = delete;
+    PlatformConnectionPool& operator=(const PlatformConnectionPool&) = delete;
+
+    void addMessage(std::shared_ptr<Message> message) override;
+
+    /**
+     * This method is used to connect the additional sessions. Every session is connected on its own, and retried with
+     * a backoff until it connects, or until the pool is disconnected.
+     */
+    void connect();
+
+    /**
+     * This method is used to disconnect the additional sessions, and to stop reconnecting them. The messages of their
+     * devices are buffered until the pool is connected again.
+     */
+    void disconnect();
+
+    /**
+     * This method is used to obtain the number of sessions, including the primary connection.
+     *
+     * @return The number of sessions.
+     */
+    std::size_t getSessionCount() const;
+
+    /**
+     * This method is used to check whether an additional session is connected.
+     *
+     * @param index The index of the session, starting at 1. The primary connection is at 0.
+     * @return Whether the session is connected. Always true for the primary connection.
+     */
+    bool isSessionConnected(std::size_t index) const;
+
+    /**
+     * This method is used to obtain the number of messages buffered for an additional session.
+     *
+     * @param index The index of the session, starting at 1. The primary connection is at 0.
+     * @return The number of buffered messages. Always 0 for the primary connection.
+     */
+    std::size_t getBufferedMessageCount(std::size_t index) const;
+
+    /**
+     * This method is used to obtain the number of messages that were dropped because the buffer of their session was
+     * full.
+     *
+     * @return The number of dropped messages.
+     */
+    std::uint64_t getDroppedMessageCount() const;
+
+private:
+    struct Session
+    {
+        PlatformSession session;
+        std::unique_ptr<ReconnectScheduler> reconnectScheduler;
+        std::atomic<bool> connected;
+
+        // Messages are handed to the session under the lock, so the buffered ones are never overtaken
+        mutable std::mutex mutex;
+        std::deque<std::shared_ptr<Message>> buffer;
+    };
+
+    void onSessionLost(Session& session);
+
+    void connectSession(Session& session, bool firstTime);
+
+    OutboundMessageHandler& m_primaryOutboundMessageHandler;
+    const DeviceKeyExtractor m_deviceKeyExtractor;
+    const std::size_t m_bufferCapacity;
+    std::atomic<std::uint64_t> m_droppedMessages;
+
+    std::atomic<bool> m_active;
+    std::vector<std::unique_ptr<Session>> m_sessions;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_PLATFORMCONNECTIONPOOL_H
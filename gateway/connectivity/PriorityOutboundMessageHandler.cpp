@@ -0,0 +1,198 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/connectivity/PriorityOutboundMessageHandler.h"
+
+#include "core/utility/Logger.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+using namespace wolkabout::legacy;
+
+namespace wolkabout::gateway
+{
+PriorityOutboundMessageHandler::PriorityOutboundMessageHandler(OutboundMessageHandler& outboundMessageHandler,
+                                                               Protocol& protocol, std::vector<OutboundLane> lanes,
+                                                               std::shared_ptr<MemoryBudget> memoryBudget)
+: m_outboundMessageHandler{outboundMessageHandler}
+, m_protocol{protocol}
+, m_memoryBudget{std::move(memoryBudget)}
+, m_stopped{false}
+, m_sending{false}
+{
+    if (lanes.empty())
+        throw std::runtime_error("Failed to create the PriorityOutboundMessageHandler - No lanes were given.");
+
+    for (auto& description : lanes)
+    {
+        const auto index = m_lanes.size();
+        for (const auto& messageType : description.messageTypes)
+        {
+            if (!m_laneByType.emplace(messageType, index).second)
+                LOG(WARN) << "A message type is assigned to more than one lane, it stays in the first one.";
+        }
+        description.weight = std::max(description.weight, std::uint32_t{1});
+        m_lanes.push_back(Lane{std::move(description), {}, 0, 0, 0, {}, {}});
+    }
+    m_sendingThread = std::thread{&PriorityOutboundMessageHandler::run, this};
+}
+
+PriorityOutboundMessageHandler::~PriorityOutboundMessageHandler()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stopped = true;
+    }
+    m_condition.notify_one();
+    if (m_sendingThread.joinable())
+        m_sendingThread.join();
+}
+
+void PriorityOutboundMessageHandler::addMessage(std::shared_ptr<Message> message)
+{
+    if (message == nullptr)
+        return;
+
+    const auto messageType = m_protocol.getMessageType(*message);
+
+    // The room is reserved before the lock is taken, so the sending thread can free it while the producer waits
+    auto reservation = std::shared_ptr<MemoryBudget::Reservation>{};
+    if (m_memoryBudget != nullptr)
+    {
+        reservation = std::make_shared<MemoryBudget::Reservation>(
+          m_memoryBudget->reserve("outbound_lanes", messageType, MemoryBudget::sizeOf(*message)));
+        if (!*reservation)
+        {
+            LOG(WARN) << "Dropping a message for the platform - The memory budget is exhausted.";
+            return;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        const auto it = m_laneByType.find(messageType);
+        auto& lane = m_lanes[it != m_laneByType.cend() ? it->second : m_lanes.size() - 1];
+        lane.messages.push_back(
+          WaitingMessage{std::move(message), std::chrono::steady_clock::now(), std::move(reservation)});
+        lane.maxDepth = std::max(lane.maxDepth, lane.messages.size());
+    }
+    m_condition.notify_one();
+}
+
+std::vector<OutboundLaneStatistics> PriorityOutboundMessageHandler::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto statistics = std::vector<OutboundLaneStatistics>{};
+    for (const auto& lane : m_lanes)
+    {
+        const auto averageWait =
+          lane.sent > 0 ? lane.totalWait / static_cast<std::int64_t>(lane.sent) : std::chrono::microseconds{0};
+        statistics.push_back(OutboundLaneStatistics{lane.description.name, lane.messages.size(), lane.maxDepth,
+                                                    lane.sent, averageWait, lane.maxWait});
+    }
+    return statistics;
+}
+
+bool PriorityOutboundMessageHandler::drain(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    return m_idleCondition.wait_for(lock, timeout, [&] {
+        return !m_sending && std::all_of(m_lanes.cbegin(), m_lanes.cend(),
+                                         [](const Lane& lane) { return lane.messages.empty(); });
+    });
+}
+
+std::vector<OutboundLane> PriorityOutboundMessageHandler::defaultLanes()
+{
+    return {{"control",
+             true,
+             1,
+             {MessageType::DEVICE_REGISTRATION, MessageType::DEVICE_REMOVAL,
+              MessageType::CHILDREN_SYNCHRONIZATION_REQUEST, MessageType::REGISTERED_DEVICES_REQUEST,
+              MessageType::TIME_SYNC}},
+            {"firmware", true, 1, {MessageType::FIRMWARE_UPDATE_STATUS}},
+            {"file_transfer",
+             false,
+             1,
+             {MessageType::FILE_UPLOAD_STATUS, MessageType::FILE_BINARY_REQUEST, MessageType::FILE_URL_DOWNLOAD_STATUS,
+              MessageType::FILE_LIST_RESPONSE}},
+            {"telemetry", false, 4, {MessageType::FEED_VALUES, MessageType::PARAMETER_SYNC}}};
+}
+
+PriorityOutboundMessageHandler::Lane* PriorityOutboundMessageHandler::nextLane()
+{
+    for (auto& lane : m_lanes)
+        if (lane.description.strict && !lane.messages.empty())
+            return &lane;
+
+    // Every waiting weighted lane gains its weight, and the one that gained the most is served, and pays for it
+    auto* chosen = static_cast<Lane*>(nullptr);
+    auto totalWeight = std::int64_t{0};
+    for (auto& lane : m_lanes)
+    {
+        if (lane.description.strict || lane.messages.empty())
+            continue;
+        lane.currentWeight += lane.description.weight;
+        totalWeight += lane.description.weight;
+        if (chosen == nullptr || lane.currentWeight > chosen->currentWeight)
+            chosen = &lane;
+    }
+    if (chosen != nullptr)
+        chosen->currentWeight -= totalWeight;
+    return chosen;
+}
+
+void PriorityOutboundMessageHandler::run()
+{
+    while (true)
+    {
+        auto message = std::shared_ptr<Message>{};
+        auto reservation = std::shared_ptr<MemoryBudget::Reservation>{};
+        {
+            std::unique_lock<std::mutex> lock{m_mutex};
+            auto* lane = static_cast<Lane*>(nullptr);
+            m_condition.wait(lock, [&] {
+                lane = nextLane();
+                return lane != nullptr || m_stopped;
+            });
+
+            // The messages that are still waiting are handed over before the thread stops
+            if (lane == nullptr)
+                return;
+            auto waiting = std::move(lane->messages.front());
+            lane->messages.pop_front();
+            const auto wait = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                                    waiting.enqueued);
+            ++lane->sent;
+            lane->totalWait += wait;
+            lane->maxWait = std::max(lane->maxWait, wait);
+            message = std::move(waiting.message);
+            reservation = std::move(waiting.reservation);
+            m_sending = true;
+        }
+
+        // The room is returned outside of the lock, and before the wrapped handler might have to reserve its own
+        reservation.reset();
+        m_outboundMessageHandler.addMessage(message);
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_sending = false;
+        }
+        m_idleCondition.notify_all();
+    }
+}
+}    // namespace wolkabout::gateway
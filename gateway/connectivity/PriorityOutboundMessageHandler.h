@@ -0,0 +1,159 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_PRIORITYOUTBOUNDMESSAGEHANDLER_H
+#define WOLKGATEWAY_PRIORITYOUTBOUNDMESSAGEHANDLER_H
+
+#include "core/connectivity/OutboundMessageHandler.h"
+#include "core/protocol/Protocol.h"
+#include "gateway/memory/MemoryBudget.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace wolkabout::gateway
+{
+// The description of a lane in which outbound messages wait to be sent
+struct OutboundLane
+{
+    std::string name;
+    // Strict lanes are always emptied first, in the order in which they are declared
+    bool strict;
+    // The share of the sending that a weighted lane gets while the other weighted lanes have messages too
+    std::uint32_t weight;
+    std::vector<MessageType> messageTypes;
+};
+
+// The metrics of a lane
+struct OutboundLaneStatistics
+{
+    std::string name;
+    std::size_t depth;
+    std::size_t maxDepth;
+    std::uint64_t sent;
+    std::chrono::microseconds averageWait;
+    std::chrono::microseconds maxWait;
+};
+
+/**
+ * This is an outbound message handler that sits in front of the platform outbound message handler, and orders the
+ * messages waiting to be sent by their importance. Every message is placed in a lane by its message type, and a
+ * sending thread hands the messages over to the wrapped handler - first from the strict lanes, and then from the
+ * weighted lanes by a smooth weighted round robin. Messages of types that are not assigned to any lane are placed in
+ * the last lane.
+ *
+ * With a memory budget, every waiting message holds its size from the budget, and a message the budget refuses is
+ * dropped. Under the backpressure policy, a producer that is not on a thread of the executor waits in `addMessage` for
+ * the room to be freed.
+ */
+class PriorityOutboundMessageHandler : public OutboundMessageHandler
+{
+public:
+    /**
+     * Default parameter constructor. Starts the sending thread.
+     *
+     * @param outboundMessageHandler The handler through which the messages are sent.
+     * @param protocol The protocol used to obtain the message type of a message.
+     * @param lanes The lanes. Must not be empty.
+     * @param memoryBudget The budget from which the room for the waiting messages is reserved. Optional.
+     * @throws std::runtime_error if no lanes are given.
+     */
+    PriorityOutboundMessageHandler(OutboundMessageHandler& outboundMessageHandler, Protocol& protocol,
+                                   std::vector<OutboundLane> lanes = defaultLanes(),
+                                   std::shared_ptr<MemoryBudget> memoryBudget = nullptr);
+
+    /**
+     * Default destructor. Hands all the waiting messages over to the wrapped handler, and stops the sending thread.
+     */
+    ~PriorityOutboundMessageHandler() override;
+
+    PriorityOutboundMessageHandler(const PriorityOutboundMessageHandler&) = delete;
+    PriorityOutboundMessageHandler& operator=(const PriorityOutboundMessageHandler&) = delete;
+
+    void addMessage(std::shared_ptr<Message> message) override;
+
+    /**
+     * This method is used to obtain the metrics of all the lanes.
+     *
+     * @return The metrics, in the order in which the lanes are declared.
+     */
+    std::vector<OutboundLaneStatistics> getStatistics() const;
+
+    /**
+     * This method is used to wait until all the waiting messages have been handed over to the wrapped handler.
+     *
+     * @param timeout How long to wait for the messages.
+     * @return Whether all the messages have been handed over in time.
+     */
+    bool drain(std::chrono::milliseconds timeout);
+
+    /**
+     * This method is used to obtain the default lanes. Registration and synchronization messages go into the strict
+     * `control` lane, followed by the strict `firmware` lane, and the weighted `file_transfer` (1) and `telemetry` (4)
+     * lanes.
+     *
+     * @return The default lanes.
+     */
+    static std::vector<OutboundLane> defaultLanes();
+
+private:
+    struct WaitingMessage
+    {
+        std::shared_ptr<Message> message;
+        std::chrono::steady_clock::time_point enqueued;
+        std::shared_ptr<MemoryBudget::Reservation> reservation;
+    };
+
+    struct Lane
+    {
+        OutboundLane description;
+        std::deque<WaitingMessage> messages;
+        std::int64_t currentWeight;
+        std::size_t maxDepth;
+        std::uint64_t sent;
+        std::chrono::microseconds totalWait;
+        std::chrono::microseconds maxWait;
+    };
+
+    Lane* nextLane();
+
+    void run();
+
+    OutboundMessageHandler& m_outboundMessageHandler;
+    Protocol& m_protocol;
+    std::shared_ptr<MemoryBudget> m_memoryBudget;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::condition_variable m_idleCondition;
+    bool m_stopped;
+    bool m_sending;
+    std::vector<Lane> m_lanes;
+    std::map<MessageType, std::size_t> m_laneByType;
+
+    std::thread m_sendingThread;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_PRIORITYOUTBOUNDMESSAGEHANDLER_H
@@ -0,0 +1,109 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/connectivity/ReconnectScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <utility>
+
+namespace wolkabout::gateway
+{
+ReconnectScheduler::ReconnectScheduler(std::shared_ptr<GatewayExecutor> executor,
+                                       std::chrono::milliseconds initialDelay, std::chrono::milliseconds maximumDelay,
+                                       double multiplier, double jitter)
+: m_initialDelay{initialDelay}
+, m_maximumDelay{std::max(initialDelay, maximumDelay)}
+, m_multiplier{std::max(multiplier, 1.0)}
+, m_jitter{std::min(std::max(jitter, 0.0), 1.0)}
+, m_retries{0}
+, m_random{std::random_device{}()}
+, m_stopped{false}
+, m_generation{0}
+, m_queue{std::move(executor), "reconnect"}
+{
+}
+
+ReconnectScheduler::~ReconnectScheduler()
+{
+    stop();
+}
+
+void ReconnectScheduler::attemptNow(Attempt attempt)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (m_stopped)
+        return;
+    m_retries = 0;
+    ++m_generation;
+    m_queue.cancelScheduled();
+    m_queue.push([this, attempt] {
+        if (!m_stopped)
+            attempt();
+    });
+}
+
+std::chrono::milliseconds ReconnectScheduler::schedule(Attempt attempt)
+{
+    const auto delay = nextDelay();
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (m_stopped)
+        return delay;
+
+    // An attempt that was cancelled after it became due is skipped once it runs
+    const auto generation = ++m_generation;
+    m_queue.cancelScheduled();
+    m_queue.schedule(delay, [this, attempt, generation] {
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            if (m_stopped || generation != m_generation)
+                return;
+        }
+        attempt();
+    });
+    return delay;
+}
+
+void ReconnectScheduler::reset()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_retries = 0;
+}
+
+void ReconnectScheduler::stop()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_stopped = true;
+    ++m_generation;
+    m_queue.cancelScheduled();
+}
+
+std::chrono::milliseconds ReconnectScheduler::nextDelay()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    // Grow the delay only until it reaches the cap, so the exponent can not overflow
+    const auto uncapped = static_cast<double>(m_initialDelay.count()) * std::pow(m_multiplier, m_retries);
+    const auto delay = std::min(uncapped, static_cast<double>(m_maximumDelay.count()));
+    if (uncapped < static_cast<double>(m_maximumDelay.count()))
+        ++m_retries;
+
+    auto distribution = std::uniform_real_distribution<double>{0.0, m_jitter};
+    const auto jittered = delay * (1.0 - distribution(m_random));
+    return std::chrono::milliseconds{static_cast<std::chrono::milliseconds::rep>(jittered)};
+}
+}    // namespace wolkabout::gateway
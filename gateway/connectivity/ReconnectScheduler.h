@@ -0,0 +1,115 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_RECONNECTSCHEDULER_H
+#define WOLKGATEWAY_RECONNECTSCHEDULER_H
+
+#include "gateway/executor/GatewayExecutor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+
+namespace wolkabout::gateway
+{
+/**
+ * This class runs connection attempts on the executor, and schedules the next one after a failure as a delayed task,
+ * so nothing is left waiting while a connection is down. The delay between attempts grows exponentially up to a cap,
+ * and is shortened by a random amount, so gateways that have lost the connection at the same moment do not keep
+ * reconnecting at the same moments.
+ */
+class ReconnectScheduler
+{
+public:
+    using Attempt = std::function<void()>;
+
+    /**
+     * Default parameter constructor.
+     *
+     * @param executor The executor on which the attempts run. If none is given, the scheduler gets a thread of its own.
+     * @param initialDelay The delay before the first retry.
+     * @param maximumDelay The cap on the delay between retries.
+     * @param multiplier The factor by which the delay grows with every retry.
+     * @param jitter The largest part of the delay (between 0 and 1) by which it can be randomly shortened.
+     */
+    explicit ReconnectScheduler(std::shared_ptr<GatewayExecutor> executor = nullptr,
+                                std::chrono::milliseconds initialDelay = std::chrono::milliseconds{2000},
+                                std::chrono::milliseconds maximumDelay = std::chrono::milliseconds{60000},
+                                double multiplier = 2.0, double jitter = 0.5);
+
+    /**
+     * Default destructor. Cancels the scheduled attempt, and waits for the running one to finish.
+     */
+    ~ReconnectScheduler();
+
+    /**
+     * This method is used to run an attempt right away. This cancels the scheduled attempt, and resets the delay.
+     *
+     * @param attempt The connection attempt.
+     */
+    void attemptNow(Attempt attempt);
+
+    /**
+     * This method is used to schedule an attempt after the next delay. Scheduling cancels the attempt that was
+     * scheduled before.
+     *
+     * @param attempt The connection attempt.
+     * @return The delay after which the attempt will run.
+     */
+    std::chrono::milliseconds schedule(Attempt attempt);
+
+    /**
+     * This method is used to reset the delay back to the initial one. Should be invoked once a connection is made.
+     */
+    void reset();
+
+    /**
+     * This method is used to cancel the scheduled attempt, and stop scheduling new ones.
+     */
+    void stop();
+
+    /**
+     * This method is used to obtain the delay before the next retry. Every call counts as a retry.
+     *
+     * @return The delay, with the jitter applied.
+     */
+    std::chrono::milliseconds nextDelay();
+
+private:
+    const std::chrono::milliseconds m_initialDelay;
+    const std::chrono::milliseconds m_maximumDelay;
+    const double m_multiplier;
+    const double m_jitter;
+
+    // The number of retries since the last reset, and the source of the jitter
+    std::mutex m_mutex;
+    std::uint32_t m_retries;
+    std::mt19937 m_random;
+    std::atomic_bool m_stopped;
+
+    // Every attempt that is run or scheduled cancels the scheduled one, which no longer runs even if it is already due
+    std::uint64_t m_generation;
+
+    // The attempts run on the queue, which is destroyed first
+    SerialQueue m_queue;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_RECONNECTSCHEDULER_H
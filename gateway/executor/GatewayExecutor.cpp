@@ -0,0 +1,398 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/executor/GatewayExecutor.h"
+
+#include "core/utility/Logger.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace wolkabout::legacy;
+
+namespace wolkabout::gateway
+{
+namespace
+{
+// Linux allows only 15 characters in the name of a thread
+const std::size_t MAX_THREAD_NAME_LENGTH = 15;
+
+// The pool whose thread this is, if the thread belongs to an executor
+thread_local const void* currentPool = nullptr;
+}    // namespace
+
+struct GatewayExecutor::Pool
+{
+    // A task that is pushed into its queue once it is due. It does not keep the queue alive.
+    struct DelayedTask
+    {
+        std::weak_ptr<SerialQueue::State> state;
+        SerialQueue::Task task;
+    };
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopped;
+
+    // The queues that have tasks waiting, in the order in which they got them
+    std::deque<std::shared_ptr<SerialQueue::State>> ready;
+
+    // The tasks that are not yet due, by the time at which they are
+    std::multimap<std::chrono::steady_clock::time_point, DelayedTask> delayed;
+};
+
+struct SerialQueue::State
+{
+    std::shared_ptr<GatewayExecutor::Pool> pool;
+
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::deque<Task> tasks;
+
+    // Whether the queue is in the ready list of the pool, and which thread is executing a task of the queue, if any
+    bool scheduled;
+    bool running;
+    std::thread::id runningThread;
+    bool closed;
+};
+
+GatewayExecutor::GatewayExecutor(std::size_t threadCount, std::string name, std::vector<unsigned int> cpuAffinity)
+: m_pool{new Pool{{}, {}, false, {}, {}}}
+{
+    threadCount = std::max(threadCount, std::size_t{1});
+    for (auto i = std::size_t{0}; i < threadCount; ++i)
+    {
+        m_threads.emplace_back(&GatewayExecutor::run, m_pool);
+
+        const auto index = "-" + std::to_string(i);
+        const auto threadName = name.substr(0, MAX_THREAD_NAME_LENGTH - index.size()) + index;
+        ::pthread_setname_np(m_threads.back().native_handle(), threadName.c_str());
+        if (!cpuAffinity.empty())
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for (const auto cpu : cpuAffinity)
+            {
+                if (cpu >= CPU_SETSIZE)
+                {
+                    LOG(WARN) << "Ignoring CPU " << cpu << " in the CPU affinity of thread '" << threadName
+                              << "' - only CPUs below " << CPU_SETSIZE << " can be set.";
+                    continue;
+                }
+                CPU_SET(cpu, &cpus);
+            }
+            const auto result = ::pthread_setaffinity_np(m_threads.back().native_handle(), sizeof(cpus), &cpus);
+            if (result != 0)
+                LOG(WARN) << "Failed to set the CPU affinity of thread '" << threadName << "' - '"
+                          << std::strerror(result) << "'.";
+        }
+    }
+}
+
+GatewayExecutor::~GatewayExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_pool->mutex};
+        m_pool->stopped = true;
+    }
+    m_pool->condition.notify_all();
+    for (auto& thread : m_threads)
+    {
+        if (thread.get_id() == std::this_thread::get_id())
+            thread.detach();
+        else if (thread.joinable())
+            thread.join();
+    }
+
+    // The queues that are still listed hold on to the pool, and the tasks are released outside of the lock
+    auto delayed = std::multimap<std::chrono::steady_clock::time_point, Pool::DelayedTask>{};
+    std::lock_guard<std::mutex> lock{m_pool->mutex};
+    m_pool->ready.clear();
+    m_pool->delayed.swap(delayed);
+}
+
+std::size_t GatewayExecutor::getThreadCount() const
+{
+    return m_threads.size();
+}
+
+std::size_t GatewayExecutor::defaultThreadCount()
+{
+    return std::max(std::size_t{std::thread::hardware_concurrency()}, std::size_t{2});
+}
+
+bool GatewayExecutor::isExecutorThread()
+{
+    return currentPool != nullptr;
+}
+
+void GatewayExecutor::run(const std::shared_ptr<Pool>& pool)
+{
+    currentPool = pool.get();
+    auto dropped = std::vector<std::function<void()>>{};
+    while (true)
+    {
+        auto state = std::shared_ptr<SerialQueue::State>{};
+        {
+            // Waiting for a task, the threads wake up for the first of the delayed tasks to push it
+            std::unique_lock<std::mutex> lock{pool->mutex};
+            while (!pool->stopped)
+            {
+                releaseDueTasks(*pool, dropped);
+                if (!pool->ready.empty())
+                    break;
+                if (pool->delayed.empty())
+                {
+                    pool->condition.wait(lock);
+                    continue;
+                }
+
+                // The task is taken out by another thread while this one waits, so its time is copied
+                const auto dueTime = pool->delayed.cbegin()->first;
+                pool->condition.wait_until(lock, dueTime);
+            }
+            if (pool->stopped)
+                return;
+            state = std::move(pool->ready.front());
+            pool->ready.pop_front();
+
+            // Another thread takes the other queues that have become ready
+            if (!pool->ready.empty())
+                pool->condition.notify_one();
+        }
+        dropped.clear();
+
+        // A single task is executed at a time, so a busy queue can not keep the others waiting
+        SerialQueue::runNext(state);
+    }
+}
+
+void GatewayExecutor::releaseDueTasks(Pool& pool, std::vector<std::function<void()>>& dropped)
+{
+    // The tasks are pushed under the lock of the pool, so none is pushed once it has been cancelled
+    const auto now = std::chrono::steady_clock::now();
+    while (!pool.delayed.empty() && pool.delayed.cbegin()->first <= now)
+    {
+        auto delayedTask = std::move(pool.delayed.begin()->second);
+        pool.delayed.erase(pool.delayed.begin());
+
+        const auto state = delayedTask.state.lock();
+        if (state == nullptr)
+        {
+            dropped.emplace_back(std::move(delayedTask.task));
+            continue;
+        }
+        std::lock_guard<std::mutex> lock{state->mutex};
+        if (state->closed)
+        {
+            dropped.emplace_back(std::move(delayedTask.task));
+            continue;
+        }
+        state->tasks.emplace_back(std::move(delayedTask.task));
+        if (!state->running && !state->scheduled)
+        {
+            state->scheduled = true;
+            pool.ready.emplace_back(state);
+        }
+    }
+}
+
+SerialQueue::SerialQueue(std::shared_ptr<GatewayExecutor> executor, const std::string& name)
+: m_executor{executor != nullptr ? std::move(executor) : std::make_shared<GatewayExecutor>(1, name)}
+, m_state{new State{m_executor->m_pool, {}, {}, {}, false, false, {}, false}}
+{
+}
+
+SerialQueue::~SerialQueue()
+{
+    // A queue destroyed by its own task can only stop taking in new tasks
+    if (!isCurrent())
+        execute([] {});
+
+    {
+        std::lock_guard<std::mutex> lock{m_state->mutex};
+        m_state->closed = true;
+        m_state->tasks.clear();
+    }
+    cancelScheduled();
+}
+
+void SerialQueue::push(Task task)
+{
+    // Once the task is listed, it could destroy the queue before this call returns
+    auto scheduledState = std::shared_ptr<State>{};
+    {
+        std::lock_guard<std::mutex> lock{m_state->mutex};
+        if (m_state->closed)
+            return;
+        m_state->tasks.emplace_back(std::move(task));
+        if (!m_state->running && !m_state->scheduled)
+        {
+            m_state->scheduled = true;
+            scheduledState = m_state;
+        }
+    }
+    if (scheduledState != nullptr)
+        enlist(scheduledState);
+}
+
+void SerialQueue::schedule(std::chrono::milliseconds delay, Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_state->mutex};
+        if (m_state->closed)
+            return;
+    }
+    const auto dueTime = std::chrono::steady_clock::now() + delay;
+    {
+        std::lock_guard<std::mutex> lock{m_state->pool->mutex};
+        m_state->pool->delayed.emplace(dueTime, GatewayExecutor::Pool::DelayedTask{m_state, std::move(task)});
+    }
+
+    // A thread that waits for a later task, or for no task at all, has to wake up earlier
+    m_state->pool->condition.notify_one();
+}
+
+void SerialQueue::cancelScheduled()
+{
+    // The tasks could hold on to anything, so they are released outside of the lock
+    auto cancelled = std::vector<Task>{};
+    std::lock_guard<std::mutex> lock{m_state->pool->mutex};
+    auto& delayed = m_state->pool->delayed;
+    for (auto it = delayed.begin(); it != delayed.end();)
+    {
+        if (it->second.state.lock() != m_state)
+        {
+            ++it;
+            continue;
+        }
+        cancelled.emplace_back(std::move(it->second.task));
+        it = delayed.erase(it);
+    }
+}
+
+void SerialQueue::execute(const Task& task)
+{
+    if (isCurrent())
+    {
+        task();
+        return;
+    }
+
+    // Any other thread waits for the executor, so it never executes the tasks of the queue by itself
+    if (currentPool != m_state->pool.get())
+    {
+        auto executed = std::make_shared<std::promise<void>>();
+        auto future = executed->get_future();
+        push([&task, executed] {
+            task();
+            executed->set_value();
+        });
+
+        // A queue that is closed drops the task, which breaks the promise
+        future.wait();
+        return;
+    }
+
+    // A thread of the executor executes the tasks pushed before by itself, instead of waiting for a thread to be free
+    std::unique_lock<std::mutex> lock{m_state->mutex};
+    while (true)
+    {
+        m_state->idle.wait(lock, [&] { return !m_state->running; });
+        m_state->running = true;
+        m_state->runningThread = std::this_thread::get_id();
+        if (m_state->tasks.empty())
+            break;
+        auto next = std::move(m_state->tasks.front());
+        m_state->tasks.pop_front();
+        lock.unlock();
+        next();
+        lock.lock();
+        m_state->running = false;
+        m_state->runningThread = {};
+    }
+    lock.unlock();
+    task();
+    finish(m_state);
+}
+
+bool SerialQueue::drain(std::chrono::milliseconds timeout)
+{
+    auto drained = std::make_shared<std::promise<void>>();
+    auto future = drained->get_future();
+    push([drained] { drained->set_value(); });
+    return future.wait_for(timeout) == std::future_status::ready;
+}
+
+bool SerialQueue::isCurrent() const
+{
+    std::lock_guard<std::mutex> lock{m_state->mutex};
+    return m_state->running && m_state->runningThread == std::this_thread::get_id();
+}
+
+void SerialQueue::enlist(const std::shared_ptr<State>& state)
+{
+    const auto pool = state->pool;
+    {
+        std::lock_guard<std::mutex> lock{pool->mutex};
+        pool->ready.emplace_back(state);
+    }
+    pool->condition.notify_one();
+}
+
+void SerialQueue::runNext(const std::shared_ptr<State>& state)
+{
+    auto task = Task{};
+    {
+        // A queue that is being executed by another thread is scheduled again by it, if it has more tasks
+        std::lock_guard<std::mutex> lock{state->mutex};
+        state->scheduled = false;
+        if (state->running || state->closed || state->tasks.empty())
+            return;
+        task = std::move(state->tasks.front());
+        state->tasks.pop_front();
+        state->running = true;
+        state->runningThread = std::this_thread::get_id();
+    }
+    task();
+    finish(state);
+}
+
+void SerialQueue::finish(const std::shared_ptr<State>& state)
+{
+    auto scheduleQueue = false;
+    {
+        std::lock_guard<std::mutex> lock{state->mutex};
+        state->running = false;
+        state->runningThread = {};
+        if (!state->tasks.empty() && !state->scheduled && !state->closed)
+        {
+            state->scheduled = true;
+            scheduleQueue = true;
+        }
+    }
+    state->idle.notify_all();
+    if (scheduleQueue)
+        enlist(state);
+}
+}    // namespace wolkabout::gateway
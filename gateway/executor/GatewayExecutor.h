@@ -0,0 +1,184 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_GATEWAYEXECUTOR_H
+#define WOLKGATEWAY_GATEWAYEXECUTOR_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace wolkabout::gateway
+{
+/**
+ * This is the pool of threads on which the components of the gateway do their work. Instead of every component
+ * owning a thread of its own, every component owns a serial queue on the executor, and the queues that have tasks
+ * waiting are served by a fixed number of threads. The threads also keep the time for the tasks scheduled with a
+ * delay, so the components need no timers of their own either.
+ */
+class GatewayExecutor
+{
+public:
+    /**
+     * Default parameter constructor. Starts the threads.
+     *
+     * @param threadCount The number of threads. At least one thread is always started.
+     * @param name The name of the threads, which is followed by their index. Linux allows only 15 characters for the
+     * whole name, so longer names are shortened.
+     * @param cpuAffinity The CPUs the threads are allowed to run on. Empty leaves the threads on all the CPUs.
+     */
+    explicit GatewayExecutor(std::size_t threadCount = defaultThreadCount(), std::string name = "wolkgw",
+                             std::vector<unsigned int> cpuAffinity = {});
+
+    /**
+     * Default destructor. Stops and joins the threads.
+     */
+    ~GatewayExecutor();
+
+    GatewayExecutor(const GatewayExecutor&) = delete;
+    GatewayExecutor& operator=(const GatewayExecutor&) = delete;
+
+    /**
+     * This method is used to obtain the number of threads of the executor.
+     *
+     * @return The number of threads.
+     */
+    std::size_t getThreadCount() const;
+
+    /**
+     * This method is used to obtain the default number of threads - one per CPU, but at least two.
+     *
+     * @return The default number of threads.
+     */
+    static std::size_t defaultThreadCount();
+
+    /**
+     * This method is used to check whether the calling thread is a thread of an executor.
+     *
+     * @return Whether the calling thread is a thread of an executor.
+     */
+    static bool isExecutorThread();
+
+private:
+    friend class SerialQueue;
+
+    struct Pool;
+
+    static void run(const std::shared_ptr<Pool>& pool);
+
+    static void releaseDueTasks(Pool& pool, std::vector<std::function<void()>>& dropped);
+
+    // The threads share the pool with the executor, so a thread that ends up destroying the executor can outlive it
+    std::shared_ptr<Pool> m_pool;
+    std::vector<std::thread> m_threads;
+};
+
+/**
+ * This is a queue of tasks executed on a gateway executor. The tasks of a single queue are executed one at a time, in
+ * the order in which they were pushed, while the tasks of different queues are executed in parallel.
+ */
+class SerialQueue
+{
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * Default parameter constructor.
+     *
+     * @param executor The executor on which the tasks are executed. If none is given, the queue gets an executor with
+     * a single thread of its own.
+     * @param name The name of the queue. Used to name the thread of its own executor.
+     */
+    explicit SerialQueue(std::shared_ptr<GatewayExecutor> executor = nullptr, const std::string& name = "queue");
+
+    /**
+     * Default destructor. Executes the tasks that are still waiting, and stops taking in new ones.
+     */
+    ~SerialQueue();
+
+    SerialQueue(const SerialQueue&) = delete;
+    SerialQueue& operator=(const SerialQueue&) = delete;
+
+    /**
+     * This method is used to push a task that will be executed on the executor.
+     *
+     * @param task The task.
+     */
+    void push(Task task);
+
+    /**
+     * This method is used to push a task once a delay has passed. Until then, the task waits on the executor, and
+     * takes no thread. A task scheduled on a queue that is destroyed in the meantime is dropped.
+     *
+     * @param delay The delay after which the task is pushed.
+     * @param task The task.
+     */
+    void schedule(std::chrono::milliseconds delay, Task task);
+
+    /**
+     * This method is used to cancel all the tasks of the queue that are scheduled, and are not yet due. The tasks
+     * that are due have already been pushed, and are executed as usual.
+     */
+    void cancelScheduled();
+
+    /**
+     * This method is used to execute a task and wait for it, once all the tasks pushed before it have been executed.
+     * No other task of the queue is executed at the same time. Called from a task of this queue, the task is executed
+     * right away. A thread of the executor executes the waiting tasks and the task by itself, so it never waits for
+     * another thread of the executor to be free. Any other thread waits for the task to be executed on the executor.
+     *
+     * The waits must not form a cycle. A task of one queue that waits for a second queue, while a task of the second
+     * queue waits for the first one, deadlocks both queues.
+     *
+     * @param task The task.
+     */
+    void execute(const Task& task);
+
+    /**
+     * This method is used to wait until all the tasks pushed before it have been executed.
+     *
+     * @param timeout How long to wait for the tasks.
+     * @return Whether all the tasks have been executed in time.
+     */
+    bool drain(std::chrono::milliseconds timeout);
+
+    /**
+     * This method is used to check whether the calling thread is executing a task of this queue.
+     *
+     * @return Whether the calling thread is executing a task of this queue.
+     */
+    bool isCurrent() const;
+
+private:
+    friend class GatewayExecutor;
+
+    struct State;
+
+    static void enlist(const std::shared_ptr<State>& state);
+
+    static void runNext(const std::shared_ptr<State>& state);
+
+    static void finish(const std::shared_ptr<State>& state);
+
+    std::shared_ptr<GatewayExecutor> m_executor;
+    std::shared_ptr<State> m_state;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_GATEWAYEXECUTOR_H
@@ -0,0 +1,221 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/memory/MemoryBudget.h"
+
+#include "gateway/executor/GatewayExecutor.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+namespace wolkabout::gateway
+{
+const double MemoryBudget::OVERLOAD_THRESHOLD = 0.9;
+const double MemoryBudget::RECOVERY_THRESHOLD = 0.75;
+
+struct MemoryBudget::State
+{
+    const std::uint64_t capacity;
+    const std::map<MessageType, OverloadPolicy> policies;
+    const OverloadPolicy defaultPolicy;
+    const std::chrono::milliseconds backpressureTimeout;
+
+    mutable std::mutex mutex;
+    std::condition_variable released;
+    std::uint64_t used;
+    std::uint64_t highWaterMark;
+    std::uint64_t refused;
+    bool overloaded;
+    std::map<std::string, MemoryConsumerStatistics> consumers;
+
+    // The listener, and the state it was last notified of, so it never hears of the same state twice in a row
+    std::mutex listenerMutex;
+    OverloadListener listener;
+    bool notifiedOverloaded;
+};
+
+MemoryBudget::MemoryBudget(std::uint64_t capacity, std::map<MessageType, OverloadPolicy> policies,
+                           OverloadPolicy defaultPolicy, std::chrono::milliseconds backpressureTimeout)
+: m_state{new State{capacity, std::move(policies), defaultPolicy, backpressureTimeout, {}, {}, 0, 0, 0, false, {}, {},
+                    nullptr, false}}
+{
+}
+
+MemoryBudget::Reservation MemoryBudget::reserve(const std::string& consumer, MessageType messageType,
+                                                std::uint64_t bytes)
+{
+    const auto policyIt = m_state->policies.find(messageType);
+    const auto policy = policyIt != m_state->policies.cend() ? policyIt->second : m_state->defaultPolicy;
+
+    auto admitted = false;
+    auto becameOverloaded = false;
+    {
+        std::unique_lock<std::mutex> lock{m_state->mutex};
+        auto& statistics = m_state->consumers[consumer];
+        statistics.name = consumer;
+        const auto fits = [&] { return m_state->used + bytes <= m_state->capacity; };
+
+        // A message larger than the whole budget would wait in vain, and a thread of the executor must not wait at all
+        if (!fits() && policy == OverloadPolicy::Backpressure && bytes <= m_state->capacity &&
+            !GatewayExecutor::isExecutorThread())
+            m_state->released.wait_for(lock, m_state->backpressureTimeout, fits);
+        admitted = fits() || policy == OverloadPolicy::Admit;
+        if (admitted)
+        {
+            m_state->used += bytes;
+            m_state->highWaterMark = std::max(m_state->highWaterMark, m_state->used);
+            statistics.used += bytes;
+            statistics.highWaterMark = std::max(statistics.highWaterMark, statistics.used);
+        }
+        else
+        {
+            ++m_state->refused;
+            ++statistics.refused;
+        }
+        if (!m_state->overloaded && static_cast<double>(m_state->used) > OVERLOAD_THRESHOLD * m_state->capacity)
+        {
+            m_state->overloaded = true;
+            becameOverloaded = true;
+        }
+    }
+    if (becameOverloaded)
+        notify(m_state);
+    if (!admitted)
+        return {};
+    return Reservation{m_state, consumer, bytes};
+}
+
+bool MemoryBudget::isOverloaded() const
+{
+    std::lock_guard<std::mutex> lock{m_state->mutex};
+    return m_state->overloaded;
+}
+
+void MemoryBudget::setOverloadListener(OverloadListener listener)
+{
+    std::lock_guard<std::mutex> lock{m_state->listenerMutex};
+    m_state->listener = std::move(listener);
+}
+
+MemoryBudgetStatistics MemoryBudget::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock{m_state->mutex};
+    auto statistics = MemoryBudgetStatistics{m_state->capacity, m_state->used,       m_state->highWaterMark,
+                                             m_state->refused,  m_state->overloaded, {}};
+    for (const auto& consumer : m_state->consumers)
+        statistics.consumers.emplace_back(consumer.second);
+    return statistics;
+}
+
+std::uint64_t MemoryBudget::sizeOf(const Message& message)
+{
+    return sizeof(Message) + message.getChannel().size() + message.getContent().size();
+}
+
+std::map<MessageType, OverloadPolicy> MemoryBudget::defaultPolicies()
+{
+    return {{MessageType::DEVICE_REGISTRATION, OverloadPolicy::Admit},
+            {MessageType::DEVICE_REMOVAL, OverloadPolicy::Admit},
+            {MessageType::CHILDREN_SYNCHRONIZATION_REQUEST, OverloadPolicy::Admit},
+            {MessageType::CHILDREN_SYNCHRONIZATION_RESPONSE, OverloadPolicy::Admit},
+            {MessageType::REGISTERED_DEVICES_REQUEST, OverloadPolicy::Admit},
+            {MessageType::REGISTERED_DEVICES_RESPONSE, OverloadPolicy::Admit},
+            {MessageType::TIME_SYNC, OverloadPolicy::Admit},
+            {MessageType::FIRMWARE_UPDATE_INSTALL, OverloadPolicy::Admit},
+            {MessageType::FIRMWARE_UPDATE_ABORT, OverloadPolicy::Admit},
+            {MessageType::FIRMWARE_UPDATE_STATUS, OverloadPolicy::Admit},
+            {MessageType::FEED_VALUES, OverloadPolicy::Backpressure},
+            {MessageType::PARAMETER_SYNC, OverloadPolicy::Backpressure}};
+}
+
+void MemoryBudget::release(const std::shared_ptr<State>& state, const std::string& consumer, std::uint64_t bytes)
+{
+    auto recovered = false;
+    {
+        std::lock_guard<std::mutex> lock{state->mutex};
+        state->used -= bytes;
+        state->consumers[consumer].used -= bytes;
+        if (state->overloaded && static_cast<double>(state->used) < RECOVERY_THRESHOLD * state->capacity)
+        {
+            state->overloaded = false;
+            recovered = true;
+        }
+    }
+    state->released.notify_all();
+    if (recovered)
+        notify(state);
+}
+
+void MemoryBudget::notify(const std::shared_ptr<State>& state)
+{
+    // The changes can race each other here, so the listener is given the state as it is now
+    std::lock_guard<std::mutex> listenerLock{state->listenerMutex};
+    auto overloaded = false;
+    {
+        std::lock_guard<std::mutex> lock{state->mutex};
+        overloaded = state->overloaded;
+    }
+    if (overloaded == state->notifiedOverloaded)
+        return;
+    state->notifiedOverloaded = overloaded;
+    if (state->listener)
+        state->listener(overloaded);
+}
+
+MemoryBudget::Reservation::Reservation(std::shared_ptr<State> state, std::string consumer, std::uint64_t bytes)
+: m_state{std::move(state)}, m_consumer{std::move(consumer)}, m_bytes{bytes}
+{
+}
+
+MemoryBudget::Reservation::~Reservation()
+{
+    release();
+}
+
+MemoryBudget::Reservation::Reservation(Reservation&& other) noexcept
+: m_state{std::move(other.m_state)}, m_consumer{std::move(other.m_consumer)}, m_bytes{other.m_bytes}
+{
+    other.m_state = nullptr;
+}
+
+MemoryBudget::Reservation& MemoryBudget::Reservation::operator=(Reservation&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        m_state = std::move(other.m_state);
+        m_consumer = std::move(other.m_consumer);
+        m_bytes = other.m_bytes;
+        other.m_state = nullptr;
+    }
+    return *this;
+}
+
+MemoryBudget::Reservation::operator bool() const
+{
+    return m_state != nullptr;
+}
+
+void MemoryBudget::Reservation::release()
+{
+    if (m_state == nullptr)
+        return;
+    MemoryBudget::release(m_state, m_consumer, m_bytes);
+    m_state = nullptr;
+}
+}    // namespace wolkabout::gateway
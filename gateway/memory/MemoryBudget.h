@@ -0,0 +1,199 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_MEMORYBUDGET_H
+#define WOLKGATEWAY_MEMORYBUDGET_H
+
+#include "core/Types.h"
+#include "core/model/Message.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace wolkabout::gateway
+{
+// What happens to a message for which there is no room left in the budget
+enum class OverloadPolicy
+{
+    // The message is taken in anyway, over the budget
+    Admit,
+    // The producer waits for the room to be freed, and the message is refused if that does not happen in time. A
+    // producer on a thread of the executor never waits, as that would hold up the other queues, and is refused at once
+    Backpressure,
+    // The message is refused right away
+    Drop
+};
+
+// The memory held by a single consumer of the budget
+struct MemoryConsumerStatistics
+{
+    std::string name;
+    std::uint64_t used;
+    std::uint64_t highWaterMark;
+    std::uint64_t refused;
+};
+
+// The memory held by all the consumers of the budget
+struct MemoryBudgetStatistics
+{
+    std::uint64_t capacity;
+    std::uint64_t used;
+    std::uint64_t highWaterMark;
+    std::uint64_t refused;
+    bool overloaded;
+    std::vector<MemoryConsumerStatistics> consumers;
+};
+
+/**
+ * This is the budget of memory that the messages waiting inside of the gateway are allowed to take, shared by the
+ * router, the services, the outbound lanes and the message persistence. Every message that is queued reserves its size
+ * from the budget, and the reservation is returned once the message leaves the queue. When there is no room left, the
+ * policy of the message type decides whether the message is admitted anyway, waited for or dropped.
+ *
+ * The budget is overloaded from the moment it is filled past the overload threshold until it is emptied below the
+ * recovery threshold. The producers can check this, or listen for it, and hold back the traffic before their messages
+ * start being refused.
+ */
+class MemoryBudget
+{
+public:
+    using OverloadListener = std::function<void(bool overloaded)>;
+
+    class Reservation;
+
+    /**
+     * Default parameter constructor.
+     *
+     * @param capacity The number of bytes the waiting messages can take.
+     * @param policies The policy of every message type.
+     * @param defaultPolicy The policy of the message types that are not given one.
+     * @param backpressureTimeout How long a producer waits for the room under the backpressure policy.
+     */
+    explicit MemoryBudget(std::uint64_t capacity, std::map<MessageType, OverloadPolicy> policies = defaultPolicies(),
+                          OverloadPolicy defaultPolicy = OverloadPolicy::Drop,
+                          std::chrono::milliseconds backpressureTimeout = std::chrono::milliseconds{100});
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    /**
+     * This method is used to reserve the room for a message.
+     *
+     * @param consumer The name of the queue that holds the message.
+     * @param messageType The type of the message.
+     * @param bytes The size of the message.
+     * @return The reservation, which returns the room once it is destroyed. Empty if the message was refused.
+     */
+    Reservation reserve(const std::string& consumer, MessageType messageType, std::uint64_t bytes);
+
+    /**
+     * This method is used to check whether the budget is overloaded.
+     *
+     * @return Whether the budget is overloaded.
+     */
+    bool isOverloaded() const;
+
+    /**
+     * This method is used to set the listener that is notified every time the budget becomes overloaded, or recovers.
+     * The listener is notified on the thread that caused the change, and must not reserve any room itself.
+     *
+     * @param listener The listener.
+     */
+    void setOverloadListener(OverloadListener listener);
+
+    /**
+     * This method is used to obtain the memory held by the budget and all of its consumers.
+     *
+     * @return The statistics. The consumers are ordered by their names.
+     */
+    MemoryBudgetStatistics getStatistics() const;
+
+    /**
+     * This method is used to obtain the number of bytes a message takes while it is waiting.
+     *
+     * @param message The message.
+     * @return The size of the message.
+     */
+    static std::uint64_t sizeOf(const Message& message);
+
+    /**
+     * This method is used to obtain the default policies. Registration, synchronization and firmware messages are
+     * always admitted, feed values and parameters apply backpressure, and everything else is dropped.
+     *
+     * @return The default policies.
+     */
+    static std::map<MessageType, OverloadPolicy> defaultPolicies();
+
+    // The share of the capacity above which the budget is overloaded, and below which it recovers
+    static const double OVERLOAD_THRESHOLD;
+    static const double RECOVERY_THRESHOLD;
+
+private:
+    struct State;
+
+    static void release(const std::shared_ptr<State>& state, const std::string& consumer, std::uint64_t bytes);
+
+    static void notify(const std::shared_ptr<State>& state);
+
+    // The reservations share the state, so a message can outlive the budget
+    std::shared_ptr<State> m_state;
+};
+
+/**
+ * This is the room reserved for a single message. It is returned to the budget once the reservation is destroyed.
+ */
+class MemoryBudget::Reservation
+{
+public:
+    Reservation() = default;
+
+    ~Reservation();
+
+    Reservation(Reservation&& other) noexcept;
+    Reservation& operator=(Reservation&& other) noexcept;
+
+    Reservation(const Reservation&) = delete;
+    Reservation& operator=(const Reservation&) = delete;
+
+    /**
+     * This method is used to check whether the room was reserved.
+     *
+     * @return Whether the room was reserved.
+     */
+    explicit operator bool() const;
+
+    /**
+     * This method is used to return the room to the budget before the reservation is destroyed.
+     */
+    void release();
+
+private:
+    friend class MemoryBudget;
+
+    Reservation(std::shared_ptr<State> state, std::string consumer, std::uint64_t bytes);
+
+    std::shared_ptr<State> m_state;
+    std::string m_consumer;
+    std::uint64_t m_bytes = 0;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_MEMORYBUDGET_H
@@ -0,0 +1,97 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/persistence/BudgetedMessagePersistence.h"
+
+#include "core/utility/Logger.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace wolkabout::legacy;
+
+namespace wolkabout::gateway
+{
+BudgetedMessagePersistence::BudgetedMessagePersistence(std::unique_ptr<MessagePersistence> persistence,
+                                                       Protocol& protocol, std::shared_ptr<MemoryBudget> memoryBudget)
+: m_persistence{std::move(persistence)}, m_protocol{protocol}, m_memoryBudget{std::move(memoryBudget)}
+{
+}
+
+bool BudgetedMessagePersistence::push(std::shared_ptr<Message> message)
+{
+    if (message == nullptr)
+        return false;
+
+    // The room is reserved before the lock is taken, as the producer might have to wait for it
+    auto reservation =
+      m_memoryBudget->reserve("persistence", m_protocol.getMessageType(*message), MemoryBudget::sizeOf(*message));
+    if (!reservation)
+    {
+        LOG(WARN) << "Dropping a message for the platform - The memory budget is exhausted.";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto stored = std::weak_ptr<Message>{message};
+    if (!m_persistence->push(std::move(message)))
+        return false;
+    m_reservations.emplace_back(StoredReservation{std::move(stored), std::move(reservation)});
+    releaseExpired();
+    return true;
+}
+
+void BudgetedMessagePersistence::pop()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    const auto message = m_persistence->front();
+    m_persistence->pop();
+    if (message != nullptr)
+    {
+        const auto it = std::find_if(m_reservations.begin(), m_reservations.end(),
+                                     [&](const StoredReservation& stored) { return stored.message.lock() == message; });
+        if (it != m_reservations.end())
+            m_reservations.erase(it);
+    }
+    releaseExpired();
+}
+
+std::shared_ptr<Message> BudgetedMessagePersistence::front()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_persistence->front();
+}
+
+bool BudgetedMessagePersistence::empty() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_persistence->empty();
+}
+
+void BudgetedMessagePersistence::releaseExpired()
+{
+    // The oldest messages are the ones usually dropped, and the rest are looked through once there have been as many
+    // pushes and pops as there are reservations, so the room of a message dropped from the middle is not held for long
+    while (!m_reservations.empty() && m_reservations.front().message.expired())
+        m_reservations.pop_front();
+    if (++m_releaseCalls < m_reservations.size())
+        return;
+    m_releaseCalls = 0;
+    m_reservations.erase(std::remove_if(m_reservations.begin(), m_reservations.end(),
+                                        [](const StoredReservation& stored) { return stored.message.expired(); }),
+                         m_reservations.end());
+}
+}    // namespace wolkabout::gateway
@@ -0,0 +1,77 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_BUDGETEDMESSAGEPERSISTENCE_H
+#define WOLKGATEWAY_BUDGETEDMESSAGEPERSISTENCE_H
+
+#include "core/persistence/MessagePersistence.h"
+#include "core/protocol/Protocol.h"
+#include "gateway/memory/MemoryBudget.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace wolkabout::gateway
+{
+/**
+ * This is a message persistence that keeps the messages of the persistence it wraps within a memory budget. Every
+ * pushed message reserves its size from the budget, and a message the budget refuses is not stored. The reservation is
+ * kept for as long as the wrapped persistence holds on to the message, so the room of a message that it pops, drops or
+ * keeps only outside of the memory is returned.
+ */
+class BudgetedMessagePersistence : public MessagePersistence
+{
+public:
+    /**
+     * Default parameter constructor.
+     *
+     * @param persistence The persistence that stores the messages.
+     * @param protocol The protocol used to obtain the message type of a message.
+     * @param memoryBudget The budget from which the room for the messages is reserved.
+     */
+    BudgetedMessagePersistence(std::unique_ptr<MessagePersistence> persistence, Protocol& protocol,
+                               std::shared_ptr<MemoryBudget> memoryBudget);
+
+    bool push(std::shared_ptr<Message> message) override;
+
+    void pop() override;
+
+    std::shared_ptr<Message> front() override;
+
+    bool empty() const override;
+
+private:
+    struct StoredReservation
+    {
+        std::weak_ptr<Message> message;
+        MemoryBudget::Reservation reservation;
+    };
+
+    void releaseExpired();
+
+    std::unique_ptr<MessagePersistence> m_persistence;
+    Protocol& m_protocol;
+    std::shared_ptr<MemoryBudget> m_memoryBudget;
+
+    // The reservations of the stored messages, in the order in which the messages were pushed
+    mutable std::mutex m_mutex;
+    std::deque<StoredReservation> m_reservations;
+    std::size_t m_releaseCalls = 0;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_BUDGETEDMESSAGEPERSISTENCE_H
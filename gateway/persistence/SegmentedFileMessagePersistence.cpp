@@ -0,0 +1,549 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/persistence/SegmentedFileMessagePersistence.h"
+
+#include "core/utility/Logger.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace wolkabout::legacy;
+
+namespace wolkabout::gateway
+{
+namespace
+{
+// The header placed at the start of every segment file
+struct SegmentHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t checksum;
+    std::uint64_t sequence;
+};
+static_assert(sizeof(SegmentHeader) == 24, "The segment header must not contain any padding.");
+
+// The header placed in front of every message in a segment
+struct RecordHeader
+{
+    std::uint32_t magic;
+    std::uint32_t checksum;
+    std::uint32_t channelSize;
+    std::uint32_t contentSize;
+    std::uint32_t state;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(RecordHeader) == 24, "The record header must not contain any padding.");
+
+const char SEGMENT_MAGIC[8] = {'W', 'G', 'M', 'S', 'G', 'S', 'E', 'G'};
+const std::uint32_t RECORD_MAGIC = 0x57474D52;
+const std::uint32_t RECORD_STORED = 0;
+const std::uint32_t RECORD_REMOVED = 1;
+const std::string SEGMENT_PREFIX = "segment-";
+const std::string SEGMENT_SUFFIX = ".wgq";
+
+std::uint32_t crc32(std::uint32_t crc, const void* data, std::size_t size)
+{
+    static const auto table = [] {
+        auto values = std::array<std::uint32_t, 256>{};
+        for (auto i = std::uint32_t{0}; i < values.size(); ++i)
+        {
+            auto value = i;
+            for (auto bit = 0; bit < 8; ++bit)
+                value = (value & 1) != 0 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+            values[i] = value;
+        }
+        return values;
+    }();
+
+    const auto* bytes = static_cast<const std::uint8_t*>(data);
+    crc = ~crc;
+    for (auto i = std::size_t{0}; i < size; ++i)
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// The checksum covers the sizes and the message, but not the state, which changes once the message is removed
+std::uint32_t recordChecksum(const RecordHeader& header, const char* payload)
+{
+    auto checksum = crc32(0, &header.channelSize, sizeof(header.channelSize));
+    checksum = crc32(checksum, &header.contentSize, sizeof(header.contentSize));
+    return crc32(checksum, payload, std::size_t{header.channelSize} + header.contentSize);
+}
+
+// Records are kept aligned, so their headers can be read in place
+std::uint64_t recordSize(std::uint64_t channelSize, std::uint64_t contentSize)
+{
+    return (sizeof(RecordHeader) + channelSize + contentSize + 7) & ~std::uint64_t{7};
+}
+
+std::string segmentPath(const std::string& directory, std::uint64_t sequence)
+{
+    auto name = std::to_string(sequence);
+    return directory + "/" + SEGMENT_PREFIX + std::string(20 - std::min<std::size_t>(name.size(), 20), '0') + name +
+           SEGMENT_SUFFIX;
+}
+
+std::string deviceKeyFromChannel(const Message& message)
+{
+    const auto& channel = message.getChannel();
+    const auto begin = channel.find('/');
+    if (begin == std::string::npos)
+        return channel;
+    const auto end = channel.find('/', begin + 1);
+    return channel.substr(begin + 1, end == std::string::npos ? std::string::npos : end - begin - 1);
+}
+}    // namespace
+
+const std::uint32_t SegmentedFileMessagePersistence::VERSION = 1;
+
+SegmentedFileMessagePersistence::SegmentedFileMessagePersistence(std::string directory, std::uint64_t byteCap,
+                                                                 std::uint64_t deviceQuota, std::uint64_t segmentSize,
+                                                                 DeviceKeyExtractor deviceKeyExtractor)
+: m_directory{std::move(directory)}
+, m_byteCap{byteCap}
+, m_deviceQuota{deviceQuota}
+, m_segmentSize{segmentSize}
+, m_deviceKeyExtractor{deviceKeyExtractor ? std::move(deviceKeyExtractor) : deviceKeyFromChannel}
+, m_activeSegment{nullptr}
+, m_firstRecord{0}
+, m_storedRecords{0}
+, m_storedBytes{0}
+, m_droppedMessages{0}
+{
+    if (::mkdir(m_directory.c_str(), 0755) != 0 && errno != EEXIST)
+        throw std::runtime_error("Failed to create the message directory '" + m_directory + "' - '" +
+                                 std::strerror(errno) + "'.");
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    recover();
+}
+
+SegmentedFileMessagePersistence::~SegmentedFileMessagePersistence()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    for (const auto& segment : m_segments)
+    {
+        ::msync(segment.second->data, segment.second->size, MS_SYNC);
+        ::munmap(segment.second->data, segment.second->size);
+    }
+}
+
+bool SegmentedFileMessagePersistence::push(std::shared_ptr<Message> message)
+{
+    const auto errorPrefix = "Failed to store the message - ";
+    if (message == nullptr)
+        return false;
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    const auto& channel = message->getChannel();
+    const auto& content = message->getContent();
+    const auto size = recordSize(channel.size(), content.size());
+    if (channel.size() > UINT32_MAX || content.size() > UINT32_MAX || size > m_byteCap ||
+        (m_deviceQuota > 0 && size > m_deviceQuota))
+    {
+        LOG(ERROR) << errorPrefix << "The message of " << size << " bytes can never fit within the caps.";
+        return false;
+    }
+
+    // Make room for the message, first within the quota of the device, and then within the total cap
+    auto deviceKey = m_deviceKeyExtractor(*message);
+    const auto droppedBefore = m_droppedMessages;
+    if (m_deviceQuota > 0)
+    {
+        auto it = m_devices.find(deviceKey);
+        while (it != m_devices.cend() && it->second.bytes + size > m_deviceQuota)
+        {
+            removeRecord(it->second.records.front());
+            ++m_droppedMessages;
+            it = m_devices.find(deviceKey);
+        }
+    }
+    while (m_storedBytes + size > m_byteCap)
+        removeOldestRecord();
+    if (m_droppedMessages > droppedBefore)
+        LOG(WARN) << "Dropped " << m_droppedMessages - droppedBefore
+                  << " oldest message(s) to make room for a message of device '" << deviceKey << "'.";
+
+    if (m_activeSegment == nullptr || m_activeSegment->writeOffset + size > m_activeSegment->size)
+    {
+        if (openSegment(size) == nullptr)
+        {
+            LOG(ERROR) << errorPrefix << "No segment to write the message into.";
+            return false;
+        }
+    }
+
+    // The message is written before its header, so the record becomes valid only once it is complete
+    auto* record = m_activeSegment->data + m_activeSegment->writeOffset;
+    std::memcpy(record + sizeof(RecordHeader), channel.data(), channel.size());
+    std::memcpy(record + sizeof(RecordHeader) + channel.size(), content.data(), content.size());
+    auto header = RecordHeader{};
+    header.magic = RECORD_MAGIC;
+    header.channelSize = static_cast<std::uint32_t>(channel.size());
+    header.contentSize = static_cast<std::uint32_t>(content.size());
+    header.state = RECORD_STORED;
+    header.checksum = recordChecksum(header, record + sizeof(RecordHeader));
+    std::memcpy(record, &header, sizeof(header));
+
+    const auto index = m_firstRecord + m_records.size();
+    m_records.push_back(Record{m_activeSegment, m_activeSegment->writeOffset, size, deviceKey, false});
+    auto& device = m_devices[deviceKey];
+    device.bytes += size;
+    device.records.push_back(index);
+    m_activeSegment->writeOffset += size;
+    ++m_activeSegment->records;
+    ++m_storedRecords;
+    m_storedBytes += size;
+    return true;
+}
+
+void SegmentedFileMessagePersistence::pop()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    trimRemovedRecords();
+    if (!m_records.empty())
+        removeRecord(m_firstRecord);
+}
+
+std::shared_ptr<Message> SegmentedFileMessagePersistence::front()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    trimRemovedRecords();
+    if (m_records.empty())
+        return nullptr;
+
+    const auto& record = m_records.front();
+    const auto* data = record.segment->data + record.offset;
+    auto header = RecordHeader{};
+    std::memcpy(&header, data, sizeof(header));
+    const auto* channel = data + sizeof(RecordHeader);
+    return std::make_shared<Message>(std::string{channel + header.channelSize, header.contentSize},
+                                     std::string{channel, header.channelSize});
+}
+
+bool SegmentedFileMessagePersistence::empty() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_storedRecords == 0;
+}
+
+std::size_t SegmentedFileMessagePersistence::size() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return static_cast<std::size_t>(m_storedRecords);
+}
+
+std::uint64_t SegmentedFileMessagePersistence::storedBytes() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_storedBytes;
+}
+
+std::uint64_t SegmentedFileMessagePersistence::byteCap() const
+{
+    return m_byteCap;
+}
+
+std::uint64_t SegmentedFileMessagePersistence::droppedMessages() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_droppedMessages;
+}
+
+bool SegmentedFileMessagePersistence::flush()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto flushed = true;
+    for (const auto& segment : m_segments)
+    {
+        if (::msync(segment.second->data, segment.second->size, MS_SYNC) != 0)
+        {
+            LOG(ERROR) << "Failed to flush '" << segment.second->path << "' - '" << std::strerror(errno) << "'.";
+            flushed = false;
+        }
+    }
+    return flushed;
+}
+
+void SegmentedFileMessagePersistence::recover()
+{
+    LOG(DEBUG) << METHOD_INFO;
+
+    auto* directory = ::opendir(m_directory.c_str());
+    if (directory == nullptr)
+    {
+        LOG(ERROR) << "Failed to open the message directory '" << m_directory << "' - '" << std::strerror(errno)
+                   << "'.";
+        return;
+    }
+    auto segments = std::map<std::uint64_t, std::string>{};
+    while (auto* entry = ::readdir(directory))
+    {
+        const auto name = std::string{entry->d_name};
+        if (name.size() <= SEGMENT_PREFIX.size() + SEGMENT_SUFFIX.size() ||
+            name.compare(0, SEGMENT_PREFIX.size(), SEGMENT_PREFIX) != 0 ||
+            name.compare(name.size() - SEGMENT_SUFFIX.size(), SEGMENT_SUFFIX.size(), SEGMENT_SUFFIX) != 0)
+            continue;
+        const auto number =
+          name.substr(SEGMENT_PREFIX.size(), name.size() - SEGMENT_PREFIX.size() - SEGMENT_SUFFIX.size());
+        if (number.find_first_not_of("0123456789") != std::string::npos)
+            continue;
+        try
+        {
+            segments.emplace(std::stoull(number), m_directory + "/" + name);
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+    ::closedir(directory);
+
+    // The segments are read back in the order in which they were written
+    for (const auto& segment : segments)
+        recoverSegment(segment.first, segment.second);
+
+    // The caps could have been lowered since the messages were stored
+    if (m_deviceQuota > 0)
+    {
+        auto deviceKeys = std::vector<std::string>{};
+        for (const auto& device : m_devices)
+            if (device.second.bytes > m_deviceQuota)
+                deviceKeys.emplace_back(device.first);
+        for (const auto& deviceKey : deviceKeys)
+        {
+            for (auto it = m_devices.find(deviceKey); it != m_devices.cend() && it->second.bytes > m_deviceQuota;
+                 it = m_devices.find(deviceKey))
+            {
+                removeRecord(it->second.records.front());
+                ++m_droppedMessages;
+            }
+        }
+    }
+    while (m_storedBytes > m_byteCap)
+        removeOldestRecord();
+    LOG(INFO) << "Recovered " << m_storedRecords << " message(s) (" << m_storedBytes << " bytes) from "
+              << m_segments.size() << " segment(s) in '" << m_directory << "'.";
+    if (m_droppedMessages > 0)
+        LOG(WARN) << "Dropped " << m_droppedMessages << " recovered message(s) that no longer fit within the caps.";
+}
+
+void SegmentedFileMessagePersistence::recoverSegment(std::uint64_t sequence, const std::string& path)
+{
+    const auto errorPrefix = "Failed to recover the segment - ";
+
+    auto fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0)
+    {
+        LOG(WARN) << errorPrefix << "Failed to open '" << path << "' - '" << std::strerror(errno) << "'.";
+        return;
+    }
+    struct stat fileStatus = {};
+    if (::fstat(fd, &fileStatus) != 0 || static_cast<std::size_t>(fileStatus.st_size) < sizeof(SegmentHeader))
+    {
+        LOG(WARN) << errorPrefix << "The file '" << path << "' is too small to be a segment.";
+        ::close(fd);
+        ::unlink(path.c_str());
+        return;
+    }
+    const auto size = static_cast<std::uint64_t>(fileStatus.st_size);
+    auto data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        LOG(WARN) << errorPrefix << "Failed to map '" << path << "' - '" << std::strerror(errno) << "'.";
+        return;
+    }
+
+    // A segment whose header was not completely written never held any messages
+    auto header = SegmentHeader{};
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 || header.version != VERSION ||
+        header.sequence != sequence || header.checksum != crc32(0, &header.sequence, sizeof(header.sequence)))
+    {
+        LOG(WARN) << errorPrefix << "The file '" << path << "' is not a valid version " << VERSION << " segment.";
+        ::munmap(data, size);
+        ::unlink(path.c_str());
+        return;
+    }
+
+    auto segment = std::unique_ptr<Segment>{new Segment{sequence, path, static_cast<char*>(data), size, size, 0}};
+    auto offset = std::uint64_t{sizeof(SegmentHeader)};
+    while (offset + sizeof(RecordHeader) <= size)
+    {
+        const auto* record = segment->data + offset;
+        auto recordHeader = RecordHeader{};
+        std::memcpy(&recordHeader, record, sizeof(recordHeader));
+        if (recordHeader.magic != RECORD_MAGIC)
+            break;
+        const auto length = recordSize(recordHeader.channelSize, recordHeader.contentSize);
+        if (offset + length > size ||
+            recordHeader.checksum != recordChecksum(recordHeader, record + sizeof(RecordHeader)))
+        {
+            LOG(WARN) << errorPrefix << "The file '" << path << "' ends with an incomplete message.";
+            break;
+        }
+        if (recordHeader.state == RECORD_STORED)
+        {
+            const auto* channel = record + sizeof(RecordHeader);
+            auto deviceKey =
+              m_deviceKeyExtractor(Message{std::string{channel + recordHeader.channelSize, recordHeader.contentSize},
+                                           std::string{channel, recordHeader.channelSize}});
+            const auto index = m_firstRecord + m_records.size();
+            m_records.push_back(Record{segment.get(), offset, length, deviceKey, false});
+            auto& device = m_devices[deviceKey];
+            device.bytes += length;
+            device.records.push_back(index);
+            ++segment->records;
+            ++m_storedRecords;
+            m_storedBytes += length;
+        }
+        offset += length;
+    }
+
+    // Nothing is appended to recovered segments, so whatever follows the last valid record is never read again
+    if (segment->records == 0)
+    {
+        ::munmap(data, size);
+        ::unlink(path.c_str());
+        return;
+    }
+    m_segments.emplace(sequence, std::move(segment));
+}
+
+SegmentedFileMessagePersistence::Segment* SegmentedFileMessagePersistence::openSegment(std::uint64_t minimumSize)
+{
+    const auto errorPrefix = "Failed to open a new segment - ";
+
+    // The segment that is full is deleted right away if all of its messages were already taken out
+    if (m_activeSegment != nullptr)
+    {
+        auto* previous = m_activeSegment;
+        m_activeSegment = nullptr;
+        if (previous->records == 0)
+            closeSegment(previous, true);
+    }
+
+    const auto sequence = m_segments.empty() ? std::uint64_t{1} : m_segments.rbegin()->first + 1;
+    const auto path = segmentPath(m_directory, sequence);
+    const auto size = std::max<std::uint64_t>(m_segmentSize, sizeof(SegmentHeader) + minimumSize);
+    auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        LOG(ERROR) << errorPrefix << "Failed to open '" << path << "' - '" << std::strerror(errno) << "'.";
+        return nullptr;
+    }
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        LOG(ERROR) << errorPrefix << "Failed to size '" << path << "' - '" << std::strerror(errno) << "'.";
+        ::close(fd);
+        ::unlink(path.c_str());
+        return nullptr;
+    }
+    auto data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        LOG(ERROR) << errorPrefix << "Failed to map '" << path << "' - '" << std::strerror(errno) << "'.";
+        ::unlink(path.c_str());
+        return nullptr;
+    }
+
+    // The header is on the disk before any message is written into the segment
+    auto header = SegmentHeader{};
+    std::memcpy(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    header.version = VERSION;
+    header.sequence = sequence;
+    header.checksum = crc32(0, &header.sequence, sizeof(header.sequence));
+    std::memcpy(data, &header, sizeof(header));
+    ::msync(data, sizeof(header), MS_SYNC);
+
+    auto segment = std::unique_ptr<Segment>{new Segment{sequence, path, static_cast<char*>(data), size,
+                                                        sizeof(SegmentHeader), 0}};
+    m_activeSegment = segment.get();
+    m_segments.emplace(sequence, std::move(segment));
+    LOG(DEBUG) << "Opened the segment '" << path << "' of " << size << " bytes.";
+    return m_activeSegment;
+}
+
+void SegmentedFileMessagePersistence::closeSegment(Segment* segment, bool deleteFile)
+{
+    if (segment == m_activeSegment)
+        m_activeSegment = nullptr;
+    ::munmap(segment->data, segment->size);
+    if (deleteFile)
+        ::unlink(segment->path.c_str());
+    m_segments.erase(segment->sequence);
+}
+
+void SegmentedFileMessagePersistence::removeRecord(std::uint64_t index)
+{
+    auto& record = m_records[index - m_firstRecord];
+    if (record.removed)
+        return;
+
+    // Only the state of the record is changed, so a message is never half removed
+    const auto state = RECORD_REMOVED;
+    std::memcpy(record.segment->data + record.offset + offsetof(RecordHeader, state), &state, sizeof(state));
+    record.removed = true;
+    --m_storedRecords;
+    m_storedBytes -= record.size;
+
+    auto device = m_devices.find(record.deviceKey);
+    if (device != m_devices.cend())
+    {
+        auto& records = device->second.records;
+        records.erase(std::find(records.begin(), records.end(), index));
+        device->second.bytes -= record.size;
+        if (records.empty())
+            m_devices.erase(device);
+    }
+
+    auto* segment = record.segment;
+    if (--segment->records == 0 && segment != m_activeSegment)
+        closeSegment(segment, true);
+    trimRemovedRecords();
+}
+
+void SegmentedFileMessagePersistence::removeOldestRecord()
+{
+    trimRemovedRecords();
+    if (m_records.empty())
+        return;
+    removeRecord(m_firstRecord);
+    ++m_droppedMessages;
+}
+
+void SegmentedFileMessagePersistence::trimRemovedRecords()
+{
+    while (!m_records.empty() && m_records.front().removed)
+    {
+        m_records.pop_front();
+        ++m_firstRecord;
+    }
+}
+}    // namespace wolkabout::gateway
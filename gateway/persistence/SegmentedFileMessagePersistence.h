@@ -0,0 +1,185 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_SEGMENTEDFILEMESSAGEPERSISTENCE_H
+#define WOLKGATEWAY_SEGMENTEDFILEMESSAGEPERSISTENCE_H
+
+#include "core/model/Message.h"
+#include "core/persistence/MessagePersistence.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace wolkabout::gateway
+{
+/**
+ * This is a message persistence that keeps the messages waiting for the platform in memory mapped segment files, so
+ * they survive a restart of the gateway, and stay out of the heap while the platform connection is down.
+ *
+ * Messages are appended to the newest segment, and every message is stored as a record with a checksum, so a record
+ * that was cut off by a power loss is recognized and left out when the segments are read back. Messages taken out
+ * of the queue are only marked as removed in their record, and a segment file is deleted once it holds no messages.
+ *
+ * The size of the stored messages is capped in total, and optionally per device. Once a cap would be exceeded, the
+ * oldest messages (of the device, or of all devices) are dropped to make room for the new one.
+ */
+class SegmentedFileMessagePersistence : public MessagePersistence
+{
+public:
+    // Returns the key of the device to which a message is accounted for the per device quota
+    using DeviceKeyExtractor = std::function<std::string(const Message&)>;
+
+    /**
+     * Default parameter constructor. Reads back all the messages that are stored in the directory.
+     *
+     * @param directory The directory in which the segment files are kept. Created if it does not exist.
+     * @param byteCap The cap on the size of all stored messages, in bytes.
+     * @param deviceQuota The cap on the size of stored messages of a single device, in bytes. Zero means no quota.
+     * @param segmentSize The size of a single segment file, in bytes.
+     * @param deviceKeyExtractor The function used to obtain the device key of a message. By default, this is the
+     * second part of the channel (`d2p/<deviceKey>/...`), which makes subdevice messages accounted to the gateway.
+     * @throws std::runtime_error if the directory can not be created.
+     */
+    explicit SegmentedFileMessagePersistence(std::string directory = "messages",
+                                             std::uint64_t byteCap = 64 * 1024 * 1024, std::uint64_t deviceQuota = 0,
+                                             std::uint64_t segmentSize = 1024 * 1024,
+                                             DeviceKeyExtractor deviceKeyExtractor = nullptr);
+
+    /**
+     * Default destructor. Flushes and unmaps all the segments.
+     */
+    ~SegmentedFileMessagePersistence() override;
+
+    SegmentedFileMessagePersistence(const SegmentedFileMessagePersistence&) = delete;
+    SegmentedFileMessagePersistence& operator=(const SegmentedFileMessagePersistence&) = delete;
+
+    bool push(std::shared_ptr<Message> message) override;
+
+    void pop() override;
+
+    std::shared_ptr<Message> front() override;
+
+    bool empty() const override;
+
+    /**
+     * This method is used to obtain the number of stored messages.
+     *
+     * @return The number of messages.
+     */
+    std::size_t size() const;
+
+    /**
+     * This method is used to obtain the size of all stored messages, in bytes.
+     *
+     * @return The size of the messages.
+     */
+    std::uint64_t storedBytes() const;
+
+    /**
+     * This method is used to obtain the cap on the size of all stored messages, in bytes.
+     *
+     * @return The cap on the size of the messages.
+     */
+    std::uint64_t byteCap() const;
+
+    /**
+     * This method is used to obtain the number of messages that were dropped to stay within the caps.
+     *
+     * @return The number of dropped messages.
+     */
+    std::uint64_t droppedMessages() const;
+
+    /**
+     * This method is used to write all the segments out to the disk, and wait for it.
+     *
+     * @return Whether all the segments have been written out.
+     */
+    bool flush();
+
+    // The version of the segment format. Segments with a different version are ignored.
+    static const std::uint32_t VERSION;
+
+private:
+    struct Segment
+    {
+        std::uint64_t sequence;
+        std::string path;
+        char* data;
+        std::uint64_t size;
+        std::uint64_t writeOffset;
+        std::uint64_t records;
+    };
+
+    struct Record
+    {
+        Segment* segment;
+        std::uint64_t offset;
+        std::uint64_t size;
+        std::string deviceKey;
+        bool removed;
+    };
+
+    struct DeviceUsage
+    {
+        std::uint64_t bytes;
+        std::deque<std::uint64_t> records;
+    };
+
+    void recover();
+
+    void recoverSegment(std::uint64_t sequence, const std::string& path);
+
+    Segment* openSegment(std::uint64_t minimumSize);
+
+    void closeSegment(Segment* segment, bool deleteFile);
+
+    void removeRecord(std::uint64_t index);
+
+    void removeOldestRecord();
+
+    void trimRemovedRecords();
+
+    const std::string m_directory;
+    const std::uint64_t m_byteCap;
+    const std::uint64_t m_deviceQuota;
+    const std::uint64_t m_segmentSize;
+    const DeviceKeyExtractor m_deviceKeyExtractor;
+
+    mutable std::mutex m_mutex;
+
+    // The segments by their sequence, the last one being the one messages are appended to
+    std::map<std::uint64_t, std::unique_ptr<Segment>> m_segments;
+    Segment* m_activeSegment;
+
+    // The records in the order of their arrival. Removed records are cleared from the front lazily.
+    std::deque<Record> m_records;
+    std::uint64_t m_firstRecord;
+    std::uint64_t m_storedRecords;
+    std::uint64_t m_storedBytes;
+    std::uint64_t m_droppedMessages;
+
+    // The indexes of the records of every device, oldest first
+    std::unordered_map<std::string, DeviceUsage> m_devices;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_SEGMENTEDFILEMESSAGEPERSISTENCE_H
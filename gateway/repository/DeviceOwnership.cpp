@@ -31,7 +31,7 @@ std::string toString(DeviceOwnership deviceOwnership)
     }
 }
 
-DeviceOwnership deviceOwnershipFromString(const std::string& value)
+DeviceOwnership deviceOwnershipFromString(std::string_view value)
 {
     if (value == "Platform")
         return DeviceOwnership::Platform;
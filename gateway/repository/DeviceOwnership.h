@@ -18,6 +18,7 @@
 #define WOLKGATEWAY_DEVICEOWNERSHIP_H
 
 #include <string>
+#include <string_view>
 
 namespace wolkabout::gateway
 {
@@ -43,7 +44,7 @@ std::string toString(DeviceOwnership deviceOwnership);
  * @param value A string value.
  * @return A DeviceOwnership value. If the value could not be parsed, will always be `DeviceOwnership::None`.
  */
-DeviceOwnership deviceOwnershipFromString(const std::string& value);
+DeviceOwnership deviceOwnershipFromString(std::string_view value);
 }    // namespace wolkabout::gateway
 
 #endif    // WOLKGATEWAY_DEVICEOWNERSHIP_H
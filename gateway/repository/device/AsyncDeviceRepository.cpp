@@ -0,0 +1,197 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/repository/device/AsyncDeviceRepository.h"
+
+#include <stdexcept>
+
+namespace wolkabout::gateway
+{
+AsyncDeviceRepository::AsyncDeviceRepository(std::shared_ptr<DeviceRepository> repository,
+                                             std::shared_ptr<GatewayExecutor> executor)
+: m_repository{std::move(repository)}, m_queue{std::move(executor), "device_storage"}
+{
+    if (m_repository == nullptr)
+        throw std::runtime_error("Failed to create the AsyncDeviceRepository - The wrapped repository is null.");
+}
+
+AsyncDeviceRepository::~AsyncDeviceRepository()
+{
+    // Everything that was queued still needs to reach the storage
+    flush();
+}
+
+const std::shared_ptr<DeviceRepository>& AsyncDeviceRepository::getRepository() const
+{
+    return m_repository;
+}
+
+void AsyncDeviceRepository::flush()
+{
+    m_queue.execute([] {});
+}
+
+bool AsyncDeviceRepository::flush(std::chrono::milliseconds timeout)
+{
+    return m_queue.drain(timeout);
+}
+
+std::future<bool> AsyncDeviceRepository::saveAsync(std::vector<StoredDeviceInformation> devices,
+                                                   std::function<void(bool)> callback)
+{
+    return enqueue<bool>([this, devices] { return m_repository->save(devices); }, std::move(callback));
+}
+
+std::future<bool> AsyncDeviceRepository::removeAsync(std::vector<std::string> deviceKeys,
+                                                     std::function<void(bool)> callback)
+{
+    return enqueue<bool>([this, deviceKeys] { return m_repository->remove(deviceKeys); }, std::move(callback));
+}
+
+std::future<StoredDeviceInformation> AsyncDeviceRepository::getAsync(
+  std::string deviceKey, std::function<void(const StoredDeviceInformation&)> callback)
+{
+    return enqueue<StoredDeviceInformation>([this, deviceKey] { return m_repository->get(deviceKey); },
+                                            std::move(callback));
+}
+
+std::future<bool> AsyncDeviceRepository::containsAsync(std::string deviceKey, std::function<void(bool)> callback)
+{
+    return enqueue<bool>([this, deviceKey] { return m_repository->containsDevice(deviceKey); }, std::move(callback));
+}
+
+std::future<bool> AsyncDeviceRepository::forEachGatewayDeviceAsync(DevicePageVisitor visitor, std::size_t pageSize,
+                                                                   std::function<void(bool)> callback)
+{
+    return enqueue<bool>([this, visitor, pageSize] { return m_repository->forEachGatewayDevice(visitor, pageSize); },
+                         std::move(callback));
+}
+
+std::future<std::vector<StoredDeviceInformation>> AsyncDeviceRepository::findDevicesAsync(
+  std::chrono::milliseconds timestampFrom, std::string deviceType, std::string externalId,
+  std::function<void(const std::vector<StoredDeviceInformation>&)> callback)
+{
+    return enqueue<std::vector<StoredDeviceInformation>>(
+      [this, timestampFrom, deviceType, externalId] {
+          return m_repository->findDevices(timestampFrom, deviceType, externalId);
+      },
+      std::move(callback));
+}
+
+std::future<std::chrono::milliseconds> AsyncDeviceRepository::latestPlatformTimestampAsync(
+  std::function<void(const std::chrono::milliseconds&)> callback)
+{
+    return enqueue<std::chrono::milliseconds>([this] { return m_repository->latestPlatformTimestamp(); },
+                                              std::move(callback));
+}
+
+bool AsyncDeviceRepository::save(const std::vector<StoredDeviceInformation>& devices)
+{
+    return execute<bool>([&] { return m_repository->save(devices); });
+}
+
+bool AsyncDeviceRepository::remove(const std::vector<std::string>& deviceKeys)
+{
+    return execute<bool>([&] { return m_repository->remove(deviceKeys); });
+}
+
+bool AsyncDeviceRepository::removeAll()
+{
+    return execute<bool>([&] { return m_repository->removeAll(); });
+}
+
+bool AsyncDeviceRepository::containsDevice(const std::string& deviceKey)
+{
+    return execute<bool>([&] { return m_repository->containsDevice(deviceKey); });
+}
+
+std::unordered_set<std::string> AsyncDeviceRepository::containsDevices(const std::vector<std::string>& deviceKeys)
+{
+    return execute<std::unordered_set<std::string>>([&] { return m_repository->containsDevices(deviceKeys); });
+}
+
+StoredDeviceInformation AsyncDeviceRepository::get(const std::string& deviceKey)
+{
+    return execute<StoredDeviceInformation>([&] { return m_repository->get(deviceKey); });
+}
+
+std::vector<StoredDeviceInformation> AsyncDeviceRepository::getMany(const std::vector<std::string>& deviceKeys)
+{
+    return execute<std::vector<StoredDeviceInformation>>([&] { return m_repository->getMany(deviceKeys); });
+}
+
+std::vector<StoredDeviceInformation> AsyncDeviceRepository::getGatewayDevices()
+{
+    return execute<std::vector<StoredDeviceInformation>>([&] { return m_repository->getGatewayDevices(); });
+}
+
+bool AsyncDeviceRepository::forEachGatewayDevice(const DevicePageVisitor& visitor, std::size_t pageSize)
+{
+    return execute<bool>([&] { return m_repository->forEachGatewayDevice(visitor, pageSize); });
+}
+
+std::vector<StoredDeviceInformation> AsyncDeviceRepository::findDevices(std::chrono::milliseconds timestampFrom,
+                                                                        const std::string& deviceType,
+                                                                        const std::string& externalId)
+{
+    return execute<std::vector<StoredDeviceInformation>>(
+      [&] { return m_repository->findDevices(timestampFrom, deviceType, externalId); });
+}
+
+std::chrono::milliseconds AsyncDeviceRepository::latestPlatformTimestamp()
+{
+    return execute<std::chrono::milliseconds>([&] { return m_repository->latestPlatformTimestamp(); });
+}
+
+bool AsyncDeviceRepository::holdsAllDevices()
+{
+    return m_repository->holdsAllDevices();
+}
+
+void AsyncDeviceRepository::addListener(const std::string& name,
+                                        const std::shared_ptr<DeviceRepositoryListener>& listener)
+{
+    m_repository->addListener(name, listener);
+}
+
+void AsyncDeviceRepository::removeListener(const std::string& name)
+{
+    m_repository->removeListener(name);
+}
+
+template <typename T>
+std::future<T> AsyncDeviceRepository::enqueue(std::function<T()> call, std::function<void(const T&)> callback)
+{
+    auto promise = std::make_shared<std::promise<T>>();
+    auto future = promise->get_future();
+    m_queue.push([call, callback, promise] {
+        auto result = call();
+        if (callback)
+            callback(result);
+        promise->set_value(std::move(result));
+    });
+    return future;
+}
+
+template <typename T> T AsyncDeviceRepository::execute(std::function<T()> call)
+{
+    // The calling thread executes the call itself, so a call made by a callback on the queue does not wait for
+    // itself, and a call made from another thread of the executor does not wait for a free thread
+    auto result = T{};
+    m_queue.execute([&] { result = call(); });
+    return result;
+}
+}    // namespace wolkabout::gateway
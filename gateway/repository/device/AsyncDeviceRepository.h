@@ -0,0 +1,196 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_ASYNCDEVICEREPOSITORY_H
+#define WOLKGATEWAY_ASYNCDEVICEREPOSITORY_H
+
+#include "gateway/executor/GatewayExecutor.h"
+#include "gateway/repository/device/DeviceRepository.h"
+
+#include <functional>
+#include <future>
+
+namespace wolkabout::gateway
+{
+/**
+ * This is a device repository that executes all the calls for the repository it wraps on its own serial queue. Next
+ * to the synchronous interface, it offers asynchronous calls that return a future, and optionally take a callback, so
+ * the caller never has to wait on the storage.
+ *
+ * All calls, synchronous and asynchronous, are executed in the order in which they were made, so a lookup will always
+ * see the result of a save that was made before it. Callbacks are invoked on the queue.
+ */
+class AsyncDeviceRepository : public DeviceRepository
+{
+public:
+    /**
+     * Default parameter constructor.
+     *
+     * @param repository The repository whose calls will be executed on the queue.
+     * @param executor The executor on which the queue is executed.
+     */
+    explicit AsyncDeviceRepository(std::shared_ptr<DeviceRepository> repository,
+                                   std::shared_ptr<GatewayExecutor> executor = nullptr);
+
+    /**
+     * Overridden destructor. Waits for all the queued calls to be executed.
+     */
+    ~AsyncDeviceRepository() override;
+
+    /**
+     * This method is used to obtain the repository whose calls are executed on the queue.
+     *
+     * @return The wrapped repository.
+     */
+    const std::shared_ptr<DeviceRepository>& getRepository() const;
+
+    /**
+     * This method is used to wait until all the calls queued before it have been executed.
+     */
+    void flush();
+
+    /**
+     * This method is used to wait, for at most the timeout, until all the calls queued before it have been executed.
+     *
+     * @param timeout How long to wait for the calls.
+     * @return Whether all the calls have been executed in time.
+     */
+    bool flush(std::chrono::milliseconds timeout);
+
+    /**
+     * This method is used to queue saving the devices in the repository.
+     *
+     * @param devices The devices information.
+     * @param callback An optional callback that will be invoked with the result once the devices have been saved.
+     * @return The future that will hold whether the devices have been successfully saved.
+     */
+    std::future<bool> saveAsync(std::vector<StoredDeviceInformation> devices,
+                                std::function<void(bool)> callback = nullptr);
+
+    /**
+     * This method is used to queue removing the devices from the repository.
+     *
+     * @param deviceKeys The device keys that need to be removed.
+     * @param callback An optional callback that will be invoked with the result once the devices have been removed.
+     * @return The future that will hold whether the devices have been removed.
+     */
+    std::future<bool> removeAsync(std::vector<std::string> deviceKeys, std::function<void(bool)> callback = nullptr);
+
+    /**
+     * This method is used to queue obtaining the information about a device.
+     *
+     * @param deviceKey The device key for which the information is requested.
+     * @param callback An optional callback that will be invoked with the information once it has been obtained.
+     * @return The future that will hold the information about the device. Will be empty if the device is not found.
+     */
+    std::future<StoredDeviceInformation> getAsync(
+      std::string deviceKey, std::function<void(const StoredDeviceInformation&)> callback = nullptr);
+
+    /**
+     * This method is used to queue checking whether the repository holds a device.
+     *
+     * @param deviceKey The device key for which presence must be confirmed.
+     * @param callback An optional callback that will be invoked with the result once the check is done.
+     * @return The future that will hold whether the device is present in the repository.
+     */
+    std::future<bool> containsAsync(std::string deviceKey, std::function<void(bool)> callback = nullptr);
+
+    /**
+     * This method is used to queue visiting all the devices that belong to the gateway, page by page. The visitor is
+     * invoked on the queue.
+     *
+     * @param visitor The visitor invoked with each page of devices. Visiting stops if the visitor returns false.
+     * @param pageSize The maximum number of devices in a page.
+     * @param callback An optional callback that will be invoked with the result once all the pages have been visited.
+     * @return The future that will hold whether all the pages have been successfully visited.
+     */
+    std::future<bool> forEachGatewayDeviceAsync(DevicePageVisitor visitor,
+                                                std::size_t pageSize = DEFAULT_DEVICE_PAGE_SIZE,
+                                                std::function<void(bool)> callback = nullptr);
+
+    /**
+     * This method is used to queue looking up the devices that match the filters.
+     *
+     * @param timestampFrom The timestamp from which the devices are looked up.
+     * @param deviceType The type of the devices. Empty matches all types.
+     * @param externalId The external id of the devices. Empty matches all external ids.
+     * @param callback An optional callback that will be invoked with the devices once they have been found.
+     * @return The future that will hold the devices that match the filters.
+     */
+    std::future<std::vector<StoredDeviceInformation>> findDevicesAsync(
+      std::chrono::milliseconds timestampFrom, std::string deviceType, std::string externalId,
+      std::function<void(const std::vector<StoredDeviceInformation>&)> callback = nullptr);
+
+    /**
+     * This method is used to queue obtaining the latest timestamp of the devices that belong to the platform.
+     *
+     * @param callback An optional callback that will be invoked with the timestamp once it has been obtained.
+     * @return The future that will hold the latest timestamp.
+     */
+    std::future<std::chrono::milliseconds> latestPlatformTimestampAsync(
+      std::function<void(const std::chrono::milliseconds&)> callback = nullptr);
+
+    /**
+     * The synchronous methods are overridden from the `gateway::DeviceRepository` interface. They queue the call as
+     * the asynchronous ones do, and wait for its result.
+     */
+    bool save(const std::vector<StoredDeviceInformation>& devices) override;
+
+    bool remove(const std::vector<std::string>& deviceKeys) override;
+
+    bool removeAll() override;
+
+    bool containsDevice(const std::string& deviceKey) override;
+
+    std::unordered_set<std::string> containsDevices(const std::vector<std::string>& deviceKeys) override;
+
+    StoredDeviceInformation get(const std::string& deviceKey) override;
+
+    std::vector<StoredDeviceInformation> getMany(const std::vector<std::string>& deviceKeys) override;
+
+    std::vector<StoredDeviceInformation> getGatewayDevices() override;
+
+    bool forEachGatewayDevice(const DevicePageVisitor& visitor,
+                              std::size_t pageSize = DEFAULT_DEVICE_PAGE_SIZE) override;
+
+    std::vector<StoredDeviceInformation> findDevices(std::chrono::milliseconds timestampFrom,
+                                                     const std::string& deviceType,
+                                                     const std::string& externalId) override;
+
+    std::chrono::milliseconds latestPlatformTimestamp() override;
+
+    bool holdsAllDevices() override;
+
+    /**
+     * Listeners are registered with the wrapped repository, and are notified on the queue.
+     */
+    void addListener(const std::string& name, const std::shared_ptr<DeviceRepositoryListener>& listener) override;
+
+    void removeListener(const std::string& name) override;
+
+private:
+    template <typename T>
+    std::future<T> enqueue(std::function<T()> call, std::function<void(const T&)> callback);
+
+    template <typename T> T execute(std::function<T()> call);
+
+    std::shared_ptr<DeviceRepository> m_repository;
+
+    SerialQueue m_queue;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_ASYNCDEVICEREPOSITORY_H
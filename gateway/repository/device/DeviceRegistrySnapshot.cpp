@@ -0,0 +1,278 @@
+/**
+ * Copyright 2022 Wolkabout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/repository/device/DeviceRegistrySnapshot.h"
+
+#include "core/utility/Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace wolkabout::legacy;
+
+namespace wolkabout::gateway
+{
+namespace
+{
+// The header placed at the start of every snapshot file
+struct SnapshotHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t count;
+    std::int64_t latestTimestamp;
+    std::uint64_t keysSize;
+};
+static_assert(sizeof(SnapshotHeader) == 40, "The snapshot header must not contain any padding.");
+
+const char SNAPSHOT_MAGIC[8] = {'W', 'G', 'D', 'E', 'V', 'S', 'N', 'P'};
+
+// The size of a file holding a number of devices, without the keys
+std::uint64_t columnsSize(std::uint64_t count)
+{
+    return sizeof(SnapshotHeader) + (count + 1) * sizeof(std::uint64_t) + count * sizeof(std::int64_t) +
+           count * sizeof(std::uint8_t);
+}
+}    // namespace
+
+const std::uint32_t DeviceRegistrySnapshot::VERSION = 1;
+
+bool DeviceRegistrySnapshot::write(const std::string& path, std::vector<StoredDeviceInformation> devices,
+                                   std::chrono::milliseconds latestTimestamp)
+{
+    const auto errorPrefix = "Failed to write the device registry snapshot - ";
+
+    // The devices that belong to no one are not stored, as the snapshot would not be read back with them
+    devices.erase(std::remove_if(devices.begin(), devices.end(),
+                                 [](const StoredDeviceInformation& device) {
+                                     return device.getDeviceBelongsTo() != DeviceOwnership::Platform &&
+                                            device.getDeviceBelongsTo() != DeviceOwnership::Gateway;
+                                 }),
+                  devices.end());
+
+    // Sort the devices by their keys, and leave only one entry per key
+    std::sort(devices.begin(), devices.end(),
+              [](const StoredDeviceInformation& first, const StoredDeviceInformation& second) {
+                  return first.getDeviceKey() < second.getDeviceKey();
+              });
+    devices.erase(std::unique(devices.begin(), devices.end(),
+                              [](const StoredDeviceInformation& first, const StoredDeviceInformation& second) {
+                                  return first.getDeviceKey() == second.getDeviceKey();
+                              }),
+                  devices.end());
+
+    // Lay out the whole file in memory, so it can be written out at once
+    const auto count = static_cast<std::uint64_t>(devices.size());
+    auto keysSize = std::uint64_t{0};
+    for (const auto& device : devices)
+        keysSize += device.getDeviceKey().size();
+    auto buffer = std::vector<char>(columnsSize(count) + keysSize);
+
+    auto header = SnapshotHeader{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = VERSION;
+    header.count = count;
+    header.latestTimestamp = static_cast<std::int64_t>(latestTimestamp.count());
+    header.keysSize = keysSize;
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    auto offsetsPosition = sizeof(SnapshotHeader);
+    auto timestampsPosition = offsetsPosition + (count + 1) * sizeof(std::uint64_t);
+    auto ownershipPosition = timestampsPosition + count * sizeof(std::int64_t);
+    auto keysPosition = ownershipPosition + count * sizeof(std::uint8_t);
+    auto keyOffset = std::uint64_t{0};
+    for (auto i = std::uint64_t{0}; i < count; ++i)
+    {
+        const auto& device = devices[i];
+        const auto timestamp = static_cast<std::int64_t>(device.getTimestamp().count());
+        const auto ownership = static_cast<std::uint8_t>(device.getDeviceBelongsTo());
+        std::memcpy(buffer.data() + offsetsPosition + i * sizeof(std::uint64_t), &keyOffset, sizeof(keyOffset));
+        std::memcpy(buffer.data() + timestampsPosition + i * sizeof(std::int64_t), &timestamp, sizeof(timestamp));
+        std::memcpy(buffer.data() + ownershipPosition + i, &ownership, sizeof(ownership));
+        std::memcpy(buffer.data() + keysPosition + keyOffset, device.getDeviceKey().data(),
+                    device.getDeviceKey().size());
+        keyOffset += device.getDeviceKey().size();
+    }
+    std::memcpy(buffer.data() + offsetsPosition + count * sizeof(std::uint64_t), &keyOffset, sizeof(keyOffset));
+
+    // Write it into the temporary file, and make sure it is on the disk before it replaces the old snapshot
+    const auto temporaryPath = path + ".tmp";
+    auto fd = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        LOG(ERROR) << errorPrefix << "Failed to open '" << temporaryPath << "' - '" << std::strerror(errno) << "'.";
+        return false;
+    }
+    auto written = std::size_t{0};
+    while (written < buffer.size())
+    {
+        auto result = ::write(fd, buffer.data() + written, buffer.size() - written);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            break;
+        written += static_cast<std::size_t>(result);
+    }
+    if (written != buffer.size() || ::fsync(fd) != 0)
+    {
+        LOG(ERROR) << errorPrefix << "Failed to write '" << temporaryPath << "' - '" << std::strerror(errno) << "'.";
+        ::close(fd);
+        ::unlink(temporaryPath.c_str());
+        return false;
+    }
+    ::close(fd);
+    if (::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        LOG(ERROR) << errorPrefix << "Failed to replace '" << path << "' - '" << std::strerror(errno) << "'.";
+        ::unlink(temporaryPath.c_str());
+        return false;
+    }
+    LOG(DEBUG) << "Written the device registry snapshot with " << count << " device(s) to '" << path << "'.";
+    return true;
+}
+
+std::unique_ptr<DeviceRegistrySnapshot> DeviceRegistrySnapshot::open(const std::string& path)
+{
+    const auto errorPrefix = "Failed to open the device registry snapshot - ";
+
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+            LOG(WARN) << errorPrefix << "Failed to open '" << path << "' - '" << std::strerror(errno) << "'.";
+        return nullptr;
+    }
+    struct stat fileStatus = {};
+    if (::fstat(fd, &fileStatus) != 0 || static_cast<std::size_t>(fileStatus.st_size) < sizeof(SnapshotHeader))
+    {
+        LOG(WARN) << errorPrefix << "The file '" << path << "' is too small to be a snapshot.";
+        ::close(fd);
+        return nullptr;
+    }
+    const auto size = static_cast<std::size_t>(fileStatus.st_size);
+    auto data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        LOG(WARN) << errorPrefix << "Failed to map '" << path << "' - '" << std::strerror(errno) << "'.";
+        return nullptr;
+    }
+
+    // Validate the header before any of the columns are looked at
+    auto header = SnapshotHeader{};
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.version != VERSION ||
+        header.count > size / (sizeof(std::uint64_t) + sizeof(std::int64_t) + sizeof(std::uint8_t)) ||
+        columnsSize(header.count) + header.keysSize != size)
+    {
+        LOG(WARN) << errorPrefix << "The file '" << path << "' is not a valid version " << VERSION << " snapshot.";
+        ::munmap(data, size);
+        return nullptr;
+    }
+
+    // And the columns themselves, so the lookups do not have to do any checks. The offsets are checked first, as the
+    // keys can not be looked at until they are known to lie within the file
+    auto snapshot = std::unique_ptr<DeviceRegistrySnapshot>{new DeviceRegistrySnapshot{data, size}};
+    for (auto i = std::uint64_t{0}; i < snapshot->m_count; ++i)
+    {
+        const auto offset = snapshot->m_keyOffsets[i];
+        const auto nextOffset = snapshot->m_keyOffsets[i + 1];
+        if (offset > nextOffset || nextOffset > header.keysSize)
+        {
+            LOG(WARN) << errorPrefix << "The file '" << path << "' contains malformed columns.";
+            return nullptr;
+        }
+    }
+    if (snapshot->m_keyOffsets[snapshot->m_count] != header.keysSize)
+    {
+        LOG(WARN) << errorPrefix << "The file '" << path << "' contains malformed columns.";
+        return nullptr;
+    }
+    for (auto i = std::uint64_t{0}; i < snapshot->m_count; ++i)
+    {
+        if ((snapshot->m_ownership[i] != static_cast<std::uint8_t>(DeviceOwnership::Platform) &&
+             snapshot->m_ownership[i] != static_cast<std::uint8_t>(DeviceOwnership::Gateway)) ||
+            (i > 0 && snapshot->keyAt(i - 1) >= snapshot->keyAt(i)))
+        {
+            LOG(WARN) << errorPrefix << "The file '" << path << "' contains malformed columns.";
+            return nullptr;
+        }
+    }
+    return snapshot;
+}
+
+DeviceRegistrySnapshot::DeviceRegistrySnapshot(void* data, std::size_t size)
+: m_data{data}
+, m_size{size}
+, m_count{reinterpret_cast<const SnapshotHeader*>(data)->count}
+, m_latestTimestamp{reinterpret_cast<const SnapshotHeader*>(data)->latestTimestamp}
+, m_keyOffsets{reinterpret_cast<const std::uint64_t*>(static_cast<const char*>(data) + sizeof(SnapshotHeader))}
+, m_timestamps{reinterpret_cast<const std::int64_t*>(m_keyOffsets + m_count + 1)}
+, m_ownership{reinterpret_cast<const std::uint8_t*>(m_timestamps + m_count)}
+, m_keys{reinterpret_cast<const char*>(m_ownership + m_count)}
+{
+}
+
+DeviceRegistrySnapshot::~DeviceRegistrySnapshot()
+{
+    ::munmap(m_data, m_size);
+}
+
+std::size_t DeviceRegistrySnapshot::size() const
+{
+    return static_cast<std::size_t>(m_count);
+}
+
+std::chrono::milliseconds DeviceRegistrySnapshot::latestTimestamp() const
+{
+    return std::chrono::milliseconds{m_latestTimestamp};
+}
+
+StoredDeviceInformation DeviceRegistrySnapshot::find(std::string_view deviceKey) const
+{
+    auto low = std::uint64_t{0};
+    auto high = m_count;
+    while (low < high)
+    {
+        const auto middle = low + (high - low) / 2;
+        const auto key = keyAt(middle);
+        if (key == deviceKey)
+            return at(middle);
+        if (key < deviceKey)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return {};
+}
+
+StoredDeviceInformation DeviceRegistrySnapshot::at(std::size_t index) const
+{
+    return {std::string{keyAt(index)}, static_cast<DeviceOwnership>(m_ownership[index]),
+            std::chrono::milliseconds{m_timestamps[index]}};
+}
+
+std::string_view DeviceRegistrySnapshot::keyAt(std::size_t index) const
+{
+    return {m_keys + m_keyOffsets[index], static_cast<std::size_t>(m_keyOffsets[index + 1] - m_keyOffsets[index])};
+}
+}    // namespace wolkabout::gateway
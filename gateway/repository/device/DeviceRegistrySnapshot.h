@@ -0,0 +1,120 @@
+/**
+ * Copyright 2022 Wolkabout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_DEVICEREGISTRYSNAPSHOT_H
+#define WOLKGATEWAY_DEVICEREGISTRYSNAPSHOT_H
+
+#include "gateway/repository/device/DeviceRepository.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wolkabout::gateway
+{
+/**
+ * This class represents a read-only, memory mapped snapshot of the device registry. The file holds a sorted array of
+ * device keys, next to the ownership and timestamp columns, so it can be used as soon as it is mapped, without parsing.
+ *
+ * The layout of the file is the header, followed by `count + 1` key offsets, `count` timestamps, `count` ownership
+ * values and finally the concatenated keys. All values are stored in the byte order of the machine that wrote them.
+ */
+class DeviceRegistrySnapshot
+{
+public:
+    /**
+     * This method is used to write a snapshot of devices into a file. The snapshot is written into a temporary file
+     * first, and renamed over the old one, so a power loss can never leave a half written snapshot behind.
+     *
+     * @param path The path of the snapshot file.
+     * @param devices The devices that should be placed in the snapshot. The ones that belong to no one are left out.
+     * @param latestTimestamp The latest platform timestamp known at the moment of writing.
+     * @return Whether the snapshot has been successfully written.
+     */
+    static bool write(const std::string& path, std::vector<StoredDeviceInformation> devices,
+                      std::chrono::milliseconds latestTimestamp);
+
+    /**
+     * This method is used to map a snapshot file into memory.
+     *
+     * @param path The path of the snapshot file.
+     * @return The snapshot. Will be `nullptr` if the file does not exist, has a different version, or is malformed.
+     */
+    static std::unique_ptr<DeviceRegistrySnapshot> open(const std::string& path);
+
+    /**
+     * Default destructor. Unmaps the file.
+     */
+    ~DeviceRegistrySnapshot();
+
+    DeviceRegistrySnapshot(const DeviceRegistrySnapshot&) = delete;
+    DeviceRegistrySnapshot& operator=(const DeviceRegistrySnapshot&) = delete;
+
+    /**
+     * This method is used to obtain the number of devices in the snapshot.
+     *
+     * @return The number of devices.
+     */
+    std::size_t size() const;
+
+    /**
+     * This method is used to obtain the latest platform timestamp that was known when the snapshot was written.
+     *
+     * @return The latest timestamp.
+     */
+    std::chrono::milliseconds latestTimestamp() const;
+
+    /**
+     * This method is used to look up a device in the snapshot by a binary search over the sorted keys.
+     *
+     * @param deviceKey The key of the device.
+     * @return The information about the device. Will be empty if the device is not in the snapshot.
+     */
+    StoredDeviceInformation find(std::string_view deviceKey) const;
+
+    /**
+     * This method is used to obtain the device at a position in the snapshot. Devices are sorted by their keys.
+     *
+     * @param index The position of the device.
+     * @return The information about the device.
+     */
+    StoredDeviceInformation at(std::size_t index) const;
+
+    // The version of the file format. Snapshots with a different version are ignored.
+    static const std::uint32_t VERSION;
+
+private:
+    DeviceRegistrySnapshot(void* data, std::size_t size);
+
+    std::string_view keyAt(std::size_t index) const;
+
+    void* m_data;
+    std::size_t m_size;
+
+    // Views into the mapped file
+    std::uint64_t m_count;
+    std::int64_t m_latestTimestamp;
+    const std::uint64_t* m_keyOffsets;
+    const std::int64_t* m_timestamps;
+    const std::uint8_t* m_ownership;
+    const char* m_keys;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_DEVICEREGISTRYSNAPSHOT_H
@@ -0,0 +1,102 @@
+/**
+ * Copyright 2022 Wolkabout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/repository/device/DeviceRepository.h"
+
+#include "core/utility/Logger.h"
+
+using namespace wolkabout::legacy;
+
+namespace wolkabout::gateway
+{
+bool DeviceRepository::holdsAllDevices()
+{
+    return true;
+}
+
+void DeviceRepository::addListener(const std::string& name, const std::shared_ptr<DeviceRepositoryListener>& listener)
+{
+    LOG(TRACE) << METHOD_INFO;
+
+    if (listener == nullptr)
+    {
+        LOG(WARN) << "Attempted to add device repository listener '" << name << "' that is null.";
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{m_listenersMutex};
+    m_listeners[name] = listener;
+    LOG(DEBUG) << "Added device repository listener '" << name << "'.";
+}
+
+void DeviceRepository::removeListener(const std::string& name)
+{
+    LOG(TRACE) << METHOD_INFO;
+
+    std::lock_guard<std::mutex> lock{m_listenersMutex};
+    m_listeners.erase(name);
+}
+
+void DeviceRepository::notifyDevicesAdded(const std::vector<StoredDeviceInformation>& devices)
+{
+    if (devices.empty())
+        return;
+    for (const auto& listener : getListeners())
+        listener->onDevicesAdded(devices);
+}
+
+void DeviceRepository::notifyDevicesUpdated(const std::vector<StoredDeviceInformation>& devices)
+{
+    if (devices.empty())
+        return;
+    for (const auto& listener : getListeners())
+        listener->onDevicesUpdated(devices);
+}
+
+void DeviceRepository::notifyDevicesRemoved(const std::vector<std::string>& deviceKeys)
+{
+    if (deviceKeys.empty())
+        return;
+    for (const auto& listener : getListeners())
+        listener->onDevicesRemoved(deviceKeys);
+}
+
+void DeviceRepository::notifyAllDevicesRemoved()
+{
+    for (const auto& listener : getListeners())
+        listener->onAllDevicesRemoved();
+}
+
+std::vector<std::shared_ptr<DeviceRepositoryListener>> DeviceRepository::getListeners()
+{
+    // Listeners are invoked outside of the lock, so they can add or remove listeners themselves
+    auto listeners = std::vector<std::shared_ptr<DeviceRepositoryListener>>{};
+    std::lock_guard<std::mutex> lock{m_listenersMutex};
+    for (auto it = m_listeners.begin(); it != m_listeners.end();)
+    {
+        if (auto listener = it->second.lock())
+        {
+            listeners.emplace_back(std::move(listener));
+            ++it;
+        }
+        else
+        {
+            it = m_listeners.erase(it);
+        }
+    }
+    return listeners;
+}
+}    // namespace wolkabout::gateway
@@ -19,9 +19,14 @@
 
 #include "core/model/messages/RegisteredDevicesResponseMessage.h"
 #include "gateway/repository/DeviceOwnership.h"
+#include "gateway/repository/device/DeviceRepositoryListener.h"
 
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -34,13 +39,22 @@ public:
     StoredDeviceInformation() : m_deviceKey{}, m_deviceBelongsTo{DeviceOwnership::Platform}, m_timestamp{} {}
 
     StoredDeviceInformation(std::string deviceKey, DeviceOwnership deviceBelongsTo,
-                            const std::chrono::milliseconds& timestamp)
-    : m_deviceKey{std::move(deviceKey)}, m_deviceBelongsTo{deviceBelongsTo}, m_timestamp{timestamp}
+                            const std::chrono::milliseconds& timestamp, std::string deviceType = {},
+                            std::string externalId = {})
+    : m_deviceKey{std::move(deviceKey)}
+    , m_deviceBelongsTo{deviceBelongsTo}
+    , m_timestamp{timestamp}
+    , m_deviceType{std::move(deviceType)}
+    , m_externalId{std::move(externalId)}
     {
     }
 
     StoredDeviceInformation(const RegisteredDeviceInformation& deviceInformation, std::chrono::milliseconds timestamp)
-    : m_deviceKey{deviceInformation.deviceKey}, m_deviceBelongsTo{DeviceOwnership::Platform}, m_timestamp{timestamp}
+    : m_deviceKey{deviceInformation.deviceKey}
+    , m_deviceBelongsTo{DeviceOwnership::Platform}
+    , m_timestamp{timestamp}
+    , m_deviceType{deviceInformation.deviceType}
+    , m_externalId{deviceInformation.externalId}
     {
     }
 
@@ -50,12 +64,26 @@ public:
 
     const std::chrono::milliseconds& getTimestamp() const { return m_timestamp; }
 
+    const std::string& getDeviceType() const { return m_deviceType; }
+
+    const std::string& getExternalId() const { return m_externalId; }
+
 private:
     std::string m_deviceKey;
     DeviceOwnership m_deviceBelongsTo;
     std::chrono::milliseconds m_timestamp;
+
+    // Known only for devices received from the platform. Saving a device with these empty keeps the stored values.
+    std::string m_deviceType;
+    std::string m_externalId;
 };
 
+// The visitor invoked with each page of devices. Returning false stops the iteration.
+using DevicePageVisitor = std::function<bool(const std::vector<StoredDeviceInformation>&)>;
+
+// The number of devices in a page, unless the user asks for a different one
+const std::size_t DEFAULT_DEVICE_PAGE_SIZE = 256;
+
 /**
  * This interface represents an persistence entity that stores information about devices.
  */
@@ -100,6 +128,14 @@ public:
      */
     virtual bool containsDevice(const std::string& deviceKey) = 0;
 
+    /**
+     * This is the method via which the user asks which of the devices the storage contains information about.
+     *
+     * @param deviceKeys The device keys for which the user is interested about.
+     * @return The keys of the devices for which the persistence contains information.
+     */
+    virtual std::unordered_set<std::string> containsDevices(const std::vector<std::string>& deviceKeys) = 0;
+
     /**
      * This is the method via which the user obtains information about a device by its key.
      *
@@ -108,6 +144,14 @@ public:
      */
     virtual StoredDeviceInformation get(const std::string& deviceKey) = 0;
 
+    /**
+     * This is the method via which the user obtains information about multiple devices by their keys.
+     *
+     * @param deviceKeys The device keys for which the user is interested about.
+     * @return The information about the devices retrieved from persistence. Devices that do not exist are left out.
+     */
+    virtual std::vector<StoredDeviceInformation> getMany(const std::vector<std::string>& deviceKeys) = 0;
+
     /**
      * This is the method via which the user obtains the information about all gateway owned devices.
      *
@@ -115,12 +159,75 @@ public:
      */
     virtual std::vector<StoredDeviceInformation> getGatewayDevices() = 0;
 
+    /**
+     * This is the method via which the user goes through all gateway owned devices one page at a time, so the whole
+     * list never has to be held in memory at once.
+     *
+     * @param visitor The visitor that is invoked with each page of devices. Returning false stops the iteration.
+     * @param pageSize The maximum number of devices in a single page.
+     * @return Whether the iteration completed without errors. Being stopped by the visitor is not an error.
+     */
+    virtual bool forEachGatewayDevice(const DevicePageVisitor& visitor,
+                                      std::size_t pageSize = DEFAULT_DEVICE_PAGE_SIZE) = 0;
+
+    /**
+     * This is the method via which the user looks up the devices the same way the platform answers a registered
+     * devices request. The timestamp of a stored device is the time at which the gateway has learned about it.
+     *
+     * @param timestampFrom The devices with a timestamp lower than this are left out.
+     * @param deviceType The type the devices must have. Empty matches any type.
+     * @param externalId The external ID the devices must have. Empty matches any external ID.
+     * @return The list of matching devices. Will be empty if an error occurs.
+     */
+    virtual std::vector<StoredDeviceInformation> findDevices(std::chrono::milliseconds timestampFrom,
+                                                             const std::string& deviceType,
+                                                             const std::string& externalId) = 0;
+
     /**
      * This is the method via which the user obtains the latest timestamp value that is stored in the persistence.
      *
      * @return The latest timestamp value for the platform owned devices.
      */
     virtual std::chrono::milliseconds latestPlatformTimestamp() = 0;
+
+    /**
+     * This is the method via which the user checks whether the repository still holds every device that was saved
+     * into it. A repository that has forgotten some devices can not answer `findDevices` the way the platform would.
+     *
+     * @return Whether `findDevices` returns every matching device. True unless the repository says otherwise.
+     */
+    virtual bool holdsAllDevices();
+
+    /**
+     * This is the method via which the user registers a listener that will be notified about every change made to the
+     * repository through `save`, `remove` and `removeAll`. The repository holds only a weak reference to the listener.
+     *
+     * @param name The name of the listener. A listener registered under the same name will be replaced.
+     * @param listener The listener.
+     */
+    virtual void addListener(const std::string& name, const std::shared_ptr<DeviceRepositoryListener>& listener);
+
+    /**
+     * This is the method via which the user unregisters a listener.
+     *
+     * @param name The name of the listener.
+     */
+    virtual void removeListener(const std::string& name);
+
+protected:
+    void notifyDevicesAdded(const std::vector<StoredDeviceInformation>& devices);
+
+    void notifyDevicesUpdated(const std::vector<StoredDeviceInformation>& devices);
+
+    void notifyDevicesRemoved(const std::vector<std::string>& deviceKeys);
+
+    void notifyAllDevicesRemoved();
+
+private:
+    std::vector<std::shared_ptr<DeviceRepositoryListener>> getListeners();
+
+    std::mutex m_listenersMutex;
+    std::map<std::string, std::weak_ptr<DeviceRepositoryListener>> m_listeners;
 };
 }    // namespace wolkabout::gateway
 
@@ -0,0 +1,71 @@
+/**
+ * Copyright 2022 Wolkabout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_DEVICEREPOSITORYLISTENER_H
+#define WOLKGATEWAY_DEVICEREPOSITORYLISTENER_H
+
+#include <string>
+#include <vector>
+
+namespace wolkabout::gateway
+{
+struct StoredDeviceInformation;
+
+/**
+ * This interface is meant to represent an object that is capable of listening to changes in a device repository, so
+ * it can keep its own view of the devices up to date without having to read the whole repository again.
+ *
+ * All the methods are invoked on the thread that made the change, after the change has been made and outside of the
+ * locks of the repository, and a bulk change is always reported as a single event.
+ */
+class DeviceRepositoryListener
+{
+public:
+    /**
+     * Default virtual destructor.
+     */
+    virtual ~DeviceRepositoryListener() = default;
+
+    /**
+     * This is the method by which the listener is notified about devices that have been added to the repository.
+     *
+     * @param devices The added devices.
+     */
+    virtual void onDevicesAdded(const std::vector<StoredDeviceInformation>& devices) = 0;
+
+    /**
+     * This is the method by which the listener is notified about devices whose information has been overwritten.
+     *
+     * @param devices The new information about the devices.
+     */
+    virtual void onDevicesUpdated(const std::vector<StoredDeviceInformation>& devices) = 0;
+
+    /**
+     * This is the method by which the listener is notified about devices that have been removed from the repository.
+     *
+     * @param deviceKeys The keys of the devices that have been removed. Keys of devices the repository did not hold are
+     * left out.
+     */
+    virtual void onDevicesRemoved(const std::vector<std::string>& deviceKeys) = 0;
+
+    /**
+     * This is the method by which the listener is notified that all the devices have been removed from the repository.
+     */
+    virtual void onAllDevicesRemoved() = 0;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_DEVICEREPOSITORYLISTENER_H
@@ -18,16 +18,26 @@
 
 #include "core/utility/Logger.h"
 
-#include <algorithm>
+#include <utility>
 
 using namespace wolkabout::legacy;
 
 namespace wolkabout::gateway
 {
-InMemoryDeviceRepository::InMemoryDeviceRepository(std::shared_ptr<DeviceRepository> persistentDeviceRepository)
+InMemoryDeviceRepository::InMemoryDeviceRepository(std::shared_ptr<DeviceRepository> persistentDeviceRepository,
+                                                   std::string snapshotPath, std::size_t platformDeviceCapacity,
+                                                   std::shared_ptr<GatewayExecutor> executor)
 : m_timestamp{0}
+, m_loaded{false}
+, m_platformDeviceCapacity{platformDeviceCapacity}
+, m_hits{0}
+, m_misses{0}
+, m_evictions{0}
+, m_snapshotPath{std::move(snapshotPath)}
+, m_reconciliationPending{false}
+, m_clearedBeforeReconciliation{false}
 , m_persistentDeviceRepository{std::move(persistentDeviceRepository)}
-, m_commandBuffer{m_persistentDeviceRepository != nullptr ? new legacy::CommandBuffer : nullptr}
+, m_queue{m_persistentDeviceRepository != nullptr ? new SerialQueue{std::move(executor), "device_cache"} : nullptr}
 {
 }
 
@@ -36,29 +46,43 @@ void InMemoryDeviceRepository::loadInformationFromPersistentRepository()
     LOG(TRACE) << METHOD_INFO;
     std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
 
-    if (m_persistentDeviceRepository != nullptr)
+    if (m_persistentDeviceRepository == nullptr || m_reconciliationPending)
+        return;
+    if (m_loaded)
     {
-        // Copy all the gateway devices
-        const auto gatewayDevices = m_persistentDeviceRepository->getGatewayDevices();
-        std::copy(gatewayDevices.cbegin(), gatewayDevices.cend(), std::back_inserter(m_devices));
+        LOG(DEBUG) << "The device cache has already been loaded from the persistent repository.";
+        return;
+    }
 
-        // Copy the timestamp
-        const auto loadedTimestamp = m_persistentDeviceRepository->latestPlatformTimestamp();
-        if (loadedTimestamp > m_timestamp)
-            m_timestamp = loadedTimestamp;
+    // If there is a snapshot, it can be used right away, and the persistent repository can be read in the background
+    if (!m_snapshotPath.empty() && (m_snapshot = DeviceRegistrySnapshot::open(m_snapshotPath)) != nullptr)
+    {
+        LOG(DEBUG) << "Loaded " << m_snapshot->size() << " device(s) from the device registry snapshot.";
+        if (m_snapshot->latestTimestamp() > m_timestamp)
+            m_timestamp = m_snapshot->latestTimestamp();
+        m_reconciliationPending = true;
+        m_loaded = true;
+        m_queue->push([this] { reconcileWithPersistentRepository(); });
+        return;
     }
+    reconcileWithPersistentRepository();
 }
 
 bool InMemoryDeviceRepository::save(const std::vector<StoredDeviceInformation>& devices)
 {
     // Store the devices info
+    auto addedDevices = std::vector<StoredDeviceInformation>{};
+    auto updatedDevices = std::vector<StoredDeviceInformation>{};
     {
         std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
         for (const auto& device : devices)
         {
-            // Save the value to the local vector
-            if (!containsDevice(device.getDeviceKey()))
-                m_devices.emplace_back(device);
+            // Save the value to the local map
+            if (m_devices.find(device.getDeviceKey()) != m_devices.cend())
+                updatedDevices.emplace_back(device);
+            else
+                addedDevices.emplace_back(device);
+            cache(device);
 
             // Update the timestamp
             if (device.getTimestamp() > m_timestamp)
@@ -67,97 +91,168 @@ bool InMemoryDeviceRepository::save(const std::vector<StoredDeviceInformation>&
     }
 
     // If the persistent repository is present, tell it to save data too
-    if (m_persistentDeviceRepository != nullptr && m_commandBuffer != nullptr)
-        m_commandBuffer->pushCommand(
-          std::make_shared<std::function<void()>>([this, devices] { m_persistentDeviceRepository->save(devices); }));
+    if (m_persistentDeviceRepository != nullptr && m_queue != nullptr)
+        m_queue->push([this, devices] { m_persistentDeviceRepository->save(devices); });
+
+    notifyDevicesAdded(addedDevices);
+    notifyDevicesUpdated(updatedDevices);
     return true;
 }
 
 bool InMemoryDeviceRepository::remove(const std::vector<std::string>& deviceKeys)
 {
-    // Empty the local vector
+    // Empty the local map
+    auto removedDeviceKeys = std::vector<std::string>{};
+    auto uncachedDeviceKeys = std::vector<std::string>{};
     {
         std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
         for (const auto& deviceKey : deviceKeys)
         {
-            const auto it = std::find_if(
-              m_devices.begin(), m_devices.end(),
-              [&](const StoredDeviceInformation& information) { return information.getDeviceKey() == deviceKey; });
-            if (it != m_devices.cend())
-                m_devices.erase(it);
+            if (uncache(deviceKey))
+                removedDeviceKeys.emplace_back(deviceKey);
+            else
+                uncachedDeviceKeys.emplace_back(deviceKey);
+            if (m_reconciliationPending)
+                m_removedBeforeReconciliation.emplace(deviceKey);
         }
     }
 
-    // If we have access to more permanent persistence, delete it too
-    if (m_persistentDeviceRepository != nullptr && m_commandBuffer != nullptr)
-    {
-        m_commandBuffer->pushCommand(std::make_shared<std::function<void()>>(
-          [this, deviceKeys] { m_persistentDeviceRepository->remove(deviceKeys); }));
-    }
+    // If we have access to more permanent persistence, delete it too. The devices that were held only there are
+    // reported once they are gone from it.
+    if (m_persistentDeviceRepository != nullptr && m_queue != nullptr)
+        m_queue->push([this, deviceKeys, uncachedDeviceKeys] {
+            auto storedDeviceKeys = std::unordered_set<std::string>{};
+            if (!uncachedDeviceKeys.empty())
+                storedDeviceKeys = m_persistentDeviceRepository->containsDevices(uncachedDeviceKeys);
+            if (!m_persistentDeviceRepository->remove(deviceKeys))
+                return;
+            auto removedStoredDeviceKeys = std::vector<std::string>{};
+            for (const auto& deviceKey : uncachedDeviceKeys)
+                if (storedDeviceKeys.find(deviceKey) != storedDeviceKeys.cend())
+                    removedStoredDeviceKeys.emplace_back(deviceKey);
+            notifyDevicesRemoved(removedStoredDeviceKeys);
+        });
+
+    notifyDevicesRemoved(removedDeviceKeys);
     return true;
 }
 
 bool InMemoryDeviceRepository::removeAll()
 {
-    // Empty the local vector
+    // Empty the local map
     {
         std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
         m_devices.clear();
+        m_recentlyUsedPlatformDevices.clear();
+        m_snapshot.reset();
+        if (m_reconciliationPending)
+            m_clearedBeforeReconciliation = true;
     }
 
     // If we have access to more permanent persistence, delete it too
-    if (m_persistentDeviceRepository != nullptr && m_commandBuffer != nullptr)
-        m_commandBuffer->pushCommand(
-          std::make_shared<std::function<void()>>([this] { m_persistentDeviceRepository->removeAll(); }));
+    if (m_persistentDeviceRepository != nullptr && m_queue != nullptr)
+        m_queue->push([this] { m_persistentDeviceRepository->removeAll(); });
+
+    notifyAllDevicesRemoved();
     return true;
 }
 
 bool InMemoryDeviceRepository::containsDevice(const std::string& deviceKey)
 {
-    bool found;
+    return !get(deviceKey).getDeviceKey().empty();
+}
+
+std::unordered_set<std::string> InMemoryDeviceRepository::containsDevices(const std::vector<std::string>& deviceKeys)
+{
+    auto found = std::unordered_set<std::string>{};
+    for (const auto& device : getMany(deviceKeys))
+        found.emplace(device.getDeviceKey());
+    return found;
+}
 
+StoredDeviceInformation InMemoryDeviceRepository::get(const std::string& deviceKey)
+{
     // Check in local memory
     {
         std::lock_guard<std::recursive_mutex> lock{m_mutex};
-        const auto it = std::find_if(
-          m_devices.begin(), m_devices.end(),
-          [&](const StoredDeviceInformation& information) { return information.getDeviceKey() == deviceKey; });
-        found = it != m_devices.cend();
+        if (const auto cached = findCached(deviceKey))
+            return *cached;
+
+        // Devices removed before the reconciliation might still wait to be removed from persistent storage
+        if (m_removedBeforeReconciliation.find(deviceKey) != m_removedBeforeReconciliation.cend())
+            return {};
+
+        // Check the snapshot if the cache has not yet been reconciled
+        if (m_snapshot != nullptr)
+        {
+            auto information = m_snapshot->find(deviceKey);
+            if (!information.getDeviceKey().empty())
+            {
+                cache(information, false, true);
+                return information;
+            }
+        }
     }
 
     // If not found, check in persistent storage
-    if (!found && m_persistentDeviceRepository != nullptr)
+    auto returningInformation = StoredDeviceInformation{};
+    if (m_persistentDeviceRepository != nullptr)
     {
-        auto returningInformation = m_persistentDeviceRepository->get(deviceKey);
+        returningInformation = m_persistentDeviceRepository->get(deviceKey);
         if (!returningInformation.getDeviceKey().empty())
         {
-            m_devices.emplace_back(returningInformation);
-            found = true;
+            std::lock_guard<std::recursive_mutex> lock{m_mutex};
+            cache(returningInformation, false);
         }
     }
-    return found;
+    return returningInformation;
 }
 
-StoredDeviceInformation InMemoryDeviceRepository::get(const std::string& deviceKey)
+std::vector<StoredDeviceInformation> InMemoryDeviceRepository::getMany(const std::vector<std::string>& deviceKeys)
 {
-    auto returningInformation = StoredDeviceInformation{};
+    auto returningInformation = std::vector<StoredDeviceInformation>{};
+    auto missingDeviceKeys = std::vector<std::string>{};
 
     // Check in local memory
     {
         std::lock_guard<std::recursive_mutex> lock{m_mutex};
-        const auto it = std::find_if(
-          m_devices.begin(), m_devices.end(),
-          [&](const StoredDeviceInformation& information) { return information.getDeviceKey() == deviceKey; });
-        if (it != m_devices.cend())
-            returningInformation = StoredDeviceInformation{*it};
+        for (const auto& deviceKey : deviceKeys)
+        {
+            if (const auto cached = findCached(deviceKey))
+            {
+                returningInformation.emplace_back(*cached);
+                continue;
+            }
+
+            // Devices removed before the reconciliation might still wait to be removed from persistent storage
+            if (m_removedBeforeReconciliation.find(deviceKey) != m_removedBeforeReconciliation.cend())
+                continue;
+
+            // Check the snapshot if the cache has not yet been reconciled
+            if (m_snapshot != nullptr)
+            {
+                auto information = m_snapshot->find(deviceKey);
+                if (!information.getDeviceKey().empty())
+                {
+                    cache(information, false, true);
+                    returningInformation.emplace_back(std::move(information));
+                    continue;
+                }
+            }
+            missingDeviceKeys.emplace_back(deviceKey);
+        }
     }
 
-    // If not found, check in persistent storage
-    if (returningInformation.getDeviceKey().empty() && m_persistentDeviceRepository != nullptr)
+    // The ones that are not found are all checked in persistent storage at once
+    if (!missingDeviceKeys.empty() && m_persistentDeviceRepository != nullptr)
     {
-        returningInformation = m_persistentDeviceRepository->get(deviceKey);
-        if (!returningInformation.getDeviceKey().empty())
-            m_devices.emplace_back(returningInformation);
+        auto persistedInformation = m_persistentDeviceRepository->getMany(missingDeviceKeys);
+        std::lock_guard<std::recursive_mutex> lock{m_mutex};
+        for (auto& information : persistedInformation)
+        {
+            cache(information, false);
+            returningInformation.emplace_back(std::move(information));
+        }
     }
     return returningInformation;
 }
@@ -167,17 +262,288 @@ std::vector<StoredDeviceInformation> InMemoryDeviceRepository::getGatewayDevices
     auto gatewayDevices = std::vector<StoredDeviceInformation>{};
     {
         std::lock_guard<std::recursive_mutex> lock{m_mutex};
-        std::copy_if(m_devices.cbegin(), m_devices.cend(), std::back_inserter(gatewayDevices),
-                     [&](const StoredDeviceInformation& information) {
-                         return information.getDeviceBelongsTo() == DeviceOwnership::Gateway;
-                     });
+        for (const auto& pair : m_devices)
+            if (pair.second.information.getDeviceBelongsTo() == DeviceOwnership::Gateway)
+                gatewayDevices.emplace_back(pair.second.information);
+
+        // Add the ones from the snapshot that have not yet made it into the cache
+        for (auto i = std::size_t{0}; m_snapshot != nullptr && i < m_snapshot->size(); ++i)
+        {
+            auto information = m_snapshot->at(i);
+            if (information.getDeviceBelongsTo() == DeviceOwnership::Gateway &&
+                m_devices.find(information.getDeviceKey()) == m_devices.cend() &&
+                m_removedBeforeReconciliation.find(information.getDeviceKey()) ==
+                  m_removedBeforeReconciliation.cend())
+                gatewayDevices.emplace_back(std::move(information));
+        }
     }
     return gatewayDevices;
 }
 
+bool InMemoryDeviceRepository::forEachGatewayDevice(const DevicePageVisitor& visitor, std::size_t pageSize)
+{
+    if (pageSize == 0)
+    {
+        LOG(ERROR) << "Failed to go through the gateway devices - The page size can not be 0.";
+        return false;
+    }
+
+    // Only a single page is copied out of the cache at a time
+    std::lock_guard<std::recursive_mutex> lock{m_mutex};
+    auto page = std::vector<StoredDeviceInformation>{};
+    page.reserve(pageSize);
+    const auto addToPage = [&](StoredDeviceInformation information) {
+        page.emplace_back(std::move(information));
+        if (page.size() < pageSize)
+            return true;
+        const auto proceed = visitor(page);
+        page.clear();
+        return proceed;
+    };
+    for (const auto& pair : m_devices)
+        if (pair.second.information.getDeviceBelongsTo() == DeviceOwnership::Gateway &&
+            !addToPage(pair.second.information))
+            return true;
+
+    // Add the ones from the snapshot that have not yet made it into the cache
+    for (auto i = std::size_t{0}; m_snapshot != nullptr && i < m_snapshot->size(); ++i)
+    {
+        auto information = m_snapshot->at(i);
+        if (information.getDeviceBelongsTo() == DeviceOwnership::Gateway &&
+            m_devices.find(information.getDeviceKey()) == m_devices.cend() &&
+            m_removedBeforeReconciliation.find(information.getDeviceKey()) == m_removedBeforeReconciliation.cend() &&
+            !addToPage(std::move(information)))
+            return true;
+    }
+    if (!page.empty())
+        visitor(page);
+    return true;
+}
+
+std::vector<StoredDeviceInformation> InMemoryDeviceRepository::findDevices(std::chrono::milliseconds timestampFrom,
+                                                                           const std::string& deviceType,
+                                                                           const std::string& externalId)
+{
+    if (m_persistentDeviceRepository != nullptr && m_queue != nullptr)
+    {
+        auto devices = std::vector<StoredDeviceInformation>{};
+        m_queue->execute(
+          [&] { devices = m_persistentDeviceRepository->findDevices(timestampFrom, deviceType, externalId); });
+        return devices;
+    }
+
+    auto devices = std::vector<StoredDeviceInformation>{};
+    std::lock_guard<std::recursive_mutex> lock{m_mutex};
+    for (const auto& pair : m_devices)
+    {
+        const auto& information = pair.second.information;
+        if (information.getTimestamp() >= timestampFrom &&
+            (deviceType.empty() || information.getDeviceType() == deviceType) &&
+            (externalId.empty() || information.getExternalId() == externalId))
+            devices.emplace_back(information);
+    }
+    return devices;
+}
+
 std::chrono::milliseconds InMemoryDeviceRepository::latestPlatformTimestamp()
 {
     std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
     return m_timestamp;
 }
+
+bool InMemoryDeviceRepository::holdsAllDevices()
+{
+    std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
+    return m_persistentDeviceRepository != nullptr || m_evictions == 0;
+}
+
+DeviceCacheStatistics InMemoryDeviceRepository::getStatistics()
+{
+    std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
+    auto statistics = DeviceCacheStatistics{};
+    statistics.platformDevices = m_recentlyUsedPlatformDevices.size();
+    statistics.gatewayDevices = m_devices.size() - statistics.platformDevices;
+    statistics.platformDeviceCapacity = m_platformDeviceCapacity;
+    statistics.hits = m_hits;
+    statistics.misses = m_misses;
+    statistics.evictions = m_evictions;
+
+    // Count in the map node (the entry and the bucket/next pointers), the key strings in it, and the list nodes
+    constexpr auto keyBufferSize = sizeof(std::string) - 1;
+    const auto stringHeapSize = [&](const std::string& value) {
+        return value.capacity() > keyBufferSize ? value.capacity() + 1 : 0;
+    };
+    statistics.approximateMemoryUsage = m_devices.bucket_count() * sizeof(void*);
+    for (const auto& pair : m_devices)
+        statistics.approximateMemoryUsage += sizeof(pair) + 2 * sizeof(void*) + stringHeapSize(pair.first) +
+                                             stringHeapSize(pair.second.information.getDeviceKey()) +
+                                             stringHeapSize(pair.second.information.getDeviceType()) +
+                                             stringHeapSize(pair.second.information.getExternalId());
+    for (const auto& deviceKey : m_recentlyUsedPlatformDevices)
+        statistics.approximateMemoryUsage += sizeof(deviceKey) + 2 * sizeof(void*) + stringHeapSize(deviceKey);
+    return statistics;
+}
+
+bool InMemoryDeviceRepository::flush(std::chrono::milliseconds timeout)
+{
+    if (m_persistentDeviceRepository == nullptr || m_queue == nullptr)
+        return true;
+    writeSnapshot();
+    return m_queue->drain(timeout);
+}
+
+const StoredDeviceInformation* InMemoryDeviceRepository::findCached(const std::string& deviceKey)
+{
+    const auto it = m_devices.find(deviceKey);
+    if (it == m_devices.end())
+    {
+        ++m_misses;
+        return nullptr;
+    }
+    ++m_hits;
+
+    // Move the platform owned device to the front of the recently used list
+    if (it->second.recentlyUsed != m_recentlyUsedPlatformDevices.end())
+        m_recentlyUsedPlatformDevices.splice(m_recentlyUsedPlatformDevices.begin(), m_recentlyUsedPlatformDevices,
+                                             it->second.recentlyUsed);
+    return &it->second.information;
+}
+
+void InMemoryDeviceRepository::cache(const StoredDeviceInformation& information, bool overwrite, bool fromSnapshot)
+{
+    const auto& deviceKey = information.getDeviceKey();
+    auto it = m_devices.find(deviceKey);
+    if (it != m_devices.end())
+    {
+        if (!overwrite)
+            return;
+        if (it->second.recentlyUsed != m_recentlyUsedPlatformDevices.end())
+            m_recentlyUsedPlatformDevices.erase(it->second.recentlyUsed);
+
+        // An empty type or external ID keeps the one that is already known
+        const auto& cached = it->second.information;
+        it->second.information = StoredDeviceInformation{
+          deviceKey, information.getDeviceBelongsTo(), information.getTimestamp(),
+          information.getDeviceType().empty() ? cached.getDeviceType() : information.getDeviceType(),
+          information.getExternalId().empty() ? cached.getExternalId() : information.getExternalId()};
+        it->second.fromSnapshot = fromSnapshot;
+    }
+    else
+    {
+        it = m_devices
+               .emplace(deviceKey, CachedDevice{information, m_recentlyUsedPlatformDevices.end(), fromSnapshot})
+               .first;
+    }
+
+    // Only the platform owned devices are tracked for eviction
+    if (information.getDeviceBelongsTo() != DeviceOwnership::Platform)
+    {
+        it->second.recentlyUsed = m_recentlyUsedPlatformDevices.end();
+        return;
+    }
+    m_recentlyUsedPlatformDevices.emplace_front(deviceKey);
+    it->second.recentlyUsed = m_recentlyUsedPlatformDevices.begin();
+
+    // And evict the least recently used ones if the cache got too large
+    while (m_platformDeviceCapacity > 0 && m_recentlyUsedPlatformDevices.size() > m_platformDeviceCapacity)
+    {
+        m_devices.erase(m_recentlyUsedPlatformDevices.back());
+        m_recentlyUsedPlatformDevices.pop_back();
+        ++m_evictions;
+    }
+}
+
+bool InMemoryDeviceRepository::uncache(const std::string& deviceKey)
+{
+    const auto it = m_devices.find(deviceKey);
+    if (it == m_devices.end())
+        return false;
+    if (it->second.recentlyUsed != m_recentlyUsedPlatformDevices.end())
+        m_recentlyUsedPlatformDevices.erase(it->second.recentlyUsed);
+    m_devices.erase(it);
+    return true;
+}
+
+void InMemoryDeviceRepository::reconcileWithPersistentRepository()
+{
+    LOG(TRACE) << METHOD_INFO;
+
+    // The persistent repository is the source of truth, so it overwrites what was read from the snapshot. Anything
+    // that has changed in the cache since the snapshot was loaded is newer than what it might still hold.
+    m_persistentDeviceRepository->forEachGatewayDevice([this](const std::vector<StoredDeviceInformation>& devices) {
+        std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
+        if (m_clearedBeforeReconciliation)
+            return false;
+        for (const auto& device : devices)
+        {
+            if (m_removedBeforeReconciliation.find(device.getDeviceKey()) != m_removedBeforeReconciliation.cend())
+                continue;
+            const auto it = m_devices.find(device.getDeviceKey());
+            cache(device, it == m_devices.end() || it->second.fromSnapshot);
+        }
+        return true;
+    });
+
+    // The rest of the entries from the snapshot are looked up, and dropped if the persistent repository lacks them
+    auto unconfirmedDeviceKeys = std::vector<std::string>{};
+    {
+        std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
+        for (const auto& pair : m_devices)
+            if (pair.second.fromSnapshot)
+                unconfirmedDeviceKeys.emplace_back(pair.first);
+    }
+    if (!unconfirmedDeviceKeys.empty())
+    {
+        const auto persistedDevices = m_persistentDeviceRepository->getMany(unconfirmedDeviceKeys);
+        std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
+        for (const auto& device : persistedDevices)
+        {
+            const auto it = m_devices.find(device.getDeviceKey());
+            if (it != m_devices.end() && it->second.fromSnapshot)
+                cache(device);
+        }
+        for (const auto& deviceKey : unconfirmedDeviceKeys)
+        {
+            const auto it = m_devices.find(deviceKey);
+            if (it != m_devices.end() && it->second.fromSnapshot)
+                uncache(deviceKey);
+        }
+    }
+
+    const auto loadedTimestamp = m_persistentDeviceRepository->latestPlatformTimestamp();
+    {
+        std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
+        if (!m_clearedBeforeReconciliation && loadedTimestamp > m_timestamp)
+            m_timestamp = loadedTimestamp;
+        m_snapshot.reset();
+        m_loaded = true;
+        m_reconciliationPending = false;
+        m_clearedBeforeReconciliation = false;
+        m_removedBeforeReconciliation.clear();
+    }
+
+    // Write a fresh snapshot for the next boot
+    writeSnapshot();
+}
+
+void InMemoryDeviceRepository::writeSnapshot()
+{
+    // The cache is complete only once it has been reconciled with the persistent repository
+    auto snapshotDevices = std::vector<StoredDeviceInformation>{};
+    auto snapshotTimestamp = std::chrono::milliseconds{};
+    {
+        std::lock_guard<std::recursive_mutex> lockGuard{m_mutex};
+        if (m_snapshotPath.empty() || !m_loaded || m_reconciliationPending)
+            return;
+        snapshotDevices.reserve(m_devices.size());
+        for (const auto& pair : m_devices)
+            snapshotDevices.emplace_back(pair.second.information);
+        snapshotTimestamp = m_timestamp;
+    }
+
+    // It is written in the background, behind the changes that are still waiting to be persisted
+    m_queue->push([this, snapshotDevices = std::move(snapshotDevices), snapshotTimestamp]() mutable {
+        DeviceRegistrySnapshot::write(m_snapshotPath, std::move(snapshotDevices), snapshotTimestamp);
+    });
+}
 }    // namespace wolkabout::gateway
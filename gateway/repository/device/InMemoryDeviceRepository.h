@@ -16,13 +16,40 @@
 #ifndef WOLKGATEWAY_INMEMORYDEVICEREPOSITORY_H
 #define WOLKGATEWAY_INMEMORYDEVICEREPOSITORY_H
 
-#include "core/utility/CommandBuffer.h"
+#include "gateway/executor/GatewayExecutor.h"
+#include "gateway/repository/device/DeviceRegistrySnapshot.h"
 #include "gateway/repository/device/DeviceRepository.h"
 
+#include <cstdint>
+#include <list>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace wolkabout::gateway
 {
+/**
+ * This struct contains the statistics of the device cache.
+ */
+struct DeviceCacheStatistics
+{
+    // The number of cached gateway owned devices, which are never evicted
+    std::size_t gatewayDevices;
+
+    // The number of cached platform owned devices, and how many of them can be held (0 means there is no limit)
+    std::size_t platformDevices;
+    std::size_t platformDeviceCapacity;
+
+    // The number of lookups that were, and were not, answered from the cache
+    std::uint64_t hits;
+    std::uint64_t misses;
+
+    // The number of platform owned devices that were evicted to keep the cache within its capacity
+    std::uint64_t evictions;
+
+    // The approximate number of bytes the cached entries take up
+    std::size_t approximateMemoryUsage;
+};
+
 class InMemoryDeviceRepository : public DeviceRepository
 {
 public:
@@ -30,11 +57,23 @@ public:
      * Default parameter constructor for this repository.
      *
      * @param persistentDeviceRepository An optional persistent device repository.
+     * @param snapshotPath An optional path of the device registry snapshot. Used only with a persistent repository.
+     * @param platformDeviceCapacity The maximum number of platform owned devices held in the cache. Once it is
+     * reached, the least recently used ones are evicted. Gateway owned devices are always kept. 0 means there is no
+     * limit. Without a persistent repository, evicted devices are forgotten, and the repository stops holding all
+     * devices.
+     * @param executor The executor on which the changes are written into the persistent repository.
      */
-    explicit InMemoryDeviceRepository(std::shared_ptr<DeviceRepository> persistentDeviceRepository = nullptr);
+    explicit InMemoryDeviceRepository(std::shared_ptr<DeviceRepository> persistentDeviceRepository = nullptr,
+                                      std::string snapshotPath = {}, std::size_t platformDeviceCapacity = 0,
+                                      std::shared_ptr<GatewayExecutor> executor = nullptr);
 
     /**
-     * This will cache the information from the persistent repository in the memory.
+     * This will cache the information from the persistent repository in the memory. Once the information has been
+     * loaded, the cache is kept up to date by the repository itself, so calling this method again does nothing.
+     *
+     * If a snapshot path is set, and a snapshot is found there, it will be mapped and used right away. The cache will
+     * then be reconciled with the persistent repository in the background, and a fresh snapshot will be written.
      */
     void loadInformationFromPersistentRepository();
 
@@ -50,7 +89,8 @@ public:
     /**
      * This method is overridden from the `gateway::DeviceRepository` interface.
      * This method will remove the devices from the cache storage, and queue the same thing to be done in persistent
-     * storage if present.
+     * storage if present. The removal of devices that were held only by the persistent storage is reported to the
+     * listeners once they have been removed from it.
      *
      * @param deviceKeys The device keys that need to be removed.
      * @return Whether the devices have been removed.
@@ -76,6 +116,16 @@ public:
      */
     bool containsDevice(const std::string& deviceKey) override;
 
+    /**
+     * This method is overridden from the `gateway::DeviceRepository` interface.
+     * This method is used to check which of the devices data is being held about. The cache is checked in a single
+     * pass, and the devices that are not found in it are checked in persistent storage at once (if it exists).
+     *
+     * @param deviceKeys The device keys for which presence must be confirmed.
+     * @return The device keys that are present in either cache or persistent storage.
+     */
+    std::unordered_set<std::string> containsDevices(const std::vector<std::string>& deviceKeys) override;
+
     /**
      * This method is overridden from the `gateway::DeviceRepository` interface.
      * This method is used to obtain information about a device.
@@ -85,6 +135,16 @@ public:
      */
     StoredDeviceInformation get(const std::string& deviceKey) override;
 
+    /**
+     * This method is overridden from the `gateway::DeviceRepository` interface.
+     * This method is used to obtain information about multiple devices. The cache is checked in a single pass, and
+     * the devices that are not found in it are obtained from persistent storage at once (if it exists).
+     *
+     * @param deviceKeys The devices in which the user is interested.
+     * @return The information about the devices that are found.
+     */
+    std::vector<StoredDeviceInformation> getMany(const std::vector<std::string>& deviceKeys) override;
+
     /**
      * This method is overridden from the `gateway::DeviceRepository` interface.
      * This method is used to obtain the list of devices this gateway owns.
@@ -93,6 +153,33 @@ public:
      */
     std::vector<StoredDeviceInformation> getGatewayDevices() override;
 
+    /**
+     * This method is overridden from the `gateway::DeviceRepository` interface.
+     * This method is used to go through the devices this gateway owns one page at a time. The cache is locked for the
+     * whole iteration, so the visitor must not block, and must not change the repository.
+     *
+     * @param visitor The visitor that is invoked with each page of devices. Returning false stops the iteration.
+     * @param pageSize The maximum number of devices in a single page.
+     * @return Whether the iteration completed. Fails only if the page size is 0.
+     */
+    bool forEachGatewayDevice(const DevicePageVisitor& visitor,
+                              std::size_t pageSize = DEFAULT_DEVICE_PAGE_SIZE) override;
+
+    /**
+     * This method is overridden from the `gateway::DeviceRepository` interface.
+     * This method is used to look up the devices by their timestamp, type and external ID. The cache can not answer
+     * this on its own if devices can be evicted from it, so if the persistent repository is present, the lookup is
+     * queued behind the changes that are still waiting to be written into it, and is answered by it.
+     *
+     * @param timestampFrom The devices with a timestamp lower than this are left out.
+     * @param deviceType The type the devices must have. Empty matches any type.
+     * @param externalId The external ID the devices must have. Empty matches any external ID.
+     * @return The list of matching devices.
+     */
+    std::vector<StoredDeviceInformation> findDevices(std::chrono::milliseconds timestampFrom,
+                                                     const std::string& deviceType,
+                                                     const std::string& externalId) override;
+
     /**
      * This method is overridden from the `gateway::DeviceRepository` interface.
      * This method is used to obtain the last timestamp when a device acquisition request has been sent. Devices after
@@ -102,17 +189,78 @@ public:
      */
     std::chrono::milliseconds latestPlatformTimestamp() override;
 
+    /**
+     * This method is overridden from the `gateway::DeviceRepository` interface.
+     * Without a persistent repository, the devices evicted from the cache are forgotten, so once a device has been
+     * evicted, `findDevices` no longer returns every matching device.
+     *
+     * @return Whether the repository still holds every device that was saved into it.
+     */
+    bool holdsAllDevices() override;
+
+    /**
+     * This method is used to obtain the statistics of the cache.
+     *
+     * @return The current statistics.
+     */
+    DeviceCacheStatistics getStatistics();
+
+    /**
+     * This method is used to wait until all the changes queued before it have been written into the persistent
+     * repository. If a snapshot path is set, a fresh snapshot is written too.
+     *
+     * @param timeout How long to wait for the changes.
+     * @return Whether all the changes have been written in time. Always true without a persistent repository.
+     */
+    bool flush(std::chrono::milliseconds timeout);
+
 private:
+    // This is the entry of the cache. Platform owned devices also hold their position in the recently used list.
+    // Entries read from the snapshot are marked until the persistent repository confirms them.
+    struct CachedDevice
+    {
+        StoredDeviceInformation information;
+        std::list<std::string>::iterator recentlyUsed;
+        bool fromSnapshot;
+    };
+
+    const StoredDeviceInformation* findCached(const std::string& deviceKey);
+
+    void cache(const StoredDeviceInformation& information, bool overwrite = true, bool fromSnapshot = false);
+
+    bool uncache(const std::string& deviceKey);
+
+    void reconcileWithPersistentRepository();
+
+    void writeSnapshot();
+
     // Store the latest timestamp
     std::chrono::milliseconds m_timestamp;
 
-    // Here we actually store the data
+    // Here we actually store the data, indexed by the device key
     std::recursive_mutex m_mutex;
-    std::vector<StoredDeviceInformation> m_devices;
+    std::unordered_map<std::string, CachedDevice> m_devices;
+    bool m_loaded;
+
+    // The keys of cached platform owned devices, from the most to the least recently used one
+    const std::size_t m_platformDeviceCapacity;
+    std::list<std::string> m_recentlyUsedPlatformDevices;
+
+    // The cache statistics
+    std::uint64_t m_hits;
+    std::uint64_t m_misses;
+    std::uint64_t m_evictions;
+
+    // The snapshot that answers for the persistent repository until the cache is reconciled with it
+    std::string m_snapshotPath;
+    std::unique_ptr<DeviceRegistrySnapshot> m_snapshot;
+    bool m_reconciliationPending;
+    bool m_clearedBeforeReconciliation;
+    std::unordered_set<std::string> m_removedBeforeReconciliation;
 
     // And optional pointer for a more persistence DeviceRepository
     std::shared_ptr<DeviceRepository> m_persistentDeviceRepository;
-    std::unique_ptr<legacy::CommandBuffer> m_commandBuffer;
+    std::unique_ptr<SerialQueue> m_queue;
 };
 }    // namespace wolkabout::gateway
 
@@ -19,21 +19,64 @@
 #include "core/model/Device.h"
 #include "core/utility/ByteUtils.h"
 #include "core/utility/Logger.h"
+#include "core/utility/StringUtils.h"
 
 #include <mutex>
 #include <sqlite3.h>
 #include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 using namespace wolkabout::legacy;
 
 namespace wolkabout::gateway
 {
+namespace
+{
+// Reads a text column without copying it out of the statement. The view is valid until the statement steps again.
+std::string_view readText(sqlite3_stmt* statement, int column)
+{
+    const auto text = reinterpret_cast<const char*>(sqlite3_column_text(statement, column));
+    if (text == nullptr)
+        return {};
+    return {text, static_cast<std::size_t>(sqlite3_column_bytes(statement, column))};
+}
+}    // namespace
+
 // Here are some create table instructions
 const std::string CREATE_DEVICE_TABLE =
   "CREATE TABLE IF NOT EXISTS Device (ID INTEGER PRIMARY KEY AUTOINCREMENT, DeviceKey TEXT NOT NULL UNIQUE, BelongsTo "
-  "TEXT CHECK( BelongsTo IN ('Platform', 'Gateway')), Timestamp INTEGER NOT NULL);";
-
-SQLiteDeviceRepository::SQLiteDeviceRepository(const std::string& connectionString) : m_db(nullptr)
+  "TEXT CHECK( BelongsTo IN ('Platform', 'Gateway')), Timestamp INTEGER NOT NULL, DeviceType TEXT NOT NULL DEFAULT '', "
+  "ExternalId TEXT NOT NULL DEFAULT '');";
+const std::string CREATE_BELONGS_TO_INDEX =
+  "CREATE INDEX IF NOT EXISTS DeviceBelongsToIndex ON Device (BelongsTo, DeviceKey);";
+const std::string CREATE_TIMESTAMP_INDEX = "CREATE INDEX IF NOT EXISTS DeviceTimestampIndex ON Device (Timestamp);";
+const std::string CREATE_DEVICE_TYPE_INDEX =
+  "CREATE INDEX IF NOT EXISTS DeviceTypeIndex ON Device (DeviceType, Timestamp);";
+const std::string CREATE_EXTERNAL_ID_INDEX = "CREATE INDEX IF NOT EXISTS DeviceExternalIdIndex ON Device (ExternalId);";
+
+// The columns that were added to the device table after it was first released, and the statements that add them
+const std::vector<std::pair<std::string, std::string>> ADDED_DEVICE_COLUMNS = {
+  {"DeviceType", "ALTER TABLE Device ADD COLUMN DeviceType TEXT NOT NULL DEFAULT '';"},
+  {"ExternalId", "ALTER TABLE Device ADD COLUMN ExternalId TEXT NOT NULL DEFAULT '';"}};
+
+// The columns read by `loadDeviceInformationFromRow`
+const std::string DEVICE_COLUMNS =
+  "Device.DeviceKey, Device.BelongsTo, Device.Timestamp, Device.DeviceType, Device.ExternalId";
+
+// The temporary table in which keys for bulk lookups are placed, so they can be joined against the device table
+const std::string CREATE_KEY_LOOKUP_TABLE =
+  "CREATE TEMP TABLE IF NOT EXISTS DeviceKeyLookup (DeviceKey TEXT NOT NULL PRIMARY KEY);";
+const std::string INSERT_KEY_LOOKUP = "INSERT OR IGNORE INTO temp.DeviceKeyLookup (DeviceKey) VALUES (?);";
+
+// Deletes a single device, by its bound key
+const std::string DELETE_DEVICE = "DELETE FROM Device WHERE Device.DeviceKey = ?;";
+
+SQLiteDeviceRepository::SQLiteDeviceRepository(const std::string& connectionString,
+                                               const SQLiteStorageProfile& storageProfile)
+: m_db(nullptr)
 {
     // Attempt to open up a connection.
     auto rc = sqlite3_open(connectionString.c_str(), &m_db);
@@ -46,16 +89,42 @@ SQLiteDeviceRepository::SQLiteDeviceRepository(const std::string& connectionStri
     }
     LOG(DEBUG) << "Successfully opened up a connection to the Device Repository '" << connectionString << "'.";
 
+    // Configure the connection before anything touches the tables
+    applyStorageProfile(storageProfile);
+
     // Create all the tables
     auto errorMessage = executeSQLStatement(CREATE_DEVICE_TABLE);
     if (!errorMessage.empty())
         throw std::runtime_error("Failed to initialize necessary tables: '" + errorMessage + "'.");
+
+    // Databases created by an older version are missing some of the columns
+    errorMessage = migrateDeviceTable();
+    if (!errorMessage.empty())
+        throw std::runtime_error("Failed to migrate the device table: '" + errorMessage + "'.");
+
+    // Create the indices for the queries that would otherwise scan the whole table
+    errorMessage = executeSQLStatement(CREATE_BELONGS_TO_INDEX + CREATE_TIMESTAMP_INDEX + CREATE_DEVICE_TYPE_INDEX +
+                                       CREATE_EXTERNAL_ID_INDEX);
+    if (!errorMessage.empty())
+        throw std::runtime_error("Failed to initialize necessary indices: '" + errorMessage + "'.");
+
+    // Only now that the tables exist can the read-only connections be opened
+    openReadConnections(connectionString, storageProfile);
 }
 
 SQLiteDeviceRepository::~SQLiteDeviceRepository()
 {
-    std::lock_guard<std::recursive_mutex> lock{m_mutex};
+    {
+        std::unique_lock<std::mutex> lock{m_readConnectionsMutex};
+        m_readConnectionsCondition.wait(
+          lock, [&] { return m_idleReadConnections.size() == m_readConnections.size(); });
+        for (const auto& connection : m_readConnections)
+            sqlite3_close(connection);
+        m_readConnections.clear();
+        m_idleReadConnections.clear();
+    }
 
+    std::lock_guard<std::recursive_mutex> lock{m_mutex};
     if (m_db)
     {
         LOG(DEBUG) << "Closed the connection to the Device Repository.";
@@ -75,42 +144,55 @@ bool SQLiteDeviceRepository::save(const std::vector<StoredDeviceInformation>& de
     }
 
     // If the device is already present, go to the update routine
+    auto deviceKeys = std::vector<std::string>{};
+    deviceKeys.reserve(devices.size());
+    for (const auto& device : devices)
+        deviceKeys.emplace_back(device.getDeviceKey());
+    const auto existingDeviceKeys = containsDevices(deviceKeys);
     auto newDevices = std::vector<StoredDeviceInformation>{};
     auto oldDevices = std::vector<StoredDeviceInformation>{};
     for (const auto& device : devices)
     {
-        if (containsDevice(device.getDeviceKey()))
+        if (existingDeviceKeys.find(device.getDeviceKey()) != existingDeviceKeys.cend())
             oldDevices.emplace_back(device);
         else
             newDevices.emplace_back(device);
     }
 
     // Update the old devices
-    if (!oldDevices.empty())
-        update(oldDevices);
+    if (!oldDevices.empty() && update(oldDevices))
+        notifyDevicesUpdated(oldDevices);
 
     // Store the information about the device
-    std::lock_guard<std::recursive_mutex> lock{m_mutex};
-    auto errorMessage = executeSQLStatement("BEGIN TRANSACTION;");
-    if (!errorMessage.empty())
-    {
-        LOG(ERROR) << errorPrefix << "Failed to start the database transaction - '" << errorMessage << "'.";
-        return false;
-    }
-    for (const auto& device : newDevices)
     {
-        // Create the device
-        errorMessage = executeSQLStatement("INSERT INTO Device(DeviceKey, BelongsTo, Timestamp) VALUES ('" +
-                                           device.getDeviceKey() + "', '" + toString(device.getDeviceBelongsTo()) +
-                                           "', " + std::to_string(device.getTimestamp().count()) + ");");
+        std::lock_guard<std::recursive_mutex> lock{m_mutex};
+        auto errorMessage = executeSQLStatement("BEGIN TRANSACTION;");
         if (!errorMessage.empty())
         {
-            executeSQLStatement("ROLLBACK;");
-            LOG(ERROR) << errorPrefix << "Failed to insert device info into the database - '" << errorMessage << "'.";
+            LOG(ERROR) << errorPrefix << "Failed to start the database transaction - '" << errorMessage << "'.";
             return false;
         }
+        for (const auto& device : newDevices)
+        {
+            // Create the device. The type and external ID come from the platform, so they are bound, not inlined.
+            errorMessage = executeSQLQuery(
+              m_db,
+              "INSERT INTO Device(DeviceKey, BelongsTo, Timestamp, DeviceType, ExternalId) VALUES (?, ?, " +
+                std::to_string(device.getTimestamp().count()) + ", ?, ?);",
+              {device.getDeviceKey(), toString(device.getDeviceBelongsTo()), device.getDeviceType(),
+               device.getExternalId()},
+              [](sqlite3_stmt*) { return false; });
+            if (!errorMessage.empty())
+            {
+                executeSQLStatement("ROLLBACK;");
+                LOG(ERROR) << errorPrefix << "Failed to insert device info into the database - '" << errorMessage
+                           << "'.";
+                return false;
+            }
+        }
+        executeSQLStatement("COMMIT;");
     }
-    executeSQLStatement("COMMIT;");
+    notifyDevicesAdded(newDevices);
     return true;
 }
 
@@ -131,19 +213,50 @@ bool SQLiteDeviceRepository::remove(const std::vector<std::string>& deviceKeys)
         return false;
     }
 
-    // Make the string for the array in sql query
-    auto arrayString = std::string{"("};
-    for (auto i = std::uint64_t{0}; i < deviceKeys.size(); ++i)
-        arrayString += "'" + deviceKeys[i] + "'" + (i < deviceKeys.size() - 1 ? ", " : "");
-    arrayString += ")";
-
-    std::lock_guard<std::recursive_mutex> lock{m_mutex};
-    auto errorMessage = executeSQLStatement("DELETE FROM Device WHERE Device.DeviceKey IN " + arrayString + ";");
-    if (!errorMessage.empty())
+    // Only the keys of the devices that were actually deleted are reported to the listeners
+    auto removedDeviceKeys = std::vector<std::string>{};
     {
-        LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
-        return false;
+        std::lock_guard<std::recursive_mutex> lock{m_mutex};
+        auto errorMessage = executeSQLStatement("BEGIN TRANSACTION;");
+        if (!errorMessage.empty())
+        {
+            LOG(ERROR) << errorPrefix << "Failed to start the database transaction - '" << errorMessage << "'.";
+            return false;
+        }
+
+        // Delete the devices one by one with a bound key, in the single transaction
+        sqlite3_stmt* statement;
+        if (sqlite3_prepare_v2(m_db, DELETE_DEVICE.c_str(), static_cast<int>(DELETE_DEVICE.size()), &statement,
+                               nullptr) != SQLITE_OK)
+        {
+            errorMessage = sqlite3_errmsg(m_db);
+        }
+        else
+        {
+            for (const auto& deviceKey : deviceKeys)
+            {
+                sqlite3_bind_text(statement, 1, deviceKey.c_str(), static_cast<int>(deviceKey.size()),
+                                  SQLITE_STATIC);
+                if (sqlite3_step(statement) != SQLITE_DONE)
+                {
+                    errorMessage = sqlite3_errmsg(m_db);
+                    break;
+                }
+                if (sqlite3_changes(m_db) > 0)
+                    removedDeviceKeys.emplace_back(deviceKey);
+                sqlite3_reset(statement);
+            }
+            sqlite3_finalize(statement);
+        }
+        if (!errorMessage.empty())
+        {
+            executeSQLStatement("ROLLBACK;");
+            LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
+            return false;
+        }
+        executeSQLStatement("COMMIT;");
     }
+    notifyDevicesRemoved(removedDeviceKeys);
     return true;
 }
 
@@ -157,13 +270,16 @@ bool SQLiteDeviceRepository::removeAll()
         return false;
     }
 
-    std::lock_guard<std::recursive_mutex> lock{m_mutex};
-    auto errorMessage = executeSQLStatement("DELETE FROM Device;");
-    if (!errorMessage.empty())
     {
-        LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
-        return false;
+        std::lock_guard<std::recursive_mutex> lock{m_mutex};
+        auto errorMessage = executeSQLStatement("DELETE FROM Device;");
+        if (!errorMessage.empty())
+        {
+            LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
+            return false;
+        }
     }
+    notifyAllDevicesRemoved();
     return true;
 }
 
@@ -177,18 +293,43 @@ bool SQLiteDeviceRepository::containsDevice(const std::string& deviceKey)
         return false;
     }
 
-    auto result = ColumnResult{};
+    auto found = false;
+    auto errorMessage = executeReadQuery("SELECT 1 FROM Device WHERE Device.DeviceKey = ? LIMIT 1;", {deviceKey},
+                                         [&](sqlite3_stmt*) {
+                                             found = true;
+                                             return false;
+                                         });
+    if (!errorMessage.empty())
     {
-        std::lock_guard<std::recursive_mutex> lock{m_mutex};
-        auto errorMessage =
-          executeSQLStatement("SELECT DeviceKey FROM Device WHERE Device.DeviceKey = '" + deviceKey + "';", &result);
-        if (!errorMessage.empty())
-        {
-            LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
-            return false;
-        }
+        LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
+        return false;
+    }
+    return found;
+}
+
+std::unordered_set<std::string> SQLiteDeviceRepository::containsDevices(const std::vector<std::string>& deviceKeys)
+{
+    // Establish the error prefix, and check whether a database session exists
+    const auto errorPrefix = "Failed to obtain information which devices exist - ";
+    if (m_db == nullptr)
+    {
+        LOG(ERROR) << errorPrefix << "The database connection is not established.";
+        return {};
     }
-    return result.size() >= 2 && result[1].front() == deviceKey;
+    if (deviceKeys.empty())
+        return {};
+
+    auto found = std::unordered_set<std::string>{};
+    auto errorMessage = queryByKeys(deviceKeys, "Device.DeviceKey", [&](sqlite3_stmt* statement) {
+        found.emplace(readText(statement, 0));
+        return true;
+    });
+    if (!errorMessage.empty())
+    {
+        LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
+        return {};
+    }
+    return found;
 }
 
 StoredDeviceInformation SQLiteDeviceRepository::get(const std::string& deviceKey)
@@ -201,23 +342,52 @@ StoredDeviceInformation SQLiteDeviceRepository::get(const std::string& deviceKey
         return {};
     }
 
-    auto result = ColumnResult{};
+    auto device = StoredDeviceInformation{};
+    auto errorMessage =
+      executeReadQuery("SELECT " + DEVICE_COLUMNS + " FROM Device WHERE Device.DeviceKey = ? LIMIT 1;",
+                       {deviceKey}, [&](sqlite3_stmt* statement) {
+                           device = loadDeviceInformationFromRow(statement);
+                           return false;
+                       });
+    if (!errorMessage.empty())
     {
-        std::lock_guard<std::recursive_mutex> lock{m_mutex};
-        auto errorMessage = executeSQLStatement(
-          "SELECT DeviceKey, BelongsTo, Timestamp FROM Device WHERE Device.DeviceKey = '" + deviceKey + "';", &result);
-        if (!errorMessage.empty())
-        {
-            LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
-            return {};
-        }
+        LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
+        return {};
     }
-    if (result.size() < 2)
-    {
+    if (device.getDeviceKey().empty())
         LOG(DEBUG) << errorPrefix << "Device not found in the database.";
+    return device;
+}
+
+std::vector<StoredDeviceInformation> SQLiteDeviceRepository::getMany(const std::vector<std::string>& deviceKeys)
+{
+    // Establish the error prefix, and check whether a database session exists
+    const auto errorPrefix = "Failed to obtain information about devices - ";
+    if (m_db == nullptr)
+    {
+        LOG(ERROR) << errorPrefix << "The database connection is not established.";
+        return {};
+    }
+    if (deviceKeys.empty())
+        return {};
+
+    auto devices = std::vector<StoredDeviceInformation>{};
+    devices.reserve(deviceKeys.size());
+    auto valid = true;
+    auto errorMessage = queryByKeys(deviceKeys, DEVICE_COLUMNS,
+                                    [&](sqlite3_stmt* statement) {
+                                        devices.emplace_back(loadDeviceInformationFromRow(statement));
+                                        valid = !devices.back().getDeviceKey().empty();
+                                        return valid;
+                                    });
+    if (!errorMessage.empty())
+    {
+        LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
         return {};
     }
-    return loadDeviceInformationFromRow(result, 1);
+    if (!valid)
+        return {};
+    return devices;
 }
 
 std::vector<StoredDeviceInformation> SQLiteDeviceRepository::getGatewayDevices()
@@ -230,26 +400,116 @@ std::vector<StoredDeviceInformation> SQLiteDeviceRepository::getGatewayDevices()
         return {};
     }
 
-    auto result = ColumnResult{};
+    auto devices = std::vector<StoredDeviceInformation>{};
+    auto valid = true;
+    auto errorMessage =
+      executeReadQuery("SELECT " + DEVICE_COLUMNS + " FROM Device WHERE Device.BelongsTo = 'Gateway';", {},
+                       [&](sqlite3_stmt* statement) {
+                           devices.emplace_back(loadDeviceInformationFromRow(statement));
+                           valid = !devices.back().getDeviceKey().empty();
+                           return valid;
+                       });
+    if (!errorMessage.empty())
     {
-        std::lock_guard<std::recursive_mutex> lock{m_mutex};
-        auto errorMessage = executeSQLStatement(
-          "SELECT DeviceKey, BelongsTo, Timestamp FROM Device WHERE Device.BelongsTo = 'Gateway';", &result);
+        LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
+        return {};
+    }
+    if (!valid)
+        return {};
+    return devices;
+}
+
+bool SQLiteDeviceRepository::forEachGatewayDevice(const DevicePageVisitor& visitor, std::size_t pageSize)
+{
+    // Establish the error prefix, and check whether a database session exists
+    const auto errorPrefix = "Failed to go through the gateway devices - ";
+    if (m_db == nullptr)
+    {
+        LOG(ERROR) << errorPrefix << "The database connection is not established.";
+        return false;
+    }
+    if (pageSize == 0)
+    {
+        LOG(ERROR) << errorPrefix << "The page size can not be 0.";
+        return false;
+    }
+
+    // Every page continues after the last key of the previous one, which is a seek on the (BelongsTo, DeviceKey) index
+    const auto query = "SELECT " + DEVICE_COLUMNS +
+                       " FROM Device WHERE Device.BelongsTo = 'Gateway' AND Device.DeviceKey > ? ORDER BY "
+                       "Device.DeviceKey LIMIT " +
+                       std::to_string(pageSize) + ";";
+    auto lastDeviceKey = std::string{};
+    auto page = std::vector<StoredDeviceInformation>{};
+    page.reserve(pageSize);
+    while (true)
+    {
+        page.clear();
+        auto valid = true;
+        auto errorMessage = executeReadQuery(query, {lastDeviceKey}, [&](sqlite3_stmt* statement) {
+            page.emplace_back(loadDeviceInformationFromRow(statement));
+            valid = !page.back().getDeviceKey().empty();
+            return valid;
+        });
         if (!errorMessage.empty())
         {
             LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
-            return {};
+            return false;
         }
+        if (!valid)
+            return false;
+        if (page.empty())
+            return true;
+
+        // The visitor is invoked once the query is done, so it does not hold on to a read connection
+        lastDeviceKey = page.back().getDeviceKey();
+        if (!visitor(page) || page.size() < pageSize)
+            return true;
+    }
+}
+
+std::vector<StoredDeviceInformation> SQLiteDeviceRepository::findDevices(std::chrono::milliseconds timestampFrom,
+                                                                         const std::string& deviceType,
+                                                                         const std::string& externalId)
+{
+    // Establish the error prefix, and check whether a database session exists
+    const auto errorPrefix = "Failed to find devices - ";
+    if (m_db == nullptr)
+    {
+        LOG(ERROR) << errorPrefix << "The database connection is not established.";
+        return {};
+    }
+
+    // Only the filters that are set are placed in the query, so it can use the index for the most selective one
+    auto query = "SELECT " + DEVICE_COLUMNS +
+                 " FROM Device WHERE Device.Timestamp >= " + std::to_string(timestampFrom.count());
+    auto parameters = std::vector<std::string>{};
+    if (!deviceType.empty())
+    {
+        query += " AND Device.DeviceType = ?";
+        parameters.emplace_back(deviceType);
+    }
+    if (!externalId.empty())
+    {
+        query += " AND Device.ExternalId = ?";
+        parameters.emplace_back(externalId);
     }
+    query += ";";
 
     auto devices = std::vector<StoredDeviceInformation>{};
-    for (auto i = std::uint64_t{1}; i < result.size(); ++i)
+    auto valid = true;
+    auto errorMessage = executeReadQuery(query, parameters, [&](sqlite3_stmt* statement) {
+        devices.emplace_back(loadDeviceInformationFromRow(statement));
+        valid = !devices.back().getDeviceKey().empty();
+        return valid;
+    });
+    if (!errorMessage.empty())
     {
-        auto device = loadDeviceInformationFromRow(result, i);
-        if (device.getDeviceKey().empty())
-            return {};
-        devices.emplace_back(std::move(device));
+        LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
+        return {};
     }
+    if (!valid)
+        return {};
     return devices;
 }
 
@@ -263,28 +523,91 @@ std::chrono::milliseconds SQLiteDeviceRepository::latestPlatformTimestamp()
         return {};
     }
 
-    std::lock_guard<std::recursive_mutex> lock{m_mutex};
-    auto result = ColumnResult{};
+    // An empty table will return a single NULL row, which is left as a zero timestamp
     auto millis = std::chrono::milliseconds{};
-    auto errorMessage = executeSQLStatement("SELECT MAX(Timestamp) FROM Device;", &result);
+    auto errorMessage = executeReadQuery("SELECT MAX(Timestamp) FROM Device;", {}, [&](sqlite3_stmt* statement) {
+        if (sqlite3_column_type(statement, 0) != SQLITE_NULL)
+            millis = std::chrono::milliseconds{sqlite3_column_int64(statement, 0)};
+        return false;
+    });
     if (!errorMessage.empty())
-    {
         LOG(ERROR) << errorPrefix << "Failed to execute the query - '" << errorMessage << "'.";
-        return millis;
+    return millis;
+}
+
+void SQLiteDeviceRepository::applyStorageProfile(const SQLiteStorageProfile& storageProfile)
+{
+    const auto errorPrefix = "Failed to apply the storage profile - ";
+
+    // The journal mode pragma returns the mode that was actually set, which can differ from the requested one
+    auto appliedJournalMode = std::string{};
+    const auto journalMode = toString(storageProfile.journalMode);
+    auto errorMessage =
+      executeSQLQuery(m_db, "PRAGMA journal_mode = " + journalMode + ";", {}, [&](sqlite3_stmt* statement) {
+          appliedJournalMode = std::string{readText(statement, 0)};
+          return false;
+      });
+    if (!errorMessage.empty())
+        LOG(WARN) << errorPrefix << "Failed to set the journal mode - '" << errorMessage << "'.";
+    else if (StringUtils::toUpperCase(appliedJournalMode) != journalMode)
+        LOG(WARN) << errorPrefix << "The database refused to switch to journal mode '" << journalMode << "'.";
+    m_journalMode = StringUtils::toUpperCase(appliedJournalMode);
+
+    configureConnection(m_db, storageProfile);
+}
+
+void SQLiteDeviceRepository::configureConnection(sqlite3* connection, const SQLiteStorageProfile& storageProfile)
+{
+    const auto errorPrefix = "Failed to apply the storage profile - ";
+
+    // Some of these return the value that was set, so they are run as queries that ignore the rows
+    for (const auto& pragma : {"PRAGMA synchronous = " + toString(storageProfile.synchronous) + ";",
+                               "PRAGMA mmap_size = " + std::to_string(storageProfile.mmapSize) + ";",
+                               "PRAGMA cache_size = " + std::to_string(storageProfile.cacheSize) + ";"})
+    {
+        auto errorMessage = executeSQLQuery(connection, pragma, {}, [](sqlite3_stmt*) { return false; });
+        if (!errorMessage.empty())
+            LOG(WARN) << errorPrefix << "Failed to execute '" << pragma << "' - '" << errorMessage << "'.";
+    }
+
+    if (sqlite3_busy_timeout(connection, static_cast<int>(storageProfile.busyTimeout.count())) != SQLITE_OK)
+        LOG(WARN) << errorPrefix << "Failed to set the busy timeout.";
+}
+
+void SQLiteDeviceRepository::openReadConnections(const std::string& connectionString,
+                                                 const SQLiteStorageProfile& storageProfile)
+{
+    const auto errorPrefix = "Failed to open the read-only connections - ";
+    if (storageProfile.readConnections == 0)
+        return;
+
+    // Without the write-ahead log, readers would be blocked by the writer anyway. An in-memory database is also
+    // private to the connection that created it, so the readers would not see any of the data.
+    if (m_journalMode != toString(SQLiteJournalMode::WAL))
+    {
+        LOG(WARN) << errorPrefix << "The database is not in 'WAL' journal mode. All the queries will be executed on "
+                  << "the writer connection.";
+        return;
     }
-    if (result.size() >= 2 && !result[1].empty())
+
+    std::lock_guard<std::mutex> lock{m_readConnectionsMutex};
+    for (auto i = std::uint32_t{0}; i < storageProfile.readConnections; ++i)
     {
-        try
-        {
-            millis = std::chrono::milliseconds{std::stoull(result[1].front())};
-        }
-        catch (const std::exception& exception)
+        sqlite3* connection = nullptr;
+        auto rc = sqlite3_open_v2(connectionString.c_str(), &connection,
+                                  SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+        if (rc != SQLITE_OK)
         {
-            LOG(ERROR) << errorPrefix << "Failed to convert string value into timestamp.";
-            return millis;
+            LOG(WARN) << errorPrefix << "Failed to open a read-only connection - '" << sqlite3_errmsg(connection)
+                      << "'.";
+            sqlite3_close(connection);
+            break;
         }
+        configureConnection(connection, storageProfile);
+        m_readConnections.emplace_back(connection);
+        m_idleReadConnections.emplace_back(connection);
     }
-    return millis;
+    LOG(DEBUG) << "Opened " << m_readConnections.size() << " read-only connection(s) to the Device Repository.";
 }
 
 bool SQLiteDeviceRepository::update(const std::vector<StoredDeviceInformation>& devices)
@@ -302,10 +625,15 @@ bool SQLiteDeviceRepository::update(const std::vector<StoredDeviceInformation>&
     }
     for (const auto& device : devices)
     {
-        // Create the device
-        errorMessage = executeSQLStatement("UPDATE Device SET BelongsTo = '" + toString(device.getDeviceBelongsTo()) +
-                                           "', Timestamp = " + std::to_string(device.getTimestamp().count()) +
-                                           " WHERE DeviceKey = '" + device.getDeviceKey() + "' LIMIT 1;");
+        // Update the device. An empty type or external ID keeps the one that is already stored.
+        errorMessage = executeSQLQuery(
+          m_db,
+          "UPDATE Device SET BelongsTo = ?, Timestamp = " + std::to_string(device.getTimestamp().count()) +
+            ", DeviceType = COALESCE(NULLIF(?, ''), DeviceType), ExternalId = COALESCE(NULLIF(?, ''), ExternalId) "
+            "WHERE DeviceKey = ?;",
+          {toString(device.getDeviceBelongsTo()), device.getDeviceType(), device.getExternalId(),
+           device.getDeviceKey()},
+          [](sqlite3_stmt*) { return false; });
         if (!errorMessage.empty())
         {
             executeSQLStatement("ROLLBACK;");
@@ -317,104 +645,208 @@ bool SQLiteDeviceRepository::update(const std::vector<StoredDeviceInformation>&
     return true;
 }
 
-StoredDeviceInformation SQLiteDeviceRepository::loadDeviceInformationFromRow(ColumnResult& result, std::uint64_t row)
+StoredDeviceInformation SQLiteDeviceRepository::loadDeviceInformationFromRow(sqlite3_stmt* statement)
 {
     const auto errorPrefix = "Failed to load device information - ";
 
-    const auto belongsTo = deviceOwnershipFromString(result[row][1]);
+    const auto belongsTo = deviceOwnershipFromString(readText(statement, 1));
     if (belongsTo == DeviceOwnership::None)
     {
         LOG(ERROR) << errorPrefix << "Device contains invalid 'BelongsTo' value.";
         return {};
     }
-    auto timestamp = std::chrono::milliseconds{};
-    try
+    if (sqlite3_column_type(statement, 2) != SQLITE_INTEGER)
     {
-        timestamp = std::chrono::milliseconds{std::stoull(result[row][2])};
+        LOG(ERROR) << errorPrefix << "Device 'Timestamp' value is not an integer.";
+        return {};
     }
-    catch (const std::exception&)
+    return {std::string{readText(statement, 0)}, belongsTo,
+            std::chrono::milliseconds{sqlite3_column_int64(statement, 2)}, std::string{readText(statement, 3)},
+            std::string{readText(statement, 4)}};
+}
+
+std::string SQLiteDeviceRepository::migrateDeviceTable()
+{
+    auto existingColumns = std::unordered_set<std::string>{};
+    auto errorMessage = executeSQLQuery(m_db, "PRAGMA table_info(Device);", {}, [&](sqlite3_stmt* statement) {
+        existingColumns.emplace(readText(statement, 1));
+        return true;
+    });
+    if (!errorMessage.empty())
+        return errorMessage;
+
+    for (const auto& column : ADDED_DEVICE_COLUMNS)
     {
-        LOG(ERROR) << errorPrefix << "Device 'Timestamp' value could not be parsed.";
-        return {};
+        if (existingColumns.find(column.first) != existingColumns.cend())
+            continue;
+        LOG(INFO) << "Adding the column '" << column.first << "' to the Device Repository.";
+        errorMessage = executeSQLStatement(column.second);
+        if (!errorMessage.empty())
+            return errorMessage;
     }
-    return {result[row][0], belongsTo, timestamp};
+    return {};
+}
+
+std::string SQLiteDeviceRepository::queryByKeys(const std::vector<std::string>& deviceKeys, const std::string& columns,
+                                                const RowVisitor& visitor)
+{
+    return withReadConnection([&](sqlite3* connection) {
+        // Fill the lookup table in a transaction that is always rolled back, which also leaves the table empty
+        auto errorMessage = executeSQLStatement(connection, CREATE_KEY_LOOKUP_TABLE + "BEGIN TRANSACTION;");
+        if (!errorMessage.empty())
+            return errorMessage;
+
+        sqlite3_stmt* statement;
+        if (sqlite3_prepare_v2(connection, INSERT_KEY_LOOKUP.c_str(), static_cast<int>(INSERT_KEY_LOOKUP.size()),
+                               &statement, nullptr) != SQLITE_OK)
+        {
+            errorMessage = sqlite3_errmsg(connection);
+            executeSQLStatement(connection, "ROLLBACK;");
+            return errorMessage;
+        }
+        for (const auto& deviceKey : deviceKeys)
+        {
+            sqlite3_bind_text(statement, 1, deviceKey.c_str(), static_cast<int>(deviceKey.size()), SQLITE_STATIC);
+            if (sqlite3_step(statement) != SQLITE_DONE)
+            {
+                errorMessage = sqlite3_errmsg(connection);
+                break;
+            }
+            sqlite3_reset(statement);
+        }
+        sqlite3_finalize(statement);
+
+        // And look up all the keys with a single join
+        if (errorMessage.empty())
+            errorMessage = executeSQLQuery(connection,
+                                           "SELECT " + columns +
+                                             " FROM temp.DeviceKeyLookup INNER JOIN Device ON Device.DeviceKey = "
+                                             "DeviceKeyLookup.DeviceKey;",
+                                           {}, visitor);
+        executeSQLStatement(connection, "ROLLBACK;");
+        return errorMessage;
+    });
 }
 
-std::string SQLiteDeviceRepository::executeSQLStatement(const std::string& sql, ColumnResult* result)
+std::string SQLiteDeviceRepository::executeSQLStatement(const std::string& sql)
+{
+    return executeSQLStatement(m_db, sql);
+}
+
+std::string SQLiteDeviceRepository::executeSQLStatement(sqlite3* connection, const std::string& sql)
 {
     const auto errorPrefix = "Failed to execute query - ";
 
     // Check if the database session is established
-    if (m_db == nullptr)
+    if (connection == nullptr)
     {
         auto errorMessage = "The database session is not established";
         LOG(ERROR) << errorPrefix << errorMessage;
         return errorMessage;
     }
 
-    // If the query does not need to have a result, execute it
-    if (result == nullptr)
+    auto errorMessage = std::string{};
+    char* errorMessageCStr;
+    auto rc = sqlite3_exec(connection, sql.c_str(), nullptr, nullptr, &errorMessageCStr);
+    if (rc != SQLITE_OK)
     {
-        auto errorMessage = std::string{};
-        char* errorMessageCStr;
-        auto rc = sqlite3_exec(m_db, sql.c_str(), nullptr, nullptr, &errorMessageCStr);
-        if (rc != SQLITE_OK)
+        LOG(ERROR) << errorPrefix << errorMessageCStr << "'.";
+        errorMessage = errorMessageCStr;
+        sqlite3_free(errorMessageCStr);
+    }
+    return errorMessage;
+}
+
+std::string SQLiteDeviceRepository::executeReadQuery(const std::string& sql, const std::vector<std::string>& parameters,
+                                                     const RowVisitor& visitor)
+{
+    return withReadConnection(
+      [&](sqlite3* connection) { return executeSQLQuery(connection, sql, parameters, visitor); });
+}
+
+std::string SQLiteDeviceRepository::withReadConnection(const std::function<std::string(sqlite3*)>& action)
+{
+    // If there are no read-only connections, the action has to wait for the writer connection
+    {
+        std::unique_lock<std::mutex> lock{m_readConnectionsMutex};
+        if (m_readConnections.empty())
         {
-            LOG(ERROR) << errorPrefix << errorMessageCStr << "'.";
-            errorMessage = errorMessageCStr;
-            sqlite3_free(errorMessageCStr);
+            lock.unlock();
+            std::lock_guard<std::recursive_mutex> writerLock{m_mutex};
+            return action(m_db);
         }
+    }
+
+    // Take one of the idle read-only connections, and give it back once the action is done
+    auto connection = static_cast<sqlite3*>(nullptr);
+    {
+        std::unique_lock<std::mutex> lock{m_readConnectionsMutex};
+        m_readConnectionsCondition.wait(lock, [&] { return !m_idleReadConnections.empty(); });
+        connection = m_idleReadConnections.back();
+        m_idleReadConnections.pop_back();
+    }
+    auto errorMessage = action(connection);
+    {
+        std::lock_guard<std::mutex> lock{m_readConnectionsMutex};
+        m_idleReadConnections.emplace_back(connection);
+    }
+    m_readConnectionsCondition.notify_all();
+    return errorMessage;
+}
+
+std::string SQLiteDeviceRepository::executeSQLQuery(sqlite3* connection, const std::string& sql,
+                                                    const std::vector<std::string>& parameters,
+                                                    const RowVisitor& visitor)
+{
+    const auto errorPrefix = "Failed to execute query - ";
+
+    // Check if the database session is established
+    if (connection == nullptr)
+    {
+        auto errorMessage = "The database session is not established";
+        LOG(ERROR) << errorPrefix << errorMessage;
         return errorMessage;
     }
 
-    // Execute the query
+    // Prepare the query
     sqlite3_stmt* statement;
-    auto rc = sqlite3_prepare_v2(m_db, sql.c_str(), -1, &statement, nullptr);
+    auto rc = sqlite3_prepare_v2(connection, sql.c_str(), static_cast<int>(sql.size()), &statement, nullptr);
     if (rc != SQLITE_OK)
     {
-        auto errorMessage = std::string(sqlite3_errmsg(m_db));
+        auto errorMessage = std::string(sqlite3_errmsg(connection));
         LOG(ERROR) << errorPrefix << errorMessage << "'.";
         return errorMessage;
     }
 
-    // Go through the rows
+    // Bind the parameters. The strings outlive the statement, so SQLite does not need to copy them.
+    for (auto i = std::size_t{0}; i < parameters.size(); ++i)
+    {
+        rc = sqlite3_bind_text(statement, static_cast<int>(i + 1), parameters[i].c_str(),
+                               static_cast<int>(parameters[i].size()), SQLITE_STATIC);
+        if (rc != SQLITE_OK)
+        {
+            auto errorMessage = std::string(sqlite3_errmsg(connection));
+            LOG(ERROR) << errorPrefix << errorMessage << "'.";
+            sqlite3_finalize(statement);
+            return errorMessage;
+        }
+    }
+
+    // Hand every row to the visitor as it is stepped over
     auto errorMessage = std::string{};
-    auto entry = std::uint64_t{1};
     while (true)
     {
-        // Check the next row
         rc = sqlite3_step(statement);
         if (rc == SQLITE_DONE)
             break;
         else if (rc != SQLITE_ROW)
         {
-            errorMessage = sqlite3_errmsg(m_db);
+            errorMessage = sqlite3_errmsg(connection);
             LOG(ERROR) << errorPrefix << errorMessage << "'.";
             break;
         }
-
-        // Get the number of columns
-        auto col = sqlite3_column_count(statement);
-
-        // Check if the first result is empty
-        if (result->find(0) == result->cend())
-        {
-            result->emplace(0, std::vector<std::string>{});
-            for (auto i = std::int32_t{0}; i < col; ++i)
-                (*result)[0].emplace_back(sqlite3_column_name(statement, i));
-        }
-
-        // Extract the data
-        if (result->find(entry) == result->cend())
-            result->emplace(entry, std::vector<std::string>{});
-        for (auto i = std::int32_t{0}; i < col; ++i)
-        {
-            auto string = reinterpret_cast<const char*>(sqlite3_column_text(statement, i));
-            if (string == nullptr)
-                string = "";
-            (*result)[entry].emplace_back(string);
-        }
-        ++entry;
+        if (!visitor(statement))
+            break;
     }
     sqlite3_finalize(statement);
     return errorMessage;
@@ -18,24 +18,29 @@
 #define DEVICEREPOSITORYIMPL_H
 
 #include "gateway/repository/device/DeviceRepository.h"
+#include "gateway/repository/device/SQLiteStorageProfile.h"
 
-#include <map>
+#include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
-// Forward declare the context structure for sqlite.
+// Forward declare the context structures for sqlite.
 struct sqlite3;
+struct sqlite3_stmt;
 
 namespace wolkabout::gateway
 {
-// This is the map in which results from an SQL query will be returned
-using ColumnResult = std::map<std::uint64_t, std::vector<std::string>>;
+// This is the function that is invoked for every row returned by an SQL query. Returning false stops the query.
+using RowVisitor = std::function<bool(sqlite3_stmt*)>;
 
 class SQLiteDeviceRepository : public DeviceRepository
 {
 public:
-    explicit SQLiteDeviceRepository(const std::string& connectionString = "deviceRepository.db");
+    explicit SQLiteDeviceRepository(const std::string& connectionString = "deviceRepository.db",
+                                    const SQLiteStorageProfile& storageProfile = SQLiteStorageProfile::defaults());
 
     ~SQLiteDeviceRepository() override;
 
@@ -47,21 +52,61 @@ public:
 
     bool containsDevice(const std::string& deviceKey) override;
 
+    std::unordered_set<std::string> containsDevices(const std::vector<std::string>& deviceKeys) override;
+
     StoredDeviceInformation get(const std::string& deviceKey) override;
 
+    std::vector<StoredDeviceInformation> getMany(const std::vector<std::string>& deviceKeys) override;
+
     std::vector<StoredDeviceInformation> getGatewayDevices() override;
 
+    bool forEachGatewayDevice(const DevicePageVisitor& visitor,
+                              std::size_t pageSize = DEFAULT_DEVICE_PAGE_SIZE) override;
+
+    std::vector<StoredDeviceInformation> findDevices(std::chrono::milliseconds timestampFrom,
+                                                     const std::string& deviceType,
+                                                     const std::string& externalId) override;
+
     std::chrono::milliseconds latestPlatformTimestamp() override;
 
 private:
+    void applyStorageProfile(const SQLiteStorageProfile& storageProfile);
+
+    void configureConnection(sqlite3* connection, const SQLiteStorageProfile& storageProfile);
+
+    void openReadConnections(const std::string& connectionString, const SQLiteStorageProfile& storageProfile);
+
     bool update(const std::vector<StoredDeviceInformation>& devices);
 
-    StoredDeviceInformation loadDeviceInformationFromRow(ColumnResult& result, std::uint64_t row);
+    std::string migrateDeviceTable();
 
-    std::string executeSQLStatement(const std::string& sqlStatement, ColumnResult* result = nullptr);
+    StoredDeviceInformation loadDeviceInformationFromRow(sqlite3_stmt* statement);
 
+    std::string queryByKeys(const std::vector<std::string>& deviceKeys, const std::string& columns,
+                            const RowVisitor& visitor);
+
+    std::string executeSQLStatement(const std::string& sqlStatement);
+
+    std::string executeSQLStatement(sqlite3* connection, const std::string& sqlStatement);
+
+    std::string executeReadQuery(const std::string& sqlQuery, const std::vector<std::string>& parameters,
+                                 const RowVisitor& visitor);
+
+    std::string withReadConnection(const std::function<std::string(sqlite3*)>& action);
+
+    std::string executeSQLQuery(sqlite3* connection, const std::string& sqlQuery,
+                                const std::vector<std::string>& parameters, const RowVisitor& visitor);
+
+    // The writer connection, and the mutex that serializes everything done on it
     std::recursive_mutex m_mutex;
     sqlite3* m_db;
+    std::string m_journalMode;
+
+    // The read-only connections used for lookups, so they are not blocked while the writer is busy
+    std::mutex m_readConnectionsMutex;
+    std::condition_variable m_readConnectionsCondition;
+    std::vector<sqlite3*> m_readConnections;
+    std::vector<sqlite3*> m_idleReadConnections;
 };
 }    // namespace wolkabout::gateway
 
@@ -0,0 +1,75 @@
+/**
+ * Copyright 2022 Wolkabout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/repository/device/SQLiteStorageProfile.h"
+
+namespace wolkabout::gateway
+{
+std::string toString(SQLiteJournalMode journalMode)
+{
+    switch (journalMode)
+    {
+    case SQLiteJournalMode::Delete:
+        return "DELETE";
+    case SQLiteJournalMode::Truncate:
+        return "TRUNCATE";
+    case SQLiteJournalMode::Persist:
+        return "PERSIST";
+    case SQLiteJournalMode::Memory:
+        return "MEMORY";
+    case SQLiteJournalMode::WAL:
+        return "WAL";
+    case SQLiteJournalMode::Off:
+        return "OFF";
+    default:
+        return {};
+    }
+}
+
+std::string toString(SQLiteSynchronous synchronous)
+{
+    switch (synchronous)
+    {
+    case SQLiteSynchronous::Off:
+        return "OFF";
+    case SQLiteSynchronous::Normal:
+        return "NORMAL";
+    case SQLiteSynchronous::Full:
+        return "FULL";
+    case SQLiteSynchronous::Extra:
+        return "EXTRA";
+    default:
+        return {};
+    }
+}
+
+SQLiteStorageProfile SQLiteStorageProfile::defaults()
+{
+    return SQLiteStorageProfile{};
+}
+
+SQLiteStorageProfile SQLiteStorageProfile::flash()
+{
+    auto profile = SQLiteStorageProfile{};
+    profile.journalMode = SQLiteJournalMode::WAL;
+    profile.synchronous = SQLiteSynchronous::Normal;
+    profile.mmapSize = 16 * 1024 * 1024;
+    profile.cacheSize = -4096;
+    profile.busyTimeout = std::chrono::milliseconds{5000};
+    profile.readConnections = 2;
+    return profile;
+}
+}    // namespace wolkabout::gateway
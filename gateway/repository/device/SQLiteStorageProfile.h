@@ -0,0 +1,106 @@
+/**
+ * Copyright 2022 Wolkabout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_SQLITESTORAGEPROFILE_H
+#define WOLKGATEWAY_SQLITESTORAGEPROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace wolkabout::gateway
+{
+// This enum describes the journal mode in which the SQLite database will be operated.
+enum class SQLiteJournalMode
+{
+    Delete,
+    Truncate,
+    Persist,
+    Memory,
+    WAL,
+    Off
+};
+
+// This enum describes how often SQLite will sync the data to the storage medium.
+enum class SQLiteSynchronous
+{
+    Off,
+    Normal,
+    Full,
+    Extra
+};
+
+/**
+ * This is a utility method that is used to convert the enumeration value into a string accepted by `PRAGMA
+ * journal_mode`.
+ *
+ * @param journalMode The SQLiteJournalMode value.
+ * @return The string representation of the value.
+ */
+std::string toString(SQLiteJournalMode journalMode);
+
+/**
+ * This is a utility method that is used to convert the enumeration value into a string accepted by `PRAGMA
+ * synchronous`.
+ *
+ * @param synchronous The SQLiteSynchronous value.
+ * @return The string representation of the value.
+ */
+std::string toString(SQLiteSynchronous synchronous);
+
+/**
+ * This struct describes the durability and performance profile with which the SQLite device repository will operate.
+ */
+struct SQLiteStorageProfile
+{
+public:
+    /**
+     * This profile leaves SQLite on its defaults - rollback journal and full synchronization on every commit.
+     *
+     * @return The profile that keeps the SQLite default behaviour.
+     */
+    static SQLiteStorageProfile defaults();
+
+    /**
+     * This profile is meant for gateways running on flash storage (SD cards, eMMC). It uses the write-ahead log and
+     * syncs only on checkpoints, which removes most of the fsyncs a commit would cause. A power loss might roll back
+     * the last few transactions, but will never corrupt the database.
+     *
+     * @return The profile tuned for flash storage.
+     */
+    static SQLiteStorageProfile flash();
+
+    // The journal mode of the database
+    SQLiteJournalMode journalMode = SQLiteJournalMode::Delete;
+
+    // The synchronization level of the database
+    SQLiteSynchronous synchronous = SQLiteSynchronous::Full;
+
+    // The amount of bytes of the database file that can be memory mapped (0 disables memory mapping)
+    std::uint64_t mmapSize = 0;
+
+    // The page cache size. Positive values are the number of pages, negative are the size in kibibytes
+    std::int64_t cacheSize = -2000;
+
+    // How long will a connection wait on a locked database before giving up (0 means fail right away)
+    std::chrono::milliseconds busyTimeout{0};
+
+    // The number of read-only connections used for lookups next to the writer connection (requires the WAL journal)
+    std::uint32_t readConnections = 0;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_SQLITESTORAGEPROFILE_H
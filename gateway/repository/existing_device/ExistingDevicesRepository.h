@@ -29,6 +29,10 @@ public:
 
     virtual void addDeviceKey(const std::string& deviceKey) = 0;
 
+    virtual void addDeviceKeys(const std::vector<std::string>& deviceKeys) = 0;
+
+    virtual void removeDeviceKeys(const std::vector<std::string>& deviceKeys) = 0;
+
     virtual std::vector<std::string> getDeviceKeys() = 0;
 };
 }    // namespace wolkabout::gateway
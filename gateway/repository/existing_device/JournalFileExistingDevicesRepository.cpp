@@ -0,0 +1,191 @@
+/**
+ * Copyright 2022 Wolkabout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/repository/existing_device/JournalFileExistingDevicesRepository.h"
+
+#include "core/utility/Logger.h"
+
+#include <cstdio>
+#include <utility>
+
+using namespace wolkabout::legacy;
+
+namespace wolkabout::gateway
+{
+namespace
+{
+// Keys are stored one per line, so a key containing a line break could not be read back
+bool isValidKey(const std::string& deviceKey)
+{
+    return !deviceKey.empty() && deviceKey.find('\n') == std::string::npos;
+}
+}    // namespace
+
+JournalFileExistingDevicesRepository::JournalFileExistingDevicesRepository(std::string file,
+                                                                           std::uint64_t compactionThreshold)
+: m_file{std::move(file)}, m_compactionThreshold{compactionThreshold}, m_journalEntries{0}
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    const auto complete = readFromFile();
+    m_journal.open(m_file, std::ios::out | std::ios::app);
+    if (!m_journal.is_open())
+        LOG(ERROR) << "Failed to open " << m_file;
+
+    // An incomplete entry must not be left at the end, or the next entry would be appended to it
+    if (!complete)
+        compact();
+    else
+        compactIfNeeded();
+}
+
+void JournalFileExistingDevicesRepository::addDeviceKey(const std::string& deviceKey)
+{
+    addDeviceKeys({deviceKey});
+}
+
+void JournalFileExistingDevicesRepository::addDeviceKeys(const std::vector<std::string>& deviceKeys)
+{
+    LOG(DEBUG) << METHOD_INFO << " " << deviceKeys.size();
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto entries = std::string{};
+    auto entryCount = std::uint64_t{0};
+    for (const auto& deviceKey : deviceKeys)
+    {
+        if (!isValidKey(deviceKey))
+        {
+            LOG(ERROR) << "Refusing to store the invalid device key '" << deviceKey << "'.";
+            continue;
+        }
+        if (m_deviceKeys.emplace(deviceKey).second)
+        {
+            entries += '+' + deviceKey + '\n';
+            ++entryCount;
+        }
+    }
+    appendToFile(entries, entryCount);
+}
+
+void JournalFileExistingDevicesRepository::removeDeviceKeys(const std::vector<std::string>& deviceKeys)
+{
+    LOG(DEBUG) << METHOD_INFO << " " << deviceKeys.size();
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto entries = std::string{};
+    auto entryCount = std::uint64_t{0};
+    for (const auto& deviceKey : deviceKeys)
+    {
+        if (m_deviceKeys.erase(deviceKey) > 0)
+        {
+            entries += '-' + deviceKey + '\n';
+            ++entryCount;
+        }
+    }
+    appendToFile(entries, entryCount);
+}
+
+std::vector<std::string> JournalFileExistingDevicesRepository::getDeviceKeys()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return {m_deviceKeys.cbegin(), m_deviceKeys.cend()};
+}
+
+bool JournalFileExistingDevicesRepository::readFromFile()
+{
+    LOG(DEBUG) << METHOD_INFO;
+
+    auto journal = std::ifstream{m_file};
+    if (!journal.is_open())
+        return true;
+
+    // A line without the line break at the end was cut off while being written, and is not applied
+    auto line = std::string{};
+    while (std::getline(journal, line))
+    {
+        if (journal.eof())
+        {
+            LOG(WARN) << "Ignoring the incomplete last entry of " << m_file;
+            return false;
+        }
+        if (line.size() < 2)
+            continue;
+        if (line.front() == '+')
+            m_deviceKeys.emplace(line.substr(1));
+        else if (line.front() == '-')
+            m_deviceKeys.erase(line.substr(1));
+        else
+            continue;
+        ++m_journalEntries;
+    }
+    return true;
+}
+
+void JournalFileExistingDevicesRepository::appendToFile(const std::string& entries, std::uint64_t entryCount)
+{
+    if (entryCount == 0)
+        return;
+
+    m_journal << entries;
+    m_journal.flush();
+    if (!m_journal.good())
+    {
+        LOG(ERROR) << "Failed to save " << m_file;
+        m_journal.clear();
+        return;
+    }
+    m_journalEntries += entryCount;
+    compactIfNeeded();
+}
+
+void JournalFileExistingDevicesRepository::compactIfNeeded()
+{
+    if (m_journalEntries > m_compactionThreshold && m_journalEntries > 2 * m_deviceKeys.size())
+        compact();
+}
+
+void JournalFileExistingDevicesRepository::compact()
+{
+    LOG(DEBUG) << METHOD_INFO << " " << m_journalEntries << " -> " << m_deviceKeys.size();
+
+    // Write the current keys into a temporary file, and replace the journal with it only once it is complete
+    const auto temporaryFile = m_file + ".tmp";
+    {
+        auto compacted = std::ofstream{temporaryFile, std::ios::out | std::ios::trunc};
+        for (const auto& deviceKey : m_deviceKeys)
+            compacted << '+' << deviceKey << '\n';
+        compacted.flush();
+        if (!compacted.good())
+        {
+            LOG(ERROR) << "Failed to compact " << m_file;
+            std::remove(temporaryFile.c_str());
+            return;
+        }
+    }
+    m_journal.close();
+    if (std::rename(temporaryFile.c_str(), m_file.c_str()) != 0)
+    {
+        LOG(ERROR) << "Failed to replace " << m_file << " with the compacted journal";
+        std::remove(temporaryFile.c_str());
+    }
+    else
+    {
+        m_journalEntries = m_deviceKeys.size();
+    }
+    m_journal.open(m_file, std::ios::out | std::ios::app);
+    if (!m_journal.is_open())
+        LOG(ERROR) << "Failed to open " << m_file;
+}
+}    // namespace wolkabout::gateway
@@ -0,0 +1,77 @@
+/**
+ * Copyright 2022 Wolkabout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_JOURNALFILEEXISTINGDEVICESREPOSITORY_H
+#define WOLKGATEWAY_JOURNALFILEEXISTINGDEVICESREPOSITORY_H
+
+#include "gateway/repository/existing_device/ExistingDevicesRepository.h"
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace wolkabout::gateway
+{
+/**
+ * This is an existing devices repository that keeps the keys in a hashed set, and persists every change by appending
+ * a line to a journal file (`+key` for added, `-key` for removed keys). Once the journal grows far beyond the number
+ * of keys, it is compacted by writing the current keys into a temporary file, which is then renamed over the journal.
+ */
+class JournalFileExistingDevicesRepository : public ExistingDevicesRepository
+{
+public:
+    /**
+     * Default parameter constructor. Replays the journal if one exists.
+     *
+     * @param file The path of the journal file.
+     * @param compactionThreshold The minimal number of journal entries before the journal is considered for
+     * compaction. The journal is compacted once it holds more than this, and more than twice the number of keys.
+     */
+    explicit JournalFileExistingDevicesRepository(std::string file = "existingDevices.journal",
+                                                  std::uint64_t compactionThreshold = 1024);
+
+    void addDeviceKey(const std::string& deviceKey) override;
+
+    void addDeviceKeys(const std::vector<std::string>& deviceKeys) override;
+
+    void removeDeviceKeys(const std::vector<std::string>& deviceKeys) override;
+
+    std::vector<std::string> getDeviceKeys() override;
+
+private:
+    bool readFromFile();
+
+    void appendToFile(const std::string& entries, std::uint64_t entryCount);
+
+    void compactIfNeeded();
+
+    void compact();
+
+    std::mutex m_mutex;
+    const std::string m_file;
+    const std::uint64_t m_compactionThreshold;
+    std::unordered_set<std::string> m_deviceKeys;
+
+    // The journal file, kept open for appending, and the number of entries in it
+    std::ofstream m_journal;
+    std::uint64_t m_journalEntries;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_JOURNALFILEEXISTINGDEVICESREPOSITORY_H
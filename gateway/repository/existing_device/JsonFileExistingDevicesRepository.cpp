@@ -20,8 +20,10 @@
 #include "core/utility/Logger.h"
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
 #include <mutex>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -48,6 +50,40 @@ void JsonFileExistingDevicesRepository::addDeviceKey(const std::string& deviceKe
     saveToFile();
 }
 
+void JsonFileExistingDevicesRepository::addDeviceKeys(const std::vector<std::string>& deviceKeys)
+{
+    LOG(DEBUG) << METHOD_INFO << " " << deviceKeys.size();
+
+    auto presentKeys = std::unordered_set<std::string>{m_deviceKeys.cbegin(), m_deviceKeys.cend()};
+    auto added = false;
+    for (const auto& deviceKey : deviceKeys)
+    {
+        if (presentKeys.emplace(deviceKey).second)
+        {
+            m_deviceKeys.push_back(deviceKey);
+            added = true;
+        }
+    }
+
+    if (added)
+        saveToFile();
+}
+
+void JsonFileExistingDevicesRepository::removeDeviceKeys(const std::vector<std::string>& deviceKeys)
+{
+    LOG(DEBUG) << METHOD_INFO << " " << deviceKeys.size();
+
+    const auto keysToRemove = std::unordered_set<std::string>{deviceKeys.cbegin(), deviceKeys.cend()};
+    const auto it = std::remove_if(m_deviceKeys.begin(), m_deviceKeys.end(), [&](const std::string& deviceKey) {
+        return keysToRemove.find(deviceKey) != keysToRemove.cend();
+    });
+    if (it == m_deviceKeys.end())
+        return;
+
+    m_deviceKeys.erase(it, m_deviceKeys.end());
+    saveToFile();
+}
+
 std::vector<std::string> JsonFileExistingDevicesRepository::getDeviceKeys()
 {
     return m_deviceKeys;
@@ -34,6 +34,10 @@ public:
 
     void addDeviceKey(const std::string& deviceKey) override;
 
+    void addDeviceKeys(const std::vector<std::string>& deviceKeys) override;
+
+    void removeDeviceKeys(const std::vector<std::string>& deviceKeys) override;
+
     std::vector<std::string> getDeviceKeys() override;
 
 private:
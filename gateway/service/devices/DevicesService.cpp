@@ -24,13 +24,14 @@
 #include "core/protocol/GatewayRegistrationProtocol.h"
 #include "core/protocol/RegistrationProtocol.h"
 #include "core/utility/Logger.h"
-#include "gateway/repository/device/DeviceRepository.h"
+#include "gateway/repository/device/AsyncDeviceRepository.h"
 #include "gateway/repository/existing_device/ExistingDevicesRepository.h"
 
 #include <algorithm>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -40,6 +41,11 @@ namespace
 {
 const std::uint16_t RETRY_COUNT = 3;
 const std::chrono::milliseconds RETRY_TIMEOUT{5000};
+
+// Requests are normally resolved by the response or the failed retries, this only cleans up the ones that never are
+const std::chrono::milliseconds REQUEST_TIME_TO_LIVE{60000};
+const std::size_t REQUEST_TABLE_CAPACITY = 1024;
+const std::chrono::milliseconds REQUEST_EXPIRY_INTERVAL{1000};
 }    // namespace
 
 namespace wolkabout::gateway
@@ -120,19 +126,61 @@ DevicesService::DevicesService(std::string gatewayKey, RegistrationProtocol& pla
                                std::shared_ptr<GatewayRegistrationProtocol> localRegistrationProtocol,
                                std::shared_ptr<OutboundMessageHandler> outboundDeviceMessageHandler,
                                std::shared_ptr<DeviceRepository> deviceRepository,
-                               std::shared_ptr<ExistingDevicesRepository> existingDevicesRepository)
+                               std::shared_ptr<ExistingDevicesRepository> existingDevicesRepository,
+                               std::shared_ptr<GatewayExecutor> executor)
 : m_gatewayKey{std::move(gatewayKey)}
 , m_platformProtocol{platformRegistrationProtocol}
 , m_outboundPlatformMessageHandler{outboundPlatformMessageHandler}
 , m_outboundPlatformRetryMessageHandler{outboundPlatformRetryMessageHandler}
 , m_localProtocol{std::move(localRegistrationProtocol)}
 , m_outboundLocalMessageHandler{std::move(outboundDeviceMessageHandler)}
-, m_deviceRepository{std::move(deviceRepository)}
+, m_deviceRepository{std::dynamic_pointer_cast<AsyncDeviceRepository>(deviceRepository)}
 , m_existingDeviceRepository{std::move(existingDevicesRepository)}
+, m_queue{executor, "devices"}
+, m_childSyncRequestId{0}
+, m_childSyncRequests{REQUEST_TIME_TO_LIVE, REQUEST_TABLE_CAPACITY,
+                      [this](const std::uint64_t&,
+                             const std::shared_ptr<ChildrenSynchronizationRequestCallback>& callback) {
+                          LOG(WARN) << TAG << "A 'ChildrenSynchronizationRequest' expired without a response.";
+                          if (callback->getLambda())
+                              m_queue.push([callback] { callback->getLambda()(nullptr); });
+                      }}
+, m_registeredDevicesRequests{REQUEST_TIME_TO_LIVE, REQUEST_TABLE_CAPACITY,
+                              [this](const RegisteredDevicesRequestParameters&,
+                                     const std::shared_ptr<RegisteredDevicesRequestCallback>& callback) {
+                                  LOG(WARN) << TAG << "A 'RegisteredDevicesRequest' expired without a response.";
+                                  if (callback->getLambda())
+                                      m_queue.push([callback] { callback->getLambda()(nullptr); });
+                              }}
+, m_registrationBatchWindow{0}
+, m_registrationBatchSize{0}
+, m_registrationBatchWindowId{0}
+, m_stopped{false}
+, m_registeredDevicesStalenessBound{0}
+, m_storedDevicesSyncTime{0}
+, m_storedDevicesFromStart{false}
 {
+    if (m_deviceRepository == nullptr && deviceRepository != nullptr)
+        m_deviceRepository = std::make_shared<AsyncDeviceRepository>(std::move(deviceRepository), std::move(executor));
+    scheduleRequestExpiry();
 }
 
-DevicesService::~DevicesService() = default;
+DevicesService::~DevicesService()
+{
+    // The timers that are waiting are cancelled, and no new ones are scheduled
+    {
+        std::lock_guard<std::mutex> lock{m_registrationBatchMutex};
+        m_stopped = true;
+        m_queue.cancelScheduled();
+    }
+
+    // A batch whose window has just closed is sent out before the members it uses are gone
+    m_queue.execute([] {});
+
+    // The queued saves might still want to push callbacks into the command buffer
+    if (m_deviceRepository != nullptr)
+        m_deviceRepository->flush();
+}
 
 bool DevicesService::registerChildDevices(
   const std::vector<DeviceRegistrationData>& devices,
@@ -158,6 +206,105 @@ bool DevicesService::registerChildDevices(
         deviceKeys.emplace_back(device.key);
     }
 
+    // Queue the registration into the current batch, unless batching is disabled. The window is scheduled under the
+    // lock, and sends the batch out on the queue once it closes.
+    auto registration = PendingChildRegistration{std::move(deviceKeys), callback};
+    auto batched = false;
+    auto sendOutBatch = false;
+    {
+        std::lock_guard<std::mutex> lock{m_registrationBatchMutex};
+        batched = m_registrationBatchWindow.count() > 0;
+        if (batched)
+        {
+            const auto startWindow = m_batchedRegistrations.empty();
+            m_batchedDevices.insert(m_batchedDevices.end(), devices.cbegin(), devices.cend());
+            m_batchedRegistrations.emplace_back(std::move(registration));
+            sendOutBatch = m_registrationBatchSize > 0 && m_batchedDevices.size() >= m_registrationBatchSize;
+            if (sendOutBatch)
+            {
+                ++m_registrationBatchWindowId;
+            }
+            else if (startWindow && !m_stopped)
+            {
+                const auto windowId = ++m_registrationBatchWindowId;
+                m_queue.schedule(m_registrationBatchWindow, [this, windowId] {
+                    {
+                        std::lock_guard<std::mutex> lock{m_registrationBatchMutex};
+                        if (windowId != m_registrationBatchWindowId)
+                            return;
+                    }
+                    sendOutChildRegistrationBatch();
+                });
+            }
+        }
+    }
+    if (!batched)
+        return sendOutChildRegistration(devices, {std::move(registration)});
+    if (sendOutBatch)
+        sendOutChildRegistrationBatch();
+    return true;
+}
+
+void DevicesService::setRegistrationBatching(std::chrono::milliseconds window, std::size_t maxBatchSize)
+{
+    LOG(TRACE) << METHOD_INFO;
+
+    {
+        std::lock_guard<std::mutex> lock{m_registrationBatchMutex};
+        m_registrationBatchWindow = window;
+        m_registrationBatchSize = maxBatchSize;
+        if (window.count() == 0)
+            ++m_registrationBatchWindowId;
+    }
+
+    // Anything that is still waiting should not wait for a window that no longer exists
+    if (window.count() == 0)
+        sendOutChildRegistrationBatch();
+}
+
+void DevicesService::setRegisteredDevicesStalenessBound(std::chrono::milliseconds stalenessBound)
+{
+    std::lock_guard<std::mutex> lock{m_storedDevicesMutex};
+    m_registeredDevicesStalenessBound = stalenessBound;
+}
+
+RequestTableStatistics DevicesService::getChildrenSynchronizationRequestStatistics() const
+{
+    return m_childSyncRequests.getStatistics();
+}
+
+RequestTableStatistics DevicesService::getRegisteredDevicesRequestStatistics() const
+{
+    return m_registeredDevicesRequests.getStatistics();
+}
+
+bool DevicesService::drain(std::chrono::milliseconds timeout)
+{
+    LOG(TRACE) << METHOD_INFO;
+
+    // The batch is not left waiting for its window to close
+    {
+        std::lock_guard<std::mutex> lock{m_registrationBatchMutex};
+        ++m_registrationBatchWindowId;
+    }
+    sendOutChildRegistrationBatch();
+
+    // The changes to the devices made while handling the messages must also reach the repository
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    if (!m_queue.drain(timeout))
+        return false;
+    if (m_deviceRepository != nullptr)
+        return m_deviceRepository->flush(std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::max(deadline - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero())));
+    return true;
+}
+
+bool DevicesService::sendOutChildRegistration(const std::vector<DeviceRegistrationData>& devices,
+                                              std::vector<PendingChildRegistration> registrations)
+{
+    LOG(TRACE) << METHOD_INFO;
+    const auto errorPrefix = "Failed to register child devices -> ";
+
     // Form the message for the registration
     const auto parsedMessage = std::shared_ptr<Message>{
       m_platformProtocol.makeOutboundMessage(m_gatewayKey, DeviceRegistrationMessage{devices})};
@@ -171,28 +318,84 @@ bool DevicesService::registerChildDevices(
     m_outboundPlatformMessageHandler.addMessage(parsedMessage);
 
     // Now that that's publish, we want to verify that with the ChildrenSynchronizationMessage
+    auto deviceKeys = std::vector<std::string>{};
+    for (const auto& device : devices)
+        deviceKeys.emplace_back(device.key);
     sendOutChildrenSynchronizationRequest(std::make_shared<ChildrenSynchronizationRequestCallback>(
-      [=](const std::shared_ptr<ChildrenSynchronizationResponseMessage>& response) {
-          // Contains all devices
-          auto succeeded = std::vector<std::string>{};
-          auto failed = std::vector<std::string>{};
-
-          // Check the devices
-          const auto& children = response != nullptr ? response->getChildren() : std::vector<std::string>{};
-          for (const auto& device : deviceKeys)
+      [registrations](const std::shared_ptr<ChildrenSynchronizationResponseMessage>& response) {
+          // A single response resolves every registration in the batch
+          auto children = std::unordered_set<std::string>{};
+          if (response != nullptr)
+              children.insert(response->getChildren().cbegin(), response->getChildren().cend());
+          for (const auto& registration : registrations)
           {
-              const auto it = std::find(children.cbegin(), children.cend(), device);
-              if (it != children.cend())
-                  succeeded.emplace_back(device);
-              else
-                  failed.emplace_back(device);
+              auto succeeded = std::vector<std::string>{};
+              auto failed = std::vector<std::string>{};
+              for (const auto& device : registration.deviceKeys)
+              {
+                  if (children.find(device) != children.cend())
+                      succeeded.emplace_back(device);
+                  else
+                      failed.emplace_back(device);
+              }
+              if (registration.callback)
+                  registration.callback(succeeded, failed);
           }
-          callback(succeeded, failed);
       },
       deviceKeys));
     return true;
 }
 
+void DevicesService::scheduleRequestExpiry()
+{
+    std::lock_guard<std::mutex> lock{m_registrationBatchMutex};
+    if (m_stopped)
+        return;
+    m_queue.schedule(REQUEST_EXPIRY_INTERVAL, [this] {
+        m_childSyncRequests.expire();
+        m_registeredDevicesRequests.expire();
+        scheduleRequestExpiry();
+    });
+}
+
+void DevicesService::sendOutChildRegistrationBatch()
+{
+    LOG(TRACE) << METHOD_INFO;
+
+    auto devices = std::vector<DeviceRegistrationData>{};
+    auto registrations = std::vector<PendingChildRegistration>{};
+    {
+        std::lock_guard<std::mutex> lock{m_registrationBatchMutex};
+        std::swap(devices, m_batchedDevices);
+        std::swap(registrations, m_batchedRegistrations);
+    }
+    if (registrations.empty())
+        return;
+
+    // A device registered more than once in the batch is sent out only with its latest information
+    auto positions = std::unordered_map<std::string, std::size_t>{};
+    auto uniqueDevices = std::vector<DeviceRegistrationData>{};
+    for (auto& device : devices)
+    {
+        const auto it = positions.find(device.key);
+        if (it != positions.cend())
+        {
+            uniqueDevices[it->second] = std::move(device);
+            continue;
+        }
+        positions.emplace(device.key, uniqueDevices.size());
+        uniqueDevices.emplace_back(std::move(device));
+    }
+    LOG(DEBUG) << TAG << "Sending out a batch of " << registrations.size() << " registration(s) with "
+               << uniqueDevices.size() << " device(s).";
+
+    // The callers have already been told the registration was accepted, so they have to be told it failed
+    if (!sendOutChildRegistration(uniqueDevices, registrations))
+        for (const auto& registration : registrations)
+            if (registration.callback)
+                registration.callback({}, registration.deviceKeys);
+}
+
 bool DevicesService::removeChildDevices(const std::vector<std::string>& deviceKeys)
 {
     LOG(TRACE) << METHOD_INFO;
@@ -236,32 +439,40 @@ void DevicesService::updateDeviceCache()
         return;
     }
     // If we have an existing device repository, we want to check whether the user wants any devices deleted.
+    // The existing devices are read on the queue of the service, the gateway devices are visited on the repository
+    // queue, and the ones to delete are removed once all are visited.
     if (m_existingDeviceRepository != nullptr)
     {
-        const auto gatewayDevices = m_deviceRepository->getGatewayDevices();
-        const auto keys = m_existingDeviceRepository->getDeviceKeys();
-        auto toDelete = std::vector<std::string>{};
-        for (const auto& gatewayDevice : gatewayDevices)
-        {
-            const auto it = std::find(keys.cbegin(), keys.cend(), gatewayDevice.getDeviceKey());
-            if (it == keys.cend())
-                toDelete.emplace_back(gatewayDevice.getDeviceKey());
-        }
-        if (!toDelete.empty())
-        {
-            if (removeChildDevices(toDelete))
-                m_deviceRepository->remove(toDelete);
-            else
-                LOG(ERROR) << "Failed to send out a 'DeviceRemoval' request to remove devices deleted from "
-                              "'ExistingDeviceRepository'.";
-        }
+        m_queue.push([this] {
+            const auto keys = m_existingDeviceRepository->getDeviceKeys();
+            const auto existingKeys = std::make_shared<std::unordered_set<std::string>>(keys.cbegin(), keys.cend());
+            const auto toDelete = std::make_shared<std::vector<std::string>>();
+            m_deviceRepository->forEachGatewayDeviceAsync(
+              [existingKeys, toDelete](const std::vector<StoredDeviceInformation>& gatewayDevices) {
+                  for (const auto& gatewayDevice : gatewayDevices)
+                      if (existingKeys->find(gatewayDevice.getDeviceKey()) == existingKeys->cend())
+                          toDelete->emplace_back(gatewayDevice.getDeviceKey());
+                  return true;
+              },
+              DEFAULT_DEVICE_PAGE_SIZE,
+              [this, toDelete](bool) {
+                  if (toDelete->empty())
+                      return;
+                  if (removeChildDevices(*toDelete))
+                      m_deviceRepository->removeAsync(*toDelete);
+                  else
+                      LOG(ERROR) << "Failed to send out a 'DeviceRemoval' request to remove devices deleted from "
+                                    "'ExistingDeviceRepository'.";
+              });
+        });
     }
 
     // Obtain the last timestamp and send out a request
-    auto lastTimestamp = m_deviceRepository->latestPlatformTimestamp();
-    LOG(DEBUG) << TAG << "Obtaining devices from timestamp " << lastTimestamp.count() << ".";
-    sendOutRegisteredDevicesRequest(RegisteredDevicesRequestParameters{lastTimestamp}, {});
-    sendOutChildrenSynchronizationRequest({});
+    m_deviceRepository->latestPlatformTimestampAsync([this](const std::chrono::milliseconds& lastTimestamp) {
+        LOG(DEBUG) << TAG << "Obtaining devices from timestamp " << lastTimestamp.count() << ".";
+        sendOutRegisteredDevicesRequest(RegisteredDevicesRequestParameters{lastTimestamp}, {});
+        sendOutChildrenSynchronizationRequest({});
+    });
 }
 
 bool DevicesService::sendOutChildrenSynchronizationRequest(
@@ -278,32 +489,32 @@ bool DevicesService::sendOutChildrenSynchronizationRequest(
         LOG(ERROR) << errorPrefix << "Failed to parse the outbound message.";
         return false;
     }
+
+    // The request is stored before it is sent out, so the response can not arrive before it
+    const auto requestId = ++m_childSyncRequestId;
+    if (callback != nullptr)
+        m_childSyncRequests.add(requestId, std::move(callback));
     m_outboundPlatformRetryMessageHandler.addMessage(RetryMessageStruct{
       parsedMessage,
       m_platformProtocol.getResponseChannelForMessage(MessageType::CHILDREN_SYNCHRONIZATION_REQUEST, m_gatewayKey),
-      [=](const std::shared_ptr<Message>&) {
+      [this, requestId](const std::shared_ptr<Message>&) {
           LOG(ERROR)
             << TAG
             << "Failed to receive response for 'ChildrenSynchronizationRequestMessage' - no response from platform.";
-          // Check the callback
-          if (callback != nullptr)
+          // The request might have already been resolved by a response to another one
+          for (const auto& pendingCallback : m_childSyncRequests.takeFailed(requestId))
           {
-              if (!callback->getRegisteringDevices().empty())
+              if (!pendingCallback->getRegisteringDevices().empty())
               {
                   LOG(ERROR) << "Failed to register devices: ";
-                  for (const auto& device : callback->getRegisteringDevices())
+                  for (const auto& device : pendingCallback->getRegisteringDevices())
                       LOG(ERROR) << "\t" << device;
               }
-              if (callback->getLambda())
-                  callback->getLambda()(nullptr);
+              if (pendingCallback->getLambda())
+                  pendingCallback->getLambda()(nullptr);
           }
       },
       RETRY_COUNT, RETRY_TIMEOUT});
-    if (callback != nullptr)
-    {
-        std::lock_guard<std::mutex> lock{m_childSyncMutex};
-        m_childSyncRequests.push(std::move(callback));
-    }
     return true;
 }
 
@@ -325,23 +536,26 @@ bool DevicesService::sendOutRegisteredDevicesRequest(RegisteredDevicesRequestPar
         return false;
     }
 
-    // Send it out
-    auto sendTime =
-      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+    // The request is stored before it is sent out, so the response can not arrive before it. Even without a lambda,
+    // the callback object holds the time the request was sent, which the devices in the response are stored with.
+    // If an identical request is already waiting for a response, this one is resolved by the same response.
+    if (callback == nullptr)
+        callback = std::make_shared<RegisteredDevicesRequestCallback>();
+    if (!m_registeredDevicesRequests.add(parameters, std::move(callback)))
+    {
+        LOG(DEBUG) << TAG << "An identical 'RegisteredDevicesRequest' is already waiting for a response.";
+        return true;
+    }
     m_outboundPlatformRetryMessageHandler.addMessage(RetryMessageStruct{
       parsedMessage,
       m_platformProtocol.getResponseChannelForMessage(MessageType::REGISTERED_DEVICES_REQUEST, m_gatewayKey),
-      [=](const std::shared_ptr<Message>&) {
+      [this, parameters](const std::shared_ptr<Message>&) {
           LOG(ERROR) << TAG << "Failed to receive response for 'RegisteredDevicesRequest' - no response from platform.";
-          if (callback != nullptr)
-          {
-              if (callback->getLambda())
-                  callback->getLambda()(nullptr);
-          }
+          for (const auto& pendingCallback : m_registeredDevicesRequests.takeFailed(parameters))
+              if (pendingCallback->getLambda())
+                  pendingCallback->getLambda()(nullptr);
       },
       RETRY_COUNT, RETRY_TIMEOUT});
-    // This callback can be null. In the case it is null, the data will go into the repositories
-    m_registeredDevicesRequests.emplace(std::move(parameters), std::move(callback));
     return true;
 }
 
@@ -433,6 +647,10 @@ void DevicesService::messageReceived(std::shared_ptr<Message> message)
         auto request = RegisteredDevicesRequestParameters{
           parsedMessage->getTimestampFrom(), parsedMessage->getDeviceType(), parsedMessage->getExternalId()};
 
+        // The repository might be recent enough to answer the request on its own
+        if (respondWithStoredDevices(deviceKey, request))
+            break;
+
         // Create the callback
         auto callback = std::shared_ptr<RegisteredDevicesRequestCallback>{};
         if (m_localProtocol != nullptr && m_outboundLocalMessageHandler != nullptr)
@@ -530,88 +748,169 @@ void DevicesService::handleChildrenSynchronizationResponse(
 {
     LOG(TRACE) << METHOD_INFO;
 
-    // Check if any callbacks are waiting
-    auto callback = std::shared_ptr<ChildrenSynchronizationRequestCallback>{};
-    {
-        std::lock_guard<std::mutex> lock{m_childSyncMutex};
-        if (!m_childSyncRequests.empty())
-        {
-            callback = m_childSyncRequests.front();
-            m_childSyncRequests.pop();
-        }
-    }
+    // The response carries nothing that would tie it to a request, so it is matched with the requests only by its
+    // content. It resolves every request that registers no devices, and every one whose devices are all listed in it.
+    // The requests it does not match are left to expire.
+    auto sharedMessage = std::shared_ptr<ChildrenSynchronizationResponseMessage>{std::move(response)};
+    const auto children =
+      std::unordered_set<std::string>{sharedMessage->getChildren().cbegin(), sharedMessage->getChildren().cend()};
+    const auto callbacks = m_childSyncRequests.takeIf(
+      [&](const std::uint64_t&, const std::shared_ptr<ChildrenSynchronizationRequestCallback>& callback) {
+          const auto& devices = callback->getRegisteringDevices();
+          return std::all_of(devices.cbegin(), devices.cend(),
+                             [&](const std::string& device) { return children.find(device) != children.cend(); });
+      });
+
+    // Prepare the callbacks to be invoked once the devices are stored
+    auto invokeCallback = [this, callbacks, sharedMessage] {
+        for (const auto& callback : callbacks)
+            if (callback->getLambda())
+                m_queue.push([callback, sharedMessage] { callback->getLambda()(sharedMessage); });
+    };
 
     // Add the devices to storage
-    LOG(INFO) << TAG << "Received info about " << response->getChildren().size() << " child devices!.";
+    LOG(INFO) << TAG << "Received info about " << sharedMessage->getChildren().size() << " child devices!.";
+    if (m_existingDeviceRepository != nullptr)
+    {
+        // The file is written on the queue of the service, ahead of the callbacks
+        m_queue.push([this, sharedMessage] {
+            // Inserting into the set of saved keys also leaves out the children that are listed more than once
+            const auto keys = m_existingDeviceRepository->getDeviceKeys();
+            auto savedDevices = std::unordered_set<std::string>{keys.cbegin(), keys.cend()};
+            auto newDevices = std::vector<std::string>{};
+            for (const auto& device : sharedMessage->getChildren())
+                if (savedDevices.emplace(device).second)
+                    newDevices.emplace_back(device);
+            if (!newDevices.empty())
+                m_existingDeviceRepository->addDeviceKeys(newDevices);
+        });
+    }
     if (m_deviceRepository != nullptr)
     {
         auto devicesToSave = std::vector<StoredDeviceInformation>{};
-        for (const auto& device : response->getChildren())
+        for (const auto& device : sharedMessage->getChildren())
             devicesToSave.emplace_back(
               StoredDeviceInformation{device, DeviceOwnership::Gateway, std::chrono::milliseconds{0}});
-        m_deviceRepository->save(devicesToSave);
-    }
-    if (m_existingDeviceRepository != nullptr)
-    {
-        auto savedDevices = m_existingDeviceRepository->getDeviceKeys();
-        for (const auto& device : response->getChildren())
-            if (std::find(savedDevices.cbegin(), savedDevices.cend(), device) == savedDevices.cend())
-                m_existingDeviceRepository->addDeviceKey(device);
-    }
-
-    // Handle the callback
-    if (callback != nullptr)
-    {
-        if (callback->getLambda())
-        {
-            auto sharedMessage = std::shared_ptr<ChildrenSynchronizationResponseMessage>{response.release()};
-            m_commandBuffer.pushCommand(std::make_shared<std::function<void()>>(
-              [callback, sharedMessage] { callback->getLambda()(sharedMessage); }));
-        }
+        m_deviceRepository->saveAsync(std::move(devicesToSave), [invokeCallback](bool) { invokeCallback(); });
+        return;
     }
+    invokeCallback();
 }
 
 void DevicesService::handleRegisteredDevicesResponse(std::unique_ptr<RegisteredDevicesResponseMessage> response)
 {
     LOG(TRACE) << METHOD_INFO;
 
-    // Look for the callback object
+    // Look for the callback objects
     auto now =
       std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-    auto callback = std::shared_ptr<RegisteredDevicesRequestCallback>{};
     const auto params = RegisteredDevicesRequestParameters{response->getTimestampFrom(), response->getDeviceType(),
                                                            response->getExternalId()};
-    {
-        std::lock_guard<std::mutex> lock{m_registeredDevicesMutex};
-        const auto callbackIt = m_registeredDevicesRequests.find(params);
-        if (callbackIt != m_registeredDevicesRequests.cend() && callbackIt->second != nullptr)
-        {
-            // Update the time when the request was sent out
-            callback = callbackIt->second;
-            now = callback->getSentTime();
-        }
-    }
+    const auto callbacks = m_registeredDevicesRequests.take(params);
+
+    // Update the time when the request was sent out
+    if (!callbacks.empty())
+        now = callbacks.front()->getSentTime();
+
+    // Prepare the callbacks to be invoked once the devices are stored
+    auto sharedMessage = std::shared_ptr<RegisteredDevicesResponseMessage>{std::move(response)};
+    auto invokeCallback = [this, callbacks, sharedMessage] {
+        for (const auto& callback : callbacks)
+            if (callback->getLambda())
+                m_queue.push([callback, sharedMessage] { callback->getLambda()(sharedMessage); });
+    };
 
     // Print something about it
-    LOG(INFO) << TAG << "Received info about " << response->getMatchingDevices().size() << " roaming devices!";
+    LOG(INFO) << TAG << "Received info about " << sharedMessage->getMatchingDevices().size() << " roaming devices!";
     if (m_deviceRepository != nullptr)
     {
+        // A response without filters, continuing from the latest stored timestamp, leaves no gap in the repository.
+        // The latest timestamp is read on the repository queue, right before the devices are saved.
+        auto bringsUpToDate = std::make_shared<bool>(false);
+        {
+            std::lock_guard<std::mutex> lock{m_storedDevicesMutex};
+            *bringsUpToDate = m_registeredDevicesStalenessBound.count() > 0 && params.getDeviceType().empty() &&
+                              params.getExternalId().empty();
+        }
+        if (*bringsUpToDate)
+            m_deviceRepository->latestPlatformTimestampAsync(
+              [bringsUpToDate, timestampFrom = params.getTimestampFrom()](const std::chrono::milliseconds& latest) {
+                  *bringsUpToDate = timestampFrom <= latest;
+              });
+
         auto devicesToSave = std::vector<StoredDeviceInformation>{};
-        if (m_deviceRepository != nullptr)
-            for (const auto& device : response->getMatchingDevices())
-                devicesToSave.emplace_back(StoredDeviceInformation{device, now});
-        m_deviceRepository->save(devicesToSave);
+        for (const auto& device : sharedMessage->getMatchingDevices())
+            devicesToSave.emplace_back(StoredDeviceInformation{device, now});
+        const auto fromStart = params.getTimestampFrom().count() <= 0;
+        m_deviceRepository->saveAsync(
+          std::move(devicesToSave), [this, invokeCallback, bringsUpToDate, now, fromStart](bool success) {
+              if (success && *bringsUpToDate)
+              {
+                  std::lock_guard<std::mutex> lock{m_storedDevicesMutex};
+                  if (now > m_storedDevicesSyncTime)
+                      m_storedDevicesSyncTime = now;
+                  m_storedDevicesFromStart = m_storedDevicesFromStart || fromStart;
+              }
+              invokeCallback();
+          });
+        return;
     }
+    invokeCallback();
+}
 
-    // Handle the callback
-    if (callback != nullptr)
+bool DevicesService::respondWithStoredDevices(const std::string& deviceKey,
+                                              const RegisteredDevicesRequestParameters& parameters)
+{
+    LOG(TRACE) << METHOD_INFO;
+
+    if (m_deviceRepository == nullptr || m_localProtocol == nullptr || m_outboundLocalMessageHandler == nullptr)
+        return false;
+
+    // The stored timestamps are not the registration timestamps, so only a request for all the devices can be
+    // answered, and only if the repository has been filled from the start, and brought up to date recently enough
+    if (parameters.getTimestampFrom().count() > 0)
+        return false;
     {
-        if (callback->getLambda())
-        {
-            auto sharedMessage = std::shared_ptr<RegisteredDevicesResponseMessage>{response.release()};
-            m_commandBuffer.pushCommand(std::make_shared<std::function<void()>>(
-              [callback, sharedMessage] { callback->getLambda()(sharedMessage); }));
-        }
+        std::lock_guard<std::mutex> lock{m_storedDevicesMutex};
+        const auto now =
+          std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+        if (!m_storedDevicesFromStart || m_registeredDevicesStalenessBound.count() <= 0 ||
+            m_storedDevicesSyncTime.count() <= 0 || now - m_storedDevicesSyncTime > m_registeredDevicesStalenessBound)
+            return false;
     }
+
+    // A repository that has forgotten some of the devices can not give the answer the platform would
+    if (!m_deviceRepository->holdsAllDevices())
+        return false;
+
+    // Look up the devices on the repository queue, and form the response the platform would give. The platform knows
+    // nothing of the devices that belong to the gateway itself, so those are left out.
+    m_deviceRepository->findDevicesAsync(
+      std::chrono::milliseconds{0}, parameters.getDeviceType(), parameters.getExternalId(),
+      [this, deviceKey, parameters](const std::vector<StoredDeviceInformation>& devices) {
+          auto matchingDevices = std::vector<RegisteredDeviceInformation>{};
+          for (const auto& device : devices)
+          {
+              if (device.getDeviceBelongsTo() != DeviceOwnership::Platform)
+                  continue;
+              auto information = RegisteredDeviceInformation{};
+              information.deviceKey = device.getDeviceKey();
+              information.externalId = device.getExternalId();
+              information.deviceType = device.getDeviceType();
+              matchingDevices.emplace_back(std::move(information));
+          }
+          LOG(DEBUG) << TAG << "Answering the local 'RegisteredDevicesRequest' with " << matchingDevices.size()
+                     << " stored device(s).";
+          auto localResponse = std::shared_ptr<Message>{m_localProtocol->makeOutboundMessage(
+            deviceKey, RegisteredDevicesResponseMessage{parameters.getTimestampFrom(), parameters.getDeviceType(),
+                                                        parameters.getExternalId(), std::move(matchingDevices)})};
+          if (localResponse == nullptr)
+          {
+              LOG(ERROR) << TAG << "Failed to parse outgoing response for local 'RegisteredDevicesRequest' message.";
+              return;
+          }
+          m_outboundLocalMessageHandler->addMessage(localResponse);
+      });
+    return true;
 }
 }    // namespace wolkabout::gateway
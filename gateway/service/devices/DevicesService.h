@@ -18,16 +18,18 @@
 #define SUBDEVICEREGISTRATIONSERVICE_H
 
 #include "core/MessageListener.h"
-#include "core/utility/CommandBuffer.h"
 #include "gateway/GatewayMessageListener.h"
+#include "gateway/executor/GatewayExecutor.h"
 #include "gateway/repository/DeviceFilter.h"
+#include "gateway/service/devices/ExpiringRequestTable.h"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -45,6 +47,7 @@ class RegistrationProtocol;
 
 namespace gateway
 {
+class AsyncDeviceRepository;
 class DeviceRepository;
 class ExistingDevicesRepository;
 
@@ -149,7 +152,8 @@ public:
      * @param outboundPlatformRetryMessageHandler The communication service for retrying platform communication.
      * @param localRegistrationProtocol The local registration protocol used for exchanging messages with sub-devices.
      * @param outboundDeviceMessageHandler The communication service for local communication.
-     * @param deviceRepository The repository for storing device information.
+     * @param deviceRepository The repository for storing device information. All the calls made to it are executed on
+     * its own I/O thread, so the threads receiving messages never wait on the storage.
      */
     DevicesService(std::string gatewayKey, RegistrationProtocol& platformRegistrationProtocol,
                    OutboundMessageHandler& outboundPlatformMessageHandler,
@@ -157,7 +161,8 @@ public:
                    std::shared_ptr<GatewayRegistrationProtocol> localRegistrationProtocol = nullptr,
                    std::shared_ptr<OutboundMessageHandler> outboundDeviceMessageHandler = nullptr,
                    std::shared_ptr<DeviceRepository> deviceRepository = nullptr,
-                   std::shared_ptr<ExistingDevicesRepository> existingDevicesRepository = nullptr);
+                   std::shared_ptr<ExistingDevicesRepository> existingDevicesRepository = nullptr,
+                   std::shared_ptr<GatewayExecutor> executor = nullptr);
 
     /**
      * Overridden destructor.
@@ -183,6 +188,55 @@ public:
      */
     virtual bool removeChildDevices(const std::vector<std::string>& deviceKeys);
 
+    /**
+     * Method that is used to enable batching of child device registrations. Registrations arriving within the window
+     * after the first one are merged into a single registration message, and are all verified with a single children
+     * synchronization request. Batching is disabled by default.
+     *
+     * @param window How long the first registration in a batch waits for others to join it. 0 disables batching.
+     * @param maxBatchSize The number of devices at which the batch is sent out without waiting for the window to
+     * close. 0 means there is no limit.
+     */
+    void setRegistrationBatching(std::chrono::milliseconds window, std::size_t maxBatchSize);
+
+    /**
+     * Method that is used to let the local registered devices requests be answered from the device repository. The
+     * repository is considered up to date with the platform once it stores the response to a request without filters
+     * that continues from the latest timestamp it holds. Until the bound passes, local requests are answered from the
+     * repository, without a platform round trip. Answering from the repository is disabled by default.
+     *
+     * The devices are stored with the time the gateway learned about them, not with the time they were registered on
+     * the platform. So only the requests for all the devices, which do not filter by time, are answered from the
+     * repository, and only once it has been filled from the start, by a request without any filters.
+     *
+     * @param stalenessBound How long after being brought up to date the repository can answer requests. 0 disables
+     * answering from the repository.
+     */
+    void setRegisteredDevicesStalenessBound(std::chrono::milliseconds stalenessBound);
+
+    /**
+     * Method that is used to obtain the statistics of the children synchronization requests waiting for a response.
+     *
+     * @return The statistics of the request table.
+     */
+    RequestTableStatistics getChildrenSynchronizationRequestStatistics() const;
+
+    /**
+     * Method that is used to obtain the statistics of the registered devices requests waiting for a response.
+     *
+     * @return The statistics of the request table.
+     */
+    RequestTableStatistics getRegisteredDevicesRequestStatistics() const;
+
+    /**
+     * Method that is used to send out the registrations still waiting for their batch, and to wait until all the
+     * messages received before it have been handled, and the changes they made have reached the device repository.
+     *
+     * @param timeout How long to wait for the messages.
+     * @return Whether all the messages have been handled in time.
+     */
+    bool drain(std::chrono::milliseconds timeout);
+
     /**
      * This is the method that should be run when the service is created and can use the connectivity objects.
      * This method will check when the DeviceRepository was last updated, and will request the list of devices that have
@@ -202,7 +256,8 @@ public:
       std::shared_ptr<ChildrenSynchronizationRequestCallback> callback);
 
     /**
-     * Method that is used to send out the request to obtain the list of requested devices.
+     * Method that is used to send out the request to obtain the list of requested devices. If an identical request is
+     * already waiting for a response, the request is not sent out again, and the callback receives the same response.
      *
      * @param parameters The parameter by which the devices will be queried.
      * @param callback The callback object that defines what will be done once a response has been received.
@@ -248,6 +303,22 @@ public:
     bool deviceExists(const std::string& deviceKey) override;
 
 private:
+    // A registration that has been requested, with the keys it has to be verified against
+    struct PendingChildRegistration
+    {
+        std::vector<std::string> deviceKeys;
+        std::function<void(const std::vector<std::string>&, const std::vector<std::string>&)> callback;
+    };
+
+    bool sendOutChildRegistration(const std::vector<DeviceRegistrationData>& devices,
+                                  std::vector<PendingChildRegistration> registrations);
+
+    void sendOutChildRegistrationBatch();
+
+    void scheduleRequestExpiry();
+
+    bool respondWithStoredDevices(const std::string& deviceKey, const RegisteredDevicesRequestParameters& parameters);
+
     void handleChildrenSynchronizationResponse(std::unique_ptr<ChildrenSynchronizationResponseMessage> response);
 
     void handleRegisteredDevicesResponse(std::unique_ptr<RegisteredDevicesResponseMessage> response);
@@ -268,17 +339,35 @@ private:
     std::shared_ptr<OutboundMessageHandler> m_outboundLocalMessageHandler;
 
     // Optional device repository
-    std::shared_ptr<DeviceRepository> m_deviceRepository;
+    std::shared_ptr<AsyncDeviceRepository> m_deviceRepository;
     std::shared_ptr<ExistingDevicesRepository> m_existingDeviceRepository;
 
-    // Storage for request objects
-    legacy::CommandBuffer m_commandBuffer;
-    std::mutex m_childSyncMutex;
-    std::queue<std::shared_ptr<ChildrenSynchronizationRequestCallback>> m_childSyncRequests;
-    std::mutex m_registeredDevicesMutex;
-    std::unordered_map<RegisteredDevicesRequestParameters, std::shared_ptr<RegisteredDevicesRequestCallback>,
-                       RegisteredDevicesRequestParametersHash>
+    // Storage for request objects. Children synchronization requests carry nothing that could correlate them with the
+    // response, so they are kept under an id that is used only to take them out once the retries have failed.
+    SerialQueue m_queue;
+    std::atomic<std::uint64_t> m_childSyncRequestId;
+    ExpiringRequestTable<std::uint64_t, std::shared_ptr<ChildrenSynchronizationRequestCallback>> m_childSyncRequests;
+    ExpiringRequestTable<RegisteredDevicesRequestParameters, std::shared_ptr<RegisteredDevicesRequestCallback>,
+                         RegisteredDevicesRequestParametersHash>
       m_registeredDevicesRequests;
+
+    // Registrations waiting for their batch to be sent out. The window that closes a batch, and the expiry of the
+    // requests, are scheduled on the queue under this lock, and no longer once the service is stopped. A window that
+    // was closed early is left to run out, but does not send out the batch of the next window.
+    std::mutex m_registrationBatchMutex;
+    std::chrono::milliseconds m_registrationBatchWindow;
+    std::size_t m_registrationBatchSize;
+    std::vector<DeviceRegistrationData> m_batchedDevices;
+    std::vector<PendingChildRegistration> m_batchedRegistrations;
+    std::uint64_t m_registrationBatchWindowId;
+    bool m_stopped;
+
+    // The time of the request whose response brought the device repository up to date with the platform, and whether
+    // the repository has been filled with all the devices registered since the start
+    std::mutex m_storedDevicesMutex;
+    std::chrono::milliseconds m_registeredDevicesStalenessBound;
+    std::chrono::milliseconds m_storedDevicesSyncTime;
+    bool m_storedDevicesFromStart;
 };
 }    // namespace gateway
 }    // namespace wolkabout
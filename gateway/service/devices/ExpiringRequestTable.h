@@ -0,0 +1,292 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_EXPIRINGREQUESTTABLE_H
+#define WOLKGATEWAY_EXPIRINGREQUESTTABLE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace wolkabout::gateway
+{
+/**
+ * This struct contains the statistics of a request table.
+ */
+struct RequestTableStatistics
+{
+    // The number of requests that are still waiting for a response
+    std::size_t outstanding;
+
+    // The number of requests that were added, that were taken out once a response arrived, and that were taken out
+    // because the request failed to be delivered
+    std::uint64_t added;
+    std::uint64_t resolved;
+    std::uint64_t failed;
+
+    // The number of requests that outlived their time to live, or were evicted to keep the table within its capacity
+    std::uint64_t expired;
+    std::uint64_t evicted;
+};
+
+/**
+ * This class holds the requests that have been sent out and are waiting for a response, under the key that correlates
+ * them with the response. Multiple requests can wait under the same key.
+ *
+ * All requests have the same time to live, so the entries are kept in the order in which they were added, which is
+ * also the order of their deadlines, and the expired ones are always at the front. `expire` is meant to be invoked
+ * periodically. Once the capacity is reached, the oldest request is evicted to make room for the new one. The expiry
+ * handler is invoked for every request that expires or is evicted, outside of the lock of the table.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>> class ExpiringRequestTable
+{
+public:
+    using ExpiryHandler = std::function<void(const Key&, const Value&)>;
+
+    /**
+     * Default parameter constructor.
+     *
+     * @param timeToLive How long a request waits for a response before it expires.
+     * @param capacity The maximum number of requests in the table. 0 means there is no limit.
+     * @param expiryHandler The handler invoked for requests that expire or are evicted.
+     */
+    ExpiringRequestTable(std::chrono::milliseconds timeToLive, std::size_t capacity,
+                         ExpiryHandler expiryHandler = nullptr)
+    : m_timeToLive{timeToLive}
+    , m_capacity{capacity}
+    , m_expiryHandler{std::move(expiryHandler)}
+    , m_added{0}
+    , m_resolved{0}
+    , m_failed{0}
+    , m_expired{0}
+    , m_evicted{0}
+    {
+    }
+
+    /**
+     * This method is used to add a request to the table.
+     *
+     * @param key The key that correlates the request with its response.
+     * @param value The request.
+     * @return Whether this is the only request waiting under the key. If it is not, it will be resolved together with
+     * the ones that were already waiting.
+     */
+    bool add(Key key, Value value)
+    {
+        auto evicted = std::vector<Entry>{};
+        auto first = false;
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            while (m_capacity > 0 && m_entries.size() >= m_capacity)
+            {
+                evicted.emplace_back(takeFront());
+                ++m_evicted;
+            }
+            m_entries.emplace_back(
+              Entry{std::move(key), std::move(value), std::chrono::steady_clock::now() + m_timeToLive});
+            first = m_index.find(m_entries.back().key) == m_index.cend();
+            m_index.emplace(m_entries.back().key, std::prev(m_entries.end()));
+            ++m_added;
+        }
+        notifyExpired(evicted);
+        return first;
+    }
+
+    /**
+     * This method is used to take out all the requests waiting under a key, once their response has arrived.
+     *
+     * @param key The key that correlates the requests with the response.
+     * @return The requests, in the order in which they were added.
+     */
+    std::vector<Value> take(const Key& key)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        auto values = takeByKey(key);
+        m_resolved += values.size();
+        return values;
+    }
+
+    /**
+     * This method is used to take out all the requests waiting under a key, once they have failed to be delivered.
+     *
+     * @param key The key under which the requests were added.
+     * @return The requests, in the order in which they were added.
+     */
+    std::vector<Value> takeFailed(const Key& key)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        auto values = takeByKey(key);
+        m_failed += values.size();
+        return values;
+    }
+
+    /**
+     * This method is used to take out the requests that match a predicate.
+     *
+     * @param predicate The predicate, invoked for every request in the order in which they were added.
+     * @return The requests that match the predicate, in the order in which they were added.
+     */
+    std::vector<Value> takeIf(const std::function<bool(const Key&, const Value&)>& predicate)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        auto values = std::vector<Value>{};
+        for (auto it = m_entries.begin(); it != m_entries.end();)
+        {
+            if (!predicate(it->key, it->value))
+            {
+                ++it;
+                continue;
+            }
+            eraseFromIndex(it);
+            values.emplace_back(std::move(it->value));
+            it = m_entries.erase(it);
+        }
+        m_resolved += values.size();
+        return values;
+    }
+
+    /**
+     * This method is used to remove all the requests whose time to live has passed.
+     *
+     * @return The number of expired requests.
+     */
+    std::size_t expire()
+    {
+        auto expired = std::vector<Entry>{};
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            const auto now = std::chrono::steady_clock::now();
+            while (!m_entries.empty() && m_entries.front().deadline <= now)
+            {
+                expired.emplace_back(takeFront());
+            }
+            m_expired += expired.size();
+        }
+        notifyExpired(expired);
+        return expired.size();
+    }
+
+    /**
+     * This method is used to obtain the number of requests in the table.
+     *
+     * @return The number of requests.
+     */
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_entries.size();
+    }
+
+    /**
+     * This method is used to check whether there are no requests in the table.
+     *
+     * @return Whether the table is empty.
+     */
+    bool empty() const { return size() == 0; }
+
+    /**
+     * This method is used to obtain the statistics of the table.
+     *
+     * @return The statistics.
+     */
+    RequestTableStatistics getStatistics() const
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return {m_entries.size(), m_added, m_resolved, m_failed, m_expired, m_evicted};
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    std::vector<Value> takeByKey(const Key& key)
+    {
+        const auto range = m_index.equal_range(key);
+        auto found = std::vector<typename std::list<Entry>::iterator>{};
+        for (auto it = range.first; it != range.second; ++it)
+            found.emplace_back(it->second);
+        m_index.erase(range.first, range.second);
+
+        // The entries are ordered by their deadlines, which grow in the order in which the entries were added
+        std::sort(found.begin(), found.end(),
+                  [](const typename std::list<Entry>::iterator& first,
+                     const typename std::list<Entry>::iterator& second) { return first->deadline < second->deadline; });
+        auto values = std::vector<Value>{};
+        for (const auto& entry : found)
+        {
+            values.emplace_back(std::move(entry->value));
+            m_entries.erase(entry);
+        }
+        return values;
+    }
+
+    Entry takeFront()
+    {
+        eraseFromIndex(m_entries.begin());
+        auto entry = std::move(m_entries.front());
+        m_entries.pop_front();
+        return entry;
+    }
+
+    void eraseFromIndex(typename std::list<Entry>::iterator entry)
+    {
+        const auto range = m_index.equal_range(entry->key);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second == entry)
+            {
+                m_index.erase(it);
+                return;
+            }
+        }
+    }
+
+    void notifyExpired(const std::vector<Entry>& entries)
+    {
+        if (!m_expiryHandler)
+            return;
+        for (const auto& entry : entries)
+            m_expiryHandler(entry.key, entry.value);
+    }
+
+    mutable std::mutex m_mutex;
+    const std::chrono::milliseconds m_timeToLive;
+    const std::size_t m_capacity;
+    ExpiryHandler m_expiryHandler;
+
+    // The requests in the order of their deadlines, and the index by their keys
+    std::list<Entry> m_entries;
+    std::unordered_multimap<Key, typename std::list<Entry>::iterator, Hash> m_index;
+
+    std::uint64_t m_added;
+    std::uint64_t m_resolved;
+    std::uint64_t m_failed;
+    std::uint64_t m_expired;
+    std::uint64_t m_evicted;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_EXPIRINGREQUESTTABLE_H
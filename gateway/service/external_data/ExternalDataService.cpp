@@ -23,6 +23,7 @@
 #include "core/utility/Logger.h"
 
 #include <algorithm>
+#include <utility>
 
 using namespace wolkabout::legacy;
 
@@ -30,12 +31,15 @@ namespace wolkabout::gateway
 {
 ExternalDataService::ExternalDataService(std::string gatewayKey, GatewaySubdeviceProtocol& gatewaySubdeviceProtocol,
                                          DataProtocol& dataProtocol, OutboundMessageHandler& outboundMessageHandler,
-                                         DataProvider& dataProvider)
+                                         DataProvider& dataProvider, std::shared_ptr<GatewayExecutor> executor,
+                                         std::shared_ptr<MemoryBudget> memoryBudget)
 : m_gatewayKey{std::move(gatewayKey)}
 , m_gatewaySubdeviceProtocol{gatewaySubdeviceProtocol}
 , m_dataProtocol{dataProtocol}
 , m_outboundMessageHandler{outboundMessageHandler}
 , m_dataProvider{dataProvider}
+, m_memoryBudget{std::move(memoryBudget)}
+, m_queue{std::move(executor), "external_data"}
 {
 }
 
@@ -65,6 +69,18 @@ void ExternalDataService::receiveMessages(const std::vector<GatewaySubdeviceMess
         auto deviceKey = m_gatewaySubdeviceProtocol.getDeviceKey(message.getMessage());
         auto sharedMessage = std::make_shared<Message>(content.getContent(), content.getChannel());
 
+        // Reserve the room for the data while it waits for the data provider
+        auto reservation = std::make_shared<MemoryBudget::Reservation>();
+        if (m_memoryBudget != nullptr)
+        {
+            *reservation = m_memoryBudget->reserve("external_data", messageType, MemoryBudget::sizeOf(content));
+            if (!*reservation)
+            {
+                LOG(WARN) << TAG << "Dropping received data - The memory budget is exhausted.";
+                continue;
+            }
+        }
+
         // Parse it into an appropriate type and pass to the handler
         switch (messageType)
         {
@@ -77,9 +93,9 @@ void ExternalDataService::receiveMessages(const std::vector<GatewaySubdeviceMess
                 LOG(ERROR) << TAG << "Received 'FeedValues' message but failed to parse it.";
                 return;
             }
-            m_commandBuffer.pushCommand(std::make_shared<std::function<void()>>([this, deviceKey, feedValuesMessage] {
+            m_queue.push([this, deviceKey, feedValuesMessage, reservation] {
                 m_dataProvider.onReadingData(deviceKey, feedValuesMessage->getReadings());
-            }));
+            });
             return;
         }
         case MessageType::PARAMETER_SYNC:
@@ -91,9 +107,9 @@ void ExternalDataService::receiveMessages(const std::vector<GatewaySubdeviceMess
                 LOG(ERROR) << TAG << "Received 'Parameters' message but failed to parse it.";
                 return;
             }
-            m_commandBuffer.pushCommand(std::make_shared<std::function<void()>>([this, deviceKey, parametersMessage] {
+            m_queue.push([this, deviceKey, parametersMessage, reservation] {
                 m_dataProvider.onParameterData(deviceKey, parametersMessage->getParameters());
-            }));
+            });
             return;
         }
         default:
@@ -236,4 +252,14 @@ void ExternalDataService::packMessageWithGatewayAndSend(const Message& message)
     // Hand it to the outbound message handler
     m_outboundMessageHandler.addMessage(gatewayMessage);
 }
+
+bool ExternalDataService::isOverloaded() const
+{
+    return m_memoryBudget != nullptr && m_memoryBudget->isOverloaded();
+}
+
+bool ExternalDataService::drain(std::chrono::milliseconds timeout)
+{
+    return m_queue.drain(timeout);
+}
 }    // namespace wolkabout::gateway
@@ -17,10 +17,14 @@
 #ifndef WOLKABOUT_EXTERNALDATASERVICE_H
 #define WOLKABOUT_EXTERNALDATASERVICE_H
 
-#include "core/utility/CommandBuffer.h"
 #include "gateway/GatewayMessageListener.h"
 #include "gateway/api/DataHandler.h"
 #include "gateway/api/DataProvider.h"
+#include "gateway/executor/GatewayExecutor.h"
+#include "gateway/memory/MemoryBudget.h"
+
+#include <chrono>
+#include <memory>
 
 namespace wolkabout
 {
@@ -35,7 +39,8 @@ class ExternalDataService : public DataHandler, public GatewayMessageListener
 public:
     ExternalDataService(std::string gatewayKey, GatewaySubdeviceProtocol& gatewaySubdeviceProtocol,
                         DataProtocol& dataProtocol, OutboundMessageHandler& outboundMessageHandler,
-                        DataProvider& dataProvider);
+                        DataProvider& dataProvider, std::shared_ptr<GatewayExecutor> executor = nullptr,
+                        std::shared_ptr<MemoryBudget> memoryBudget = nullptr);
 
     std::vector<MessageType> getMessageTypes() const override;
 
@@ -61,6 +66,17 @@ public:
 
     void updateParameter(const std::string& deviceKey, Parameter parameter) override;
 
+    bool isOverloaded() const override;
+
+    /**
+     * This method is used to wait until all the data received from the platform before it has been handed to the data
+     * provider.
+     *
+     * @param timeout How long to wait for the data.
+     * @return Whether all the data has been handed over in time.
+     */
+    bool drain(std::chrono::milliseconds timeout);
+
 private:
     void packMessageWithGatewayAndSend(const Message& message);
 
@@ -80,8 +96,11 @@ private:
     // And this is the external data provider.
     DataProvider& m_dataProvider;
 
-    // The command buffer for asynchronous execution
-    legacy::CommandBuffer m_commandBuffer;
+    // The budget the data waiting for the data provider is kept within, if there is one
+    std::shared_ptr<MemoryBudget> m_memoryBudget;
+
+    // The queue on which the data is handed to the data provider
+    SerialQueue m_queue;
 };
 }    // namespace gateway
 }    // namespace wolkabout
@@ -0,0 +1,171 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gateway/service/platform_status/GatewayLoadMonitor.h"
+
+#include "core/utility/Logger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+using namespace wolkabout::legacy;
+
+namespace wolkabout::gateway
+{
+namespace
+{
+// The weight of the newest sample in the smoothed send rate
+const double SEND_RATE_SMOOTHING = 0.5;
+
+std::string describe(GatewayLoadState state)
+{
+    switch (state)
+    {
+    case GatewayLoadState::Normal:
+        return "back to the normal load";
+    case GatewayLoadState::Throttle:
+        return "throttling";
+    case GatewayLoadState::Shed:
+        return "shedding";
+    }
+    return "";
+}
+}    // namespace
+
+const double GatewayLoadMonitor::THROTTLE_OCCUPANCY = 0.5;
+const double GatewayLoadMonitor::SHED_OCCUPANCY = 0.9;
+const double GatewayLoadMonitor::OCCUPANCY_HYSTERESIS = 0.1;
+const double GatewayLoadMonitor::RATE_CHANGE = 0.2;
+
+GatewayLoadMonitor::GatewayLoadMonitor(Sampler sampler, Listener listener, std::shared_ptr<GatewayExecutor> executor,
+                                       std::chrono::milliseconds interval)
+: m_sampler{std::move(sampler)}
+, m_listener{std::move(listener)}
+, m_interval{interval}
+, m_status{GatewayLoadState::Normal, GatewayLoadStatus::NO_SUGGESTED_RATE, 0, false}
+, m_publishedRate{GatewayLoadStatus::NO_SUGGESTED_RATE}
+, m_lastSentMessages{0}
+, m_sendRate{0}
+, m_generation{0}
+, m_queue{std::move(executor), "load-monitor"}
+{
+}
+
+GatewayLoadMonitor::~GatewayLoadMonitor()
+{
+    stop();
+}
+
+void GatewayLoadMonitor::start()
+{
+    auto generation = std::uint64_t{0};
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        generation = ++m_generation;
+        m_queue.cancelScheduled();
+    }
+
+    // Starting over, the modules that have just connected hear of the load right away
+    m_queue.execute([this] { evaluate(true); });
+    scheduleSample(generation);
+}
+
+void GatewayLoadMonitor::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        ++m_generation;
+        m_queue.cancelScheduled();
+    }
+
+    // The sample that is already being taken is waited for
+    m_queue.execute([] {});
+}
+
+GatewayLoadStatus GatewayLoadMonitor::getStatus() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_status;
+}
+
+void GatewayLoadMonitor::scheduleSample(std::uint64_t generation)
+{
+    // The samples are scheduled and cancelled under the lock, so a stopped monitor schedules no more of them
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (generation != m_generation)
+        return;
+    m_queue.schedule(m_interval, [this, generation] {
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            if (generation != m_generation)
+                return;
+        }
+        evaluate(false);
+        scheduleSample(generation);
+    });
+}
+
+void GatewayLoadMonitor::evaluate(bool notify)
+{
+    const auto sample = m_sampler();
+    const auto now = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock{m_mutex};
+
+    // The rate at which the messages are sent out since the last sample
+    if (m_lastSample != std::chrono::steady_clock::time_point{} && sample.sentMessages >= m_lastSentMessages)
+    {
+        const auto seconds = std::chrono::duration<double>(now - m_lastSample).count();
+        if (seconds > 0)
+        {
+            const auto rate = static_cast<double>(sample.sentMessages - m_lastSentMessages) / seconds;
+            m_sendRate = SEND_RATE_SMOOTHING * rate + (1 - SEND_RATE_SMOOTHING) * m_sendRate;
+        }
+    }
+    m_lastSample = now;
+    m_lastSentMessages = sample.sentMessages;
+
+    // A state is entered at its threshold, and left only once the occupancy drops well below it
+    const auto previousState = m_status.state;
+    const auto occupancy = std::max(sample.occupancy, 0.0);
+    auto state = GatewayLoadState::Normal;
+    if (occupancy >= SHED_OCCUPANCY ||
+        (previousState == GatewayLoadState::Shed && occupancy >= SHED_OCCUPANCY - OCCUPANCY_HYSTERESIS))
+        state = GatewayLoadState::Shed;
+    else if (occupancy >= THROTTLE_OCCUPANCY || sample.replaying ||
+             (previousState != GatewayLoadState::Normal && occupancy >= THROTTLE_OCCUPANCY - OCCUPANCY_HYSTERESIS))
+        state = GatewayLoadState::Throttle;
+    const auto suggestedRate = state == GatewayLoadState::Normal ?
+                                 GatewayLoadStatus::NO_SUGGESTED_RATE :
+                                 m_sendRate * std::max(1.0 - std::min(occupancy, 1.0), 0.0);
+    m_status = GatewayLoadStatus{state, suggestedRate, occupancy, sample.replaying};
+
+    // The modules hear of every change of the state, but of the rate only once it has changed noticeably
+    const auto rateChanged =
+      state != GatewayLoadState::Normal && std::fabs(suggestedRate - m_publishedRate) > RATE_CHANGE * m_publishedRate;
+    if (!notify && state == previousState && !rateChanged)
+        return;
+    if (state != previousState)
+        LOG(INFO) << "The gateway is " << describe(state) << " at the occupancy of " << occupancy << ".";
+    m_publishedRate = suggestedRate;
+
+    // The listener publishes the load, which is not done under the lock
+    const auto status = m_status;
+    lock.unlock();
+    if (m_listener)
+        m_listener(status);
+}
+}    // namespace wolkabout::gateway
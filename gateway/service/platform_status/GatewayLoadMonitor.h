@@ -0,0 +1,132 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WOLKGATEWAY_GATEWAYLOADMONITOR_H
+#define WOLKGATEWAY_GATEWAYLOADMONITOR_H
+
+#include "gateway/executor/GatewayExecutor.h"
+#include "gateway/service/platform_status/GatewayPlatformStatusService.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace wolkabout::gateway
+{
+// The state of the gateway from which its load is derived
+struct GatewayLoadSample
+{
+    // How full the queues of the gateway are, between 0 and 1
+    double occupancy;
+
+    // Whether the persisted messages are being replayed
+    bool replaying;
+
+    // The number of messages that were sent out to the platform so far
+    std::uint64_t sentMessages;
+};
+
+/**
+ * This class periodically samples how full the queues of the gateway are, whether the backlog is being replayed, and
+ * how fast the messages are sent out to the platform, and derives the load of the gateway from it. The gateway starts
+ * throttling once its queues are half full, or while the backlog is replayed, and sheds once they are almost full. Each
+ * state is left only once the occupancy drops well below the threshold at which it was entered, so the state does not
+ * flap. Outside of the normal state, the modules are asked to send at the rate at which the messages are sent out,
+ * reduced by the occupancy, so the queues can empty. The rate is the total for all the modules, as the monitor does not
+ * know how many of them are sending.
+ *
+ * The listener is notified when the state changes, or when the suggested rate changes noticeably. It is called without
+ * any lock of the monitor held, so it can take its time to publish the load.
+ */
+class GatewayLoadMonitor
+{
+public:
+    using Sampler = std::function<GatewayLoadSample()>;
+    using Listener = std::function<void(const GatewayLoadStatus&)>;
+
+    /**
+     * Default parameter constructor.
+     *
+     * @param sampler The function used to sample the state of the gateway.
+     * @param listener The listener that is notified of the load.
+     * @param executor The executor on which the state is sampled. If none is given, the monitor gets a thread of its
+     * own.
+     * @param interval The interval at which the state is sampled.
+     */
+    GatewayLoadMonitor(Sampler sampler, Listener listener, std::shared_ptr<GatewayExecutor> executor = nullptr,
+                       std::chrono::milliseconds interval = std::chrono::milliseconds{1000});
+
+    /**
+     * Default destructor. Stops the sampling.
+     */
+    ~GatewayLoadMonitor();
+
+    /**
+     * This method is used to start sampling the state. The listener is notified of the current load right away.
+     */
+    void start();
+
+    /**
+     * This method is used to stop sampling the state.
+     */
+    void stop();
+
+    /**
+     * This method is used to obtain the last evaluated load.
+     *
+     * @return The load of the gateway.
+     */
+    GatewayLoadStatus getStatus() const;
+
+    // The occupancy at which the gateway starts to throttle, and to shed
+    static const double THROTTLE_OCCUPANCY;
+    static const double SHED_OCCUPANCY;
+
+    // How far below the threshold of a state the occupancy has to drop for the state to be left
+    static const double OCCUPANCY_HYSTERESIS;
+
+    // The relative change of the suggested rate that is published on its own
+    static const double RATE_CHANGE;
+
+private:
+    void evaluate(bool notify);
+
+    void scheduleSample(std::uint64_t generation);
+
+    const Sampler m_sampler;
+    const Listener m_listener;
+    const std::chrono::milliseconds m_interval;
+
+    mutable std::mutex m_mutex;
+    GatewayLoadStatus m_status;
+    double m_publishedRate;
+
+    // The sent out messages at the last sample, and the smoothed rate at which they are sent out
+    std::chrono::steady_clock::time_point m_lastSample;
+    std::uint64_t m_lastSentMessages;
+    double m_sendRate;
+
+    // Every start and stop makes the samples scheduled before it stale, even the ones that are already due
+    std::uint64_t m_generation;
+
+    // The samples are taken on the queue, which is destroyed first
+    SerialQueue m_queue;
+};
+}    // namespace wolkabout::gateway
+
+#endif    // WOLKGATEWAY_GATEWAYLOADMONITOR_H
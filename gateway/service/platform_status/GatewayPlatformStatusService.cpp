@@ -21,10 +21,33 @@
 #include "core/protocol/GatewayPlatformStatusProtocol.h"
 #include "core/utility/Logger.h"
 
+#include <nlohmann/json.hpp>
+
 using namespace wolkabout::legacy;
 
 namespace wolkabout::gateway
 {
+namespace
+{
+std::string toString(GatewayLoadState state)
+{
+    switch (state)
+    {
+    case GatewayLoadState::Normal:
+        return "NORMAL";
+    case GatewayLoadState::Throttle:
+        return "THROTTLE";
+    case GatewayLoadState::Shed:
+        return "SHED";
+    }
+    return "NORMAL";
+}
+}    // namespace
+
+const double GatewayLoadStatus::NO_SUGGESTED_RATE = -1;
+
+const std::string GatewayPlatformStatusService::LOAD_STATUS_CHANNEL = "p2d/load_status";
+
 GatewayPlatformStatusService::GatewayPlatformStatusService(ConnectivityService& connectivityService,
                                                            GatewayPlatformStatusProtocol& protocol,
                                                            std::string deviceKey)
@@ -50,4 +73,21 @@ void GatewayPlatformStatusService::sendPlatformConnectionStatusMessage(bool conn
     if (!m_connectivityService.publish(message))
         LOG(ERROR) << errorPrefix << " -> Failed to send the message.";
 }
+
+void GatewayPlatformStatusService::sendLoadStatusMessage(const GatewayLoadStatus& status)
+{
+    LOG(TRACE) << METHOD_INFO;
+    const auto errorPrefix = "Failed to send 'LoadStatusMessage'";
+
+    // Make the message
+    auto json = nlohmann::json{
+      {"state", toString(status.state)}, {"occupancy", status.occupancy}, {"replaying", status.replaying}};
+    if (status.suggestedRate != GatewayLoadStatus::NO_SUGGESTED_RATE)
+        json["suggestedRate"] = status.suggestedRate;
+    auto message = std::make_shared<Message>(json.dump(), LOAD_STATUS_CHANNEL);
+
+    // Try to send out the message
+    if (!m_connectivityService.publish(message))
+        LOG(ERROR) << errorPrefix << " -> Failed to send the message.";
+}
 }    // namespace wolkabout::gateway
@@ -27,6 +27,37 @@ class GatewayPlatformStatusProtocol;
 
 namespace gateway
 {
+// How loaded the gateway is, and how the local modules should react to it
+enum class GatewayLoadState
+{
+    // The modules can send at their own rate
+    Normal,
+    // The modules should slow down to the suggested rate
+    Throttle,
+    // The modules should hold back everything that is not essential
+    Shed
+};
+
+// The load of the gateway, as it is published to the local modules
+struct GatewayLoadStatus
+{
+    GatewayLoadState state;
+
+    // The rate at which the modules are asked to send, in messages per second. This is the total for all the modules
+    // together, which they share. 0 while the platform takes no messages at all, and `NO_SUGGESTED_RATE` in the normal
+    // state, where the modules are not limited.
+    double suggestedRate;
+
+    // How full the queues of the gateway are, between 0 and 1
+    double occupancy;
+
+    // Whether the messages persisted while the platform was unreachable are being replayed
+    bool replaying;
+
+    // The suggested rate of the normal state
+    static const double NO_SUGGESTED_RATE;
+};
+
 class GatewayPlatformStatusService
 {
 public:
@@ -37,6 +68,19 @@ public:
 
     virtual void sendPlatformConnectionStatusMessage(bool connected);
 
+    /**
+     * This method is used to publish the load of the gateway to the local modules, so the cooperative ones can slow
+     * down at the source. The status is published as a JSON object on the `LOAD_STATUS_CHANNEL`, for example
+     * `{"state":"THROTTLE","suggestedRate":120.0,"occupancy":0.62,"replaying":true}`. The suggested rate is the total
+     * rate of all the modules, and is left out in the normal state.
+     *
+     * @param status The load of the gateway.
+     */
+    virtual void sendLoadStatusMessage(const GatewayLoadStatus& status);
+
+    // The channel on which the load of the gateway is published
+    static const std::string LOAD_STATUS_CHANNEL;
+
 private:
     ConnectivityService& m_connectivityService;
     GatewayPlatformStatusProtocol& m_protocol;
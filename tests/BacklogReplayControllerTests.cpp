@@ -0,0 +1,111 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "core/persistence/inmemory/InMemoryMessagePersistence.h"
+#include "core/utility/Logger.h"
+#include "gateway/connectivity/BacklogReplayController.h"
+#include "tests/mocks/ConnectivityServiceMock.h"
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class BacklogReplayControllerTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    void SetUp() override
+    {
+        for (auto i = 0; i < 10; ++i)
+            persistence.push(std::make_shared<wolkabout::Message>("{}", "d2p/TestGateway/feed_values"));
+    }
+
+    InMemoryMessagePersistence persistence;
+
+    NiceMock<ConnectivityServiceMock> connectivityService;
+
+    std::mutex mutex;
+
+    std::condition_variable conditionVariable;
+};
+
+TEST_F(BacklogReplayControllerTests, BacklogReplayIsPaced)
+{
+    // Two messages can go out right away, and every next one waits for its token, at the rate of twenty per second
+    const auto startedAt = std::chrono::steady_clock::now();
+    auto publishedAt = std::vector<std::chrono::steady_clock::duration>{};
+    EXPECT_CALL(connectivityService, publish).Times(10).WillRepeatedly([&](std::shared_ptr<wolkabout::Message>) {
+        std::lock_guard<std::mutex> lock{mutex};
+        publishedAt.emplace_back(std::chrono::steady_clock::now() - startedAt);
+        return true;
+    });
+    auto progressReports = 0;
+    const auto onProgress = [&](const BacklogReplayProgress&) {
+        std::lock_guard<std::mutex> lock{mutex};
+        ++progressReports;
+    };
+    auto controller = BacklogReplayController{persistence, connectivityService, 20, 2, onProgress, nullptr,
+                                              std::chrono::milliseconds{10}, std::chrono::milliseconds{100}};
+    auto completed = false;
+    controller.start([&] {
+        std::lock_guard<std::mutex> lock{mutex};
+        completed = true;
+        conditionVariable.notify_one();
+    });
+
+    std::unique_lock<std::mutex> lock{mutex};
+    ASSERT_TRUE(conditionVariable.wait_for(lock, std::chrono::seconds{10}, [&] { return completed; }));
+    ASSERT_EQ(publishedAt.size(), 10);
+    for (auto i = std::size_t{2}; i < publishedAt.size(); ++i)
+        EXPECT_GE(publishedAt[i], std::chrono::milliseconds{50 * (i - 1) - 1});
+    EXPECT_GE(progressReports, 2);
+    lock.unlock();
+
+    EXPECT_TRUE(persistence.empty());
+    EXPECT_EQ(controller.getProgress().replayedMessages, 10);
+    EXPECT_GE(controller.getProgress().elapsed, std::chrono::milliseconds{399});
+    EXPECT_TRUE(controller.getProgress().completed);
+    EXPECT_FALSE(controller.isRunning());
+}
+
+TEST_F(BacklogReplayControllerTests, FailedPublishPausesTheReplay)
+{
+    // The third message can not be published, so it stays in the persistence for the next replay
+    auto attempts = 0;
+    EXPECT_CALL(connectivityService, publish).Times(3).WillRepeatedly([&](std::shared_ptr<wolkabout::Message>) {
+        std::lock_guard<std::mutex> lock{mutex};
+        conditionVariable.notify_one();
+        return ++attempts < 3;
+    });
+    auto controller = BacklogReplayController{persistence, connectivityService};
+    controller.start();
+
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        ASSERT_TRUE(conditionVariable.wait_for(lock, std::chrono::seconds{10}, [&] { return attempts == 3; }));
+    }
+    controller.stop();
+    EXPECT_EQ(controller.getProgress().replayedMessages, 2);
+    EXPECT_FALSE(controller.getProgress().completed);
+    EXPECT_FALSE(persistence.empty());
+}
@@ -0,0 +1,132 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "core/persistence/inmemory/InMemoryMessagePersistence.h"
+#include "core/utility/Logger.h"
+#include "gateway/persistence/BudgetedMessagePersistence.h"
+#include "tests/mocks/DataProtocolMock.h"
+
+#include <gtest/gtest.h>
+
+#include <deque>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+namespace
+{
+// Holds a limited number of messages, and drops the oldest one to make room for a new one
+class CappedMessagePersistence : public MessagePersistence
+{
+public:
+    explicit CappedMessagePersistence(std::size_t capacity) : m_capacity{capacity} {}
+
+    bool push(std::shared_ptr<wolkabout::Message> message) override
+    {
+        if (m_messages.size() == m_capacity)
+            m_messages.pop_front();
+        m_messages.emplace_back(std::move(message));
+        return true;
+    }
+
+    void pop() override
+    {
+        if (!m_messages.empty())
+            m_messages.pop_front();
+    }
+
+    std::shared_ptr<wolkabout::Message> front() override
+    {
+        return m_messages.empty() ? nullptr : m_messages.front();
+    }
+
+    bool empty() const override { return m_messages.empty(); }
+
+private:
+    std::size_t m_capacity;
+    std::deque<std::shared_ptr<wolkabout::Message>> m_messages;
+};
+}    // namespace
+
+class BudgetedMessagePersistenceTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    void SetUp() override
+    {
+        EXPECT_CALL(m_protocolMock, getMessageType).WillRepeatedly(Return(MessageType::FEED_VALUES));
+    }
+
+    std::uint64_t Used() const { return memoryBudget->getStatistics().used; }
+
+    static std::shared_ptr<wolkabout::Message> GenerateMessage()
+    {
+        return std::make_shared<wolkabout::Message>("{}", "d2p/TestGateway/d/TestDevice/feed_values");
+    }
+
+    DataProtocolMock m_protocolMock;
+
+    std::shared_ptr<MemoryBudget> memoryBudget = std::make_shared<MemoryBudget>(
+      1000, std::map<MessageType, OverloadPolicy>{{MessageType::FEED_VALUES, OverloadPolicy::Drop}});
+};
+
+TEST_F(BudgetedMessagePersistenceTests, ReturnTheRoomOfThePoppedMessages)
+{
+    auto persistence = BudgetedMessagePersistence{std::unique_ptr<MessagePersistence>{new InMemoryMessagePersistence},
+                                                  m_protocolMock, memoryBudget};
+    const auto message = GenerateMessage();
+    const auto size = MemoryBudget::sizeOf(*message);
+    ASSERT_TRUE(persistence.push(message));
+    ASSERT_TRUE(persistence.push(GenerateMessage()));
+    EXPECT_EQ(Used(), 2 * size);
+
+    EXPECT_EQ(persistence.front(), message);
+    persistence.pop();
+    EXPECT_EQ(Used(), size);
+    persistence.pop();
+    EXPECT_EQ(Used(), 0);
+    EXPECT_TRUE(persistence.empty());
+}
+
+TEST_F(BudgetedMessagePersistenceTests, ReturnTheRoomOfTheMessagesThePersistenceDrops)
+{
+    auto persistence = BudgetedMessagePersistence{std::unique_ptr<MessagePersistence>{new CappedMessagePersistence{2}},
+                                                  m_protocolMock, memoryBudget};
+    const auto size = MemoryBudget::sizeOf(*GenerateMessage());
+    for (auto i = 0; i < 5; ++i)
+        ASSERT_TRUE(persistence.push(GenerateMessage()));
+    EXPECT_EQ(Used(), 2 * size);
+
+    // Popping the messages that are left returns the rest of the room
+    persistence.pop();
+    persistence.pop();
+    EXPECT_TRUE(persistence.empty());
+    EXPECT_EQ(Used(), 0);
+}
+
+TEST_F(BudgetedMessagePersistenceTests, RefuseTheMessagesOverTheBudget)
+{
+    auto persistence = BudgetedMessagePersistence{std::unique_ptr<MessagePersistence>{new InMemoryMessagePersistence},
+                                                  m_protocolMock, memoryBudget};
+    auto taken = memoryBudget->reserve("test", MessageType::DEVICE_REGISTRATION, 990);
+    ASSERT_TRUE(taken);
+
+    EXPECT_FALSE(persistence.push(GenerateMessage()));
+    EXPECT_TRUE(persistence.empty());
+    EXPECT_EQ(memoryBudget->getStatistics().refused, 1);
+}
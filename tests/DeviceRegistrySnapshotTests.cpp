@@ -0,0 +1,161 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "core/utility/Logger.h"
+#include "gateway/repository/device/DeviceRegistrySnapshot.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class DeviceRegistrySnapshotTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    void TearDown() override { std::remove(SNAPSHOT_PATH.c_str()); }
+
+    static std::string ReadFile()
+    {
+        auto file = std::ifstream{SNAPSHOT_PATH, std::ios::binary};
+        return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+
+    static void WriteFile(const std::string& content)
+    {
+        auto file = std::ofstream{SNAPSHOT_PATH, std::ios::binary | std::ios::trunc};
+        file << content;
+    }
+
+    static bool WriteSnapshot()
+    {
+        return DeviceRegistrySnapshot::write(
+          SNAPSHOT_PATH,
+          {StoredDeviceInformation{"B", DeviceOwnership::Gateway, std::chrono::milliseconds{200}},
+           StoredDeviceInformation{"A", DeviceOwnership::Platform, std::chrono::milliseconds{100}},
+           StoredDeviceInformation{"B", DeviceOwnership::Gateway, std::chrono::milliseconds{200}},
+           StoredDeviceInformation{"CC", DeviceOwnership::Platform, std::chrono::milliseconds{300}}},
+          std::chrono::milliseconds{300});
+    }
+
+    static const std::string SNAPSHOT_PATH;
+};
+
+const std::string DeviceRegistrySnapshotTests::SNAPSHOT_PATH = "./deviceRegistrySnapshotTests.snapshot";
+
+TEST_F(DeviceRegistrySnapshotTests, RoundTrip)
+{
+    ASSERT_TRUE(WriteSnapshot());
+    const auto snapshot = DeviceRegistrySnapshot::open(SNAPSHOT_PATH);
+    ASSERT_NE(snapshot, nullptr);
+
+    // The devices are sorted by their keys, and listed only once
+    EXPECT_EQ(snapshot->size(), 3);
+    EXPECT_EQ(snapshot->latestTimestamp(), std::chrono::milliseconds{300});
+    EXPECT_EQ(snapshot->at(0).getDeviceKey(), "A");
+    EXPECT_EQ(snapshot->at(2).getDeviceKey(), "CC");
+
+    const auto device = snapshot->find("B");
+    EXPECT_EQ(device.getDeviceKey(), "B");
+    EXPECT_EQ(device.getDeviceBelongsTo(), DeviceOwnership::Gateway);
+    EXPECT_EQ(device.getTimestamp(), std::chrono::milliseconds{200});
+    EXPECT_TRUE(snapshot->find("C").getDeviceKey().empty());
+    EXPECT_TRUE(snapshot->find("D").getDeviceKey().empty());
+}
+
+TEST_F(DeviceRegistrySnapshotTests, EmptySnapshot)
+{
+    ASSERT_TRUE(DeviceRegistrySnapshot::write(SNAPSHOT_PATH, {}, std::chrono::milliseconds{0}));
+    const auto snapshot = DeviceRegistrySnapshot::open(SNAPSHOT_PATH);
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_EQ(snapshot->size(), 0);
+    EXPECT_TRUE(snapshot->find("A").getDeviceKey().empty());
+}
+
+TEST_F(DeviceRegistrySnapshotTests, MissingFile)
+{
+    EXPECT_EQ(DeviceRegistrySnapshot::open(SNAPSHOT_PATH), nullptr);
+}
+
+TEST_F(DeviceRegistrySnapshotTests, TruncatedFile)
+{
+    ASSERT_TRUE(WriteSnapshot());
+    const auto content = ReadFile();
+    WriteFile(content.substr(0, content.size() - 1));
+    EXPECT_EQ(DeviceRegistrySnapshot::open(SNAPSHOT_PATH), nullptr);
+    WriteFile(content.substr(0, 16));
+    EXPECT_EQ(DeviceRegistrySnapshot::open(SNAPSHOT_PATH), nullptr);
+}
+
+TEST_F(DeviceRegistrySnapshotTests, CorruptFile)
+{
+    ASSERT_TRUE(WriteSnapshot());
+    const auto content = ReadFile();
+
+    // A wrong magic
+    auto corrupted = content;
+    corrupted[0] = 'X';
+    WriteFile(corrupted);
+    EXPECT_EQ(DeviceRegistrySnapshot::open(SNAPSHOT_PATH), nullptr);
+
+    // Keys that are out of order
+    corrupted = content;
+    std::swap(corrupted[corrupted.size() - 4], corrupted[corrupted.size() - 3]);
+    WriteFile(corrupted);
+    EXPECT_EQ(DeviceRegistrySnapshot::open(SNAPSHOT_PATH), nullptr);
+
+    // An ownership value that does not exist
+    corrupted = content;
+    corrupted[corrupted.size() - 5] = 7;
+    WriteFile(corrupted);
+    EXPECT_EQ(DeviceRegistrySnapshot::open(SNAPSHOT_PATH), nullptr);
+
+    // And the ownership of a device that belongs to no one
+    corrupted = content;
+    corrupted[corrupted.size() - 5] = static_cast<char>(DeviceOwnership::None);
+    WriteFile(corrupted);
+    EXPECT_EQ(DeviceRegistrySnapshot::open(SNAPSHOT_PATH), nullptr);
+}
+
+TEST_F(DeviceRegistrySnapshotTests, MalformedKeyOffsets)
+{
+    ASSERT_TRUE(WriteSnapshot());
+    const auto content = ReadFile();
+    const auto writeOffsets = [&](const std::vector<std::uint64_t>& offsets) {
+        auto corrupted = content;
+        std::memcpy(&corrupted[40], offsets.data(), offsets.size() * sizeof(std::uint64_t));
+        WriteFile(corrupted);
+    };
+
+    // Offsets that keep increasing, but point far past the end of the file
+    writeOffsets({0, 5000, 6000, 4});
+    EXPECT_EQ(DeviceRegistrySnapshot::open(SNAPSHOT_PATH), nullptr);
+
+    // And a last offset that does not end where the keys do
+    writeOffsets({0, 1, 2, 5000});
+    EXPECT_EQ(DeviceRegistrySnapshot::open(SNAPSHOT_PATH), nullptr);
+
+    // While the original offsets are fine
+    writeOffsets({0, 1, 2, 4});
+    EXPECT_NE(DeviceRegistrySnapshot::open(SNAPSHOT_PATH), nullptr);
+}
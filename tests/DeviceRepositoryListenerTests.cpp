@@ -0,0 +1,167 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <any>
+#include <sstream>
+
+#define private public
+#define protected public
+#include "gateway/repository/device/DeviceRepository.h"
+#undef private
+#undef protected
+
+#include "core/utility/Logger.h"
+#include "gateway/repository/device/AsyncDeviceRepository.h"
+#include "gateway/repository/device/InMemoryDeviceRepository.h"
+#include "gateway/repository/device/SQLiteDeviceRepository.h"
+#include "tests/mocks/DeviceRepositoryListenerMock.h"
+
+#include <gtest/gtest.h>
+
+#include <future>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class DeviceRepositoryListenerTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    void SetUp() override { m_listenerMock = std::make_shared<StrictMock<DeviceRepositoryListenerMock>>(); }
+
+    static StoredDeviceInformation Device(const std::string& deviceKey, const std::string& deviceType = {})
+    {
+        return StoredDeviceInformation{deviceKey, DeviceOwnership::Platform, std::chrono::milliseconds{1},
+                                       deviceType};
+    }
+
+    static std::vector<std::string> KeysOf(const std::vector<StoredDeviceInformation>& devices)
+    {
+        auto deviceKeys = std::vector<std::string>{};
+        for (const auto& device : devices)
+            deviceKeys.emplace_back(device.getDeviceKey());
+        return deviceKeys;
+    }
+
+    std::shared_ptr<StrictMock<DeviceRepositoryListenerMock>> m_listenerMock;
+};
+
+TEST_F(DeviceRepositoryListenerTests, NotifyRegisteredListeners)
+{
+    auto repository = InMemoryDeviceRepository{};
+    repository.addListener("Test", m_listenerMock);
+
+    // A bulk save is reported as a single event
+    auto added = std::vector<std::string>{};
+    EXPECT_CALL(*m_listenerMock, onDevicesAdded).WillOnce([&](const std::vector<StoredDeviceInformation>& devices) {
+        added = KeysOf(devices);
+    });
+    ASSERT_TRUE(repository.save({Device("A"), Device("B")}));
+    EXPECT_THAT(added, ElementsAre("A", "B"));
+
+    // Known devices are reported as updated, new ones as added
+    auto updated = std::vector<std::string>{};
+    EXPECT_CALL(*m_listenerMock, onDevicesAdded).WillOnce([&](const std::vector<StoredDeviceInformation>& devices) {
+        added = KeysOf(devices);
+    });
+    EXPECT_CALL(*m_listenerMock, onDevicesUpdated).WillOnce([&](const std::vector<StoredDeviceInformation>& devices) {
+        updated = KeysOf(devices);
+    });
+    ASSERT_TRUE(repository.save({Device("A", "Type"), Device("C")}));
+    EXPECT_THAT(added, ElementsAre("C"));
+    EXPECT_THAT(updated, ElementsAre("A"));
+
+    // Only the devices that were held are reported as removed
+    EXPECT_CALL(*m_listenerMock, onDevicesRemoved(ElementsAre("A"))).Times(1);
+    ASSERT_TRUE(repository.remove({"A", "X"}));
+    ASSERT_TRUE(repository.remove({"X"}));
+
+    EXPECT_CALL(*m_listenerMock, onAllDevicesRemoved).Times(1);
+    ASSERT_TRUE(repository.removeAll());
+
+    // And nothing is reported once the listener is removed
+    repository.removeListener("Test");
+    ASSERT_TRUE(repository.save({Device("D")}));
+}
+
+TEST_F(DeviceRepositoryListenerTests, ExpiredListenersAreDropped)
+{
+    auto repository = InMemoryDeviceRepository{};
+    repository.addListener("Test", m_listenerMock);
+    repository.addListener("Null", nullptr);
+    EXPECT_EQ(repository.m_listeners.size(), 1);
+
+    // The repository does not keep the listener alive
+    auto listener = std::weak_ptr<DeviceRepositoryListener>{m_listenerMock};
+    m_listenerMock.reset();
+    EXPECT_TRUE(listener.expired());
+    ASSERT_TRUE(repository.save({Device("A")}));
+    EXPECT_TRUE(repository.m_listeners.empty());
+}
+
+TEST_F(DeviceRepositoryListenerTests, NotifyOutsideOfTheLocks)
+{
+    auto repository = InMemoryDeviceRepository{};
+    repository.addListener("Test", m_listenerMock);
+
+    // Another thread can use the repository, and the listener can change the listeners, while being notified
+    auto otherListener = std::make_shared<NiceMock<DeviceRepositoryListenerMock>>();
+    EXPECT_CALL(*m_listenerMock, onDevicesAdded).WillOnce([&](const std::vector<StoredDeviceInformation>&) {
+        auto lookup = std::async(std::launch::async, [&] { return repository.containsDevice("A"); });
+        ASSERT_EQ(lookup.wait_for(std::chrono::seconds{1}), std::future_status::ready);
+        EXPECT_TRUE(lookup.get());
+        repository.addListener("Other", otherListener);
+        repository.removeListener("Test");
+    });
+    ASSERT_TRUE(repository.save({Device("A")}));
+
+    EXPECT_CALL(*otherListener, onDevicesAdded).Times(1);
+    ASSERT_TRUE(repository.save({Device("B")}));
+}
+
+TEST_F(DeviceRepositoryListenerTests, SQLiteReportsOnlyTheRemovedDevices)
+{
+    auto repository = SQLiteDeviceRepository{":memory:"};
+    repository.addListener("Test", m_listenerMock);
+
+    EXPECT_CALL(*m_listenerMock, onDevicesAdded).Times(1);
+    ASSERT_TRUE(repository.save({Device("A"), Device("B")}));
+    EXPECT_CALL(*m_listenerMock, onDevicesRemoved(ElementsAre("A"))).Times(1);
+    ASSERT_TRUE(repository.remove({"A", "X"}));
+    ASSERT_TRUE(repository.remove({"X"}));
+}
+
+TEST_F(DeviceRepositoryListenerTests, EvictedDevicesAreReportedOnceRemovedFromPersistentStorage)
+{
+    auto persistentRepository = std::make_shared<SQLiteDeviceRepository>(":memory:");
+    auto repository = InMemoryDeviceRepository{persistentRepository, {}, 1};
+    ASSERT_TRUE(repository.save({Device("A"), Device("B")}));
+    ASSERT_TRUE(repository.flush(std::chrono::seconds{1}));
+    repository.addListener("Test", m_listenerMock);
+
+    // A was evicted from the cache, so only the persistent repository can tell whether it was held
+    auto removed = std::promise<std::vector<std::string>>{};
+    EXPECT_CALL(*m_listenerMock, onDevicesRemoved)
+      .WillOnce([&](const std::vector<std::string>& deviceKeys) { removed.set_value(deviceKeys); });
+    ASSERT_TRUE(repository.remove({"A", "X"}));
+    ASSERT_TRUE(repository.flush(std::chrono::seconds{1}));
+    auto future = removed.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds{1}), std::future_status::ready);
+    EXPECT_THAT(future.get(), ElementsAre("A"));
+}
@@ -24,6 +24,7 @@
 #undef protected
 
 #include "core/utility/Logger.h"
+#include "gateway/repository/device/AsyncDeviceRepository.h"
 #include "tests/mocks/DeviceRepositoryMock.h"
 #include "tests/mocks/ExistingDeviceRepositoryMock.h"
 #include "tests/mocks/GatewayRegistrationProtocolMock.h"
@@ -33,6 +34,8 @@
 
 #include <gtest/gtest.h>
 
+#include <thread>
+
 using namespace wolkabout;
 using namespace wolkabout::gateway;
 using namespace ::testing;
@@ -52,6 +55,7 @@ public:
         localOutboundMessageHandlerMock = std::make_shared<StrictMock<OutboundMessageHandlerMock>>();
         deviceRepositoryMock = std::make_shared<StrictMock<DeviceRepositoryMock>>();
         existingDevicesRepositoryMock = std::make_shared<ExistingDevicesRepositoryMock>();
+
         service = std::unique_ptr<DevicesService>{
           new DevicesService{GATEWAY_KEY, *registrationProtocolMock, *platformOutboundMessageHandlerMock,
                              *platformOutboundRetryMessageHandlerMock, gatewayRegistrationProtocolMock,
@@ -112,7 +116,9 @@ TEST_F(DevicesServiceTests, DeviceExistsNoRepository)
 TEST_F(DevicesServiceTests, DeviceExistsRepository)
 {
     EXPECT_CALL(*deviceRepositoryMock, containsDevice(DEVICE_KEY)).WillOnce(Return(true));
+    EXPECT_CALL(*deviceRepositoryMock, containsDevice("UNKNOWN_DEVICE")).WillOnce(Return(false));
     EXPECT_TRUE(service->deviceExists(DEVICE_KEY));
+    EXPECT_FALSE(service->deviceExists("UNKNOWN_DEVICE"));
 }
 
 TEST_F(DevicesServiceTests, HandleChildrenSynchronizationResponseWithCallback)
@@ -122,7 +128,7 @@ TEST_F(DevicesServiceTests, HandleChildrenSynchronizationResponseWithCallback)
       new ChildrenSynchronizationResponseMessage{{"Child1", "Child2"}}};
     const auto address = responseMessage.get();
     std::atomic_bool called{false};
-    service->m_childSyncRequests.push(std::make_shared<ChildrenSynchronizationRequestCallback>(
+    service->m_childSyncRequests.add(1, std::make_shared<ChildrenSynchronizationRequestCallback>(
       [&](const std::shared_ptr<ChildrenSynchronizationResponseMessage>& message) {
           EXPECT_EQ(address, message.get());
           called = true;
@@ -132,7 +138,7 @@ TEST_F(DevicesServiceTests, HandleChildrenSynchronizationResponseWithCallback)
     // Set up the repositories to be invoked
     EXPECT_CALL(*deviceRepositoryMock, save).Times(1);
     EXPECT_CALL(*existingDevicesRepositoryMock, getDeviceKeys).WillOnce(Return(std::vector<std::string>{"Child1"}));
-    EXPECT_CALL(*existingDevicesRepositoryMock, addDeviceKey).Times(1);
+    EXPECT_CALL(*existingDevicesRepositoryMock, addDeviceKeys(std::vector<std::string>{"Child2"})).Times(1);
 
     // Invoke the method
     ASSERT_NO_FATAL_FAILURE(service->handleChildrenSynchronizationResponse(std::move(responseMessage)));
@@ -151,7 +157,7 @@ TEST_F(DevicesServiceTests, HandlerRegisteredDevicesResponseWithCallback)
     auto responseMessage = std::unique_ptr<RegisteredDevicesResponseMessage>{new RegisteredDevicesResponseMessage{
       std::chrono::milliseconds{1234567890}, "Type1", {}, {{"Device1", "Id1", "Type1"}, {"Device2", "Id2", "Type1"}}}};
     const auto address = responseMessage.get();
-    service->m_registeredDevicesRequests.emplace(
+    service->m_registeredDevicesRequests.add(
       RegisteredDevicesRequestParameters{responseMessage->getTimestampFrom(), responseMessage->getDeviceType(),
                                          responseMessage->getExternalId()},
       std::make_shared<RegisteredDevicesRequestCallback>(
@@ -174,6 +180,34 @@ TEST_F(DevicesServiceTests, HandlerRegisteredDevicesResponseWithCallback)
     EXPECT_TRUE(called);
 }
 
+TEST_F(DevicesServiceTests, HandleRegisteredDevicesResponseBringsRepositoryUpToDate)
+{
+    service->setRegisteredDevicesStalenessBound(std::chrono::minutes{1});
+
+    // The response continues from the latest stored timestamp, so the repository has no gaps once it is stored
+    EXPECT_CALL(*deviceRepositoryMock, latestPlatformTimestamp).WillOnce(Return(std::chrono::milliseconds{1234567890}));
+    EXPECT_CALL(*deviceRepositoryMock, save).WillOnce(Return(true));
+    ASSERT_NO_FATAL_FAILURE(service->handleRegisteredDevicesResponse(
+      std::unique_ptr<RegisteredDevicesResponseMessage>{new RegisteredDevicesResponseMessage{
+        std::chrono::milliseconds{1234567890}, {}, {}, {{"Device1", "Id1", "Type1"}}}}));
+    service->m_deviceRepository->flush();
+    EXPECT_GT(service->m_storedDevicesSyncTime.count(), 0);
+    EXPECT_FALSE(service->m_storedDevicesFromStart);
+}
+
+TEST_F(DevicesServiceTests, HandleRegisteredDevicesResponseFillsRepositoryFromStart)
+{
+    service->setRegisteredDevicesStalenessBound(std::chrono::minutes{1});
+
+    EXPECT_CALL(*deviceRepositoryMock, latestPlatformTimestamp).WillOnce(Return(std::chrono::milliseconds{0}));
+    EXPECT_CALL(*deviceRepositoryMock, save).WillOnce(Return(true));
+    ASSERT_NO_FATAL_FAILURE(service->handleRegisteredDevicesResponse(
+      std::unique_ptr<RegisteredDevicesResponseMessage>{new RegisteredDevicesResponseMessage{
+        std::chrono::milliseconds{0}, {}, {}, {{"Device1", "Id1", "Type1"}}}}));
+    service->m_deviceRepository->flush();
+    EXPECT_TRUE(service->m_storedDevicesFromStart);
+}
+
 TEST_F(DevicesServiceTests, ReceivedMessagesOneMessageOfUnknownType)
 {
     // Set up the expected calls
@@ -218,7 +252,7 @@ TEST_F(DevicesServiceTests, ReceivedMessageTwoMessagesBothCallTheActualMethods)
                                              {{"Device1", "Id1", "Type1"}, {"Device2", "Id2", "Type1"}}}})));
     EXPECT_CALL(*deviceRepositoryMock, save).Times(2);
     EXPECT_CALL(*existingDevicesRepositoryMock, getDeviceKeys).Times(1);
-    EXPECT_CALL(*existingDevicesRepositoryMock, addDeviceKey).Times(1);
+    EXPECT_CALL(*existingDevicesRepositoryMock, addDeviceKeys).Times(1);
 
     // Invoke the service
     ASSERT_NO_FATAL_FAILURE(service->receiveMessages(
@@ -272,13 +306,110 @@ TEST_F(DevicesServiceTests, RegisterChildDevicesProtocolParses)
           if (!(success.empty() || failed.empty()))
               called = true;
       }));
-    ASSERT_FALSE(service->m_childSyncRequests.empty());
-    ASSERT_TRUE(service->m_childSyncRequests.front()->getLambda());
-    ASSERT_NO_FATAL_FAILURE(service->m_childSyncRequests.front()->getLambda()(
+    const auto requests = service->m_childSyncRequests.take(1);
+    ASSERT_EQ(requests.size(), 1);
+    ASSERT_TRUE(requests.front()->getLambda());
+    ASSERT_NO_FATAL_FAILURE(requests.front()->getLambda()(
       std::make_shared<ChildrenSynchronizationResponseMessage>(std::vector<std::string>{"D1"})));
     EXPECT_TRUE(called);
 }
 
+TEST_F(DevicesServiceTests, RegisterChildDevicesBatchSentOutOnceFull)
+{
+    service->setRegistrationBatching(std::chrono::seconds{10}, 3);
+
+    // A single registration and a single synchronization request for both calls
+    EXPECT_CALL(*registrationProtocolMock, makeOutboundMessage(_, A<const DeviceRegistrationMessage&>()))
+      .WillOnce([](const std::string&, const DeviceRegistrationMessage& message) {
+          EXPECT_EQ(message.getDevices().size(), 3);
+          return std::unique_ptr<wolkabout::Message>{new wolkabout::Message{"", ""}};
+      });
+    EXPECT_CALL(*platformOutboundMessageHandlerMock, addMessage).Times(1);
+    EXPECT_CALL(*registrationProtocolMock, makeOutboundMessage(_, A<const ChildrenSynchronizationRequestMessage&>()))
+      .WillOnce(Return(ByMove(std::unique_ptr<wolkabout::Message>{new wolkabout::Message{"", ""}})));
+    EXPECT_CALL(*registrationProtocolMock,
+                getResponseChannelForMessage(MessageType::CHILDREN_SYNCHRONIZATION_REQUEST, _))
+      .Times(1);
+    EXPECT_CALL(*platformOutboundRetryMessageHandlerMock, addMessage).Times(1);
+
+    // Register the devices in two calls, and resolve both of them with one response
+    auto firstResult = std::pair<std::vector<std::string>, std::vector<std::string>>{};
+    auto secondResult = std::pair<std::vector<std::string>, std::vector<std::string>>{};
+    ASSERT_TRUE(service->registerChildDevices({DeviceRegistrationData{"Device One", "D1", "", {}, {}, {}},
+                                               DeviceRegistrationData{"Device Two", "D2", "", {}, {}, {}}},
+                                              [&](const std::vector<std::string>& success,
+                                                  const std::vector<std::string>& failed) {
+                                                  firstResult = {success, failed};
+                                              }));
+    EXPECT_TRUE(service->m_childSyncRequests.empty());
+    ASSERT_TRUE(service->registerChildDevices({DeviceRegistrationData{"Device Three", "D3", "", {}, {}, {}}},
+                                              [&](const std::vector<std::string>& success,
+                                                  const std::vector<std::string>& failed) {
+                                                  secondResult = {success, failed};
+                                              }));
+    const auto requests = service->m_childSyncRequests.take(1);
+    ASSERT_EQ(requests.size(), 1);
+    ASSERT_NO_FATAL_FAILURE(requests.front()->getLambda()(
+      std::make_shared<ChildrenSynchronizationResponseMessage>(std::vector<std::string>{"D1", "D3"})));
+    EXPECT_EQ(firstResult.first, std::vector<std::string>{"D1"});
+    EXPECT_EQ(firstResult.second, std::vector<std::string>{"D2"});
+    EXPECT_EQ(secondResult.first, std::vector<std::string>{"D3"});
+    EXPECT_TRUE(secondResult.second.empty());
+}
+
+TEST_F(DevicesServiceTests, RegisterChildDevicesBatchSentOutOnceWindowCloses)
+{
+    service->setRegistrationBatching(std::chrono::milliseconds{10}, 0);
+
+    // The batch fails to be parsed, which has to be reported to the caller
+    std::atomic_bool called{false};
+    EXPECT_CALL(*registrationProtocolMock, makeOutboundMessage(_, A<const DeviceRegistrationMessage&>()))
+      .WillOnce(Return(ByMove(nullptr)));
+    ASSERT_TRUE(service->registerChildDevices(
+      {DeviceRegistrationData{"Device One", "D1", "", {}, {}, {}}},
+      [&](const std::vector<std::string>& success, const std::vector<std::string>& failed) {
+          EXPECT_TRUE(success.empty());
+          EXPECT_EQ(failed, std::vector<std::string>{"D1"});
+          called = true;
+          conditionVariable.notify_one();
+      }));
+    if (!called)
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        conditionVariable.wait_for(lock, std::chrono::milliseconds{100}, [&] { return called.load(); });
+    }
+    EXPECT_TRUE(called);
+}
+
+TEST_F(DevicesServiceTests, RegisterChildDevicesBatchedFromManyThreads)
+{
+    service->setRegistrationBatching(std::chrono::milliseconds{1}, 5);
+
+    // Every batch fails to be parsed, so every registration is reported back
+    EXPECT_CALL(*registrationProtocolMock, makeOutboundMessage(_, A<const DeviceRegistrationMessage&>()))
+      .WillRepeatedly([](const std::string&, const DeviceRegistrationMessage&) {
+          return std::unique_ptr<wolkabout::Message>{};
+      });
+    std::atomic<std::size_t> reported{0};
+    auto threads = std::vector<std::thread>{};
+    for (auto i = 0; i < 4; ++i)
+        threads.emplace_back([&, i] {
+            for (auto j = 0; j < 25; ++j)
+                service->registerChildDevices(
+                  {DeviceRegistrationData{"Device", "D" + std::to_string(i * 25 + j), "", {}, {}, {}}},
+                  [&](const std::vector<std::string>&, const std::vector<std::string>&) {
+                      ++reported;
+                      conditionVariable.notify_one();
+                  });
+        });
+    for (auto& thread : threads)
+        thread.join();
+
+    std::unique_lock<std::mutex> lock{mutex};
+    conditionVariable.wait_for(lock, std::chrono::seconds{1}, [&] { return reported.load() == 100; });
+    EXPECT_EQ(reported, 100);
+}
+
 TEST_F(DevicesServiceTests, RemoveChildDevicesEmptyVector)
 {
     EXPECT_FALSE(service->removeChildDevices({}));
@@ -325,6 +456,8 @@ TEST_F(DevicesServiceTests, SendOutChildrenSynchronizationRequestRetryCallbackCa
       [&](const std::shared_ptr<ChildrenSynchronizationResponseMessage>&) { called = true; },
       std::vector<std::string>{"Device 1", "Device 2"})));
     EXPECT_TRUE(called);
+    EXPECT_EQ(service->getChildrenSynchronizationRequestStatistics().resolved, 0);
+    EXPECT_EQ(service->getChildrenSynchronizationRequestStatistics().failed, 1);
 }
 
 TEST_F(DevicesServiceTests, SendOutRegisteredDevicesRequestFailsToParse)
@@ -346,7 +479,63 @@ TEST_F(DevicesServiceTests, SendOutRegisteredDevicesRequestRetryCallback)
     EXPECT_TRUE(service->m_registeredDevicesRequests.empty());
     ASSERT_TRUE(service->sendOutRegisteredDevicesRequest(
       RegisteredDevicesRequestParameters{std::chrono::milliseconds{1234567890}}, {}));
-    EXPECT_FALSE(service->m_registeredDevicesRequests.empty());
+    EXPECT_TRUE(service->m_registeredDevicesRequests.empty());
+    EXPECT_EQ(service->getRegisteredDevicesRequestStatistics().resolved, 0);
+    EXPECT_EQ(service->getRegisteredDevicesRequestStatistics().failed, 1);
+}
+
+TEST_F(DevicesServiceTests, SendOutRegisteredDevicesRequestJoinsIdenticalRequest)
+{
+    EXPECT_CALL(*registrationProtocolMock, makeOutboundMessage(_, A<const RegisteredDevicesRequestMessage&>()))
+      .Times(3)
+      .WillRepeatedly([](const std::string&, const RegisteredDevicesRequestMessage&) {
+          return std::unique_ptr<wolkabout::Message>{new wolkabout::Message{"", ""}};
+      });
+    EXPECT_CALL(*registrationProtocolMock, getResponseChannelForMessage(MessageType::REGISTERED_DEVICES_REQUEST, _))
+      .Times(2);
+    EXPECT_CALL(*platformOutboundRetryMessageHandlerMock, addMessage).Times(2);
+
+    // Only the first of the identical requests is sent out
+    const auto params = RegisteredDevicesRequestParameters{std::chrono::milliseconds{1234567890}, "Type1", {}};
+    ASSERT_TRUE(service->sendOutRegisteredDevicesRequest(params, {}));
+    ASSERT_TRUE(service->sendOutRegisteredDevicesRequest(params, {}));
+    ASSERT_TRUE(service->sendOutRegisteredDevicesRequest(
+      RegisteredDevicesRequestParameters{std::chrono::milliseconds{1234567890}, "Type2", {}}, {}));
+    EXPECT_EQ(service->m_registeredDevicesRequests.take(params).size(), 2);
+}
+
+TEST_F(DevicesServiceTests, HandleChildrenSynchronizationResponseResolvesMatchingRequests)
+{
+    // The requests are resolved only if the response lists all of their devices, the others are left to expire
+    std::atomic_int resolved{0};
+    const auto makeCallback = [&](std::vector<std::string> devices) {
+        return std::make_shared<ChildrenSynchronizationRequestCallback>(
+          [&](const std::shared_ptr<ChildrenSynchronizationResponseMessage>&) {
+              ++resolved;
+              conditionVariable.notify_one();
+          },
+          std::move(devices));
+    };
+    service->m_deviceRepository = nullptr;
+    service->m_existingDeviceRepository = nullptr;
+    service->m_childSyncRequests.add(1, makeCallback({"D5"}));
+    service->m_childSyncRequests.add(2, makeCallback({"D1", "D3"}));
+    service->m_childSyncRequests.add(3, makeCallback({"D1", "D4"}));
+    service->m_childSyncRequests.add(4, makeCallback({}));
+
+    ASSERT_NO_FATAL_FAILURE(service->handleChildrenSynchronizationResponse(
+      std::unique_ptr<ChildrenSynchronizationResponseMessage>{
+        new ChildrenSynchronizationResponseMessage{{"D1", "D2", "D3"}}}));
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        conditionVariable.wait_for(lock, std::chrono::milliseconds{100}, [&] { return resolved == 2; });
+    }
+    EXPECT_EQ(resolved, 2);
+    const auto statistics = service->getChildrenSynchronizationRequestStatistics();
+    EXPECT_EQ(statistics.outstanding, 2);
+    EXPECT_EQ(statistics.resolved, 2);
+    EXPECT_EQ(service->m_childSyncRequests.take(1).size(), 1);
+    EXPECT_EQ(service->m_childSyncRequests.take(3).size(), 1);
 }
 
 TEST_F(DevicesServiceTests, UpdateDeviceCacheNoDeviceRepository)
@@ -359,9 +548,12 @@ TEST_F(DevicesServiceTests, UpdateDeviceCacheWithDevicesToDeleteFailsToDelete)
 {
     // Update calls
     EXPECT_CALL(*deviceRepositoryMock, latestPlatformTimestamp).Times(1);
-    EXPECT_CALL(*deviceRepositoryMock, getGatewayDevices)
-      .WillOnce(Return(std::vector<StoredDeviceInformation>{
-        StoredDeviceInformation{"Test Device Key", DeviceOwnership::Gateway, std::chrono::milliseconds{0}}}));
+    EXPECT_CALL(*deviceRepositoryMock, forEachGatewayDevice)
+      .WillOnce([](const DevicePageVisitor& visitor, std::size_t) {
+          visitor(std::vector<StoredDeviceInformation>{
+            StoredDeviceInformation{"Test Device Key", DeviceOwnership::Gateway, std::chrono::milliseconds{0}}});
+          return true;
+      });
     EXPECT_CALL(*deviceRepositoryMock, remove).Times(0);
     EXPECT_CALL(*existingDevicesRepositoryMock, getDeviceKeys).WillOnce(Return(std::vector<std::string>{}));
     EXPECT_CALL(*registrationProtocolMock, makeOutboundMessage(_, A<const DeviceRemovalMessage&>()))
@@ -373,17 +565,22 @@ TEST_F(DevicesServiceTests, UpdateDeviceCacheWithDevicesToDeleteFailsToDelete)
     EXPECT_CALL(*registrationProtocolMock, makeOutboundMessage(_, A<const RegisteredDevicesRequestMessage&>()))
       .WillOnce(Return(ByMove(nullptr)));
 
-    // Call the service
+    // Call the service, and wait for the calls it queued
     ASSERT_NO_FATAL_FAILURE(service->updateDeviceCache());
+    EXPECT_TRUE(service->m_queue.drain(std::chrono::seconds{1}));
+    service->m_deviceRepository->flush();
 }
 
 TEST_F(DevicesServiceTests, UpdateDeviceCacheWithDevicesToDeleteSucceedsToDelete)
 {
     // Update calls
     EXPECT_CALL(*deviceRepositoryMock, latestPlatformTimestamp).Times(1);
-    EXPECT_CALL(*deviceRepositoryMock, getGatewayDevices)
-      .WillOnce(Return(std::vector<StoredDeviceInformation>{
-        StoredDeviceInformation{"Test Device Key", DeviceOwnership::Gateway, std::chrono::milliseconds{0}}}));
+    EXPECT_CALL(*deviceRepositoryMock, forEachGatewayDevice)
+      .WillOnce([](const DevicePageVisitor& visitor, std::size_t) {
+          visitor(std::vector<StoredDeviceInformation>{
+            StoredDeviceInformation{"Test Device Key", DeviceOwnership::Gateway, std::chrono::milliseconds{0}}});
+          return true;
+      });
     EXPECT_CALL(*deviceRepositoryMock, remove).Times(1);
     EXPECT_CALL(*existingDevicesRepositoryMock, getDeviceKeys).WillOnce(Return(std::vector<std::string>{}));
     EXPECT_CALL(*registrationProtocolMock, makeOutboundMessage(_, A<const DeviceRemovalMessage&>()))
@@ -396,8 +593,10 @@ TEST_F(DevicesServiceTests, UpdateDeviceCacheWithDevicesToDeleteSucceedsToDelete
     EXPECT_CALL(*registrationProtocolMock, makeOutboundMessage(_, A<const RegisteredDevicesRequestMessage&>()))
       .WillOnce(Return(ByMove(nullptr)));
 
-    // Call the service
+    // Call the service, and wait for the calls it queued
     ASSERT_NO_FATAL_FAILURE(service->updateDeviceCache());
+    EXPECT_TRUE(service->m_queue.drain(std::chrono::seconds{1}));
+    service->m_deviceRepository->flush();
 }
 
 TEST_F(DevicesServiceTests, MessageReceivedNoLocalProtocol)
@@ -454,9 +653,10 @@ TEST_F(DevicesServiceTests, MessageReceivedDeviceRegistrationRegistersDevicesBut
 
     // Call the service and handle the callback
     ASSERT_NO_FATAL_FAILURE(service->messageReceived(std::make_shared<wolkabout::Message>("", "")));
-    ASSERT_FALSE(service->m_childSyncRequests.empty());
-    ASSERT_TRUE(service->m_childSyncRequests.front()->getLambda());
-    ASSERT_NO_FATAL_FAILURE(service->m_childSyncRequests.front()->getLambda()(
+    const auto requests = service->m_childSyncRequests.take(1);
+    ASSERT_EQ(requests.size(), 1);
+    ASSERT_TRUE(requests.front()->getLambda());
+    ASSERT_NO_FATAL_FAILURE(requests.front()->getLambda()(
       std::make_shared<ChildrenSynchronizationResponseMessage>(std::vector<std::string>{"D1"})));
 }
 
@@ -489,9 +689,10 @@ TEST_F(DevicesServiceTests, MessageReceivedDeviceRegistrationRegistersDevices)
 
     // Call the service and handle the callback
     ASSERT_NO_FATAL_FAILURE(service->messageReceived(std::make_shared<wolkabout::Message>("", "")));
-    ASSERT_FALSE(service->m_childSyncRequests.empty());
-    ASSERT_TRUE(service->m_childSyncRequests.front()->getLambda());
-    ASSERT_NO_FATAL_FAILURE(service->m_childSyncRequests.front()->getLambda()(
+    const auto requests = service->m_childSyncRequests.take(1);
+    ASSERT_EQ(requests.size(), 1);
+    ASSERT_TRUE(requests.front()->getLambda());
+    ASSERT_NO_FATAL_FAILURE(requests.front()->getLambda()(
       std::make_shared<ChildrenSynchronizationResponseMessage>(std::vector<std::string>{"D1"})));
 }
 
@@ -580,15 +781,82 @@ TEST_F(DevicesServiceTests, MessageReceivedRegisteredDevicesCallbackCalledWithMe
     // Call the service
     ASSERT_NO_FATAL_FAILURE(service->messageReceived(std::make_shared<wolkabout::Message>("", "")));
     // Find the callback and invoke it
-    ASSERT_FALSE(service->m_registeredDevicesRequests.empty());
     const auto params = RegisteredDevicesRequestParameters{std::chrono::milliseconds{1234567890}, {}, {}};
-    const auto requestsIt = service->m_registeredDevicesRequests.find(params);
-    ASSERT_NE(requestsIt, service->m_registeredDevicesRequests.cend());
-    ASSERT_NO_FATAL_FAILURE(requestsIt->second->getLambda()(
+    const auto requests = service->m_registeredDevicesRequests.take(params);
+    ASSERT_EQ(requests.size(), 1);
+    ASSERT_NO_FATAL_FAILURE(requests.front()->getLambda()(
       std::make_shared<RegisteredDevicesResponseMessage>(std::chrono::milliseconds{1234567890}, std::string{},
                                                          std::string{}, std::vector<RegisteredDeviceInformation>{})));
 }
 
+TEST_F(DevicesServiceTests, MessageReceivedRegisteredDevicesAnsweredFromRepository)
+{
+    service->setRegisteredDevicesStalenessBound(std::chrono::minutes{1});
+    service->m_storedDevicesSyncTime =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+    service->m_storedDevicesFromStart = true;
+
+    // Handle calls
+    EXPECT_CALL(*gatewayRegistrationProtocolMock, getMessageType)
+      .WillOnce(Return(MessageType::REGISTERED_DEVICES_REQUEST));
+    EXPECT_CALL(*gatewayRegistrationProtocolMock, getDeviceKey).WillOnce(Return(DEVICE_KEY));
+    EXPECT_CALL(*gatewayRegistrationProtocolMock, parseRegisteredDevicesRequestMessage)
+      .WillOnce(Return(ByMove(std::unique_ptr<RegisteredDevicesRequestMessage>{
+        new RegisteredDevicesRequestMessage{std::chrono::milliseconds{0}, "Type1", {}}})));
+
+    // The devices are looked up in the repository, and nothing is sent to the platform. The gateway devices are left
+    // out, as the platform would not list them.
+    EXPECT_CALL(*deviceRepositoryMock, holdsAllDevices).WillRepeatedly(Return(true));
+    EXPECT_CALL(*deviceRepositoryMock, findDevices(std::chrono::milliseconds{0}, "Type1", ""))
+      .WillOnce(Return(std::vector<StoredDeviceInformation>{
+        StoredDeviceInformation{"Device1", DeviceOwnership::Platform, std::chrono::milliseconds{1234567891}, "Type1",
+                                "Id1"},
+        StoredDeviceInformation{"Device2", DeviceOwnership::Gateway, std::chrono::milliseconds{0}, "Type1"}}));
+    EXPECT_CALL(*gatewayRegistrationProtocolMock,
+                makeOutboundMessage(DEVICE_KEY, A<const RegisteredDevicesResponseMessage&>()))
+      .WillOnce([](const std::string&, const RegisteredDevicesResponseMessage& response) {
+          EXPECT_EQ(response.getDeviceType(), "Type1");
+          EXPECT_EQ(response.getMatchingDevices().size(), 1);
+          EXPECT_EQ(response.getMatchingDevices().front().deviceKey, "Device1");
+          EXPECT_EQ(response.getMatchingDevices().front().externalId, "Id1");
+          return std::unique_ptr<wolkabout::Message>{new wolkabout::Message{"", ""}};
+      });
+    EXPECT_CALL(*localOutboundMessageHandlerMock, addMessage).Times(1);
+    ASSERT_NO_FATAL_FAILURE(service->messageReceived(std::make_shared<wolkabout::Message>("", "")));
+    service->m_deviceRepository->flush();
+    EXPECT_TRUE(service->m_registeredDevicesRequests.empty());
+}
+
+TEST_F(DevicesServiceTests, RespondWithStoredDevicesOnlyForAllDevices)
+{
+    service->setRegisteredDevicesStalenessBound(std::chrono::minutes{1});
+    service->m_storedDevicesSyncTime =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+
+    // The repository has not been filled from the start, so not even a request for all the devices is answered
+    EXPECT_FALSE(service->respondWithStoredDevices(
+      DEVICE_KEY, RegisteredDevicesRequestParameters{std::chrono::milliseconds{0}, "Type1", {}}));
+
+    // And the stored timestamps are not the registration timestamps, so a request filtering by time is not answered
+    service->m_storedDevicesFromStart = true;
+    EXPECT_FALSE(service->respondWithStoredDevices(
+      DEVICE_KEY, RegisteredDevicesRequestParameters{std::chrono::milliseconds{1234567890}, "Type1", {}}));
+}
+
+TEST_F(DevicesServiceTests, RespondWithStoredDevicesOnlyIfTheRepositoryHoldsAllDevices)
+{
+    service->setRegisteredDevicesStalenessBound(std::chrono::minutes{1});
+    service->m_storedDevicesSyncTime =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+    service->m_storedDevicesFromStart = true;
+
+    // The repository has forgotten some of the devices, so the request is left to the platform
+    EXPECT_CALL(*deviceRepositoryMock, holdsAllDevices).WillRepeatedly(Return(false));
+    EXPECT_CALL(*deviceRepositoryMock, findDevices).Times(0);
+    EXPECT_FALSE(service->respondWithStoredDevices(
+      DEVICE_KEY, RegisteredDevicesRequestParameters{std::chrono::milliseconds{0}, "Type1", {}}));
+}
+
 TEST_F(DevicesServiceTests, MessageReceivedRegisteredDevicesCallbackCalledWithMessageSendsToLocalBroker)
 {
     // Handle calls
@@ -612,11 +880,10 @@ TEST_F(DevicesServiceTests, MessageReceivedRegisteredDevicesCallbackCalledWithMe
     // Call the service
     ASSERT_NO_FATAL_FAILURE(service->messageReceived(std::make_shared<wolkabout::Message>("", "")));
     // Find the callback and invoke it
-    ASSERT_FALSE(service->m_registeredDevicesRequests.empty());
     const auto params = RegisteredDevicesRequestParameters{std::chrono::milliseconds{1234567890}, {}, {}};
-    const auto requestsIt = service->m_registeredDevicesRequests.find(params);
-    ASSERT_NE(requestsIt, service->m_registeredDevicesRequests.cend());
-    ASSERT_NO_FATAL_FAILURE(requestsIt->second->getLambda()(
+    const auto requests = service->m_registeredDevicesRequests.take(params);
+    ASSERT_EQ(requests.size(), 1);
+    ASSERT_NO_FATAL_FAILURE(requests.front()->getLambda()(
       std::make_shared<RegisteredDevicesResponseMessage>(std::chrono::milliseconds{1234567890}, std::string{},
                                                          std::string{}, std::vector<RegisteredDeviceInformation>{})));
 }
@@ -15,6 +15,7 @@
  */
 
 #include <any>
+#include <map>
 #include <sstream>
 
 #define private public
@@ -357,3 +358,56 @@ TEST_F(ExternalDataServiceTests, ReceiveParametersMessage)
     }
     EXPECT_TRUE(called);
 }
+
+TEST_F(ExternalDataServiceTests, ReceiveFeedValuesOverMemoryBudget)
+{
+    // Most of the budget is already taken
+    auto memoryBudget = std::make_shared<MemoryBudget>(
+      1000, std::map<MessageType, OverloadPolicy>{{MessageType::FEED_VALUES, OverloadPolicy::Drop}});
+    service = std::unique_ptr<ExternalDataService>{
+      new ExternalDataService{GATEWAY_KEY, m_gatewaySubdeviceProtocolMock, *m_dataProtocolMock,
+                              m_platformOutboundMessageHandler, m_dataProviderMock, nullptr, memoryBudget}};
+    auto taken = memoryBudget->reserve("test", MessageType::DEVICE_REGISTRATION, 950);
+    ASSERT_TRUE(taken);
+    EXPECT_TRUE(service->isOverloaded());
+
+    // The received data does not fit, and is dropped
+    EXPECT_CALL(m_gatewaySubdeviceProtocolMock, getMessageType).WillOnce(Return(MessageType::FEED_VALUES));
+    EXPECT_CALL(m_gatewaySubdeviceProtocolMock, getDeviceKey).WillOnce(Return(GATEWAY_KEY));
+    EXPECT_CALL(*m_dataProtocolMock, parseFeedValues).Times(0);
+    EXPECT_CALL(m_dataProviderMock, onReadingData).Times(0);
+    ASSERT_NO_FATAL_FAILURE(service->receiveMessages(GenerateMessages(1)));
+    EXPECT_TRUE(service->drain(std::chrono::milliseconds{100}));
+
+    const auto statistics = memoryBudget->getStatistics();
+    EXPECT_EQ(statistics.refused, 1);
+    EXPECT_EQ(statistics.highWaterMark, 950);
+    ASSERT_EQ(statistics.consumers.size(), 2);
+    EXPECT_EQ(statistics.consumers[0].name, "external_data");
+    EXPECT_EQ(statistics.consumers[0].refused, 1);
+
+    // And the overload is over once the room is returned
+    taken.release();
+    EXPECT_FALSE(service->isOverloaded());
+}
+
+TEST_F(ExternalDataServiceTests, ReceiveFeedValuesOverMemoryBudgetOnTheExecutor)
+{
+    // The data handed over by the router arrives on a thread of the executor, which must not wait for the room
+    auto memoryBudget = std::make_shared<MemoryBudget>(
+      1000, std::map<MessageType, OverloadPolicy>{{MessageType::FEED_VALUES, OverloadPolicy::Backpressure}},
+      OverloadPolicy::Drop, std::chrono::seconds{10});
+    service = std::unique_ptr<ExternalDataService>{
+      new ExternalDataService{GATEWAY_KEY, m_gatewaySubdeviceProtocolMock, *m_dataProtocolMock,
+                              m_platformOutboundMessageHandler, m_dataProviderMock, nullptr, memoryBudget}};
+    auto taken = memoryBudget->reserve("test", MessageType::DEVICE_REGISTRATION, 1000);
+    ASSERT_TRUE(taken);
+
+    EXPECT_CALL(m_gatewaySubdeviceProtocolMock, getMessageType).WillOnce(Return(MessageType::FEED_VALUES));
+    EXPECT_CALL(m_gatewaySubdeviceProtocolMock, getDeviceKey).WillOnce(Return(GATEWAY_KEY));
+    EXPECT_CALL(m_dataProviderMock, onReadingData).Times(0);
+    auto queue = SerialQueue{nullptr, "router"};
+    queue.push([&] { service->receiveMessages(GenerateMessages(1)); });
+    EXPECT_TRUE(queue.drain(std::chrono::seconds{1}));
+    EXPECT_EQ(memoryBudget->getStatistics().refused, 1);
+}
@@ -0,0 +1,186 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "core/utility/Logger.h"
+#include "gateway/executor/GatewayExecutor.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <sched.h>
+#include <thread>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class GatewayExecutorTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    // Waits for a task that signals the condition variable, for much longer than any delay in the tests
+    bool waitFor(const std::function<bool()>& predicate)
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        return conditionVariable.wait_for(lock, std::chrono::seconds{5}, predicate);
+    }
+
+    void signal(const std::function<void()>& change)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        change();
+        conditionVariable.notify_one();
+    }
+
+    std::mutex mutex;
+    std::condition_variable conditionVariable;
+};
+
+TEST_F(GatewayExecutorTests, SerialQueuesShareTheExecutor)
+{
+    // Two queues on a single thread still execute their tasks in order, one at a time
+    auto executor = std::make_shared<GatewayExecutor>(1);
+    auto order = std::vector<int>{};
+    auto running = std::atomic<int>{0};
+    auto overlapped = std::atomic<bool>{false};
+    {
+        auto first = SerialQueue{executor, "first"};
+        auto second = SerialQueue{executor, "second"};
+        for (auto i = 0; i < 10; ++i)
+        {
+            first.push([&, i] {
+                if (++running > 1)
+                    overlapped = true;
+                order.emplace_back(i);
+                --running;
+            });
+            second.push([&] {
+                if (++running > 1)
+                    overlapped = true;
+                --running;
+            });
+        }
+
+        // A task executed on the calling thread sees everything pushed before it, even from within another task
+        auto executed = false;
+        second.push([&] { first.execute([&] { executed = order.size() == 10; }); });
+        EXPECT_TRUE(second.drain(std::chrono::seconds{1}));
+        EXPECT_TRUE(executed);
+    }
+    EXPECT_FALSE(overlapped);
+    EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+}
+
+TEST_F(GatewayExecutorTests, SerialQueueExecutesTheTasksOfOtherThreadsOnTheExecutor)
+{
+    // Only the threads of the executor execute the tasks of the queue, even with a CPU that can not be set
+    auto executor = std::make_shared<GatewayExecutor>(1, "wolkgw", std::vector<unsigned int>{0, CPU_SETSIZE});
+    auto queue = SerialQueue{executor, "queue"};
+    auto threads = std::vector<std::thread::id>{};
+    auto blocker = std::promise<void>{};
+    auto blocked = blocker.get_future().share();
+    queue.push([&, blocked] {
+        threads.emplace_back(std::this_thread::get_id());
+        blocked.wait();
+    });
+    auto waiting = std::async(std::launch::async, [&] {
+        queue.execute([&] { threads.emplace_back(std::this_thread::get_id()); });
+    });
+    EXPECT_EQ(waiting.wait_for(std::chrono::milliseconds{50}), std::future_status::timeout);
+    blocker.set_value();
+    EXPECT_EQ(waiting.wait_for(std::chrono::seconds{1}), std::future_status::ready);
+
+    queue.execute([&] { threads.emplace_back(std::this_thread::get_id()); });
+    ASSERT_EQ(threads.size(), 3);
+    EXPECT_EQ(threads[0], threads[1]);
+    EXPECT_EQ(threads[0], threads[2]);
+    EXPECT_NE(threads[0], std::this_thread::get_id());
+}
+
+TEST_F(GatewayExecutorTests, ScheduledTaskWaitsForTheDelay)
+{
+    // The delayed task does not hold back the task pushed after it
+    auto executor = std::make_shared<GatewayExecutor>(1);
+    auto queue = SerialQueue{executor, "queue"};
+    auto order = std::vector<int>{};
+    auto executedAt = std::chrono::steady_clock::time_point{};
+    const auto scheduledAt = std::chrono::steady_clock::now();
+    queue.schedule(std::chrono::milliseconds{50}, [&] {
+        signal([&] {
+            order.emplace_back(1);
+            executedAt = std::chrono::steady_clock::now();
+        });
+    });
+    queue.push([&] { signal([&] { order.emplace_back(0); }); });
+
+    ASSERT_TRUE(waitFor([&] { return order.size() == 2; }));
+    EXPECT_EQ(order, (std::vector<int>{0, 1}));
+    EXPECT_GE(executedAt - scheduledAt, std::chrono::milliseconds{50});
+}
+
+TEST_F(GatewayExecutorTests, ScheduledTasksRunInTheOrderOfTheirDelays)
+{
+    auto executor = std::make_shared<GatewayExecutor>(2);
+    auto queue = SerialQueue{executor, "queue"};
+    auto order = std::vector<int>{};
+    for (const auto delay : {30, 10, 20})
+        queue.schedule(std::chrono::milliseconds{delay}, [&, delay] { signal([&] { order.emplace_back(delay); }); });
+
+    ASSERT_TRUE(waitFor([&] { return order.size() == 3; }));
+    EXPECT_EQ(order, (std::vector<int>{10, 20, 30}));
+}
+
+TEST_F(GatewayExecutorTests, CancelledTasksAreNotExecuted)
+{
+    // The single thread would execute the cancelled task before the later one, had it not been cancelled
+    auto executor = std::make_shared<GatewayExecutor>(1);
+    auto cancelled = SerialQueue{executor, "cancelled"};
+    auto other = SerialQueue{executor, "other"};
+    auto cancelledExecuted = std::atomic_bool{false};
+    auto otherExecuted = false;
+    auto captured = std::make_shared<int>(0);
+    cancelled.schedule(std::chrono::milliseconds{20}, [&, captured] { cancelledExecuted = true; });
+    other.schedule(std::chrono::milliseconds{60}, [&] { signal([&] { otherExecuted = true; }); });
+    cancelled.cancelScheduled();
+
+    // The cancelled task does not hold on to what it captured
+    EXPECT_EQ(captured.use_count(), 1);
+    ASSERT_TRUE(waitFor([&] { return otherExecuted; }));
+    EXPECT_FALSE(cancelledExecuted);
+}
+
+TEST_F(GatewayExecutorTests, ScheduledTasksOfADestroyedQueueAreDropped)
+{
+    auto executor = std::make_shared<GatewayExecutor>(1);
+    auto other = SerialQueue{executor, "other"};
+    auto droppedExecuted = std::atomic_bool{false};
+    auto otherExecuted = false;
+    auto captured = std::make_shared<int>(0);
+    {
+        auto dropped = SerialQueue{executor, "dropped"};
+        dropped.schedule(std::chrono::milliseconds{20}, [&, captured] { droppedExecuted = true; });
+    }
+    other.schedule(std::chrono::milliseconds{60}, [&] { signal([&] { otherExecuted = true; }); });
+
+    EXPECT_EQ(captured.use_count(), 1);
+    ASSERT_TRUE(waitFor([&] { return otherExecuted; }));
+    EXPECT_FALSE(droppedExecuted);
+}
@@ -150,3 +150,26 @@ TEST_F(GatewayMessageRouterTests, ReceivedMessageHappyFlow)
     }
     EXPECT_TRUE(called);
 }
+
+TEST_F(GatewayMessageRouterTests, ReceivedMessageReturnsTheRoomBeforeHandingItOver)
+{
+    // The listener reserves the room for whatever it keeps by itself, so the router must not hold on to its own
+    auto memoryBudget = std::make_shared<MemoryBudget>(1000);
+    service = std::unique_ptr<GatewayMessageRouter>{
+      new GatewayMessageRouter{m_gatewaySubdeviceProtocolMock, nullptr, memoryBudget}};
+    auto types = std::vector<MessageType>{MessageType::FEED_VALUES};
+    auto listener = std::make_shared<NiceMock<GatewayMessageListenerMock>>();
+    EXPECT_CALL(*listener, getMessageTypes).WillOnce(Return(types));
+    ASSERT_NO_FATAL_FAILURE(service->addListener("TestListener", listener));
+
+    auto usedWhenHandedOver = std::uint64_t{1};
+    EXPECT_CALL(*listener, receiveMessages).WillOnce([&](const std::vector<GatewaySubdeviceMessage>&) {
+        usedWhenHandedOver = memoryBudget->getStatistics().used;
+    });
+    EXPECT_CALL(m_gatewaySubdeviceProtocolMock, getMessageType).WillOnce(Return(MessageType::FEED_VALUES));
+    EXPECT_CALL(m_gatewaySubdeviceProtocolMock, parseIncomingSubdeviceMessage)
+      .WillOnce(Return(std::vector<GatewaySubdeviceMessage>{GatewaySubdeviceMessage{wolkabout::Message{"", ""}}}));
+    ASSERT_NO_FATAL_FAILURE(service->messageReceived(std::make_shared<wolkabout::Message>("", "")));
+    EXPECT_TRUE(service->drain(std::chrono::seconds{1}));
+    EXPECT_EQ(usedWhenHandedOver, 0);
+}
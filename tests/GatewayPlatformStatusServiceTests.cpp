@@ -19,6 +19,7 @@
 
 #define private public
 #define protected public
+#include "gateway/service/platform_status/GatewayLoadMonitor.h"
 #include "gateway/service/platform_status/GatewayPlatformStatusService.h"
 #undef private
 #undef protected
@@ -28,6 +29,7 @@
 #include "tests/mocks/GatewayPlatformStatusProtocolMock.h"
 
 #include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
 
 using namespace wolkabout;
 using namespace wolkabout::gateway;
@@ -75,3 +77,96 @@ TEST_F(GatewayPlatformStatusServiceTests, PublishStatusHappyFlow)
     EXPECT_CALL(m_connectivityServiceMock, publish).WillOnce(Return(true));
     ASSERT_NO_FATAL_FAILURE(service->sendPlatformConnectionStatusMessage(true));
 }
+
+TEST_F(GatewayPlatformStatusServiceTests, PublishLoadStatus)
+{
+    auto published = std::shared_ptr<wolkabout::Message>{};
+    EXPECT_CALL(m_connectivityServiceMock, publish).WillOnce(DoAll(SaveArg<0>(&published), Return(true)));
+    ASSERT_NO_FATAL_FAILURE(
+      service->sendLoadStatusMessage(GatewayLoadStatus{GatewayLoadState::Throttle, 40.0, 0.6, true}));
+
+    ASSERT_NE(published, nullptr);
+    EXPECT_EQ(published->getChannel(), GatewayPlatformStatusService::LOAD_STATUS_CHANNEL);
+    const auto json = nlohmann::json::parse(published->getContent());
+    EXPECT_EQ(json["state"], "THROTTLE");
+    EXPECT_DOUBLE_EQ(json["suggestedRate"].get<double>(), 40.0);
+    EXPECT_DOUBLE_EQ(json["occupancy"].get<double>(), 0.6);
+    EXPECT_TRUE(json["replaying"].get<bool>());
+}
+
+TEST_F(GatewayPlatformStatusServiceTests, LoadMonitorStatesWithHysteresis)
+{
+    auto sample = GatewayLoadSample{0.0, false, 0};
+    auto statuses = std::vector<GatewayLoadStatus>{};
+    auto monitor = GatewayLoadMonitor{[&] { return sample; },
+                                      [&](const GatewayLoadStatus& status) { statuses.emplace_back(status); }};
+
+    // Nothing is published while the state does not change
+    monitor.evaluate(false);
+    EXPECT_TRUE(statuses.empty());
+
+    // The gateway throttles once it fills up, or while it replays the backlog
+    sample.occupancy = 0.55;
+    monitor.evaluate(false);
+    ASSERT_EQ(statuses.size(), 1);
+    EXPECT_EQ(statuses.back().state, GatewayLoadState::Throttle);
+    sample.occupancy = 0.1;
+    sample.replaying = true;
+    monitor.evaluate(false);
+    EXPECT_EQ(monitor.getStatus().state, GatewayLoadState::Throttle);
+
+    // And sheds when almost full, which it keeps doing until the occupancy drops well below the threshold
+    sample.replaying = false;
+    sample.occupancy = 0.95;
+    monitor.evaluate(false);
+    EXPECT_EQ(monitor.getStatus().state, GatewayLoadState::Shed);
+    sample.occupancy = 0.85;
+    monitor.evaluate(false);
+    EXPECT_EQ(monitor.getStatus().state, GatewayLoadState::Shed);
+    sample.occupancy = 0.75;
+    monitor.evaluate(false);
+    EXPECT_EQ(monitor.getStatus().state, GatewayLoadState::Throttle);
+    sample.occupancy = 0.45;
+    monitor.evaluate(false);
+    EXPECT_EQ(monitor.getStatus().state, GatewayLoadState::Throttle);
+    sample.occupancy = 0.3;
+    monitor.evaluate(false);
+    EXPECT_EQ(monitor.getStatus().state, GatewayLoadState::Normal);
+    EXPECT_EQ(statuses.back().state, GatewayLoadState::Normal);
+    EXPECT_DOUBLE_EQ(statuses.back().suggestedRate, GatewayLoadStatus::NO_SUGGESTED_RATE);
+}
+
+TEST_F(GatewayPlatformStatusServiceTests, LoadMonitorSuggestsNoRateWhileTheUplinkIsStalled)
+{
+    // The listener can look at the monitor, as it is not notified under its lock
+    auto sample = GatewayLoadSample{0.0, false, 0};
+    auto statuses = std::vector<GatewayLoadStatus>{};
+    auto monitor = std::unique_ptr<GatewayLoadMonitor>{};
+    monitor.reset(new GatewayLoadMonitor{[&] { return sample; }, [&](const GatewayLoadStatus&) {
+        statuses.emplace_back(monitor->getStatus());
+    }});
+    monitor->evaluate(true);
+    ASSERT_EQ(statuses.size(), 1);
+    EXPECT_EQ(statuses.back().state, GatewayLoadState::Normal);
+    EXPECT_DOUBLE_EQ(statuses.back().suggestedRate, GatewayLoadStatus::NO_SUGGESTED_RATE);
+
+    // Nothing is sent out while the queues fill up, so the modules are asked to hold on
+    sample.occupancy = 0.6;
+    monitor->evaluate(false);
+    ASSERT_EQ(statuses.size(), 2);
+    EXPECT_EQ(statuses.back().state, GatewayLoadState::Throttle);
+    EXPECT_DOUBLE_EQ(statuses.back().suggestedRate, 0.0);
+
+    // Which is published, unlike the rate of the normal state
+    auto normal = std::shared_ptr<wolkabout::Message>{};
+    auto stalled = std::shared_ptr<wolkabout::Message>{};
+    EXPECT_CALL(m_connectivityServiceMock, publish)
+      .WillOnce(DoAll(SaveArg<0>(&normal), Return(true)))
+      .WillOnce(DoAll(SaveArg<0>(&stalled), Return(true)));
+    ASSERT_NO_FATAL_FAILURE(service->sendLoadStatusMessage(statuses.front()));
+    ASSERT_NO_FATAL_FAILURE(service->sendLoadStatusMessage(statuses.back()));
+    ASSERT_NE(normal, nullptr);
+    ASSERT_NE(stalled, nullptr);
+    EXPECT_FALSE(nlohmann::json::parse(normal->getContent()).contains("suggestedRate"));
+    EXPECT_DOUBLE_EQ(nlohmann::json::parse(stalled->getContent())["suggestedRate"].get<double>(), 0.0);
+}
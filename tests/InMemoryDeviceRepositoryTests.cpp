@@ -0,0 +1,219 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <any>
+#include <sstream>
+
+#define private public
+#define protected public
+#include "gateway/repository/device/InMemoryDeviceRepository.h"
+#undef private
+#undef protected
+
+#include "core/utility/Logger.h"
+#include "tests/mocks/DeviceRepositoryMock.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class InMemoryDeviceRepositoryTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    void SetUp() override { m_persistentRepositoryMock = std::make_shared<NiceMock<DeviceRepositoryMock>>(); }
+
+    static StoredDeviceInformation PlatformDevice(const std::string& deviceKey)
+    {
+        return StoredDeviceInformation{deviceKey, DeviceOwnership::Platform, std::chrono::milliseconds{1}};
+    }
+
+    static StoredDeviceInformation GatewayDevice(const std::string& deviceKey)
+    {
+        return StoredDeviceInformation{deviceKey, DeviceOwnership::Gateway, std::chrono::milliseconds{1}};
+    }
+
+    static std::vector<std::string> KeysOf(const std::vector<StoredDeviceInformation>& devices)
+    {
+        auto deviceKeys = std::vector<std::string>{};
+        for (const auto& device : devices)
+            deviceKeys.emplace_back(device.getDeviceKey());
+        return deviceKeys;
+    }
+
+    std::shared_ptr<NiceMock<DeviceRepositoryMock>> m_persistentRepositoryMock;
+};
+
+TEST_F(InMemoryDeviceRepositoryTests, GetManyFromTheCache)
+{
+    auto repository = InMemoryDeviceRepository{};
+    ASSERT_TRUE(repository.save({PlatformDevice("A"), GatewayDevice("B")}));
+
+    EXPECT_THAT(KeysOf(repository.getMany({"A", "B", "C"})), UnorderedElementsAre("A", "B"));
+    EXPECT_THAT(repository.containsDevices({"A", "C"}), UnorderedElementsAre("A"));
+    EXPECT_TRUE(repository.getMany({}).empty());
+}
+
+TEST_F(InMemoryDeviceRepositoryTests, GetManyLooksUpTheMissingDevicesAtOnce)
+{
+    auto repository = InMemoryDeviceRepository{m_persistentRepositoryMock};
+    ASSERT_TRUE(repository.save({PlatformDevice("A")}));
+
+    // Only the devices that are not cached are looked up, in a single call
+    EXPECT_CALL(*m_persistentRepositoryMock, getMany(ElementsAre("B", "C")))
+      .WillOnce(Return(std::vector<StoredDeviceInformation>{PlatformDevice("B")}));
+    EXPECT_THAT(KeysOf(repository.getMany({"A", "B", "C"})), UnorderedElementsAre("A", "B"));
+
+    // And the ones that were found are cached from then on
+    EXPECT_CALL(*m_persistentRepositoryMock, getMany(ElementsAre("C")))
+      .WillOnce(Return(std::vector<StoredDeviceInformation>{}));
+    EXPECT_THAT(repository.containsDevices({"A", "B", "C"}), UnorderedElementsAre("A", "B"));
+    ASSERT_TRUE(repository.flush(std::chrono::seconds{1}));
+}
+
+TEST_F(InMemoryDeviceRepositoryTests, ReconcileOverwritesTheSnapshot)
+{
+    const auto snapshotPath = std::string{"./inMemoryDeviceRepositoryTests.snapshot"};
+    ASSERT_TRUE(DeviceRegistrySnapshot::write(
+      snapshotPath, {GatewayDevice("G1"), GatewayDevice("G2"), PlatformDevice("P1"), PlatformDevice("P2")},
+      std::chrono::milliseconds{1}));
+    auto repository = InMemoryDeviceRepository{m_persistentRepositoryMock, snapshotPath};
+
+    // Load the snapshot, without letting the reconciliation run yet, and cache some of its devices
+    repository.m_snapshot = DeviceRegistrySnapshot::open(snapshotPath);
+    ASSERT_NE(repository.m_snapshot, nullptr);
+    repository.m_reconciliationPending = true;
+    repository.m_loaded = true;
+    EXPECT_THAT(KeysOf(repository.getMany({"G1", "G2", "P1", "P2"})), UnorderedElementsAre("G1", "G2", "P1", "P2"));
+    ASSERT_TRUE(repository.save(
+      {StoredDeviceInformation{"P2", DeviceOwnership::Platform, std::chrono::milliseconds{5}, "Local"}}));
+
+    // G2 and P1 are no longer in the persistent repository, and G1 has changed there
+    EXPECT_CALL(*m_persistentRepositoryMock, forEachGatewayDevice)
+      .WillOnce([&](const DevicePageVisitor& visitor, std::size_t) {
+          visitor({StoredDeviceInformation{"G1", DeviceOwnership::Gateway, std::chrono::milliseconds{2}, "Type"}});
+          return true;
+      });
+    EXPECT_CALL(*m_persistentRepositoryMock, getMany(UnorderedElementsAre("G2", "P1")))
+      .WillOnce(Return(std::vector<StoredDeviceInformation>{}));
+    repository.reconcileWithPersistentRepository();
+
+    // The devices the persistent repository lacks are dropped, and the changed ones are overwritten
+    EXPECT_EQ(repository.m_devices.count("G2"), 0);
+    EXPECT_EQ(repository.m_devices.count("P1"), 0);
+    EXPECT_EQ(repository.m_devices.at("G1").information.getDeviceType(), "Type");
+
+    // Except for the ones that have been changed in the cache since the snapshot was loaded
+    EXPECT_EQ(repository.m_devices.at("P2").information.getDeviceType(), "Local");
+
+    // And the fresh snapshot holds what the cache holds
+    ASSERT_TRUE(repository.flush(std::chrono::seconds{1}));
+    const auto snapshot = DeviceRegistrySnapshot::open(snapshotPath);
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_EQ(snapshot->size(), 2);
+    EXPECT_EQ(snapshot->find("G1").getTimestamp(), std::chrono::milliseconds{2});
+    EXPECT_FALSE(snapshot->find("P2").getDeviceKey().empty());
+    std::remove(snapshotPath.c_str());
+}
+
+TEST_F(InMemoryDeviceRepositoryTests, FlushRewritesTheSnapshot)
+{
+    const auto snapshotPath = std::string{"./inMemoryDeviceRepositoryTests.snapshot"};
+    std::remove(snapshotPath.c_str());
+    auto repository = InMemoryDeviceRepository{m_persistentRepositoryMock, snapshotPath};
+    repository.loadInformationFromPersistentRepository();
+    ASSERT_TRUE(repository.flush(std::chrono::seconds{1}));
+    auto snapshot = DeviceRegistrySnapshot::open(snapshotPath);
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_EQ(snapshot->size(), 0);
+
+    ASSERT_TRUE(repository.save({GatewayDevice("G1")}));
+    ASSERT_TRUE(repository.flush(std::chrono::seconds{1}));
+    snapshot = DeviceRegistrySnapshot::open(snapshotPath);
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_EQ(snapshot->size(), 1);
+    std::remove(snapshotPath.c_str());
+}
+
+TEST_F(InMemoryDeviceRepositoryTests, EvictTheLeastRecentlyUsedPlatformDevices)
+{
+    auto repository = InMemoryDeviceRepository{nullptr, {}, 2};
+    ASSERT_TRUE(repository.save({PlatformDevice("P1"), PlatformDevice("P2")}));
+
+    // Using P1 leaves P2 as the least recently used one
+    EXPECT_TRUE(repository.containsDevice("P1"));
+    ASSERT_TRUE(repository.save({PlatformDevice("P3")}));
+    EXPECT_THAT(repository.containsDevices({"P1", "P2", "P3"}), UnorderedElementsAre("P1", "P3"));
+
+    // Saving a cached device again also counts as using it
+    ASSERT_TRUE(repository.save({PlatformDevice("P1")}));
+    ASSERT_TRUE(repository.save({PlatformDevice("P4")}));
+    EXPECT_THAT(repository.containsDevices({"P1", "P3", "P4"}), UnorderedElementsAre("P1", "P4"));
+
+    const auto statistics = repository.getStatistics();
+    EXPECT_EQ(statistics.platformDevices, 2);
+    EXPECT_EQ(statistics.platformDeviceCapacity, 2);
+    EXPECT_EQ(statistics.evictions, 2);
+}
+
+TEST_F(InMemoryDeviceRepositoryTests, EvictedDevicesAreForgottenWithoutPersistence)
+{
+    auto repository = InMemoryDeviceRepository{nullptr, {}, 1};
+    ASSERT_TRUE(repository.save({PlatformDevice("P1")}));
+    EXPECT_TRUE(repository.holdsAllDevices());
+
+    // Once a device is evicted, the lookup of the devices is no longer complete
+    ASSERT_TRUE(repository.save({PlatformDevice("P2")}));
+    EXPECT_FALSE(repository.holdsAllDevices());
+    EXPECT_THAT(KeysOf(repository.findDevices(std::chrono::milliseconds{0}, {}, {})), UnorderedElementsAre("P2"));
+}
+
+TEST_F(InMemoryDeviceRepositoryTests, GatewayDevicesAreNeverEvicted)
+{
+    auto repository = InMemoryDeviceRepository{nullptr, {}, 1};
+    ASSERT_TRUE(repository.save({GatewayDevice("G1"), GatewayDevice("G2"), PlatformDevice("P1")}));
+    ASSERT_TRUE(repository.save({PlatformDevice("P2"), GatewayDevice("G3")}));
+
+    EXPECT_THAT(repository.containsDevices({"G1", "G2", "G3", "P1", "P2"}),
+                UnorderedElementsAre("G1", "G2", "G3", "P2"));
+    EXPECT_THAT(KeysOf(repository.getGatewayDevices()), UnorderedElementsAre("G1", "G2", "G3"));
+
+    // A platform device that becomes owned by the gateway is no longer tracked for eviction
+    ASSERT_TRUE(repository.save({GatewayDevice("P2"), PlatformDevice("P3"), PlatformDevice("P4")}));
+    EXPECT_THAT(repository.containsDevices({"P2", "P3", "P4"}), UnorderedElementsAre("P2", "P4"));
+    const auto statistics = repository.getStatistics();
+    EXPECT_EQ(statistics.gatewayDevices, 4);
+    EXPECT_EQ(statistics.platformDevices, 1);
+}
+
+TEST_F(InMemoryDeviceRepositoryTests, EvictedDevicesAreLookedUpAgain)
+{
+    auto repository = InMemoryDeviceRepository{m_persistentRepositoryMock, {}, 1};
+    ASSERT_TRUE(repository.save({PlatformDevice("P1"), PlatformDevice("P2")}));
+
+    EXPECT_CALL(*m_persistentRepositoryMock, get("P1")).WillOnce(Return(PlatformDevice("P1")));
+    EXPECT_TRUE(repository.containsDevice("P1"));
+    EXPECT_TRUE(repository.containsDevice("P1"));
+    EXPECT_EQ(repository.getStatistics().evictions, 2);
+    EXPECT_TRUE(repository.holdsAllDevices());
+    ASSERT_TRUE(repository.flush(std::chrono::seconds{1}));
+}
@@ -0,0 +1,121 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "core/utility/Logger.h"
+#include "gateway/repository/existing_device/JournalFileExistingDevicesRepository.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class JournalFileExistingDevicesRepositoryTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    void SetUp() override { std::remove(JOURNAL_PATH.c_str()); }
+
+    void TearDown() override { std::remove(JOURNAL_PATH.c_str()); }
+
+    static std::string ReadJournal()
+    {
+        auto file = std::ifstream{JOURNAL_PATH};
+        return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+
+    static void WriteJournal(const std::string& content)
+    {
+        auto file = std::ofstream{JOURNAL_PATH, std::ios::trunc};
+        file << content;
+    }
+
+    static const std::string JOURNAL_PATH;
+};
+
+const std::string JournalFileExistingDevicesRepositoryTests::JOURNAL_PATH = "./existingDevicesTests.journal";
+
+TEST_F(JournalFileExistingDevicesRepositoryTests, ReplayTheJournal)
+{
+    {
+        auto repository = JournalFileExistingDevicesRepository{JOURNAL_PATH};
+        repository.addDeviceKeys({"A", "B", "C"});
+        repository.addDeviceKey("A");
+        repository.removeDeviceKeys({"B", "D"});
+        EXPECT_THAT(repository.getDeviceKeys(), UnorderedElementsAre("A", "C"));
+    }
+
+    // Only the actual changes were written down
+    EXPECT_EQ(ReadJournal(), "+A\n+B\n+C\n-B\n");
+    auto repository = JournalFileExistingDevicesRepository{JOURNAL_PATH};
+    EXPECT_THAT(repository.getDeviceKeys(), UnorderedElementsAre("A", "C"));
+}
+
+TEST_F(JournalFileExistingDevicesRepositoryTests, RefuseInvalidKeys)
+{
+    auto repository = JournalFileExistingDevicesRepository{JOURNAL_PATH};
+    repository.addDeviceKeys({"", "A\nB", "C"});
+    EXPECT_THAT(repository.getDeviceKeys(), ElementsAre("C"));
+    EXPECT_EQ(ReadJournal(), "+C\n");
+}
+
+TEST_F(JournalFileExistingDevicesRepositoryTests, IgnoreTheTornLastLine)
+{
+    WriteJournal("+A\n+B\n-A\n+C");
+    {
+        auto repository = JournalFileExistingDevicesRepository{JOURNAL_PATH};
+        EXPECT_THAT(repository.getDeviceKeys(), ElementsAre("B"));
+
+        // The journal is compacted right away, so the next entry does not get appended to the torn one
+        repository.addDeviceKey("D");
+    }
+    EXPECT_EQ(ReadJournal(), "+B\n+D\n");
+    auto repository = JournalFileExistingDevicesRepository{JOURNAL_PATH};
+    EXPECT_THAT(repository.getDeviceKeys(), UnorderedElementsAre("B", "D"));
+}
+
+TEST_F(JournalFileExistingDevicesRepositoryTests, CompactTheJournal)
+{
+    {
+        auto repository = JournalFileExistingDevicesRepository{JOURNAL_PATH, 4};
+        repository.addDeviceKey("A");
+        for (auto i = 0; i < 10; ++i)
+        {
+            repository.addDeviceKey("B");
+            repository.removeDeviceKeys({"B"});
+        }
+        EXPECT_THAT(repository.getDeviceKeys(), ElementsAre("A"));
+    }
+
+    // The journal never grows far beyond the threshold, and still holds the same keys
+    EXPECT_LE(ReadJournal().size(), 5 * std::string{"+B\n"}.size());
+    EXPECT_EQ(ReadJournal().substr(0, 3), "+A\n");
+    auto repository = JournalFileExistingDevicesRepository{JOURNAL_PATH, 4};
+    EXPECT_THAT(repository.getDeviceKeys(), ElementsAre("A"));
+}
+
+TEST_F(JournalFileExistingDevicesRepositoryTests, SkipMalformedLines)
+{
+    WriteJournal("+A\nX\n\n?B\n+C\n");
+    auto repository = JournalFileExistingDevicesRepository{JOURNAL_PATH};
+    EXPECT_THAT(repository.getDeviceKeys(), UnorderedElementsAre("A", "C"));
+}
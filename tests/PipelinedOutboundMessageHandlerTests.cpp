@@ -0,0 +1,126 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "core/utility/Logger.h"
+#include "gateway/connectivity/PipelinedOutboundMessageHandler.h"
+#include "tests/mocks/OutboundMessageHandlerMock.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class PipelinedOutboundMessageHandlerTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    void SetUp() override
+    {
+        // Every publish is held until the test releases them, so the messages stay in flight
+        EXPECT_CALL(outboundMessageHandlerMock, addMessage)
+          .WillRepeatedly([this](std::shared_ptr<wolkabout::Message> message) {
+              std::unique_lock<std::mutex> lock{mutex};
+              entered.emplace_back(message->getContent());
+              conditionVariable.notify_all();
+              conditionVariable.wait(lock, [&] { return released; });
+          });
+    }
+
+    void waitUntilEntered(std::size_t count)
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        conditionVariable.wait(lock, [&] { return entered.size() >= count; });
+    }
+
+    void release()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            released = true;
+        }
+        conditionVariable.notify_all();
+    }
+
+    static std::shared_ptr<wolkabout::Message> makeMessage(const std::string& content, const std::string& deviceKey)
+    {
+        return std::make_shared<wolkabout::Message>(content, "d2p/" + deviceKey + "/feed_values");
+    }
+
+    OutboundMessageHandlerMock outboundMessageHandlerMock;
+
+    std::mutex mutex;
+
+    std::condition_variable conditionVariable;
+
+    std::vector<std::string> entered;
+
+    bool released = false;
+};
+
+TEST_F(PipelinedOutboundMessageHandlerTests, KeepsTheWindowInFlight)
+{
+    // Four channels fill the window, and the second message of every channel waits behind the first one
+    auto handler = PipelinedOutboundMessageHandler{outboundMessageHandlerMock, 4};
+    for (auto i = 0; i < 8; ++i)
+        handler.addMessage(makeMessage(std::to_string(i), "D" + std::to_string(i % 4)));
+    waitUntilEntered(4);
+    EXPECT_EQ(handler.getInFlight(), 4);
+    EXPECT_EQ(handler.getWaiting(), 4);
+
+    release();
+    ASSERT_TRUE(handler.drain(std::chrono::seconds{10}));
+    EXPECT_EQ(handler.getPeakInFlight(), 4);
+    EXPECT_EQ(handler.getCompleted(), 8);
+
+    // The messages on the same channel keep their order
+    std::lock_guard<std::mutex> lock{mutex};
+    ASSERT_EQ(entered.size(), 8);
+    for (auto i = 0; i < 4; ++i)
+    {
+        const auto first = std::find(entered.cbegin(), entered.cend(), std::to_string(i));
+        const auto second = std::find(entered.cbegin(), entered.cend(), std::to_string(i + 4));
+        EXPECT_LT(first, second);
+    }
+}
+
+TEST_F(PipelinedOutboundMessageHandlerTests, BusyChannelDoesNotHoldBackTheOthers)
+{
+    // The second message of the first device waits, while the producer goes on, and the other device is published
+    auto handler = PipelinedOutboundMessageHandler{outboundMessageHandlerMock, 2};
+    handler.addMessage(makeMessage("A1", "A"));
+    handler.addMessage(makeMessage("A2", "A"));
+    handler.addMessage(makeMessage("B1", "B"));
+    waitUntilEntered(2);
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        EXPECT_THAT(entered, UnorderedElementsAre("A1", "B1"));
+    }
+    EXPECT_EQ(handler.getWaiting(), 1);
+
+    release();
+    ASSERT_TRUE(handler.drain(std::chrono::seconds{10}));
+    std::lock_guard<std::mutex> lock{mutex};
+    ASSERT_EQ(entered.size(), 3);
+    EXPECT_EQ(entered.back(), "A2");
+}
@@ -0,0 +1,158 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <any>
+#include <sstream>
+
+#define private public
+#include "gateway/connectivity/PlatformConnectionPool.h"
+#undef private
+
+#include "core/utility/Logger.h"
+#include "tests/mocks/ConnectivityServiceMock.h"
+#include "tests/mocks/OutboundMessageHandlerMock.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class PlatformConnectionPoolTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    void SetUp() override
+    {
+        sessionConnectivityService = std::make_shared<NiceMock<ConnectivityServiceMock>>();
+        sessionOutboundMessageHandler = std::make_shared<NiceMock<OutboundMessageHandlerMock>>();
+        ON_CALL(*sessionConnectivityService, connect).WillByDefault(Return(true));
+    }
+
+    // The sessions connect on the threads of their reconnect schedulers
+    static bool waitUntilConnected(const PlatformConnectionPool& pool, std::size_t index)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+        while (!pool.isSessionConnected(index) && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        return pool.isSessionConnected(index);
+    }
+
+    NiceMock<OutboundMessageHandlerMock> primaryOutboundMessageHandler;
+
+    std::shared_ptr<ConnectivityServiceMock> sessionConnectivityService;
+
+    std::shared_ptr<OutboundMessageHandlerMock> sessionOutboundMessageHandler;
+
+    std::mutex mutex;
+};
+
+TEST_F(PlatformConnectionPoolTests, ShardsByDeviceKey)
+{
+    // Remember which connection every device was sent through
+    auto connections = std::map<std::string, std::set<int>>{};
+    ON_CALL(primaryOutboundMessageHandler, addMessage).WillByDefault([&](std::shared_ptr<wolkabout::Message> message) {
+        std::lock_guard<std::mutex> lock{mutex};
+        connections[message->getContent()].emplace(0);
+    });
+    ON_CALL(*sessionOutboundMessageHandler, addMessage).WillByDefault([&](std::shared_ptr<wolkabout::Message> message) {
+        std::lock_guard<std::mutex> lock{mutex};
+        connections[message->getContent()].emplace(1);
+    });
+
+    auto pool = PlatformConnectionPool{primaryOutboundMessageHandler,
+                                       {PlatformSession{sessionConnectivityService, sessionOutboundMessageHandler}},
+                                       [](const wolkabout::Message& message) { return message.getContent(); }};
+    pool.connect();
+    ASSERT_EQ(pool.getSessionCount(), 2);
+    ASSERT_TRUE(waitUntilConnected(pool, 1));
+    for (auto i = 0; i < 64; ++i)
+        pool.addMessage(std::make_shared<wolkabout::Message>("D" + std::to_string(i % 16), "d2p/feed_values"));
+
+    // Every device goes through a single connection, and both connections get a share of the devices
+    auto throughSession = 0;
+    for (const auto& pair : connections)
+    {
+        EXPECT_EQ(pair.second.size(), 1);
+        throughSession += pair.second.count(1);
+    }
+    EXPECT_EQ(connections.size(), 16);
+    EXPECT_GT(throughSession, 0);
+    EXPECT_LT(throughSession, 16);
+
+    // While the session is down, its devices are buffered, and do not move over to the primary connection
+    pool.disconnect();
+    EXPECT_FALSE(pool.isSessionConnected(1));
+    connections.clear();
+    for (auto i = 0; i < 16; ++i)
+        pool.addMessage(std::make_shared<wolkabout::Message>("D" + std::to_string(i), "d2p/feed_values"));
+    for (const auto& pair : connections)
+        EXPECT_EQ(pair.second, std::set<int>{0});
+    EXPECT_EQ(connections.size() + pool.getBufferedMessageCount(1), 16);
+}
+
+TEST_F(PlatformConnectionPoolTests, KeepsTheOrderOfADeviceAcrossASessionFlap)
+{
+    // Find a device that goes through the additional session
+    auto deviceKey = std::string{};
+    for (auto i = 0; deviceKey.empty(); ++i)
+        if (std::hash<std::string>{}("D" + std::to_string(i)) % 2 == 1)
+            deviceKey = "D" + std::to_string(i);
+
+    auto sent = std::vector<std::string>{};
+    EXPECT_CALL(primaryOutboundMessageHandler, addMessage).Times(0);
+    ON_CALL(*sessionOutboundMessageHandler, addMessage).WillByDefault([&](std::shared_ptr<wolkabout::Message> message) {
+        std::lock_guard<std::mutex> lock{mutex};
+        sent.emplace_back(message->getContent());
+    });
+
+    auto pool = PlatformConnectionPool{primaryOutboundMessageHandler,
+                                       {PlatformSession{sessionConnectivityService, sessionOutboundMessageHandler}},
+                                       [&](const wolkabout::Message&) { return deviceKey; }, nullptr,
+                                       std::chrono::milliseconds{10}};
+    pool.connect();
+    ASSERT_TRUE(waitUntilConnected(pool, 1));
+    auto count = 0;
+    for (; count < 10; ++count)
+        pool.addMessage(std::make_shared<wolkabout::Message>(std::to_string(count), "d2p/feed_values"));
+
+    // The session is lost, and fails to reconnect a couple of times
+    EXPECT_CALL(*sessionConnectivityService, connect)
+      .WillOnce(Return(false))
+      .WillOnce(Return(false))
+      .WillRepeatedly(Return(true));
+    pool.onSessionLost(*pool.m_sessions.front());
+    for (; count < 20; ++count)
+        pool.addMessage(std::make_shared<wolkabout::Message>(std::to_string(count), "d2p/feed_values"));
+    ASSERT_TRUE(waitUntilConnected(pool, 1));
+    for (; count < 30; ++count)
+        pool.addMessage(std::make_shared<wolkabout::Message>(std::to_string(count), "d2p/feed_values"));
+
+    // All the messages of the device went through its session, in the order in which they were added
+    std::lock_guard<std::mutex> lock{mutex};
+    ASSERT_EQ(sent.size(), 30);
+    for (auto i = 0; i < 30; ++i)
+        EXPECT_EQ(sent[i], std::to_string(i));
+    EXPECT_EQ(pool.getBufferedMessageCount(1), 0);
+}
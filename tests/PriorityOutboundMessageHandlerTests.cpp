@@ -0,0 +1,142 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "core/utility/Logger.h"
+#include "gateway/connectivity/PriorityOutboundMessageHandler.h"
+#include "tests/mocks/DataProtocolMock.h"
+#include "tests/mocks/OutboundMessageHandlerMock.h"
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class PriorityOutboundMessageHandlerTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    void SetUp() override
+    {
+        ON_CALL(dataProtocolMock, getMessageType).WillByDefault([](const wolkabout::Message& message) {
+            if (message.getContent() == "control")
+                return MessageType::DEVICE_REGISTRATION;
+            if (message.getContent() == "file")
+                return MessageType::FILE_UPLOAD_STATUS;
+            return MessageType::FEED_VALUES;
+        });
+
+        // The first message keeps the sending thread busy until it is released, while the others queue up behind it
+        EXPECT_CALL(outboundMessageHandlerMock, addMessage)
+          .WillRepeatedly([this](std::shared_ptr<wolkabout::Message> message) {
+              std::unique_lock<std::mutex> lock{mutex};
+              ++entered;
+              conditionVariable.notify_all();
+              conditionVariable.wait(lock, [&] { return released; });
+              sent.emplace_back(message->getChannel());
+          });
+    }
+
+    void waitUntilEntered()
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        conditionVariable.wait(lock, [&] { return entered > 0; });
+    }
+
+    void release()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            released = true;
+        }
+        conditionVariable.notify_all();
+    }
+
+    NiceMock<DataProtocolMock> dataProtocolMock;
+
+    OutboundMessageHandlerMock outboundMessageHandlerMock;
+
+    std::mutex mutex;
+
+    std::condition_variable conditionVariable;
+
+    int entered = 0;
+
+    bool released = false;
+
+    std::vector<std::string> sent;
+};
+
+TEST_F(PriorityOutboundMessageHandlerTests, ControlIsSentBeforeTelemetry)
+{
+    {
+        auto handler = PriorityOutboundMessageHandler{outboundMessageHandlerMock, dataProtocolMock};
+        handler.addMessage(std::make_shared<wolkabout::Message>("telemetry", "T1"));
+        waitUntilEntered();
+        handler.addMessage(std::make_shared<wolkabout::Message>("telemetry", "T2"));
+        handler.addMessage(std::make_shared<wolkabout::Message>("telemetry", "T3"));
+        handler.addMessage(std::make_shared<wolkabout::Message>("control", "C1"));
+        release();
+        ASSERT_TRUE(handler.drain(std::chrono::seconds{10}));
+
+        const auto statistics = handler.getStatistics();
+        ASSERT_EQ(statistics.size(), 4);
+        EXPECT_EQ(statistics.front().name, "control");
+        EXPECT_EQ(statistics.front().sent, 1);
+        EXPECT_EQ(statistics.back().name, "telemetry");
+        EXPECT_EQ(statistics.back().sent, 3);
+        EXPECT_EQ(statistics.back().maxDepth, 2);
+        EXPECT_EQ(statistics.back().depth, 0);
+    }
+    EXPECT_EQ(sent, (std::vector<std::string>{"T1", "C1", "T2", "T3"}));
+}
+
+TEST_F(PriorityOutboundMessageHandlerTests, WeightedLanesShareTheSending)
+{
+    {
+        auto handler = PriorityOutboundMessageHandler{outboundMessageHandlerMock, dataProtocolMock};
+        handler.addMessage(std::make_shared<wolkabout::Message>("telemetry", "T0"));
+        waitUntilEntered();
+        for (const auto& channel : {"T1", "T2", "T3", "T4", "T5"})
+            handler.addMessage(std::make_shared<wolkabout::Message>("telemetry", channel));
+        handler.addMessage(std::make_shared<wolkabout::Message>("file", "F1"));
+        handler.addMessage(std::make_shared<wolkabout::Message>("file", "F2"));
+        release();
+        ASSERT_TRUE(handler.drain(std::chrono::seconds{10}));
+    }
+
+    // The telemetry lane weighs four times as much, so the file transfer lane gets one of every five messages sent
+    EXPECT_EQ(sent, (std::vector<std::string>{"T0", "T1", "T2", "F1", "T3", "T4", "T5", "F2"}));
+}
+
+TEST_F(PriorityOutboundMessageHandlerTests, UnassignedMessageTypesGoIntoTheLastLane)
+{
+    ON_CALL(dataProtocolMock, getMessageType).WillByDefault(Return(MessageType::UNKNOWN));
+    release();
+    {
+        auto handler = PriorityOutboundMessageHandler{outboundMessageHandlerMock, dataProtocolMock};
+        handler.addMessage(std::make_shared<wolkabout::Message>("", "U1"));
+        ASSERT_TRUE(handler.drain(std::chrono::seconds{10}));
+        EXPECT_EQ(handler.getStatistics().back().sent, 1);
+    }
+    EXPECT_EQ(sent, (std::vector<std::string>{"U1"}));
+}
@@ -0,0 +1,92 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "core/utility/Logger.h"
+#include "gateway/connectivity/ReconnectScheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class ReconnectSchedulerTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+};
+
+TEST_F(ReconnectSchedulerTests, DelaysGrowUpToTheCap)
+{
+    auto scheduler =
+      ReconnectScheduler{nullptr, std::chrono::milliseconds{100}, std::chrono::milliseconds{1000}, 2.0, 0.5};
+    for (const auto& expected : {100, 200, 400, 800, 1000, 1000})
+    {
+        const auto delay = scheduler.nextDelay().count();
+        EXPECT_LE(delay, expected);
+        EXPECT_GE(delay, expected / 2);
+    }
+
+    // Once reset, the delays start from the beginning
+    scheduler.reset();
+    EXPECT_LE(scheduler.nextDelay().count(), 100);
+}
+
+TEST_F(ReconnectSchedulerTests, ScheduledAttemptWaitsForTheDelay)
+{
+    auto scheduler =
+      ReconnectScheduler{nullptr, std::chrono::milliseconds{100}, std::chrono::milliseconds{100}, 2.0, 0.5};
+    std::mutex mutex;
+    std::condition_variable conditionVariable;
+    auto attempted = false;
+
+    const auto scheduledAt = std::chrono::steady_clock::now();
+    const auto delay = scheduler.schedule([&] {
+        std::lock_guard<std::mutex> lock{mutex};
+        attempted = true;
+        conditionVariable.notify_one();
+    });
+    EXPECT_GE(delay.count(), 50);
+
+    std::unique_lock<std::mutex> lock{mutex};
+    ASSERT_TRUE(conditionVariable.wait_for(lock, std::chrono::seconds{10}, [&] { return attempted; }));
+    EXPECT_GE(std::chrono::steady_clock::now() - scheduledAt, delay);
+}
+
+TEST_F(ReconnectSchedulerTests, AttemptNowRunsRightAwayAndResetsTheDelay)
+{
+    auto scheduler =
+      ReconnectScheduler{nullptr, std::chrono::milliseconds{100}, std::chrono::milliseconds{1000}, 2.0, 0.0};
+    EXPECT_EQ(scheduler.nextDelay().count(), 100);
+    EXPECT_EQ(scheduler.nextDelay().count(), 200);
+
+    std::mutex mutex;
+    std::condition_variable conditionVariable;
+    auto attempted = false;
+    scheduler.attemptNow([&] {
+        std::lock_guard<std::mutex> lock{mutex};
+        attempted = true;
+        conditionVariable.notify_one();
+    });
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        ASSERT_TRUE(conditionVariable.wait_for(lock, std::chrono::seconds{10}, [&] { return attempted; }));
+    }
+    EXPECT_EQ(scheduler.nextDelay().count(), 100);
+}
@@ -0,0 +1,234 @@
+/**
+ * Copyright 2022 WolkAbout Technology s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "core/utility/Logger.h"
+#include "gateway/persistence/SegmentedFileMessagePersistence.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <unistd.h>
+
+using namespace wolkabout;
+using namespace wolkabout::gateway;
+using namespace ::testing;
+
+class SegmentedFileMessagePersistenceTests : public Test
+{
+public:
+    static void SetUpTestCase() { Logger::init(LogLevel::TRACE, Logger::Type::CONSOLE); }
+
+    void TearDown() override
+    {
+        for (const auto& file : ListSegments())
+            std::remove((DIRECTORY + "/" + file).c_str());
+        ::rmdir(DIRECTORY.c_str());
+    }
+
+    static std::vector<std::string> ListSegments()
+    {
+        auto files = std::vector<std::string>{};
+        auto* directory = ::opendir(DIRECTORY.c_str());
+        if (directory == nullptr)
+            return files;
+        while (auto* entry = ::readdir(directory))
+            if (entry->d_name[0] != '.')
+                files.emplace_back(entry->d_name);
+        ::closedir(directory);
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    // Every message is stored in a record of 48 bytes, behind the segment header of 24 bytes
+    static std::shared_ptr<wolkabout::Message> MakeMessage(const std::string& deviceKey, char content)
+    {
+        return std::make_shared<wolkabout::Message>(std::string(16, content), "d2p/" + deviceKey + "/x");
+    }
+
+    static void OverwriteSegment(const std::string& file, std::uint64_t offset, const std::string& bytes)
+    {
+        auto stream = std::fstream{DIRECTORY + "/" + file, std::ios::binary | std::ios::in | std::ios::out};
+        stream.seekp(static_cast<std::streamoff>(offset));
+        stream.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    static const std::string DIRECTORY;
+    static const std::uint64_t SEGMENT_HEADER_SIZE;
+    static const std::uint64_t RECORD_SIZE;
+};
+
+const std::string SegmentedFileMessagePersistenceTests::DIRECTORY = "./segmentedFileMessagePersistenceTests";
+const std::uint64_t SegmentedFileMessagePersistenceTests::SEGMENT_HEADER_SIZE = 24;
+const std::uint64_t SegmentedFileMessagePersistenceTests::RECORD_SIZE = 48;
+
+TEST_F(SegmentedFileMessagePersistenceTests, RecoverTheStoredMessages)
+{
+    {
+        auto persistence = SegmentedFileMessagePersistence{DIRECTORY};
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'a')));
+        ASSERT_TRUE(persistence.push(MakeMessage("D2", 'b')));
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'c')));
+        persistence.pop();
+        ASSERT_TRUE(persistence.flush());
+    }
+
+    // The popped message stays removed, and the rest are read back in their order
+    auto persistence = SegmentedFileMessagePersistence{DIRECTORY};
+    ASSERT_EQ(persistence.size(), 2);
+    EXPECT_EQ(persistence.storedBytes(), 2 * RECORD_SIZE);
+    EXPECT_EQ(persistence.front()->getChannel(), "d2p/D2/x");
+    EXPECT_EQ(persistence.front()->getContent(), std::string(16, 'b'));
+    persistence.pop();
+    EXPECT_EQ(persistence.front()->getContent(), std::string(16, 'c'));
+    persistence.pop();
+    EXPECT_TRUE(persistence.empty());
+    EXPECT_EQ(persistence.front(), nullptr);
+}
+
+TEST_F(SegmentedFileMessagePersistenceTests, LeaveOutTheRecordsFailingTheChecksum)
+{
+    {
+        auto persistence = SegmentedFileMessagePersistence{DIRECTORY};
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'a')));
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'b')));
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'c')));
+    }
+    const auto segments = ListSegments();
+    ASSERT_EQ(segments.size(), 1);
+
+    // A flipped byte in the content of the second message stops the recovery at that message
+    OverwriteSegment(segments.front(), SEGMENT_HEADER_SIZE + RECORD_SIZE + 24 + 12, "X");
+    auto persistence = SegmentedFileMessagePersistence{DIRECTORY};
+    ASSERT_EQ(persistence.size(), 1);
+    EXPECT_EQ(persistence.front()->getContent(), std::string(16, 'a'));
+}
+
+TEST_F(SegmentedFileMessagePersistenceTests, LeaveOutTheTornLastRecord)
+{
+    {
+        auto persistence = SegmentedFileMessagePersistence{DIRECTORY};
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'a')));
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'b')));
+    }
+    const auto segments = ListSegments();
+    ASSERT_EQ(segments.size(), 1);
+
+    // The header of the last message is written, but its content is cut off
+    OverwriteSegment(segments.front(), SEGMENT_HEADER_SIZE + RECORD_SIZE + 24, std::string(24, '\0'));
+    {
+        auto persistence = SegmentedFileMessagePersistence{DIRECTORY};
+        ASSERT_EQ(persistence.size(), 1);
+
+        // Nothing is appended to the recovered segment, so the new message follows the recovered one
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'c')));
+        EXPECT_EQ(ListSegments().size(), 2);
+    }
+    auto persistence = SegmentedFileMessagePersistence{DIRECTORY};
+    ASSERT_EQ(persistence.size(), 2);
+    EXPECT_EQ(persistence.front()->getContent(), std::string(16, 'a'));
+    persistence.pop();
+    EXPECT_EQ(persistence.front()->getContent(), std::string(16, 'c'));
+}
+
+TEST_F(SegmentedFileMessagePersistenceTests, DeleteTheInvalidSegments)
+{
+    {
+        auto persistence = SegmentedFileMessagePersistence{DIRECTORY};
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'a')));
+    }
+    const auto segments = ListSegments();
+    ASSERT_EQ(segments.size(), 1);
+
+    // The checksum of the segment header no longer matches
+    OverwriteSegment(segments.front(), 16, "X");
+    auto persistence = SegmentedFileMessagePersistence{DIRECTORY};
+    EXPECT_TRUE(persistence.empty());
+    EXPECT_TRUE(ListSegments().empty());
+}
+
+TEST_F(SegmentedFileMessagePersistenceTests, DropTheOldestMessagesOfTheDeviceOverItsQuota)
+{
+    auto persistence = SegmentedFileMessagePersistence{DIRECTORY, 1024, 2 * RECORD_SIZE};
+    ASSERT_TRUE(persistence.push(MakeMessage("D1", 'a')));
+    ASSERT_TRUE(persistence.push(MakeMessage("D2", 'b')));
+    ASSERT_TRUE(persistence.push(MakeMessage("D1", 'c')));
+    ASSERT_TRUE(persistence.push(MakeMessage("D1", 'd')));
+
+    // Only the message of the device over its quota is dropped
+    EXPECT_EQ(persistence.size(), 3);
+    EXPECT_EQ(persistence.droppedMessages(), 1);
+    EXPECT_EQ(persistence.front()->getContent(), std::string(16, 'b'));
+    persistence.pop();
+    EXPECT_EQ(persistence.front()->getContent(), std::string(16, 'c'));
+}
+
+TEST_F(SegmentedFileMessagePersistenceTests, DropTheOldestMessagesOverTheCap)
+{
+    auto persistence = SegmentedFileMessagePersistence{DIRECTORY, 2 * RECORD_SIZE};
+    ASSERT_TRUE(persistence.push(MakeMessage("D1", 'a')));
+    ASSERT_TRUE(persistence.push(MakeMessage("D2", 'b')));
+    ASSERT_TRUE(persistence.push(MakeMessage("D3", 'c')));
+    EXPECT_EQ(persistence.size(), 2);
+    EXPECT_EQ(persistence.storedBytes(), 2 * RECORD_SIZE);
+    EXPECT_EQ(persistence.droppedMessages(), 1);
+    EXPECT_EQ(persistence.front()->getContent(), std::string(16, 'b'));
+
+    // A message that could never fit is refused, without dropping anything
+    EXPECT_FALSE(persistence.push(std::make_shared<wolkabout::Message>(std::string(2 * RECORD_SIZE, 'x'), "d2p/D1/x")));
+    EXPECT_EQ(persistence.size(), 2);
+    EXPECT_EQ(persistence.droppedMessages(), 1);
+}
+
+TEST_F(SegmentedFileMessagePersistenceTests, DropTheRecoveredMessagesOverTheLoweredCap)
+{
+    {
+        auto persistence = SegmentedFileMessagePersistence{DIRECTORY};
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'a')));
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'b')));
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", 'c')));
+    }
+    auto persistence = SegmentedFileMessagePersistence{DIRECTORY, 2 * RECORD_SIZE};
+    EXPECT_EQ(persistence.size(), 2);
+    EXPECT_EQ(persistence.droppedMessages(), 1);
+    EXPECT_EQ(persistence.front()->getContent(), std::string(16, 'b'));
+}
+
+TEST_F(SegmentedFileMessagePersistenceTests, DeleteTheSegmentOnceAllOfItsMessagesArePopped)
+{
+    // Every segment holds two messages
+    auto persistence = SegmentedFileMessagePersistence{DIRECTORY, 1024, 0, SEGMENT_HEADER_SIZE + 2 * RECORD_SIZE};
+    for (auto content = 'a'; content < 'f'; ++content)
+        ASSERT_TRUE(persistence.push(MakeMessage("D1", content)));
+    EXPECT_EQ(ListSegments().size(), 3);
+
+    persistence.pop();
+    EXPECT_EQ(ListSegments().size(), 3);
+    persistence.pop();
+    EXPECT_EQ(ListSegments().size(), 2);
+    persistence.pop();
+    persistence.pop();
+    EXPECT_EQ(ListSegments().size(), 1);
+
+    // The segment messages are appended to is kept, even once it is empty
+    persistence.pop();
+    EXPECT_TRUE(persistence.empty());
+    EXPECT_EQ(ListSegments().size(), 1);
+    ASSERT_TRUE(persistence.push(MakeMessage("D1", 'f')));
+    EXPECT_EQ(ListSegments().size(), 1);
+}
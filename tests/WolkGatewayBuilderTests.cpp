@@ -21,10 +21,13 @@
 #define protected public
 #include "gateway/WolkGateway.h"
 #include "gateway/WolkGatewayBuilder.h"
+#include "gateway/connectivity/ReconnectScheduler.h"
+#include "gateway/persistence/SegmentedFileMessagePersistence.h"
 #undef private
 #undef protected
 
 #include "core/utility/Logger.h"
+#include "tests/mocks/ConnectivityServiceMock.h"
 #include "tests/mocks/DataProtocolMock.h"
 #include "tests/mocks/DataProviderMock.h"
 #include "tests/mocks/ErrorProtocolMock.h"
@@ -41,7 +44,9 @@
 #include "tests/mocks/PersistenceMock.h"
 #include "tests/mocks/RegistrationProtocolMock.h"
 
+#include <condition_variable>
 #include <gtest/gtest.h>
+#include <mutex>
 
 using namespace wolkabout;
 using namespace wolkabout::gateway;
@@ -127,6 +132,51 @@ TEST_F(WolkGatewayBuilderTests, FirmwareParameterListener)
     ASSERT_NE(wolk, nullptr);
 }
 
+TEST_F(WolkGatewayBuilderTests, SegmentedFileMessagePersistence)
+{
+    auto wolk = std::unique_ptr<WolkGateway>{};
+    ASSERT_NO_FATAL_FAILURE([&] {
+        wolk = WolkGatewayBuilder{gateway}
+                 .withSegmentedFileMessagePersistence("./messages", 1024 * 1024, 64 * 1024)
+                 .build();
+    }());
+    ASSERT_NE(wolk, nullptr);
+    ASSERT_NE(std::dynamic_pointer_cast<SegmentedFileMessagePersistence>(wolk->m_messagePersistence), nullptr);
+}
+
+TEST_F(WolkGatewayBuilderTests, ConnectionLostReconnectsAfterADelay)
+{
+    // The attempts can still be running until the gateway is gone, so what they use must outlive it
+    std::mutex mutex;
+    std::condition_variable conditionVariable;
+    auto attemptedAt = std::chrono::steady_clock::time_point{};
+    auto wolk = WolkGatewayBuilder{gateway}.build();
+    ASSERT_NE(wolk, nullptr);
+
+    // The callback stays with the service the builder has made, and the attempts go to the mock
+    auto builtConnectivityService = std::move(wolk->m_connectivityService);
+    auto connectivityServiceMock = std::unique_ptr<ConnectivityServiceMock>{new NiceMock<ConnectivityServiceMock>};
+    EXPECT_CALL(*connectivityServiceMock, connect).WillRepeatedly([&] {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (attemptedAt == std::chrono::steady_clock::time_point{})
+            attemptedAt = std::chrono::steady_clock::now();
+        conditionVariable.notify_one();
+        return false;
+    });
+    wolk->m_connectivityService = std::move(connectivityServiceMock);
+    wolk->m_platformReconnectScheduler.reset(
+      new ReconnectScheduler{nullptr, std::chrono::milliseconds{200}, std::chrono::milliseconds{200}, 2.0, 0.5});
+
+    // Even the first attempt waits for at least the shortest jittered delay
+    const auto lostAt = std::chrono::steady_clock::now();
+    ASSERT_NO_FATAL_FAILURE(builtConnectivityService->m_onConnectionLost());
+    std::unique_lock<std::mutex> lock{mutex};
+    ASSERT_TRUE(conditionVariable.wait_for(lock, std::chrono::seconds{10}, [&] {
+        return attemptedAt != std::chrono::steady_clock::time_point{};
+    }));
+    EXPECT_GE(attemptedAt - lostAt, std::chrono::milliseconds{100});
+}
+
 TEST_F(WolkGatewayBuilderTests, FullExample)
 {
     auto wolk = std::unique_ptr<WolkGateway>{};
@@ -140,7 +190,18 @@ TEST_F(WolkGatewayBuilderTests, FullExample)
                  .parameterHandler(parameterHandlerMock)
                  .withPersistence(std::move(persistenceMock))
                  .withMessagePersistence(std::move(messagePersistenceMock))
+                 .backlogReplay(100, 10, [](const BacklogReplayProgress&) {})
+                 .withOutboundPriorityLanes()
+                 .publishWindow(16)
+                 .platformSessions(4)
+                 .withExecutor(std::make_shared<GatewayExecutor>(2))
+                 .withMemoryBudget(std::make_shared<MemoryBudget>(16 * 1024 * 1024))
                  .deviceStoragePolicy(DeviceStoragePolicy::FULL)
+                 .deviceStorageProfile(SQLiteStorageProfile::flash())
+                 .deviceRegistrySnapshot(true)
+                 .deviceCacheCapacity(1024)
+                 .registrationBatching(std::chrono::milliseconds{50}, 100)
+                 .registeredDevicesStalenessBound(std::chrono::minutes{5})
                  .withExistingDeviceRepository(std::move(existingDevicesRepositoryMock))
                  .withDataProtocol(std::move(dataProtocolMock))
                  .withErrorProtocol(errorRetainTime, std::move(errorProtocolMock))
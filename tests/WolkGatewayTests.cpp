@@ -20,10 +20,13 @@
 #define private public
 #define protected public
 #include "gateway/WolkGateway.h"
+#include "gateway/connectivity/PriorityOutboundMessageHandler.h"
+#include "gateway/connectivity/ReconnectScheduler.h"
 #include "gateway/repository/device/InMemoryDeviceRepository.h"
 #undef private
 #undef protected
 
+#include "core/persistence/inmemory/InMemoryMessagePersistence.h"
 #include "core/utility/Logger.h"
 #include "tests/mocks/ConnectivityServiceMock.h"
 #include "tests/mocks/DataProtocolMock.h"
@@ -37,6 +40,7 @@
 #include "tests/mocks/RegistrationProtocolMock.h"
 
 #include <gtest/gtest.h>
+#include <thread>
 
 using namespace wolkabout;
 using namespace wolkabout::connect;
@@ -115,33 +119,48 @@ TEST_F(WolkGatewayTests, NothingExplodesIfBothAreNull)
 
 TEST_F(WolkGatewayTests, RepeatMechanisms)
 {
-    // Set up the services
-    EXPECT_CALL(*dataServiceMock, publishReadings()).Times(2);
-    EXPECT_CALL(*dataServiceMock, publishAttributes()).Times(2);
-    EXPECT_CALL(*dataServiceMock, publishParameters()).Times(2);
+    std::mutex mutex;
+    std::condition_variable conditionVariable;
+
+    // Set up the services, and count in everything that is published once the platform is connected
+    auto published = 0;
+    const auto countPublished = [&] {
+        std::lock_guard<std::mutex> lock{mutex};
+        ++published;
+        conditionVariable.notify_one();
+    };
+    EXPECT_CALL(*dataServiceMock, publishReadings()).Times(2).WillRepeatedly(countPublished);
+    EXPECT_CALL(*dataServiceMock, publishAttributes()).Times(2).WillRepeatedly(countPublished);
+    EXPECT_CALL(*dataServiceMock, publishParameters()).Times(2).WillRepeatedly(countPublished);
     service->m_dataService = std::move(dataServiceMock);
 
     // Set up the connectivity service mocks
     auto platformConnectivityService = std::unique_ptr<ConnectivityServiceMock>{new NiceMock<ConnectivityServiceMock>};
     auto localConnectivityService = std::make_shared<NiceMock<ConnectivityServiceMock>>();
-    std::atomic_bool platformConnected{false};
-    std::atomic_bool localConnected{false};
+    auto platformConnected = false;
+    auto localConnected = false;
     EXPECT_CALL(*platformConnectivityService, connect).WillOnce(Return(false)).WillOnce([&]() {
+        std::lock_guard<std::mutex> lock{mutex};
         platformConnected = true;
+        conditionVariable.notify_one();
         return true;
     });
     EXPECT_CALL(*localConnectivityService, connect).WillOnce(Return(false)).WillOnce([&]() {
+        std::lock_guard<std::mutex> lock{mutex};
         localConnected = true;
+        conditionVariable.notify_one();
         return true;
     });
     service->m_connectivityService = std::move(platformConnectivityService);
     service->m_localConnectivityService = std::move(localConnectivityService);
+    service->m_platformReconnectScheduler.reset(new ReconnectScheduler{nullptr, std::chrono::milliseconds{100}});
+    service->m_localReconnectScheduler.reset(new ReconnectScheduler{nullptr, std::chrono::milliseconds{100}});
 
     // Connect
     ASSERT_NO_FATAL_FAILURE(service->connect());
-    std::this_thread::sleep_for(std::chrono::seconds(2) * 5);    // At least 4 * RECONNECT_DELAY_MSEC
-    EXPECT_TRUE(platformConnected);
-    EXPECT_TRUE(localConnected);
+    std::unique_lock<std::mutex> lock{mutex};
+    EXPECT_TRUE(conditionVariable.wait_for(lock, std::chrono::seconds{10},
+                                           [&] { return platformConnected && localConnected && published == 6; }));
 }
 
 TEST_F(WolkGatewayTests, ConnectHappyFlow)
@@ -217,3 +236,58 @@ TEST_F(WolkGatewayTests, ConnectHappyFlow)
     EXPECT_FALSE(service->isPlatformConnected());
     EXPECT_FALSE(service->isLocalConnected());
 }
+
+TEST_F(WolkGatewayTests, ShutdownDrainsBeforeDisconnecting)
+{
+    // The messages waiting in the priority lanes take a while to be sent
+    std::atomic<int> sent{0};
+    EXPECT_CALL(outboundMessageHandlerMock, addMessage).Times(3).WillRepeatedly([&](std::shared_ptr<Message>) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{20});
+        ++sent;
+    });
+    service->m_priorityOutboundMessageHandler = std::unique_ptr<PriorityOutboundMessageHandler>{
+      new PriorityOutboundMessageHandler{outboundMessageHandlerMock, dataProtocolMock}};
+    for (auto i = 0; i < 3; ++i)
+        service->m_priorityOutboundMessageHandler->addMessage(std::make_shared<Message>("", "d2p/feed_values"));
+
+    // The connections are closed only once everything has been sent
+    auto platformConnectivityService = std::unique_ptr<ConnectivityServiceMock>{new NiceMock<ConnectivityServiceMock>};
+    auto localConnectivityService = std::make_shared<NiceMock<ConnectivityServiceMock>>();
+    auto sentBeforeDisconnect = 0;
+    EXPECT_CALL(*platformConnectivityService, disconnect).WillOnce([&]() {
+        sentBeforeDisconnect = sent;
+        return true;
+    });
+    EXPECT_CALL(*localConnectivityService, disconnect).Times(1);
+    service->m_connectivityService = std::move(platformConnectivityService);
+    service->m_localConnectivityService = std::move(localConnectivityService);
+
+    const auto report = service->shutdown(std::chrono::seconds{1});
+    EXPECT_TRUE(report.completed);
+    EXPECT_EQ(sentBeforeDisconnect, 3);
+    ASSERT_EQ(report.stages.size(), 4);
+    EXPECT_EQ(report.stages[0].name, "stop_ingest");
+    EXPECT_EQ(report.stages[1].name, "drain");
+    EXPECT_GE(report.stages[1].elapsed, std::chrono::milliseconds{40});
+    EXPECT_EQ(report.stages[2].name, "flush");
+    EXPECT_EQ(report.stages[3].name, "disconnect");
+}
+
+TEST_F(WolkGatewayTests, ShutdownWhileOfflineReportsTheMessagesHeldInMemory)
+{
+    // The platform is not connected, so the message can not be published, and is lost once the gateway stops
+    service->m_messagePersistence = std::make_shared<InMemoryMessagePersistence>();
+    service->m_messagePersistence->push(std::make_shared<Message>("", "d2p/feed_values"));
+    service->m_connectivityService = std::unique_ptr<ConnectivityServiceMock>{new NiceMock<ConnectivityServiceMock>};
+    ASSERT_FALSE(service->isPlatformConnected());
+
+    const auto report = service->shutdown(std::chrono::milliseconds{500});
+    EXPECT_FALSE(report.completed);
+    ASSERT_EQ(report.stages.size(), 4);
+    EXPECT_TRUE(report.stages[0].completed);
+    EXPECT_EQ(report.stages[1].name, "drain");
+    EXPECT_TRUE(report.stages[1].completed);
+    EXPECT_EQ(report.stages[2].name, "flush");
+    EXPECT_FALSE(report.stages[2].completed);
+    EXPECT_TRUE(report.stages[3].completed);
+}
@@ -31,9 +31,15 @@ public:
     MOCK_METHOD(bool, remove, (const std::vector<std::string>&));
     MOCK_METHOD(bool, removeAll, ());
     MOCK_METHOD(bool, containsDevice, (const std::string&));
+    MOCK_METHOD(std::unordered_set<std::string>, containsDevices, (const std::vector<std::string>&));
     MOCK_METHOD(StoredDeviceInformation, get, (const std::string&));
+    MOCK_METHOD(std::vector<StoredDeviceInformation>, getMany, (const std::vector<std::string>&));
     MOCK_METHOD(std::vector<StoredDeviceInformation>, getGatewayDevices, ());
+    MOCK_METHOD(bool, forEachGatewayDevice, (const DevicePageVisitor&, std::size_t));
+    MOCK_METHOD(std::vector<StoredDeviceInformation>, findDevices,
+                (std::chrono::milliseconds, const std::string&, const std::string&));
     MOCK_METHOD(std::chrono::milliseconds, latestPlatformTimestamp, ());
+    MOCK_METHOD(bool, holdsAllDevices, ());
 };
 
 #endif    // WOLKGATEWAY_DEVICEREPOSITORYMOCK_H
@@ -27,6 +27,8 @@ class ExistingDevicesRepositoryMock : public ExistingDevicesRepository
 {
 public:
     MOCK_METHOD(void, addDeviceKey, (const std::string&));
+    MOCK_METHOD(void, addDeviceKeys, (const std::vector<std::string>&));
+    MOCK_METHOD(void, removeDeviceKeys, (const std::vector<std::string>&));
     MOCK_METHOD(std::vector<std::string>, getDeviceKeys, ());
 };
 
@@ -35,6 +35,7 @@ public:
     {
     }
     MOCK_METHOD(void, sendPlatformConnectionStatusMessage, (bool));
+    MOCK_METHOD(void, sendLoadStatusMessage, (const GatewayLoadStatus&));
 };
 
 #endif    // WOLKGATEWAY_GATEWAYPLATFORMSTATUSSERVICEMOCK_H